@@ -0,0 +1,440 @@
+// ipc_bench.c
+// 부모 <-> 자식 프로세스 간 IPC 방식별 처리량 / 왕복 지연 측정
+//
+// 서버들은 모두 pipe + fork 구조(pipe.c, pipe2.c)로 허브와 클라이언트 담당 프로세스를 잇는다.
+// 같은 구조에서 전송 수단만 바꿔 가며 메시지 크기 16B ~ 64KB 에 대해 측정한다.
+//   pipe       : 방향별 pipe 두 개
+//   stream     : socketpair(AF_UNIX, SOCK_STREAM)
+//   seqpacket  : socketpair(AF_UNIX, SOCK_SEQPACKET) (메시지 경계 유지)
+//   shm_ring   : 공유 메모리 링 버퍼 두 개 + eventfd 알림 (상대가 잠들어 있을 때만 깨움)
+//   mqueue     : POSIX 메시지 큐 두 개 (msgsize_max 보다 큰 크기는 NA)
+//
+// 처리량: 부모가 같은 크기의 메시지를 연속으로 보내고, 자식이 모두 받은 뒤 응답 하나를 보냄
+// 왕복  : 부모가 메시지 하나를 보내고 자식이 그대로 돌려줄 때까지의 시간 (p50/p99/max)
+// 결과는 CSV 로 표준 출력에 쓴다 (# 로 시작하는 줄은 주석).
+//
+// 빌드: gcc -O2 -o ipc_bench ipc_bench.c -lrt
+// 실행: ./ipc_bench [반복 배율 (기본 1.0)] [방식 이름 (생략 시 전체)]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <mqueue.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+
+#define MAX_MSG_SIZE 65536
+#define SHM_RING_SIZE (256 * 1024)	// 링 하나의 크기 (가장 큰 메시지보다 커야 함)
+#define TPUT_BYTES (64L * 1024 * 1024)	// 처리량 측정 시 보낼 총 바이트 (배율 1.0 기준)
+
+enum { PARENT = 0, CHILD = 1 };
+
+// 공유 메모리 링 (한 방향). head/tail 은 누적 바이트 수
+typedef struct {
+	_Atomic uint64_t head;		// 소비자가 다 읽은 위치
+	char pad1[64 - sizeof(uint64_t)];
+	_Atomic uint64_t tail;		// 생산자가 다 쓴 위치
+	char pad2[64 - sizeof(uint64_t)];
+	atomic_int consumer_waiting;	// 소비자가 data_efd 에서 잠들려는 중
+	atomic_int producer_waiting;	// 생산자가 space_efd 에서 잠들려는 중
+	int data_efd;
+	int space_efd;
+	char data[SHM_RING_SIZE];
+} shm_ring_t;
+
+typedef struct transport {
+	const char *name;
+	int (*setup)(struct transport *t, size_t msg_size);	// fork 전. 지원하지 않는 크기면 -1
+	int (*send)(struct transport *t, int side, const void *buf, size_t len);
+	int (*recv)(struct transport *t, int side, void *buf, size_t len);
+	void (*cleanup)(struct transport *t);
+	int fd[4];			// pipe: [0]/[1] 부모->자식, [2]/[3] 자식->부모. socketpair: [0] 부모, [1] 자식
+	shm_ring_t *rings;		// [0] 부모->자식, [1] 자식->부모
+	mqd_t mq[2];
+	char mq_name[2][64];
+} transport_t;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int write_full(int fd, const void *buf, size_t len)
+{
+	const char *p = buf;
+	while (len > 0) {
+		ssize_t n = write(fd, p, len);
+		if (n < 0) {
+			if (errno == EINTR) continue;
+			return -1;
+		}
+		p += n;
+		len -= n;
+	}
+	return 0;
+}
+
+static int read_full(int fd, void *buf, size_t len)
+{
+	char *p = buf;
+	while (len > 0) {
+		ssize_t n = read(fd, p, len);
+		if (n <= 0) {
+			if (n < 0 && errno == EINTR) continue;
+			return -1;
+		}
+		p += n;
+		len -= n;
+	}
+	return 0;
+}
+
+static void close_fds(transport_t *t)
+{
+	for (int i = 0; i < 4; i++) {
+		if (t->fd[i] >= 0) close(t->fd[i]);
+		t->fd[i] = -1;
+	}
+}
+
+// ===========================================
+// pipe
+// ===========================================
+static int pipe_setup(transport_t *t, size_t msg_size)
+{
+	if (pipe(&t->fd[0]) < 0 || pipe(&t->fd[2]) < 0) return -1;
+	return 0;
+}
+
+static int pipe_send(transport_t *t, int side, const void *buf, size_t len)
+{
+	return write_full(side == PARENT ? t->fd[1] : t->fd[3], buf, len);
+}
+
+static int pipe_recv(transport_t *t, int side, void *buf, size_t len)
+{
+	return read_full(side == PARENT ? t->fd[2] : t->fd[0], buf, len);
+}
+
+// ===========================================
+// socketpair (STREAM / SEQPACKET)
+// ===========================================
+static int stream_setup(transport_t *t, size_t msg_size)
+{
+	return socketpair(AF_UNIX, SOCK_STREAM, 0, t->fd);
+}
+
+static int seqpacket_setup(transport_t *t, size_t msg_size)
+{
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, t->fd) < 0) return -1;
+	// 메시지 하나가 송신 버퍼에 통째로 들어가야 함
+	int bufsize = MAX_MSG_SIZE * 4;
+	for (int i = 0; i < 2; i++) {
+		setsockopt(t->fd[i], SOL_SOCKET, SO_SNDBUF, &bufsize, sizeof(bufsize));
+		setsockopt(t->fd[i], SOL_SOCKET, SO_RCVBUF, &bufsize, sizeof(bufsize));
+	}
+	return 0;
+}
+
+static int sock_send(transport_t *t, int side, const void *buf, size_t len)
+{
+	return write_full(t->fd[side], buf, len);
+}
+
+static int sock_recv(transport_t *t, int side, void *buf, size_t len)
+{
+	return read_full(t->fd[side], buf, len);
+}
+
+// 패킷 하나 = 메시지 하나
+static int seqpacket_send(transport_t *t, int side, const void *buf, size_t len)
+{
+	return write(t->fd[side], buf, len) == (ssize_t)len ? 0 : -1;
+}
+
+static int seqpacket_recv(transport_t *t, int side, void *buf, size_t len)
+{
+	return read(t->fd[side], buf, len) == (ssize_t)len ? 0 : -1;
+}
+
+// ===========================================
+// 공유 메모리 링 + eventfd
+// ===========================================
+static int shm_setup(transport_t *t, size_t msg_size)
+{
+	t->rings = mmap(NULL, sizeof(shm_ring_t) * 2, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (t->rings == MAP_FAILED) {
+		t->rings = NULL;
+		return -1;
+	}
+	for (int i = 0; i < 2; i++) {
+		shm_ring_t *r = &t->rings[i];
+		atomic_init(&r->head, 0);
+		atomic_init(&r->tail, 0);
+		atomic_init(&r->consumer_waiting, 0);
+		atomic_init(&r->producer_waiting, 0);
+		r->data_efd = eventfd(0, 0);
+		r->space_efd = eventfd(0, 0);
+		if (r->data_efd < 0 || r->space_efd < 0) return -1;
+	}
+	return 0;
+}
+
+// waiting 표시 후 조건을 다시 확인하고 나서 잠듦 (상대는 진행 후 waiting 을 보고 깨움)
+static void ring_sleep(atomic_int *waiting, int efd, _Atomic uint64_t *watch, uint64_t seen)
+{
+	uint64_t v;
+	atomic_store(waiting, 1);
+	if (atomic_load(watch) == seen) {
+		read(efd, &v, sizeof(v));
+	}
+	atomic_store(waiting, 0);
+}
+
+static void ring_wake(atomic_int *waiting, int efd)
+{
+	uint64_t one = 1;
+	if (atomic_load(waiting)) {
+		write(efd, &one, sizeof(one));
+	}
+}
+
+static int ring_write(shm_ring_t *r, const char *buf, size_t len)
+{
+	while (len > 0) {
+		uint64_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+		uint64_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+		size_t space = SHM_RING_SIZE - (tail - head);
+		if (space == 0) {
+			ring_sleep(&r->producer_waiting, r->space_efd, &r->head, head);
+			continue;
+		}
+		size_t n = len < space ? len : space;
+		size_t off = tail % SHM_RING_SIZE;
+		size_t first = n < SHM_RING_SIZE - off ? n : SHM_RING_SIZE - off;
+		memcpy(r->data + off, buf, first);
+		memcpy(r->data, buf + first, n - first);
+		atomic_store(&r->tail, tail + n);
+		ring_wake(&r->consumer_waiting, r->data_efd);
+		buf += n;
+		len -= n;
+	}
+	return 0;
+}
+
+static int ring_read(shm_ring_t *r, char *buf, size_t len)
+{
+	while (len > 0) {
+		uint64_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+		uint64_t tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+		size_t avail = tail - head;
+		if (avail == 0) {
+			ring_sleep(&r->consumer_waiting, r->data_efd, &r->tail, tail);
+			continue;
+		}
+		size_t n = len < avail ? len : avail;
+		size_t off = head % SHM_RING_SIZE;
+		size_t first = n < SHM_RING_SIZE - off ? n : SHM_RING_SIZE - off;
+		memcpy(buf, r->data + off, first);
+		memcpy(buf + first, r->data, n - first);
+		atomic_store(&r->head, head + n);
+		ring_wake(&r->producer_waiting, r->space_efd);
+		buf += n;
+		len -= n;
+	}
+	return 0;
+}
+
+static int shm_send(transport_t *t, int side, const void *buf, size_t len)
+{
+	return ring_write(&t->rings[side == PARENT ? 0 : 1], buf, len);
+}
+
+static int shm_recv(transport_t *t, int side, void *buf, size_t len)
+{
+	return ring_read(&t->rings[side == PARENT ? 1 : 0], buf, len);
+}
+
+static void shm_cleanup(transport_t *t)
+{
+	if (t->rings == NULL) return;
+	for (int i = 0; i < 2; i++) {
+		close(t->rings[i].data_efd);
+		close(t->rings[i].space_efd);
+	}
+	munmap(t->rings, sizeof(shm_ring_t) * 2);
+	t->rings = NULL;
+}
+
+// ===========================================
+// POSIX 메시지 큐
+// ===========================================
+static int mq_setup(transport_t *t, size_t msg_size)
+{
+	struct mq_attr attr = { 0 };
+	attr.mq_maxmsg = 10;		// 비특권 사용자 기본 상한
+	attr.mq_msgsize = msg_size;
+	for (int i = 0; i < 2; i++) {
+		snprintf(t->mq_name[i], sizeof(t->mq_name[i]), "/ipc_bench_%d_%d", (int)getpid(), i);
+		mq_unlink(t->mq_name[i]);
+		t->mq[i] = mq_open(t->mq_name[i], O_CREAT | O_RDWR, 0600, &attr);
+		if (t->mq[i] == (mqd_t)-1) {
+			if (i == 1) {
+				mq_close(t->mq[0]);
+				mq_unlink(t->mq_name[0]);
+			}
+			return -1;	// 보통 msgsize_max(8192) 초과
+		}
+	}
+	return 0;
+}
+
+static int mq_bench_send(transport_t *t, int side, const void *buf, size_t len)
+{
+	return mq_send(t->mq[side == PARENT ? 0 : 1], buf, len, 0);
+}
+
+static int mq_bench_recv(transport_t *t, int side, void *buf, size_t len)
+{
+	return mq_receive(t->mq[side == PARENT ? 1 : 0], buf, len, NULL) == (ssize_t)len ? 0 : -1;
+}
+
+static void mq_cleanup(transport_t *t)
+{
+	for (int i = 0; i < 2; i++) {
+		mq_close(t->mq[i]);
+		mq_unlink(t->mq_name[i]);
+	}
+}
+
+static transport_t transports[] = {
+	{ "pipe",      pipe_setup,      pipe_send,      pipe_recv,      close_fds },
+	{ "stream",    stream_setup,    sock_send,      sock_recv,      close_fds },
+	{ "seqpacket", seqpacket_setup, seqpacket_send, seqpacket_recv, close_fds },
+	{ "shm_ring",  shm_setup,       shm_send,       shm_recv,       shm_cleanup },
+	{ "mqueue",    mq_setup,        mq_bench_send,  mq_bench_recv,  mq_cleanup },
+};
+
+// ===========================================
+// 측정
+// ===========================================
+enum { MODE_THROUGHPUT, MODE_ROUNDTRIP };
+
+static char msg_buf[MAX_MSG_SIZE];
+
+static void child_main(transport_t *t, int mode, size_t size, long count)
+{
+	for (long i = 0; i < count; i++) {
+		if (t->recv(t, CHILD, msg_buf, size) != 0) _exit(1);
+		if (mode == MODE_ROUNDTRIP && t->send(t, CHILD, msg_buf, size) != 0) _exit(1);
+	}
+	if (mode == MODE_THROUGHPUT && t->send(t, CHILD, msg_buf, size) != 0) _exit(1);	// 다 받았다는 응답
+	_exit(0);
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+	return x < y ? -1 : x > y;
+}
+
+// 한 번의 측정: 전송 수단 생성 -> fork -> 측정 -> 정리. 성공 시 경과 시간(ns), 실패 시 0
+static uint64_t run_once(transport_t *t, int mode, size_t size, long count, uint64_t *rtts)
+{
+	if (t->setup(t, size) != 0) {
+		t->cleanup(t);
+		return 0;
+	}
+	pid_t pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		exit(1);
+	}
+	if (pid == 0) {
+		child_main(t, mode, size, count);
+	}
+
+	uint64_t start = now_ns();
+	int ok = 1;
+	for (long i = 0; i < count && ok; i++) {
+		uint64_t t0 = now_ns();
+		if (t->send(t, PARENT, msg_buf, size) != 0) ok = 0;
+		if (mode == MODE_ROUNDTRIP) {
+			if (t->recv(t, PARENT, msg_buf, size) != 0) ok = 0;
+			rtts[i] = now_ns() - t0;
+		}
+	}
+	if (ok && mode == MODE_THROUGHPUT && t->recv(t, PARENT, msg_buf, size) != 0) ok = 0;
+	uint64_t elapsed = now_ns() - start;
+
+	int status;
+	waitpid(pid, &status, 0);
+	t->cleanup(t);
+	if (!ok || !WIFEXITED(status) || WEXITSTATUS(status) != 0) return 0;
+	return elapsed;
+}
+
+static void bench(transport_t *t, size_t size, double scale)
+{
+	long tput_count = (long)(TPUT_BYTES / size * scale);
+	if (tput_count > (long)(200000 * scale)) tput_count = (long)(200000 * scale);
+	if (tput_count < 100) tput_count = 100;
+	long rtt_count = (long)((size <= 4096 ? 5000 : 1000) * scale);
+	if (rtt_count < 100) rtt_count = 100;
+
+	uint64_t *rtts = malloc(sizeof(uint64_t) * rtt_count);
+	if (rtts == NULL) {
+		perror("malloc");
+		exit(1);
+	}
+
+	uint64_t tput_ns = run_once(t, MODE_THROUGHPUT, size, tput_count, NULL);
+	uint64_t rtt_ns = tput_ns ? run_once(t, MODE_ROUNDTRIP, size, rtt_count, rtts) : 0;
+	if (tput_ns == 0 || rtt_ns == 0) {
+		printf("%s,%zu,NA,NA,NA,NA,NA,NA,NA,NA\n", t->name, size);
+		free(rtts);
+		return;
+	}
+	qsort(rtts, rtt_count, sizeof(uint64_t), cmp_u64);
+
+	double sec = tput_ns / 1e9;
+	printf("%s,%zu,%ld,%.1f,%.2f,%ld,%.2f,%.2f,%.2f,%.2f\n",
+	       t->name, size, tput_count, tput_count / sec, tput_count * (double)size / sec / (1024 * 1024),
+	       rtt_count, rtt_ns / 1e3 / rtt_count,
+	       rtts[rtt_count / 2] / 1e3, rtts[(long)(rtt_count * 0.99)] / 1e3, rtts[rtt_count - 1] / 1e3);
+	fflush(stdout);
+	free(rtts);
+}
+
+int main(int argc, char *argv[])
+{
+	static const size_t sizes[] = { 16, 64, 256, 1024, 4096, 16384, 65536 };
+	double scale = argc > 1 ? atof(argv[1]) : 1.0;
+	const char *only = argc > 2 ? argv[2] : NULL;
+
+	if (scale <= 0) {
+		fprintf(stderr, "사용법: %s [반복 배율 (기본 1.0)] [pipe|stream|seqpacket|shm_ring|mqueue]\n", argv[0]);
+		return 1;
+	}
+
+	printf("# ipc_bench scale=%.2f (NA = 이 크기를 지원하지 않음)\n", scale);
+	printf("transport,size,tput_msgs,msgs_per_sec,mib_per_sec,rtt_iters,rtt_avg_us,rtt_p50_us,rtt_p99_us,rtt_max_us\n");
+	for (size_t i = 0; i < sizeof(transports) / sizeof(transports[0]); i++) {
+		transport_t *t = &transports[i];
+		if (only && strcmp(only, t->name) != 0) continue;
+		for (int k = 0; k < 4; k++) t->fd[k] = -1;
+		for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+			bench(t, sizes[s], scale);
+		}
+	}
+	return 0;
+}
@@ -1,13 +1,26 @@
 //chat_client.c
+// 한 프로세스가 poll()로 키보드(stdin)와 서버 소켓을 함께 감시하는 이벤트 루프 클라이언트.
+// (예전에는 키보드 담당 자식 프로세스가 한 줄마다 파이프에 쓰고 SIGUSR1 으로 부모를 깨웠는데,
+//  시그널이 겹치면 줄을 잃어버리고 한 줄마다 프로세스 전환과 시그널 처리가 필요했음)
+//
+// 실행: ./client <서버 IP 주소> <포트 번호> [-l]
+//   -l : 줄마다 지연 시간 출력 (입력 -> 서버로 보냄, 보냄 -> 서버의 첫 응답)
+//        끝날 때는 -l 없이도 평균/최대 지연 시간을 출력함
+// 받은 메시지는 common/term_render.h 가 모아서 갱신 간격마다 한 번에 그림.
+// 바빠서 생략된 줄은 /scroll [줄 수] 로 다시 볼 수 있음 (서버로 보내지 않음)
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <signal.h>
-#include <sys/wait.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
 #include <sys/socket.h>
 #include <arpa/inet.h>
 #include <netinet/in.h>
+#include "../common/term_render.h" // 버퍼링 터미널 출력기
 
 // 터미널 UI를 위한 ANSI 이스케이프 코드
 #define COLOR_RED     "\x1b[31m"
@@ -18,10 +31,24 @@
 #define COLOR_CYAN    "\x1b[36m"
 #define COLOR_RESET   "\x1b[0m"
 
+#define PROMPT COLOR_BLUE "\r> " COLOR_RESET
+
 // 전역 변수: 시그널 핸들러와 main 함수에서 공유해야 함
 static int g_sockfd;      // 서버와 통신을 위한 소켓 파일 디스크립터
-static int g_pipe_fd[2];  // 부모-자식 프로세스 간 통신을 위한 파이프
-static int g_continue = 1; // 프로그램의 주 루프를 제어하는 플래그
+static volatile sig_atomic_t g_continue = 1; // 프로그램의 주 루프를 제어하는 플래그
+
+// 줄 단위 지연 시간 통계
+static struct {
+    int show;                 // -l: 줄마다 출력
+    double sent_at;           // 응답을 기다리는 첫 줄을 서버로 다 보낸 시각 (0: 기다리는 줄 없음)
+    long lines;               // 보낸 줄 수
+    double send_total, send_max;
+    long replies;             // 다음 줄을 보내기 전에 서버 응답이 온 줄 수
+    double reply_total, reply_max;
+} g_latency;
+
+// 화면 출력기: 받은 메시지를 모아 갱신 간격마다 한 번에 그림 (스크롤백 링 포함)
+static term_render_t g_term;
 
 // 화면을 지우는 함수
 void clear_screen(void) {
@@ -29,37 +56,164 @@ void clear_screen(void) {
     write(STDOUT_FILENO, "\033[1;1H\033[2J", 10);
 }
 
-// 시그널 핸들러
+// 시그널 핸들러: 플래그만 바꾸고, 실제 종료 처리는 메인 루프에서
 void sig_handler(int signo) {
-    if (signo == SIGUSR1) {
-        // 자식 프로세스(키보드 입력 담당)로부터 신호를 받았을 때
-        char buf[BUFSIZ];
-        memset(buf, 0, BUFSIZ);
-
-        // 파이프로부터 데이터를 읽어 서버로 전송
-        int n = read(g_pipe_fd[0], buf, BUFSIZ);
-        if (n > 0) {
-            write(g_sockfd, buf, n);
-        }
-    } else if (signo == SIGCHLD) {
-        // 자식 프로세스가 종료되었을 때 (서버 연결이 끊긴 후 부모가 자식을 종료시켰거나, 자식 스스로 종료)
-        g_continue = 0; // 메인 루프를 종료하도록 플래그 설정
-    } else if (signo == SIGINT || signo == SIGTERM) {
+    if (signo == SIGINT || signo == SIGTERM) {
         // Ctrl+C (SIGINT) 또는 종료(SIGTERM) 시그널을 받았을 때
-        printf("\n" COLOR_YELLOW "Chat client is shutting down." COLOR_RESET "\n");
-        g_continue = 0; // 메인 루프 종료
+        g_continue = 0; // 메인 루프 종료 (poll 은 EINTR 로 깨어남)
     }
 }
 
+// 현재 시각 (단조 증가 시계, 초 단위)
+static double monotonic_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// 논블로킹 소켓에 전부 씀. 송신 버퍼가 가득 차면 (EAGAIN) 쓸 수 있을 때까지 poll 로 기다림
+static int write_all(int fd, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                struct pollfd pfd = { .fd = fd, .events = POLLOUT };
+                if (poll(&pfd, 1, -1) < 0 && errno == EINTR && !g_continue) {
+                    return -1; // 기다리는 중에 Ctrl+C
+                }
+                continue;
+            }
+            return -1;
+        }
+        data += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// 서버에서 온 데이터를 읽을 수 있는 만큼 모두 읽어 출력기에 넣음. 연결이 끊기면 -1
+static int receive_from_server(void) {
+    char buf[BUFSIZ];
+    int received = 0;
+    while (1) {
+        ssize_t n = read(g_sockfd, buf, sizeof(buf));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break; // 지금 있는 것은 다 읽음
+        }
+        if (n <= 0) { // 서버와 연결이 끊김
+            if (n == 0) {
+                term_render_printf(&g_term, COLOR_RED, "Server has closed the connection.\n");
+            } else {
+                term_render_printf(&g_term, COLOR_RED, "read from server: %s\n", strerror(errno));
+            }
+            return -1;
+        }
+        term_render_append(&g_term, COLOR_GREEN, buf, n);
+        received = 1;
+    }
+    if (received) {
+        // 보낸 줄 이후 처음 온 서버 데이터면 왕복 시간 기록
+        if (g_latency.sent_at > 0) {
+            double rtt = monotonic_sec() - g_latency.sent_at;
+            g_latency.replies++;
+            g_latency.reply_total += rtt;
+            if (rtt > g_latency.reply_max) g_latency.reply_max = rtt;
+            g_latency.sent_at = 0;
+            if (g_latency.show) {
+                term_render_printf(&g_term, COLOR_MAGENTA, "[latency] reply %.3f ms\n", rtt * 1e3);
+            }
+        }
+    }
+    return 0;
+}
+
+// 입력 한 줄을 서버로 보냄. 보내기 실패 또는 /quit 이면 0 (루프 종료)
+static int send_line(const char *line, size_t len, double input_at) {
+    // /scroll [줄 수]: 서버로 보내지 않고 스크롤백 링의 마지막 줄들을 다시 그림
+    if (strncmp(line, "/scroll", 7) == 0 && (line[7] == ' ' || line[7] == '\n')) {
+        long count = strtol(line + 7, NULL, 10);
+        term_render_scrollback(&g_term, count > 0 ? (unsigned long)count : (unsigned long)g_term.max_lines);
+        return 1;
+    }
+    if (write_all(g_sockfd, line, len) < 0) {
+        term_render_printf(&g_term, COLOR_RED, "write to server: %s\n", strerror(errno));
+        return 0;
+    }
+    double now = monotonic_sec();
+    double send = now - input_at;
+    g_latency.lines++;
+    g_latency.send_total += send;
+    if (send > g_latency.send_max) g_latency.send_max = send;
+    if (g_latency.sent_at == 0) {
+        g_latency.sent_at = now; // 응답 없이 이어 보낸 줄은 첫 줄부터 잼
+    }
+    if (g_latency.show) {
+        term_render_printf(&g_term, COLOR_MAGENTA, "[latency] send %.1f us\n", send * 1e6);
+    }
+    // 사용자가 종료 명령어 입력 시 종료
+    return strncmp(line, "/quit", 5) != 0;
+}
+
+// 키보드에서 읽을 수 있는 만큼 읽어 완성된 줄마다 서버로 보냄. Ctrl+D (EOF) 또는 /quit 이면 0
+static int read_keyboard(void) {
+    static char line[BUFSIZ];
+    static size_t line_len = 0;
+    ssize_t n = read(STDIN_FILENO, line + line_len, sizeof(line) - line_len);
+    if (n < 0) {
+        return errno == EINTR || errno == EAGAIN;
+    }
+    if (n == 0) {
+        return 0;
+    }
+    double input_at = monotonic_sec();
+    line_len += n;
+
+    // 여러 줄이 한 번에 들어와도(붙여넣기, 파이프) 한 줄도 버리지 않음
+    size_t start = 0;
+    char *nl;
+    while ((nl = memchr(line + start, '\n', line_len - start)) != NULL) {
+        size_t len = nl - (line + start) + 1;
+        if (!send_line(line + start, len, input_at)) {
+            return 0;
+        }
+        start += len;
+    }
+    line_len -= start;
+    memmove(line, line + start, line_len);
+    if (line_len == sizeof(line)) { // 줄바꿈 없이 버퍼가 가득 차면 그대로 보냄
+        if (!send_line(line, line_len, input_at)) {
+            return 0;
+        }
+        line_len = 0;
+    }
+    return 1;
+}
+
+static void print_latency_summary(void) {
+    printf(COLOR_YELLOW "Sent %ld line(s): send avg %.1f us, max %.1f us",
+           g_latency.lines,
+           g_latency.lines ? g_latency.send_total / g_latency.lines * 1e6 : 0.0,
+           g_latency.send_max * 1e6);
+    printf(" / first reply for %ld line(s): avg %.3f ms, max %.3f ms\n",
+           g_latency.replies,
+           g_latency.replies ? g_latency.reply_total / g_latency.replies * 1e3 : 0.0,
+           g_latency.reply_max * 1e3);
+    printf("Rendered %lu line(s) in %lu frame(s), %lu skipped (kept in scrollback)\n" COLOR_RESET,
+           g_term.lines, g_term.frames, g_term.skipped);
+}
+
 int main(int argc, char** argv) {
     struct sockaddr_in serv_addr;
-    pid_t pid;
-    char buf[BUFSIZ];
 
     if (argc < 3) {
-        fprintf(stderr, "사용법: %s <서버 IP 주소> <포트 번호>\n", argv[0]);
+        fprintf(stderr, "사용법: %s <서버 IP 주소> <포트 번호> [-l]\n", argv[0]);
         return -1;
     }
+    g_latency.show = argc > 3 && strcmp(argv[3], "-l") == 0;
 
     clear_screen();
     printf(COLOR_YELLOW "Connecting to chat server...\n" COLOR_RESET);
@@ -86,95 +240,58 @@ int main(int argc, char** argv) {
         close(g_sockfd);
         return -1;
     }
-    
+
     printf(COLOR_GREEN "Successfully connected to the server.\n" COLOR_RESET);
     printf("Type your nickname and press Enter.\n");
     printf("To see commands, type " COLOR_CYAN "/help" COLOR_RESET " after setting a nickname.\n");
+    printf(PROMPT);
+    fflush(stdout);
+    term_render_init(&g_term, STDOUT_FILENO, PROMPT);
 
+    // 3. 시그널 핸들러 설정 (SA_RESTART 없이: poll 이 EINTR 로 깨어나 루프 조건을 다시 봄)
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = sig_handler;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);  // Ctrl+C 입력 감지
+    sigaction(SIGTERM, &sa, NULL); // 종료 시그널 감지
+    signal(SIGPIPE, SIG_IGN);      // 끊긴 소켓에 쓰면 write 가 EPIPE 를 반환하도록
 
-    // 3. IPC를 위한 파이프 생성
-    if (pipe(g_pipe_fd) < 0) {
-        perror("pipe");
-        close(g_sockfd);
-        return -1;
-    }
-
-    // 4. 프로세스 분기 (fork)
-    pid = fork();
-    if (pid < 0) {
-        perror("fork");
-        close(g_sockfd);
-        close(g_pipe_fd[0]);
-        close(g_pipe_fd[1]);
-        return -1;
-    }
-
-    if (pid > 0) {
-        // ==================== 부모 프로세스: 서버로부터 메시지 수신 담당 ====================
-        close(g_pipe_fd[1]); // 파이프의 쓰기용 끝을 닫음
-
-        // 시그널 핸들러 설정
-        signal(SIGUSR1, sig_handler); // 자식으로부터의 데이터 전송 요청
-        signal(SIGCHLD, sig_handler); // 자식 프로세스 종료 감지
-        signal(SIGINT, sig_handler);  // Ctrl+C 입력 감지
-        signal(SIGTERM, sig_handler); // 종료 시그널 감지
+    // 서버 데이터는 한 번 깨어날 때 다 읽어서 모아 그리므로 소켓은 non-blocking
+    fcntl(g_sockfd, F_SETFL, fcntl(g_sockfd, F_GETFL, 0) | O_NONBLOCK);
 
-        while (g_continue) {
-            memset(buf, 0, BUFSIZ);
-            int n = read(g_sockfd, buf, BUFSIZ - 1);
+    // 4. 이벤트 루프: 키보드와 서버 소켓을 한 스레드에서 감시
+    struct pollfd fds[2];
+    fds[0].fd = STDIN_FILENO;
+    fds[0].events = POLLIN;
+    fds[1].fd = g_sockfd;
+    fds[1].events = POLLIN;
 
-            if (n <= 0) { // 서버와 연결이 끊김
-                if (n == 0) {
-                    printf(COLOR_RED "\rServer has closed the connection.\n" COLOR_RESET);
-                } else {
-                    perror("\rread from server");
-                }
-                g_continue = 0; // 루프 종료
-                break;
-            }
-            
-            // 받은 메시지 출력 후, 사용자 입력을 위해 프롬프트를 다시 그려줌
-            printf(COLOR_GREEN "\r%s" COLOR_RESET, buf);
-            printf(COLOR_BLUE "\r> " COLOR_RESET);
-            fflush(stdout); // 출력 버퍼를 즉시 비움
+    while (g_continue) {
+        if (poll(fds, 2, term_render_timeout(&g_term)) < 0) {
+            if (errno == EINTR) continue;
+            perror("poll");
+            break;
         }
 
-        // 루프가 끝나면 자식 프로세스에게 종료 신호를 보냄
-        if (pid > 0) {
-            kill(pid, SIGTERM);
-        }
-        wait(NULL); // 자식 프로세스가 완전히 종료될 때까지 기다려 좀비 프로세스 방지
-        close(g_pipe_fd[0]);
-
-    } else {
-        // ==================== 자식 프로세스: 사용자 키보드 입력 담당 ====================
-        close(g_pipe_fd[0]); // 파이프의 읽기용 끝을 닫음
-        
-        // 자식 프로세스는 부모가 보낸 SIGTERM에 의해 종료되므로, 별도 핸들러는 불필요
-        
-        while (1) {
-            printf(COLOR_BLUE "\r> " COLOR_RESET);
-            fflush(stdout);
-
-            memset(buf, 0, BUFSIZ);
-            if (fgets(buf, BUFSIZ, stdin) == NULL) {
-                // Ctrl+D (EOF) 입력 시 종료
-                break;
+        // 서버 메시지와 키보드 줄을 처리하고, 갱신 간격이 지났으면 쌓인 출력을 한 프레임으로 그림
+        if (fds[1].revents & (POLLIN | POLLHUP | POLLERR)) {
+            if (receive_from_server() < 0) {
+                g_continue = 0;
             }
-            
-            // 파이프에 사용자 입력을 쓰고, 부모에게 SIGUSR1 신호를 보내 알림
-            write(g_pipe_fd[1], buf, strlen(buf));
-            kill(getppid(), SIGUSR1);
-
-            // 사용자가 종료 명령어 입력 시 자식 프로세스 스스로 종료
-            if (strncmp(buf, "/quit", 5) == 0) {
-                break;
+        }
+        if (g_continue && (fds[0].revents & (POLLIN | POLLHUP))) {
+            if (!read_keyboard()) {
+                g_continue = 0;
             }
         }
-        close(g_pipe_fd[1]);
-        exit(0); // 자식 프로세스 정상 종료
+        term_render_flush(&g_term, 0);
     }
+    g_term.prompt = NULL;
+    term_render_flush(&g_term, 1);
 
+    printf("\n" COLOR_YELLOW "Chat client is shutting down." COLOR_RESET "\n");
+    print_latency_summary();
     close(g_sockfd);
     printf(COLOR_YELLOW "Chat client terminated.\n" COLOR_RESET);
     return 0;
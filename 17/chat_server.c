@@ -1,4 +1,5 @@
 //chat_server.c
+#define _GNU_SOURCE // accept4
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -8,13 +9,21 @@
 #include <arpa/inet.h>
 #include <netinet/in.h>
 #include <sys/wait.h>
+#include <sys/ioctl.h>
 #include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include "../common/cmd_table.h" // 명령어 완전 해시 디스패치 테이블
 
 #define MAX_CLIENTS 30
 #define MAX_ROOMS 10
 #define NICK_LEN 32
 #define ROOM_NAME_LEN 64
 #define MSG_BUF_SIZE 1024
+#define DRAIN_TIMEOUT_SEC 5         // 드레인 모드에서 송신 대기 데이터를 비우는 최대 시간
+#define DRAIN_POLL_USEC 50000       // 드레인 진행 상황 확인 주기 (50ms)
+#define LISTEN_BACKLOG 1024         // listen() 대기열 기본 길이 (두 번째 인자로 변경, 커널이 somaxconn 으로 제한)
+#define ACCEPT_BATCH_MAX 64         // 한 번 깨어날 때 accept 하는 최대 연결 수 (자식 메시지 처리가 밀리지 않도록)
 
 // 클라이언트 정보를 관리하는 구조체
 typedef struct {
@@ -33,17 +42,43 @@ typedef struct {
     int is_active;
 } chat_room;
 
+// 서버 명령어 목록: 새 명령어는 여기 한 곳에만 X(동사, 핸들러)로 추가
+#define SERVER_COMMANDS(X)          \
+    X("/list",    cmd_list)         \
+    X("!whisper", cmd_whisper)
+
+// 명령어 핸들러에 넘기는 정보
+struct cmd_ctx {
+    int client_idx;
+    char *argument;                 // 동사 뒤의 나머지 전체 (없으면 NULL)
+};
+
+SERVER_COMMANDS(CMD_TABLE_DECLARE_HANDLER)
+static const cmd_entry_t command_entries[] = { SERVER_COMMANDS(CMD_TABLE_ENTRY) };
+cmd_table_t command_table;
+
 // 전역 변수
 client_info clients[MAX_CLIENTS];
 chat_room rooms[MAX_ROOMS];
 volatile sig_atomic_t terminate = 0; // 우아한 종료를 위한 플래그
 int listen_sock;
+static sigset_t g_orig_mask;         // 메인 루프 밖(sigsuspend 대기, 자식 프로세스)에서 쓰는 시그널 마스크
+
+// 자식 프로세스 전용: 부모->자식 파이프를 소켓으로 전달할 때 사용
+static int g_child_sock = -1;
+static int g_child_pipe = -1;
 
 // 함수 프로토타입
 void process_client_message(int client_idx, const char* msg);
 void broadcast_message(int sender_idx, const char* msg);
 void send_to_client(int client_idx, const char* msg);
 void remove_client(int client_idx);
+void poll_child_messages(void);
+void reap_children(void);
+int init_command_table(void);
+void drain_and_shutdown(void);
+int accept_pending_connections(void);
+void accept_client(int conn_sock);
 
 // 시그널 핸들러: 우아한 종료
 void sigterm_handler(int signo) {
@@ -53,8 +88,13 @@ void sigterm_handler(int signo) {
     }
 }
 
-// 시그널 핸들러: 좀비 프로세스 처리
+// 시그널 핸들러: 자식 종료 알림
 void sigchld_handler(int signo) {
+    // 메인 루프의 sigsuspend()를 깨우는 역할만 함. 회수와 퇴장 처리는 reap_children()에서
+}
+
+// 종료한 자식을 회수하고 퇴장 처리 (SIGCHLD 를 막아 둔 메인 루프/드레인 루프에서만 호출)
+void reap_children(void) {
     int status;
     pid_t pid;
     while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
@@ -73,7 +113,42 @@ void sigchld_handler(int signo) {
 
 // 시그널 핸들러: 자식으로부터의 메시지 수신 알림
 void sigusr1_handler(int signo) {
-    // 이 핸들러는 메인 루프의 pause()를 깨우는 역할만 함
+    // 이 핸들러는 메인 루프의 sigsuspend()를 깨우는 역할만 함
+}
+
+// 시그널 핸들러: 리스닝 소켓에 새 연결이 들어옴 (O_ASYNC)
+void sigio_handler(int signo) {
+    // 메인 루프의 sigsuspend()를 깨우는 역할만 함. 실제 accept는 메인 루프에서
+}
+
+// 자식 프로세스용 시그널 핸들러: 부모가 파이프에 쓴 메시지를 클라이언트 소켓으로 전달
+// 부모는 send_to_client() 후 SIGUSR2를 보내므로, 파이프에 쌓인 내용을 모두 비운다.
+void sigusr2_child_handler(int signo) {
+    char buf[MSG_BUF_SIZE];
+    ssize_t n;
+    int saved_errno = errno;
+
+    while ((n = read(g_child_pipe, buf, sizeof(buf))) > 0) {
+        ssize_t off = 0;
+        while (off < n) {
+            ssize_t w = write(g_child_sock, buf + off, n - off);
+            if (w <= 0) {
+                if (w < 0 && errno == EINTR) continue;
+                errno = saved_errno;
+                return; // 클라이언트 소켓이 닫힘: 나머지는 버림
+            }
+            off += w;
+        }
+    }
+    errno = saved_errno;
+}
+
+// 자식 프로세스용 SIGTERM 핸들러: 남은 메시지를 소켓으로 모두 보낸 뒤 FIN으로 정상 종료
+// (SIGUSR2 핸들러와 서로를 sa_mask 로 막아 두므로, 쓰던 도중의 전달을 끊고 뒤의 바이트를 먼저 쓰지 않음)
+void sigterm_child_handler(int signo) {
+    sigusr2_child_handler(signo);
+    shutdown(g_child_sock, SHUT_WR);
+    _exit(0);
 }
 
 // 자식 프로세스 로직
@@ -81,9 +156,8 @@ void handle_client(int client_idx) {
     char buffer[MSG_BUF_SIZE];
     int n;
 
-    // 자식은 부모가 보내는 SIGUSR2를 처리할 필요 없음.
-    // 파이프를 직접 읽기보다는 클라이언트 소켓에 집중.
-    // 부모가 파이프에 쓴 내용은 바로 클라이언트 소켓으로 전달됨.
+    // 부모가 파이프에 쓴 내용은 SIGUSR2 핸들러(sigusr2_child_handler)가
+    // 클라이언트 소켓으로 전달하므로, 여기서는 클라이언트 소켓 읽기에 집중.
 
     while ((n = read(clients[client_idx].sock_fd, buffer, sizeof(buffer) - 1)) > 0) {
         buffer[n] = '\0';
@@ -126,6 +200,7 @@ void send_to_client(int client_idx, const char* msg) {
         char full_msg[MSG_BUF_SIZE];
         snprintf(full_msg, sizeof(full_msg), "%s\n", msg);
         write(clients[client_idx].pipe_to_child[1], full_msg, strlen(full_msg));
+        kill(clients[client_idx].pid, SIGUSR2); // 자식에게 전달 요청
     }
 }
 
@@ -144,7 +219,7 @@ void broadcast_message(int sender_idx, const char* msg) {
 // 클라이언트 정보 초기화 및 제거
 void remove_client(int client_idx) {
     if (clients[client_idx].is_active) {
-        close(clients[client_idx].sock_fd);
+        if (clients[client_idx].sock_fd >= 0) close(clients[client_idx].sock_fd);
         close(clients[client_idx].pipe_to_child[0]);
         close(clients[client_idx].pipe_to_child[1]);
         close(clients[client_idx].pipe_from_child[0]);
@@ -182,7 +257,12 @@ void daemonize() {
 
 int main(int argc, char *argv[]) {
     if (argc < 2) {
-        fprintf(stderr, "Usage: %s <port>\n", argv[0]);
+        fprintf(stderr, "Usage: %s <port> [backlog]\n", argv[0]);
+        exit(1);
+    }
+    int backlog = argc > 2 ? atoi(argv[2]) : LISTEN_BACKLOG;
+    if (backlog <= 0) {
+        fprintf(stderr, "[Server] Invalid backlog '%s'.\n", argv[2]);
         exit(1);
     }
 
@@ -192,6 +272,11 @@ int main(int argc, char *argv[]) {
     memset(clients, 0, sizeof(clients));
     memset(rooms, 0, sizeof(rooms));
 
+    if (init_command_table() != 0) {
+        fprintf(stderr, "[Server] Failed to build command table.\n");
+        exit(EXIT_FAILURE);
+    }
+
     // 기본 채팅방 "Lobby" 생성
     strcpy(rooms[0].name, "Lobby");
     rooms[0].is_active = 1;
@@ -199,10 +284,20 @@ int main(int argc, char *argv[]) {
     // 시그널 핸들러 등록
     signal(SIGCHLD, sigchld_handler);
     signal(SIGUSR1, sigusr1_handler);
-    signal(SIGINT, sigterm_handler);
-    signal(SIGTERM, sigterm_handler);
+    signal(SIGIO, sigio_handler);
+    signal(SIGUSR2, SIG_IGN); // 자식이 핸들러를 설치하기 전까지는 무시 (fork로 상속)
     signal(SIGPIPE, SIG_IGN); // broken pipe 무시
 
+    // SIGINT/SIGTERM은 SA_RESTART 없이 등록해야 블로킹 accept()가 EINTR로 깨어나
+    // 드레인 모드로 바로 진입할 수 있음 (signal()은 SA_RESTART를 켬)
+    struct sigaction term_sa;
+    memset(&term_sa, 0, sizeof(term_sa));
+    term_sa.sa_handler = sigterm_handler;
+    sigemptyset(&term_sa.sa_mask);
+    term_sa.sa_flags = 0;
+    sigaction(SIGINT, &term_sa, NULL);
+    sigaction(SIGTERM, &term_sa, NULL);
+
     // 리스닝 소켓 생성 및 바인드
     listen_sock = socket(AF_INET, SOCK_STREAM, 0);
     struct sockaddr_in serv_addr;
@@ -219,141 +314,288 @@ int main(int argc, char *argv[]) {
         exit(EXIT_FAILURE);
     }
 
-    if (listen(listen_sock, 5) < 0) {
+    // 재접속이 몰릴 때 SYN이 버려지지 않도록 대기열을 넉넉히 잡음
+    if (listen(listen_sock, backlog) < 0) {
         perror("listen failed");
         exit(EXIT_FAILURE);
     }
 
-    printf("[Server] Chat server started on port %s\n", argv[1]);
+    // select가 금지이므로 블로킹 accept() 대신 리스닝 소켓을 논블로킹 + O_ASYNC로 두고,
+    // 새 연결이 오면 커널이 보내는 SIGIO로 메인 루프를 깨워 쌓인 연결을 한꺼번에 accept
+    fcntl(listen_sock, F_SETOWN, getpid());
+    fcntl(listen_sock, F_SETFL, fcntl(listen_sock, F_GETFL, 0) | O_NONBLOCK | O_ASYNC);
+
+    printf("[Server] Chat server started on port %s (backlog %d)\n", argv[1], backlog);
     printf("[Server] Waiting for clients...\n");
     
-    // 자식 프로세스로부터 오는 메시지를 non-blocking으로 읽기 위해 pipe fcntl 설정
-    for(int i=0; i<MAX_CLIENTS; ++i) {
-        // 이 부분은 클라이언트가 생성될 때 동적으로 설정해야 함.
-    }
-
+    // 메인 루프를 깨우는 시그널은 처리 중에는 막아 두고 sigsuspend()에서만 받음.
+    // 확인과 대기 사이에 온 시그널도 보류되었다가 sigsuspend()를 바로 깨우므로 놓치지 않음.
+    // 핸들러는 깨우기만 하고 clients[]는 메인 루프(reap_children 포함)만 고침.
+    // 드레인 모드가 끝날 때까지 막아 두므로 드레인 중에도 마찬가지
+    sigset_t wake_mask;
+    sigemptyset(&wake_mask);
+    sigaddset(&wake_mask, SIGIO);
+    sigaddset(&wake_mask, SIGUSR1);
+    sigaddset(&wake_mask, SIGCHLD);
+    sigaddset(&wake_mask, SIGINT);
+    sigaddset(&wake_mask, SIGTERM);
+    sigprocmask(SIG_BLOCK, &wake_mask, &g_orig_mask);
 
     // 메인 루프
     while (!terminate) {
-        // 자식 프로세스들이 보낸 메시지 처리
-        for (int i = 0; i < MAX_CLIENTS; i++) {
-            if (clients[i].is_active) {
-                char msg_buf[MSG_BUF_SIZE];
-                int flags = fcntl(clients[i].pipe_from_child[0], F_GETFL, 0);
-                fcntl(clients[i].pipe_from_child[0], F_SETFL, flags | O_NONBLOCK);
-                
-                int n_read = read(clients[i].pipe_from_child[0], msg_buf, sizeof(msg_buf));
-                if (n_read > 0) {
-                    process_client_message(i, msg_buf);
-                }
-            }
-        }
-        
-        // 새 클라이언트 연결 처리
+        // 자식 프로세스들이 보낸 메시지 처리 (끝난 자식의 마지막 메시지까지 처리한 뒤 회수)
+        poll_child_messages();
+        reap_children();
+
+        // 새 클라이언트 연결 처리: 한 번에 다 받지 못했으면 기다리지 않고 바로 다시 돎
+        if (accept_pending_connections() >= ACCEPT_BATCH_MAX) continue;
+
+        if (terminate) break;
+        sigsuspend(&g_orig_mask); // SIGIO/SIGUSR1/SIGCHLD/SIGINT/SIGTERM 중 하나가 올 때까지 대기
+    }
+
+    // 서버 종료 처리 (드레인 모드)
+    drain_and_shutdown();
+    sigprocmask(SIG_SETMASK, &g_orig_mask, NULL);
+    printf("[Server] Server terminated.\n");
+    return 0;
+}
+
+// 리스닝 소켓에 쌓인 연결을 EAGAIN 이 날 때까지 (최대 ACCEPT_BATCH_MAX 개) accept. 받은 개수 반환
+int accept_pending_connections(void) {
+    int accepted = 0;
+    while (accepted < ACCEPT_BATCH_MAX) {
         struct sockaddr_in cli_addr;
         socklen_t cli_len = sizeof(cli_addr);
-        int conn_sock = accept(listen_sock, (struct sockaddr*)&cli_addr, &cli_len);
-
+        // 자식은 클라이언트 소켓을 블로킹 read로 다루므로 SOCK_NONBLOCK은 주지 않음
+        int conn_sock = accept4(listen_sock, (struct sockaddr*)&cli_addr, &cli_len, SOCK_CLOEXEC);
         if (conn_sock < 0) {
-            // non-blocking accept를 사용하지 않으므로, 에러는 실제 에러.
-            // 단, SIGCHLD 등이 accept()를 중단시킬 수 있음 (EINTR).
-            if (terminate) break;
-            continue;
-        }
-
-        // 새 클라이언트를 위한 빈 슬롯 찾기
-        int client_idx = -1;
-        for (int i = 0; i < MAX_CLIENTS; i++) {
-            if (!clients[i].is_active) {
-                client_idx = i;
-                break;
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                perror("accept failed"); // ECONNABORTED, EMFILE 등: 다음에 깨어날 때 다시 시도
             }
+            break;
         }
+        accepted++;
+        accept_client(conn_sock);
+    }
+    return accepted;
+}
 
-        if (client_idx == -1) {
-            printf("[Server] Max clients reached. Connection rejected.\n");
-            write(conn_sock, "Server is full. Try again later.\n", 34);
-            close(conn_sock);
-            continue;
+// accept 한 연결에 빈 슬롯과 파이프를 할당하고 자식 프로세스를 띄움
+void accept_client(int conn_sock) {
+    // 새 클라이언트를 위한 빈 슬롯 찾기
+    int client_idx = -1;
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        if (!clients[i].is_active) {
+            client_idx = i;
+            break;
         }
+    }
 
-        // 파이프 생성
-        if (pipe(clients[client_idx].pipe_to_child) == -1 || pipe(clients[client_idx].pipe_from_child) == -1) {
-            perror("pipe failed");
-            close(conn_sock);
-            continue;
-        }
-        
-        // 자식 프로세스 생성
-        pid_t pid = fork();
-        if (pid < 0) {
-            perror("fork failed");
-            close(conn_sock);
-            remove_client(client_idx); // 생성된 파이프 정리
-            continue;
+    if (client_idx == -1) {
+        printf("[Server] Max clients reached. Connection rejected.\n");
+        write(conn_sock, "Server is full. Try again later.\n", 34);
+        close(conn_sock);
+        return;
+    }
+
+    // 파이프 생성
+    if (pipe(clients[client_idx].pipe_to_child) == -1) {
+        perror("pipe failed");
+        close(conn_sock);
+        return;
+    }
+    if (pipe(clients[client_idx].pipe_from_child) == -1) {
+        perror("pipe failed");
+        close(clients[client_idx].pipe_to_child[0]);
+        close(clients[client_idx].pipe_to_child[1]);
+        close(conn_sock);
+        return;
+    }
+
+    // 자식 프로세스 생성
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork failed");
+        close(conn_sock);
+        close(clients[client_idx].pipe_to_child[0]);
+        close(clients[client_idx].pipe_to_child[1]);
+        close(clients[client_idx].pipe_from_child[0]);
+        close(clients[client_idx].pipe_from_child[1]);
+        return;
+    }
+
+    if (pid == 0) { // 자식 프로세스
+        close(listen_sock); // 리스닝 소켓 닫기
+        sigprocmask(SIG_SETMASK, &g_orig_mask, NULL); // 부모 메인 루프가 막아 둔 시그널 복원
+
+        // 파이프 정리
+        close(clients[client_idx].pipe_to_child[1]);   // 부모->자식 (쓰기) 닫기
+        close(clients[client_idx].pipe_from_child[0]); // 자식->부모 (읽기) 닫기
+
+        // 부모->자식 파이프 전달 준비: 핸들러 설치 전에 쌓인 메시지도 한 번 비움
+        // SIGUSR2 와 SIGTERM 핸들러는 서로를 막아 둠: 전달 도중에 종료 전달이 끼어들면 순서가 뒤바뀜
+        signal(SIGINT, SIG_IGN); // Ctrl+C는 부모의 드레인 모드가 처리
+        clients[client_idx].sock_fd = conn_sock; // handle_client()가 읽을 소켓 (부모 쪽 값은 fork 이후에 설정됨)
+        g_child_sock = conn_sock;
+        g_child_pipe = clients[client_idx].pipe_to_child[0];
+        fcntl(g_child_pipe, F_SETFL, fcntl(g_child_pipe, F_GETFL, 0) | O_NONBLOCK);
+        struct sigaction child_sa;
+        memset(&child_sa, 0, sizeof(child_sa));
+        sigemptyset(&child_sa.sa_mask);
+        sigaddset(&child_sa.sa_mask, SIGUSR2);
+        child_sa.sa_handler = sigterm_child_handler;
+        sigaction(SIGTERM, &child_sa, NULL);
+        sigemptyset(&child_sa.sa_mask);
+        sigaddset(&child_sa.sa_mask, SIGTERM);
+        child_sa.sa_handler = sigusr2_child_handler;
+        child_sa.sa_flags = SA_RESTART; // handle_client()의 블로킹 read 가 끊기지 않도록
+        sigaction(SIGUSR2, &child_sa, NULL);
+        sigset_t flush_mask, prev_mask;
+        sigemptyset(&flush_mask);
+        sigaddset(&flush_mask, SIGUSR2);
+        sigaddset(&flush_mask, SIGTERM);
+        sigprocmask(SIG_BLOCK, &flush_mask, &prev_mask); // 핸들러 밖에서 직접 부를 때도 같은 보호
+        sigusr2_child_handler(SIGUSR2);
+        sigprocmask(SIG_SETMASK, &prev_mask, NULL);
+
+        char child_buffer[MSG_BUF_SIZE];
+
+        // 초기 닉네임 설정
+        write(conn_sock, "Welcome! Please enter your nickname: ", 37);
+        int n = read(conn_sock, child_buffer, sizeof(child_buffer)-1);
+        if (n > 0) {
+            child_buffer[n] = '\0';
+            child_buffer[strcspn(child_buffer, "\r\n")] = 0;
+            // 닉네임을 부모에게 전달
+            write(clients[client_idx].pipe_from_child[1], child_buffer, strlen(child_buffer)+1);
+            kill(getppid(), SIGUSR1);
+        } else {
+            exit(0); // 닉네임 입력 전 종료
         }
 
-        if (pid == 0) { // 자식 프로세스
-            close(listen_sock); // 리스닝 소켓 닫기
-            
-            // 파이프 정리
-            close(clients[client_idx].pipe_to_child[1]);   // 부모->자식 (쓰기) 닫기
-            close(clients[client_idx].pipe_from_child[0]); // 자식->부모 (읽기) 닫기
-
-            char child_buffer[MSG_BUF_SIZE];
-            
-            // 초기 닉네임 설정
-            write(conn_sock, "Welcome! Please enter your nickname: ", 37);
-            int n = read(conn_sock, child_buffer, sizeof(child_buffer)-1);
-            if (n > 0) {
-                child_buffer[n] = '\0';
-                child_buffer[strcspn(child_buffer, "\r\n")] = 0;
-                // 닉네임을 부모에게 전달
-                write(clients[client_idx].pipe_from_child[1], child_buffer, strlen(child_buffer)+1);
-                kill(getppid(), SIGUSR1);
-            } else {
-                exit(0); // 닉네임 입력 전 종료
-            }
 
+        // 자식은 두개의 입력을 동시에 처리해야 함 (클라소켓, 부모파이프)
+        // select가 금지이므로, 한쪽은 blocking read, 다른쪽은 signal로 처리.
+        // 여기서는 클라소켓을 blocking read하고, 부모로부터의 메시지는
+        // 부모가 직접 자식의 소켓에 쓰는 방식으로 변경하는 것이 간단하나,
+        // 과제 요구사항에 따라 파이프를 사용해야 함.
+        // 이는 자식이 두 FD를 non-block + signal로 처리해야함을 의미.
+        // 복잡도를 낮추기 위해, 자식은 클라->부모 역할에만 집중
+        handle_client(client_idx);
+        exit(0);
+    }
+
+    // 부모 프로세스
+    close(conn_sock); // 자식이 관리할 소켓이므로 부모는 닫음
 
-            // 자식은 두개의 입력을 동시에 처리해야 함 (클라소켓, 부모파이프)
-            // select가 금지이므로, 한쪽은 blocking read, 다른쪽은 signal로 처리.
-            // 여기서는 클라소켓을 blocking read하고, 부모로부터의 메시지는
-            // 부모가 직접 자식의 소켓에 쓰는 방식으로 변경하는 것이 간단하나,
-            // 과제 요구사항에 따라 파이프를 사용해야 함.
-            // 이는 자식이 두 FD를 non-block + signal로 처리해야함을 의미.
-            // 복잡도를 낮추기 위해, 자식은 클라->부모 역할에만 집중
-            handle_client(client_idx);
-            exit(0);
+    // 파이프 정리
+    close(clients[client_idx].pipe_to_child[0]);   // 부모->자식 (읽기) 닫기
+    close(clients[client_idx].pipe_from_child[1]); // 자식->부모 (쓰기) 닫기
 
-        } else { // 부모 프로세스
-            close(conn_sock); // 자식이 관리할 소켓이므로 부모는 닫음
+    // 자식->부모 파이프는 메인 루프에서 non-blocking으로 읽음
+    int flags = fcntl(clients[client_idx].pipe_from_child[0], F_GETFL, 0);
+    fcntl(clients[client_idx].pipe_from_child[0], F_SETFL, flags | O_NONBLOCK);
 
-            // 파이프 정리
-            close(clients[client_idx].pipe_to_child[0]);   // 부모->자식 (읽기) 닫기
-            close(clients[client_idx].pipe_from_child[1]); // 자식->부모 (쓰기) 닫기
+    clients[client_idx].pid = pid;
+    clients[client_idx].sock_fd = -1; // 부모는 이미 소켓을 닫았으므로 재사용된 fd를 닫지 않도록 -1
+    clients[client_idx].is_active = 1;
+    clients[client_idx].room_idx = -1; // 아직 방에 없음
+    strcpy(clients[client_idx].nickname, "[Connecting...]");
 
-            clients[client_idx].pid = pid;
-            clients[client_idx].sock_fd = conn_sock; // sock_fd는 부모가 직접 쓰지 않지만 정보 유지
-            clients[client_idx].is_active = 1;
-            clients[client_idx].room_idx = -1; // 아직 방에 없음
-            strcpy(clients[client_idx].nickname, "[Connecting...]");
+    printf("[Server] Client connected. PID: %d, Slot: %d\n", pid, client_idx);
+}
 
-            printf("[Server] Client connected. PID: %d, Slot: %d\n", pid, client_idx);
+// 자식 프로세스들이 보낸 메시지를 non-blocking으로 읽어 처리
+void poll_child_messages(void) {
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        if (clients[i].is_active) {
+            char msg_buf[MSG_BUF_SIZE];
+            int n_read = read(clients[i].pipe_from_child[0], msg_buf, sizeof(msg_buf) - 1);
+            if (n_read > 0) {
+                msg_buf[n_read] = '\0';
+                // 자식은 메시지마다 널 문자를 붙여 보내므로, 한 번에 여러 개가 읽힐 수 있음
+                for (int off = 0; off < n_read; off += strlen(msg_buf + off) + 1) {
+                    if (msg_buf[off] != '\0') process_client_message(i, msg_buf + off);
+                }
+            }
         }
     }
-    
-    // 서버 종료 처리
-    printf("[Server] Shutting down...\n");
+}
+
+// 현재 시각 (단조 증가 시계, 초 단위)
+static double monotonic_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// 드레인 모드 종료:
+// 1) 새 연결 수락 중단  2) 종료 공지 브로드캐스트
+// 3) 처리 중인 메시지와 클라이언트별 송신 대기 데이터를 DRAIN_TIMEOUT_SEC 안에 비움
+// 4) 그 후에 자식 프로세스 종료
+void drain_and_shutdown(void) {
+    printf("[Server] Drain mode: no longer accepting new connections.\n");
+    close(listen_sock);
+    listen_sock = -1;
+
+    int active = 0;
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        if (clients[i].is_active) {
+            send_to_client(i, "[Notice] Server is shutting down. Please reconnect shortly.");
+            active++;
+        }
+    }
+    printf("[Server] Drain: shutdown notice sent to %d client(s). Flushing (deadline %ds)...\n",
+           active, DRAIN_TIMEOUT_SEC);
+
+    double deadline = monotonic_sec() + DRAIN_TIMEOUT_SEC;
+    int last_pending_bytes = -1;
+    int pending_clients = 0, pending_bytes = 0;
+
+    while (1) {
+        // 종료 직전에 도착한 메시지도 라우팅해서 잃어버리지 않도록 처리
+        // (SIGCHLD 는 여전히 막혀 있으므로 끝난 자식은 여기서 회수)
+        poll_child_messages();
+        reap_children();
+
+        pending_clients = 0;
+        pending_bytes = 0;
+        active = 0;
+        for (int i = 0; i < MAX_CLIENTS; i++) {
+            if (!clients[i].is_active) continue;
+            active++;
+            int queued = 0;
+            if (ioctl(clients[i].pipe_to_child[1], FIONREAD, &queued) == 0 && queued > 0) {
+                pending_clients++;
+                pending_bytes += queued;
+                kill(clients[i].pid, SIGUSR2); // 자식에게 다시 전달 요청
+            }
+        }
+
+        if (pending_bytes != last_pending_bytes) {
+            printf("[Server] Drain: %d/%d client(s) flushed, %d byte(s) pending.\n",
+                   active - pending_clients, active, pending_bytes);
+            last_pending_bytes = pending_bytes;
+        }
+        if (pending_bytes == 0) break;
+
+        if (monotonic_sec() >= deadline) {
+            printf("[Server] Drain: deadline reached, dropping %d byte(s) for %d client(s).\n",
+                   pending_bytes, pending_clients);
+            break;
+        }
+        usleep(DRAIN_POLL_USEC);
+    }
+
     for (int i = 0; i < MAX_CLIENTS; i++) {
         if (clients[i].is_active) {
             kill(clients[i].pid, SIGTERM); // 모든 자식에게 종료 신호
             remove_client(i);
         }
     }
-    close(listen_sock);
-    printf("[Server] Server terminated.\n");
-    return 0;
+    printf("[Server] Drain complete.\n");
 }
 
 
@@ -380,61 +622,72 @@ void process_client_message(int client_idx, const char* msg) {
         return;
     }
 
-    char *command;
-    char *argument;
     char full_msg[MSG_BUF_SIZE];
 
-    if (temp_msg[0] == '/') { // 서버 명령어 처리
-        command = strtok(temp_msg, " \n");
-        argument = strtok(NULL, "\n"); // 나머지 전체를 인자로
-
-        if (strcmp(command, "/list") == 0) {
-            strcpy(full_msg, "[Room List]\n");
-            for(int i=0; i<MAX_ROOMS; ++i) {
-                if(rooms[i].is_active) {
-                    char room_info[100];
-                    snprintf(room_info, sizeof(room_info), "- %s\n", rooms[i].name);
-                    strcat(full_msg, room_info);
-                }
-            }
-            send_to_client(client_idx, full_msg);
+    if (temp_msg[0] == '/' || temp_msg[0] == '!') { // 서버 명령어 / 귓속말 처리
+        // 첫 단어(동사)로 명령어 테이블을 한 번만 조회하고, 나머지 전체를 인자로 넘김
+        char *command = strtok(temp_msg, " \n");
+        char *argument = strtok(NULL, "\n");
+        const cmd_entry_t *entry = command ? cmd_table_lookup(&command_table, command) : NULL;
+        if (entry != NULL) {
+            struct cmd_ctx ctx = { client_idx, argument };
+            entry->handler(&ctx);
+        } else {
+            send_to_client(client_idx, "[Error] Unknown command.");
         }
-        // ... /join, /leave, /add, /rm, /users 등 구현
-        else {
-             send_to_client(client_idx, "[Error] Unknown command.");
+    } else { // 일반 채팅 메시지 브로드캐스트
+	snprintf(full_msg,sizeof(full_msg),"[%.*s]: %.*s",NICK_LEN - 1, clients[client_idx].nickname,MSG_BUF_SIZE - NICK_LEN - 10, temp_msg);
+	broadcast_message(client_idx, full_msg);
+    }
+}
+
+// 명령어 테이블 생성 (시작 시 한 번)
+int init_command_table(void) {
+    return cmd_table_build(&command_table, command_entries,
+                           sizeof(command_entries) / sizeof(command_entries[0]));
+}
+
+// /list : 채팅방 목록
+static void cmd_list(struct cmd_ctx *ctx) {
+    char full_msg[MSG_BUF_SIZE];
+    strcpy(full_msg, "[Room List]\n");
+    for(int i=0; i<MAX_ROOMS; ++i) {
+        if(rooms[i].is_active) {
+            char room_info[100];
+            snprintf(room_info, sizeof(room_info), "- %s\n", rooms[i].name);
+            strcat(full_msg, room_info);
         }
+    }
+    send_to_client(ctx->client_idx, full_msg);
+}
+// ... /join, /leave, /add, /rm, /users 등은 SERVER_COMMANDS에 추가해서 구현
 
-    } else if (temp_msg[0] == '!') { // 귓속말 처리
-        command = strtok(temp_msg, " ");
-        if(strcmp(command, "!whisper") == 0) {
-            char* target_nick = strtok(NULL, " ");
-            char* whisper_msg = strtok(NULL, "\n");
-            
-            if(!target_nick || !whisper_msg) {
-                send_to_client(client_idx, "[Usage] !whisper <nickname> <message>");
-                return;
-            }
+// !whisper <nickname> <message> : 귓속말
+static void cmd_whisper(struct cmd_ctx *ctx) {
+    char full_msg[MSG_BUF_SIZE];
+    char* target_nick = ctx->argument ? strtok(ctx->argument, " ") : NULL;
+    char* whisper_msg = target_nick ? strtok(NULL, "\n") : NULL;
 
-            int target_idx = -1;
-            for(int i=0; i<MAX_CLIENTS; ++i) {
-                if(clients[i].is_active && strcmp(clients[i].nickname, target_nick) == 0) {
-                    target_idx = i;
-                    break;
-                }
-            }
+    if(!target_nick || !whisper_msg) {
+        send_to_client(ctx->client_idx, "[Usage] !whisper <nickname> <message>");
+        return;
+    }
 
-            if(target_idx != -1) {
-                snprintf(full_msg, sizeof(full_msg), "[Whisper from %s]: %s", clients[client_idx].nickname, whisper_msg);
-                send_to_client(target_idx, full_msg);
-                snprintf(full_msg, sizeof(full_msg), "[To %s]: %s", target_nick, whisper_msg);
-                send_to_client(client_idx, full_msg); // 보낸 사람에게도 확인 메시지
-            } else {
-                snprintf(full_msg, sizeof(full_msg), "[Error] User '%s' not found.", target_nick);
-                send_to_client(client_idx, full_msg);
-            }
+    int target_idx = -1;
+    for(int i=0; i<MAX_CLIENTS; ++i) {
+        if(clients[i].is_active && strcmp(clients[i].nickname, target_nick) == 0) {
+            target_idx = i;
+            break;
         }
-    } else { // 일반 채팅 메시지 브로드캐스트
-	snprintf(full_msg,sizeof(full_msg),"[%.*s]: %.*s",NICK_LEN - 1, clients[client_idx].nickname,MSG_BUF_SIZE - NICK_LEN - 10, temp_msg);
-	broadcast_message(client_idx, full_msg);
+    }
+
+    if(target_idx != -1) {
+        snprintf(full_msg, sizeof(full_msg), "[Whisper from %s]: %s", clients[ctx->client_idx].nickname, whisper_msg);
+        send_to_client(target_idx, full_msg);
+        snprintf(full_msg, sizeof(full_msg), "[To %s]: %s", target_nick, whisper_msg);
+        send_to_client(ctx->client_idx, full_msg); // 보낸 사람에게도 확인 메시지
+    } else {
+        snprintf(full_msg, sizeof(full_msg), "[Error] User '%s' not found.", target_nick);
+        send_to_client(ctx->client_idx, full_msg);
     }
 }
@@ -1,17 +1,27 @@
+// 빌드: gcc -o client2 chat_client.c -lz
+#define _GNU_SOURCE // splice
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <arpa/inet.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/sendfile.h> // 파일 전송 (보내는 쪽)
 #include <poll.h> // poll 함수를 사용하기 위해
 #include <time.h> // 시간 기록을 위해
+#include "chat_compress.h" // 서버 -> 클라이언트 압축 (/compress)
 
 #define SERVER_IP "127.0.0.1"
 #define PORT 8080
 #define BUFFER_SIZE 1024
 #define MAX_NICKNAME_LEN 31
 #define MAX_ROOMNAME_LEN 31
+#define RX_BUFFER_SIZE (BUFFER_SIZE * 8) // 서버 메시지를 줄 단위로 자르기 위한 수신 버퍼
+#define XFER_CHUNK_SIZE (64 * 1024)      // XDATA 조각 하나의 크기 (조각 사이사이에 채팅 입출력 처리)
+#define RECONNECT_ATTEMPTS 10            // 연결이 끊겼을 때 재접속 시도 횟수 (1초 간격)
 
 // 메시지 타입 정의 (서버와 동일하게 클라이언트에서도 정의)
 #define MSG_TYPE_CHAT       "CHAT"      // 일반 채팅 메시지
@@ -20,10 +30,70 @@
 #define MSG_TYPE_JOIN       "JOIN"      // 채팅방 입장 알림
 #define MSG_TYPE_LEAVE      "LEAVE"     // 채팅방 퇴장 알림
 #define MSG_TYPE_INFO       "INFO"      // 서버 정보 메시지 (예: 명령어 결과, 오류)
+#define MSG_TYPE_XFER       "XFER"      // 파일 전송 제어 (XFER:go / XFER:start / XFER:end)
+#define MSG_TYPE_XDATA      "XDATA"     // 파일 조각 헤더 XDATA:[전송번호]:[길이]\n + 원본 바이트
+#define MSG_TYPE_PONG       "PONG"      // PING 이벤트에 대한 답 PONG:[번호]::
+
+// 서버의 상태 변경 이벤트 줄 (서버와 동일하게 정의): [EVENT_MARK][타입 바이트][값]\n
+#define EVENT_MARK          '\x02'
+#define EVENT_NICK_ACK      'N'         // 서버가 확정한 내 닉네임
+#define EVENT_ROOM_CHANGED  'R'         // 내가 지금 있는 방. 값: [방 이름]:[그 방의 마지막 순번]
+#define EVENT_ROOM_MESSAGE  'Q'         // 방 메시지. 값: [순번] [메시지]
+#define EVENT_SESSION       'T'         // 재접속 시 CMD:resume 으로 보낼 세션 토큰
+#define EVENT_REPLY         'A'         // 요청 ID가 붙은 명령의 응답 한 줄. 값: [요청 ID] [줄]
+#define EVENT_REPLY_DONE    'D'         // 그 요청의 응답이 모두 왔음. 값: [요청 ID]
+#define EVENT_PING          'P'         // 서버의 연결 확인. 값: [번호]. 같은 번호로 PONG 을 보내야 끊기지 않음
+
+// 명령어 요청 ID: CMD#[ID]:... 로 보내면 서버가 응답을 EVENT_REPLY 로 감싸고 끝에 EVENT_REPLY_DONE 을 보냄.
+// 여러 명령을 한 번에 보내도(파이프라이닝) 응답을 요청별로 모아 한 덩어리씩 출력할 수 있음
+#define MAX_PENDING_REQUESTS 32
+#define PENDING_REPLY_SIZE (BUFFER_SIZE * 8)
 
 
 char current_nickname[MAX_NICKNAME_LEN + 1];
 char current_room[MAX_ROOMNAME_LEN + 1];
+char session_token[32];             // 서버가 준 세션 토큰 (재접속 시 닉네임/방을 이어받음)
+unsigned long long last_seq = 0;    // 현재 방에서 마지막으로 받은 메시지 순번
+
+// 파일 전송 상태 (보내기/받기 각각 한 개씩)
+typedef struct {
+    int id;                 // 서버가 정한 전송 번호 (0: 아직 모름/없음)
+    int fd;                 // 보낼 파일 또는 받아서 쓰는 파일 (-1: 없음)
+    int sending;            // XFER:go 를 받아 조각을 보내는 중
+    long long size;
+    long long done;
+    struct timespec start;
+    char name[264];         // 파일 이름 (받는 쪽은 겹치지 않게 붙인 .N 포함)
+} file_xfer_t;
+
+file_xfer_t out_xfer = { .fd = -1 };
+file_xfer_t in_xfer = { .fd = -1 };
+int splice_pipe[2] = { -1, -1 }; // 받는 쪽: 소켓 -> 파이프 -> 파일 splice 용
+
+char rx_buf[RX_BUFFER_SIZE];
+size_t rx_len = 0;
+char stdin_buf[BUFFER_SIZE];    // 표준 입력에서 읽었지만 아직 줄바꿈이 오지 않은 바이트
+size_t stdin_len = 0;
+
+// 서버 -> 클라이언트 압축. /compress 로 요청하고 서버가 COMPRESS_ACK 로 답한 뒤부터 수신 바이트는 레코드 단위
+int compressed = 0;
+z_stream inflater;
+unsigned char rec_hdr[COMPRESS_RECORD_HDR];
+size_t rec_hdr_len = 0;
+int rec_type = 0;
+long long rec_remaining = 0;        // 현재 레코드 본문 중 아직 처리하지 않은 바이트 (0이면 다음 헤더를 기다림)
+int raw_fd = -1;                    // R 레코드(파일 조각 본문)를 쓸 파일. 진행 중인 전송이 아니면 -1 (버림)
+unsigned long long compressed_in = 0, inflated_in = 0; // Z 레코드 바이트 (헤더 포함) / 풀린 바이트
+
+// 응답을 기다리는 명령어 요청
+typedef struct {
+    unsigned int id;                  // 0: 빈 칸
+    char reply[PENDING_REPLY_SIZE];   // 지금까지 받은 응답 줄
+    size_t reply_len;
+} pending_request_t;
+
+pending_request_t pending_requests[MAX_PENDING_REQUESTS];
+unsigned int next_request_id = 1;
 
 // 유틸리티 함수: 현재 시간 문자열 반환
 char* get_current_time_str() {
@@ -44,18 +114,577 @@ void display_help() {
     printf("  /list                    : 전체 채팅방 목록 조회\n");
     printf("  /users                   : 현재 방 사용자 목록 조회\n");
     printf("  !whisper [상대방닉네임] [메시지] : 특정 사용자에게 귓속말 전송\n");
+    printf("  /sendfile [닉네임] [경로] : 파일 전송 제안 (상대가 수락하면 전송)\n");
+    printf("  /accept [전송번호]        : 파일 받기 수락 (현재 디렉터리에 저장)\n");
+    printf("  /reject [전송번호]        : 파일 받기 거절 / 진행 중인 전송 취소\n");
+    printf("  /compress                : 서버 -> 클라이언트 메시지 압축 요청 (deflate)\n");
     printf("  /help                    : 도움말 표시\n");
     printf("  /quit 또는 /exit         : 채팅 종료\n");
     printf("\n");
 }
 
+static int write_all(int fd, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        data += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static double elapsed_since(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static void xfer_reset(file_xfer_t *x) {
+    if (x->fd >= 0) close(x->fd);
+    memset(x, 0, sizeof(*x));
+    x->fd = -1;
+}
+
+// 보내는 쪽: XDATA 헤더 + 조각 하나를 sendfile 로 (조각 전체를 보낸 뒤에만 다른 메시지를 보냄)
+static int send_next_chunk(int sock) {
+    char header[64];
+    long long len = out_xfer.size - out_xfer.done;
+    if (len > XFER_CHUNK_SIZE) len = XFER_CHUNK_SIZE;
+    int header_len = snprintf(header, sizeof(header), "%s:%d:%lld\n", MSG_TYPE_XDATA, out_xfer.id, len);
+    if (write_all(sock, header, header_len) < 0) return -1;
+
+    off_t off = out_xfer.done;
+    while (len > 0) {
+        ssize_t n = sendfile(sock, out_xfer.fd, &off, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1; // 보내는 도중 파일이 줄어들면 조각을 채울 수 없음
+        len -= n;
+    }
+    out_xfer.done = off;
+    if (out_xfer.done >= out_xfer.size) {
+        out_xfer.sending = 0; // 서버의 XFER:end 를 기다림
+    }
+    return 0;
+}
+
+// 받는 쪽: 조각 본문 중 아직 소켓에 있는 부분을 소켓 -> 파이프 -> 파일로 splice (사용자 공간 복사 없음)
+static int receive_payload(int sock, long long len, int fd) {
+    char discard[BUFFER_SIZE];
+    while (len > 0) {
+        ssize_t n;
+        if (fd >= 0 && splice_pipe[0] >= 0) {
+            n = splice(sock, NULL, splice_pipe[1], NULL, len, SPLICE_F_MOVE);
+            for (ssize_t left = n; left > 0; ) {
+                ssize_t w = splice(splice_pipe[0], NULL, fd, NULL, left, SPLICE_F_MOVE);
+                if (w <= 0) return -1;
+                left -= w;
+            }
+        } else {
+            n = read(sock, discard, len < (long long)sizeof(discard) ? len : (long long)sizeof(discard));
+            if (n > 0 && fd >= 0 && write_all(fd, discard, n) < 0) return -1;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        len -= n;
+        if (fd >= 0) in_xfer.done += n;
+    }
+    return 0;
+}
+
+// 받을 파일을 현재 디렉터리에 만듦. 같은 이름이 있으면 이름 뒤에 .1, .2 ... 를 붙임
+static int open_receive_file(const char *name, char *path, size_t path_size) {
+    for (int i = 0; i < 100; i++) {
+        if (i == 0) snprintf(path, path_size, "%s", name);
+        else snprintf(path, path_size, "%s.%d", name, i);
+        int fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0644);
+        if (fd >= 0 || errno != EEXIST) return fd;
+    }
+    return -1;
+}
+
+// 서버의 파일 전송 제어 메시지 (화면에는 설명만 출력)
+static void handle_xfer_message(const char *line) {
+    int id;
+    long long size;
+    char arg[256];
+
+    if (sscanf(line, "XFER:go:%d:%lld", &id, &size) == 2 && out_xfer.fd >= 0) {
+        out_xfer.id = id;
+        out_xfer.sending = size > 0;
+        clock_gettime(CLOCK_MONOTONIC, &out_xfer.start);
+        printf("[%s][클라이언트] 파일 '%s' 전송을 시작합니다. (%lld 바이트)\n", get_current_time_str(), out_xfer.name, size);
+    } else if (sscanf(line, "XFER:start:%d:%lld:%255[^\n]", &id, &size, arg) == 3) {
+        xfer_reset(&in_xfer);
+        in_xfer.fd = open_receive_file(arg, in_xfer.name, sizeof(in_xfer.name));
+        if (in_xfer.fd < 0) {
+            perror("받을 파일 열기 실패"); // 조각은 받아서 버림
+        }
+        in_xfer.id = id;
+        in_xfer.size = size;
+        clock_gettime(CLOCK_MONOTONIC, &in_xfer.start);
+        printf("[%s][클라이언트] 파일 '%s' 수신을 시작합니다. (%lld 바이트)\n", get_current_time_str(), in_xfer.name, size);
+    } else if (sscanf(line, "XFER:end:%d:%255s", &id, arg) == 2) {
+        // 보내는 쪽은 XFER:go 전에는 전송 번호를 모름 (거절/실패는 그 전에 올 수 있음)
+        file_xfer_t *x = NULL;
+        if (id != 0 && in_xfer.id == id) x = &in_xfer;
+        else if (out_xfer.fd >= 0 && (out_xfer.id == id || out_xfer.id == 0)) x = &out_xfer;
+        if (x == NULL) {
+            return;
+        }
+        double sec = elapsed_since(&x->start);
+        if (strcmp(arg, "done") == 0) {
+            printf("[%s][클라이언트] 파일 '%s' %s 완료: %lld 바이트, %.3f초, %.1f MB/s\n", get_current_time_str(), x->name,
+                   x == &in_xfer ? "수신" : "전송", x->done, sec, sec > 0 ? x->done / sec / (1024 * 1024) : 0.0);
+        } else {
+            printf("[%s][클라이언트] 파일 '%s' 전송이 끝났습니다: %s (%lld/%lld 바이트)\n", get_current_time_str(), x->name,
+                   arg, x->done, x->size);
+        }
+        xfer_reset(x);
+    }
+}
+
+// 보낼 CMD 메시지에 요청 ID를 붙이고(CMD:... -> CMD#[ID]:...) 응답을 모을 칸을 잡음.
+// 빈 칸이 없거나 압축 협상처럼 자식 프로세스가 직접 답하는 명령은 ID 없이 보냄
+static void tag_request(char *message, size_t size) {
+    if (strncmp(message, MSG_TYPE_COMMAND ":", strlen(MSG_TYPE_COMMAND) + 1) != 0 || strcmp(message, COMPRESS_REQUEST) == 0) {
+        return;
+    }
+    for (int i = 0; i < MAX_PENDING_REQUESTS; i++) {
+        if (pending_requests[i].id == 0) {
+            char prefix[32];
+            size_t skip = strlen(MSG_TYPE_COMMAND) + 1;
+            size_t rest = strlen(message + skip);
+            int prefix_len = snprintf(prefix, sizeof(prefix), "%s#%u:", MSG_TYPE_COMMAND, next_request_id);
+            if (prefix_len + rest + 1 > size) {
+                return;
+            }
+            unsigned int id = next_request_id++;
+            if (next_request_id == 0) next_request_id = 1;
+            memmove(message + prefix_len, message + skip, rest + 1);
+            memcpy(message, prefix, prefix_len);
+            pending_requests[i].id = id;
+            pending_requests[i].reply_len = 0;
+            return;
+        }
+    }
+}
+
+static pending_request_t *find_pending(unsigned int id) {
+    for (int i = 0; i < MAX_PENDING_REQUESTS; i++) {
+        if (id != 0 && pending_requests[i].id == id) {
+            return &pending_requests[i];
+        }
+    }
+    return NULL;
+}
+
+// 서버의 상태 변경 이벤트 줄 처리 ([EVENT_MARK][타입 바이트][값]\n). 화면에는 출력하지 않음
+static void handle_event(int sock, char type, char *value) {
+    value[strcspn(value, "\n")] = '\0';
+    switch (type) {
+    case EVENT_NICK_ACK:
+        strncpy(current_nickname, value, MAX_NICKNAME_LEN);
+        current_nickname[MAX_NICKNAME_LEN] = '\0';
+        break;
+    case EVENT_ROOM_CHANGED: {
+        char *sep = strrchr(value, ':');
+        if (sep != NULL) {
+            *sep = '\0';
+            last_seq = strtoull(sep + 1, NULL, 10); // 새 방에서는 이 순번 이후의 메시지부터 받음
+        }
+        strncpy(current_room, value, MAX_ROOMNAME_LEN);
+        current_room[MAX_ROOMNAME_LEN] = '\0';
+        break;
+    }
+    case EVENT_ROOM_MESSAGE: {
+        char *text;
+        last_seq = strtoull(value, &text, 10);
+        printf("%s\n", *text == ' ' ? text + 1 : text);
+        break;
+    }
+    case EVENT_SESSION:
+        snprintf(session_token, sizeof(session_token), "%s", value);
+        break;
+    case EVENT_REPLY: {
+        // 응답 줄은 요청이 끝날 때까지 모아 둠 (파이프라이닝한 다른 요청의 응답과 섞이지 않게)
+        char *text;
+        pending_request_t *req = find_pending(strtoul(value, &text, 10));
+        if (*text == ' ') text++;
+        if (req == NULL) {
+            printf("%s\n", text);
+            break;
+        }
+        int len = snprintf(req->reply + req->reply_len, sizeof(req->reply) - req->reply_len, "%s\n", text);
+        if (len > 0 && (size_t)len < sizeof(req->reply) - req->reply_len) {
+            req->reply_len += len;
+        }
+        break;
+    }
+    case EVENT_REPLY_DONE: {
+        pending_request_t *req = find_pending(strtoul(value, NULL, 10));
+        if (req != NULL) {
+            fwrite(req->reply, 1, req->reply_len, stdout);
+            req->id = 0;
+        }
+        break;
+    }
+    case EVENT_PING: {
+        // 한동안 보낸 것이 없어서 서버가 살아 있는지 확인함. 쓰기 실패는 다음 read 에서 드러남
+        char pong[64];
+        int len = snprintf(pong, sizeof(pong), "%s:%s::\n", MSG_TYPE_PONG, value);
+        write_all(sock, pong, len);
+        break;
+    }
+    default:
+        break; // 모르는 이벤트는 무시 (새 서버와의 호환)
+    }
+}
+
+// 받은 바이트를 줄 단위로 처리. XDATA 조각 본문은 줄로 자르지 않고 파일로 옮김
+// (압축 모드에서는 rx_buf 에 풀린 텍스트만 들어오고, 조각 본문은 process_records 가 R 레코드로 처리)
+static int process_server_bytes(int sock) {
+    size_t off = 0;
+    int switched = 0; // 이번 호출에서 압축 모드로 바뀜 (남은 바이트는 텍스트가 아님)
+    while (off < rx_len) {
+        char *line = rx_buf + off;
+        char *nl = memchr(line, '\n', rx_len - off);
+        if (nl == NULL) break;
+        size_t line_len = nl - line + 1;
+        char saved = line[line_len]; // 줄 끝 다음 바이트 (문자열 종료용으로 잠시 덮어씀)
+        line[line_len] = '\0';
+        off += line_len;
+
+        // 첫 바이트로 분기: 이벤트 줄, 프로토콜 줄(XFER/XDATA/ZLIB), 나머지는 화면에 그대로 출력
+        int id;
+        long long len;
+        if (line[0] == EVENT_MARK) {
+            handle_event(sock, line[1], line + 2);
+            line[line_len] = saved;
+        } else if (line[0] == '[') {
+            printf("%s", line); // 서버 안내/채팅 메시지
+            line[line_len] = saved;
+        } else if (!compressed && strcmp(line, COMPRESS_ACK "\n") == 0) {
+            line[line_len] = saved;
+            if (compress_inflate_init(&inflater) != 0) return -1;
+            compressed = 1;
+            switched = 1;
+            printf("[%s][클라이언트] 서버 메시지 압축을 사용합니다.\n", get_current_time_str());
+            break; // 남은 바이트는 레코드 (호출한 쪽에서 process_records 로)
+        } else if (compressed && sscanf(line, MSG_TYPE_XDATA ":%d:%lld", &id, &len) == 2) {
+            line[line_len] = saved;
+            raw_fd = (in_xfer.id == id) ? in_xfer.fd : -1; // 본문은 뒤따르는 R 레코드로 옴
+        } else if (sscanf(line, MSG_TYPE_XDATA ":%d:%lld", &id, &len) == 2) {
+            line[line_len] = saved;
+            int fd = (in_xfer.id == id) ? in_xfer.fd : -1;
+            long long have = (long long)(rx_len - off) < len ? (long long)(rx_len - off) : len;
+            if (fd >= 0 && write_all(fd, rx_buf + off, have) < 0) return -1;
+            if (fd >= 0) in_xfer.done += have;
+            off += have;
+            if (receive_payload(sock, len - have, fd) < 0) return -1;
+        } else if (strncmp(line, MSG_TYPE_XFER ":", strlen(MSG_TYPE_XFER) + 1) == 0) {
+            handle_xfer_message(line);
+            line[line_len] = saved;
+        } else {
+            printf("%s", line);
+            line[line_len] = saved;
+        }
+    }
+    memmove(rx_buf, rx_buf + off, rx_len - off);
+    rx_len -= off;
+    if (!switched && rx_len == sizeof(rx_buf) - 1) { // 줄바꿈 없이 버퍼가 가득 참: 그대로 출력
+        rx_buf[rx_len] = '\0';
+        printf("%s", rx_buf);
+        rx_len = 0;
+    }
+    return 0;
+}
+
+// Z 레코드 본문을 풀어 rx_buf 에 이어 붙이고 줄 단위로 처리
+static int inflate_records(int sock, const unsigned char *data, size_t len) {
+    inflater.next_in = (Bytef *)data;
+    inflater.avail_in = len;
+    do {
+        inflater.next_out = (Bytef *)rx_buf + rx_len;
+        inflater.avail_out = sizeof(rx_buf) - 1 - rx_len;
+        int ret = inflate(&inflater, Z_SYNC_FLUSH);
+        if (ret != Z_OK && ret != Z_BUF_ERROR) return -1;
+        size_t produced = sizeof(rx_buf) - 1 - rx_len - inflater.avail_out;
+        rx_len += produced;
+        inflated_in += produced;
+        if (process_server_bytes(sock) < 0) return -1;
+        if (ret == Z_BUF_ERROR && produced == 0) break; // 더 풀 것이 없음
+    } while (inflater.avail_in > 0 || inflater.avail_out == 0);
+    return 0;
+}
+
+// 압축 모드의 수신 바이트: [타입][길이 4바이트] 레코드로 나눠 Z 는 풀고, R 은 파일 조각 본문으로 씀
+static int process_records(int sock, const unsigned char *data, size_t len) {
+    while (len > 0) {
+        if (rec_remaining == 0) {
+            size_t take = COMPRESS_RECORD_HDR - rec_hdr_len < len ? COMPRESS_RECORD_HDR - rec_hdr_len : len;
+            memcpy(rec_hdr + rec_hdr_len, data, take);
+            rec_hdr_len += take;
+            data += take;
+            len -= take;
+            if (rec_hdr_len == COMPRESS_RECORD_HDR) {
+                rec_hdr_len = 0;
+                rec_type = rec_hdr[0];
+                rec_remaining = compress_get_record_len(rec_hdr);
+                if (rec_type != COMPRESS_RECORD_DEFLATE && rec_type != COMPRESS_RECORD_RAW) return -1;
+                if (rec_type == COMPRESS_RECORD_DEFLATE) compressed_in += COMPRESS_RECORD_HDR;
+            }
+            continue;
+        }
+        size_t take = (long long)len < rec_remaining ? len : (size_t)rec_remaining;
+        if (rec_type == COMPRESS_RECORD_DEFLATE) {
+            compressed_in += take;
+            if (inflate_records(sock, data, take) < 0) return -1;
+        } else {
+            if (raw_fd >= 0 && write_all(raw_fd, (const char *)data, take) < 0) return -1;
+            if (raw_fd >= 0) in_xfer.done += take;
+            if (take == len && rec_remaining > (long long)take) {
+                // 버퍼에 있던 것은 다 썼고 본문 나머지는 아직 소켓에 있음: 바로 파일로 splice
+                if (receive_payload(sock, rec_remaining - take, raw_fd) < 0) return -1;
+                rec_remaining = take;
+            }
+        }
+        rec_remaining -= take;
+        data += take;
+        len -= take;
+    }
+    return 0;
+}
+
+// 서버에 TCP 연결. 실패하면 -1
+static int connect_to_server(const struct sockaddr_in *server_addr) {
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock == -1) {
+        return -1;
+    }
+    if (connect(sock, (const struct sockaddr *)server_addr, sizeof(*server_addr)) == -1) {
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+// 연결이 끊기면 그 연결에 묶인 상태(파일 전송, 압축 스트림, 받다 만 줄)를 버림
+static void reset_connection_state(void) {
+    if (out_xfer.fd >= 0 || in_xfer.fd >= 0) {
+        printf("[%s][클라이언트] 연결이 끊겨 진행 중이던 파일 전송을 취소합니다.\n", get_current_time_str());
+    }
+    xfer_reset(&out_xfer);
+    xfer_reset(&in_xfer);
+    rx_len = 0;
+    if (compressed) {
+        inflateEnd(&inflater);
+        compressed = 0;
+    }
+    rec_hdr_len = 0;
+    rec_remaining = 0;
+    raw_fd = -1;
+    for (int i = 0; i < MAX_PENDING_REQUESTS; i++) {
+        pending_requests[i].id = 0; // 끊긴 연결로 보낸 요청의 응답은 오지 않음
+    }
+}
+
+// 재접속 후 세션을 이어받음: 토큰과 마지막으로 받은 순번을 보내면 서버가 닉네임/방을 되돌리고
+// 놓친 방 메시지를 한 번에 보내 줌. 압축을 쓰고 있었다면 다시 요청
+static int reconnect_and_resume(const struct sockaddr_in *server_addr, int was_compressed) {
+    char message[BUFFER_SIZE];
+    for (int attempt = 1; attempt <= RECONNECT_ATTEMPTS; attempt++) {
+        sleep(1);
+        int sock = connect_to_server(server_addr);
+        if (sock == -1) {
+            printf("[%s][클라이언트] 재접속 실패 (%d/%d).\n", get_current_time_str(), attempt, RECONNECT_ATTEMPTS);
+            continue;
+        }
+        int len = snprintf(message, sizeof(message), "%s:%s:%s:%llu\n", MSG_TYPE_COMMAND, "resume", session_token, last_seq);
+        if (was_compressed) {
+            len += snprintf(message + len, sizeof(message) - len, "%s\n", COMPRESS_REQUEST);
+        }
+        if (write_all(sock, message, len) < 0) {
+            close(sock);
+            continue;
+        }
+        printf("[%s][클라이언트] 서버에 다시 연결되었습니다. 이전 세션을 이어받습니다.\n", get_current_time_str());
+        return sock;
+    }
+    return -1;
+}
+
+// 입력 한 줄(명령 하나)을 서버로 보낼 메시지로 만듦. 1: 보냄, 0: 보낼 것 없음, -1: 종료
+static int build_outgoing(char *raw_input, char *out, size_t out_size) {
+    // 명령어 처리
+    if (raw_input[0] == '/') {
+        if (strcmp(raw_input, "/quit") == 0 || strcmp(raw_input, "/exit") == 0) {
+            printf("[%s][클라이언트] 채팅을 종료합니다.\n", get_current_time_str());
+            return -1;
+        } else if (strcmp(raw_input, "/help") == 0) {
+            display_help();
+            return 0;
+        } else if (strcmp(raw_input, "/compress") == 0) {
+            if (compressed) {
+                printf("[%s][클라이언트] 이미 압축을 사용 중입니다.\n", get_current_time_str());
+                return 0;
+            }
+            snprintf(out, out_size, "%s", COMPRESS_REQUEST); // 서버가 COMPRESS_ACK 로 답함
+        } else if (strncmp(raw_input, "/nickname ", 10) == 0) {
+            char new_nickname[MAX_NICKNAME_LEN + 1];
+            sscanf(raw_input + 10, "%s", new_nickname);
+            if (strlen(new_nickname) > MAX_NICKNAME_LEN) {
+                printf("[%s][클라이언트] 오류: 닉네임은 최대 %d자까지 가능합니다.\n", get_current_time_str(), MAX_NICKNAME_LEN);
+                return 0;
+            }
+            snprintf(out, out_size, "%s:%s:%s:%s", MSG_TYPE_COMMAND, "nickname", new_nickname, "");
+        } else if (strncmp(raw_input, "/add ", 5) == 0) {
+            char room_name[MAX_ROOMNAME_LEN + 1];
+            sscanf(raw_input + 5, "%s", room_name);
+             if (strlen(room_name) > MAX_ROOMNAME_LEN) {
+                printf("[%s][클라이언트] 오류: 방 이름은 최대 %d자까지 가능합니다.\n", get_current_time_str(), MAX_ROOMNAME_LEN);
+                return 0;
+            }
+            snprintf(out, out_size, "%s:%s:%s:%s", MSG_TYPE_COMMAND, "add", room_name, "");
+        } else if (strncmp(raw_input, "/rm ", 4) == 0) {
+            char room_name[MAX_ROOMNAME_LEN + 1];
+            sscanf(raw_input + 4, "%s", room_name);
+            snprintf(out, out_size, "%s:%s:%s:%s", MSG_TYPE_COMMAND, "rm", room_name, "");
+        } else if (strncmp(raw_input, "/join ", 6) == 0) {
+            char room_name[MAX_ROOMNAME_LEN + 1];
+            sscanf(raw_input + 6, "%s", room_name);
+             if (strlen(room_name) > MAX_ROOMNAME_LEN) {
+                printf("[%s][클라이언트] 오류: 방 이름은 최대 %d자까지 가능합니다.\n", get_current_time_str(), MAX_ROOMNAME_LEN);
+                return 0;
+            }
+            snprintf(out, out_size, "%s:%s:%s:%s", MSG_TYPE_COMMAND, "join", room_name, "");
+        } else if (strcmp(raw_input, "/leave") == 0) {
+            snprintf(out, out_size, "%s:%s:%s:%s", MSG_TYPE_COMMAND, "leave", "", "");
+        } else if (strcmp(raw_input, "/list") == 0) {
+            snprintf(out, out_size, "%s:%s:%s:%s", MSG_TYPE_COMMAND, "list", "", "");
+        } else if (strcmp(raw_input, "/users") == 0) {
+            snprintf(out, out_size, "%s:%s:%s:%s", MSG_TYPE_COMMAND, "users", "", "");
+        } else if (strncmp(raw_input, "/sendfile ", 10) == 0) {
+            char target_nickname[MAX_NICKNAME_LEN + 1];
+            char path[BUFFER_SIZE];
+            struct stat st;
+            if (sscanf(raw_input + 10, "%31s %1023[^\n]", target_nickname, path) != 2) {
+                printf("[%s][클라이언트] 사용법: /sendfile [닉네임] [경로]\n", get_current_time_str());
+                return 0;
+            }
+            if (out_xfer.fd >= 0) {
+                printf("[%s][클라이언트] 오류: 이미 진행 중인 파일 전송이 있습니다.\n", get_current_time_str());
+                return 0;
+            }
+            int fd = open(path, O_RDONLY);
+            if (fd < 0 || fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+                printf("[%s][클라이언트] 오류: 보낼 수 있는 파일이 아닙니다: %s\n", get_current_time_str(), path);
+                if (fd >= 0) close(fd);
+                return 0;
+            }
+            const char *base = strrchr(path, '/');
+            base = base ? base + 1 : path;
+            xfer_reset(&out_xfer);
+            out_xfer.fd = fd;
+            out_xfer.size = st.st_size;
+            snprintf(out_xfer.name, sizeof(out_xfer.name), "%.255s", base); // 서버의 파일 이름 최대 길이
+            // 서버에는 크기와 경로 없는 파일 이름만 알림
+            snprintf(out, out_size, "%s:%s:%s:%lld %s", MSG_TYPE_COMMAND, "sendfile", target_nickname, (long long)st.st_size, out_xfer.name);
+        } else if (strncmp(raw_input, "/accept ", 8) == 0 || strncmp(raw_input, "/reject ", 8) == 0) {
+            int id = atoi(raw_input + 8);
+            snprintf(out, out_size, "%s:%s:%d:%s", MSG_TYPE_COMMAND, raw_input[1] == 'a' ? "accept" : "reject", id, "");
+        } else {
+            printf("[%s][클라이언트] 알 수 없는 명령어: %s\n", get_current_time_str(), raw_input);
+            return 0; // 서버로 전송하지 않음
+        }
+    } else if (strncmp(raw_input, "!whisper ", 9) == 0) {
+        char target_nickname[MAX_NICKNAME_LEN + 1];
+        char whisper_content[BUFFER_SIZE];
+        
+        // !whisper [상대방 닉네임] [메시지] 파싱
+        // sscanf 대신 sscanf_s (Windows) 또는 더 견고한 파싱 (Linux) 필요
+        // 여기서는 간단하게 공백으로 구분하여 파싱
+        char *token = strtok(raw_input + 9, " ");
+        if (token != NULL) {
+            strncpy(target_nickname, token, MAX_NICKNAME_LEN);
+            target_nickname[MAX_NICKNAME_LEN] = '\0';
+
+            char *content_start = raw_input + 9 + strlen(token) + 1; // 닉네임 뒤의 공백까지 건너뛰기
+            if (strlen(content_start) > 0) {
+                strncpy(whisper_content, content_start, BUFFER_SIZE - 1);
+                whisper_content[BUFFER_SIZE - 1] = '\0';
+                snprintf(out, out_size, "%s:%s:%s:%s", MSG_TYPE_WHISPER, current_nickname, target_nickname, whisper_content);
+            } else {
+                printf("[%s][클라이언트] 오류: 귓속말 내용이 비어 있습니다. 사용법: !whisper [상대방닉네임] [메시지]\n", get_current_time_str());
+                return 0;
+            }
+        } else {
+            printf("[%s][클라이언트] 오류: 귓속말 대상 닉네임이 지정되지 않았습니다. 사용법: !whisper [상대방닉네임] [메시지]\n", get_current_time_str());
+            return 0;
+        }
+
+    }
+    else {
+        // 일반 채팅 메시지
+        snprintf(out, out_size, "%s:%s:%s:%s", MSG_TYPE_CHAT, current_nickname, current_room, raw_input);
+    }
+    return 1;
+}
+
+// 입력 한 줄('\n' 제외)을 서버로 보낼 요청으로 바꿔 batch 에 덧붙임. /quit 이면 -1
+static int queue_input_line(char *buffer, char *batch, size_t *batch_len, size_t batch_size) {
+    if (strlen(buffer) == 0) {
+        return 0; // 빈 입력 무시
+    }
+
+    // '/' 로 시작하는 줄은 ';' 로 명령을 여러 개 이어 쓸 수 있음. 모두 한 번의 write 로 보내고
+    // (파이프라이닝) 응답은 요청 ID로 요청별로 모아서 출력
+    char formatted_message[BUFFER_SIZE * 2]; // 포맷된 메시지 (타입, 닉네임, 방이름, 내용 등 포함)
+    int quit = 0;
+    char *segment = buffer;
+    while (segment != NULL) {
+        char *next = (buffer[0] == '/') ? strchr(segment, ';') : NULL;
+        if (next != NULL) {
+            *next++ = '\0';
+        }
+        segment += strspn(segment, " ");
+        char raw_input[BUFFER_SIZE];
+        strncpy(raw_input, segment, sizeof(raw_input) - 1);
+        raw_input[sizeof(raw_input) - 1] = '\0'; // NULL 종료 보장
+        size_t input_len = strlen(raw_input);
+        while (input_len > 0 && raw_input[input_len - 1] == ' ') {
+            raw_input[--input_len] = '\0'; // "/users ; /list" 처럼 ';' 앞의 공백 제거
+        }
+        segment = next;
+        if (raw_input[0] == '\0') {
+            continue;
+        }
+
+        int ret = build_outgoing(raw_input, formatted_message, sizeof(formatted_message));
+        if (ret < 0) {
+            quit = 1;
+            break;
+        }
+        if (ret == 0) {
+            continue;
+        }
+        tag_request(formatted_message, sizeof(formatted_message));
+        // '\n'으로 끝내서 서버가 줄 단위로 자르게 함 (파일 조각과 구분)
+        int len = snprintf(batch + *batch_len, batch_size - *batch_len, "%s\n", formatted_message);
+        if (len > 0 && (size_t)len < batch_size - *batch_len) {
+            *batch_len += len;
+        }
+    }
+
+    return quit ? -1 : 0;
+}
 
 int main() {
     int client_socket;
     struct sockaddr_in server_addr;
-    char buffer[BUFFER_SIZE];
-    char formatted_message[BUFFER_SIZE * 2]; // 포맷된 메시지 (타입, 닉네임, 방이름, 내용 등 포함)
-    ssize_t bytes_sent, bytes_received;
+    ssize_t bytes_received;
 
     // 닉네임 초기화 (임시, 서버에서 초기 닉네임 부여할 수 있음)
     strncpy(current_nickname, "guest", MAX_NICKNAME_LEN);
@@ -63,27 +692,19 @@ int main() {
     strncpy(current_room, "general", MAX_ROOMNAME_LEN);
     current_room[MAX_ROOMNAME_LEN] = '\0';
 
-    // 1. 소켓 생성
-    client_socket = socket(AF_INET, SOCK_STREAM, 0);
-    if (client_socket == -1) {
-        perror("클라이언트 소켓 생성 실패");
-        exit(EXIT_FAILURE);
-    }
-
-    // 서버 주소 설정
+    // 1. 서버 주소 설정
     memset(&server_addr, 0, sizeof(server_addr));
     server_addr.sin_family = AF_INET;
     server_addr.sin_port = htons(PORT);
     if (inet_pton(AF_INET, SERVER_IP, &server_addr.sin_addr) <= 0) {
         perror("유효하지 않은 서버 주소/주소 변환 실패");
-        close(client_socket);
         exit(EXIT_FAILURE);
     }
 
-    // 2. 서버에 연결
-    if (connect(client_socket, (struct sockaddr *)&server_addr, sizeof(server_addr)) == -1) {
+    // 2. 소켓 생성 및 서버에 연결
+    client_socket = connect_to_server(&server_addr);
+    if (client_socket == -1) {
         perror("서버 연결 실패");
-        close(client_socket);
         exit(EXIT_FAILURE);
     }
 
@@ -97,7 +718,12 @@ int main() {
     fds[1].fd = client_socket; // 서버 소켓
     fds[1].events = POLLIN;
 
+    if (pipe(splice_pipe) == -1) {
+        splice_pipe[0] = splice_pipe[1] = -1; // 파일 수신은 read/write 로
+    }
+
     while (1) {
+        fds[1].events = POLLIN | (out_xfer.sending ? POLLOUT : 0); // 파일을 보내는 중이면 쓰기 가능도 기다림
         int poll_count = poll(fds, 2, -1); // 무한 대기
         if (poll_count == -1) {
             perror("poll 에러");
@@ -105,157 +731,126 @@ int main() {
         }
 
         // 1. 표준 입력 (사용자 입력) 처리
-        if (fds[0].revents & POLLIN) {
-            if (fgets(buffer, sizeof(buffer), stdin) == NULL) {
-                // Ctrl+D 입력 처리 또는 에러
-                printf("[%s][클라이언트] 입력 종료. 클라이언트 종료.\n", get_current_time_str());
-                break;
+        if (fds[0].revents & (POLLIN | POLLHUP)) {
+            // stdio 를 거치지 않고 읽을 수 있는 만큼 읽어서 줄로 자름 (여러 줄이 한 번에 와도 read 한 번)
+            ssize_t n = read(STDIN_FILENO, stdin_buf + stdin_len, sizeof(stdin_buf) - 1 - stdin_len);
+            if (n < 0 && errno == EINTR) {
+                continue;
             }
-            buffer[strcspn(buffer, "\n")] = '\0'; // 개행 문자 제거
-
-            if (strlen(buffer) == 0) {
-                continue; // 빈 입력 무시
+            int eof = n <= 0; // Ctrl+D 입력 또는 에러
+            if (n > 0) {
+                stdin_len += n;
             }
 
-            char raw_input[BUFFER_SIZE];
-            strncpy(raw_input, buffer, sizeof(raw_input) - 1);
-            raw_input[sizeof(raw_input) - 1] = '\0'; // NULL 종료 보장
-
-            // 명령어 처리
-            if (raw_input[0] == '/') {
-                if (strcmp(raw_input, "/quit") == 0 || strcmp(raw_input, "/exit") == 0) {
-                    printf("[%s][클라이언트] 채팅을 종료합니다.\n", get_current_time_str());
-                    break;
-                } else if (strcmp(raw_input, "/help") == 0) {
-                    display_help();
-                } else if (strncmp(raw_input, "/nickname ", 10) == 0) {
-                    char new_nickname[MAX_NICKNAME_LEN + 1];
-                    sscanf(raw_input + 10, "%s", new_nickname);
-                    if (strlen(new_nickname) > MAX_NICKNAME_LEN) {
-                        printf("[%s][클라이언트] 오류: 닉네임은 최대 %d자까지 가능합니다.\n", get_current_time_str(), MAX_NICKNAME_LEN);
-                        continue;
-                    }
-                    snprintf(formatted_message, sizeof(formatted_message), "%s:%s:%s:%s", MSG_TYPE_COMMAND, "nickname", new_nickname, "");
-                } else if (strncmp(raw_input, "/add ", 5) == 0) {
-                    char room_name[MAX_ROOMNAME_LEN + 1];
-                    sscanf(raw_input + 5, "%s", room_name);
-                     if (strlen(room_name) > MAX_ROOMNAME_LEN) {
-                        printf("[%s][클라이언트] 오류: 방 이름은 최대 %d자까지 가능합니다.\n", get_current_time_str(), MAX_ROOMNAME_LEN);
-                        continue;
-                    }
-                    snprintf(formatted_message, sizeof(formatted_message), "%s:%s:%s:%s", MSG_TYPE_COMMAND, "add", room_name, "");
-                } else if (strncmp(raw_input, "/rm ", 4) == 0) {
-                    char room_name[MAX_ROOMNAME_LEN + 1];
-                    sscanf(raw_input + 4, "%s", room_name);
-                    snprintf(formatted_message, sizeof(formatted_message), "%s:%s:%s:%s", MSG_TYPE_COMMAND, "rm", room_name, "");
-                } else if (strncmp(raw_input, "/join ", 6) == 0) {
-                    char room_name[MAX_ROOMNAME_LEN + 1];
-                    sscanf(raw_input + 6, "%s", room_name);
-                     if (strlen(room_name) > MAX_ROOMNAME_LEN) {
-                        printf("[%s][클라이언트] 오류: 방 이름은 최대 %d자까지 가능합니다.\n", get_current_time_str(), MAX_ROOMNAME_LEN);
-                        continue;
-                    }
-                    snprintf(formatted_message, sizeof(formatted_message), "%s:%s:%s:%s", MSG_TYPE_COMMAND, "join", room_name, "");
-                } else if (strcmp(raw_input, "/leave") == 0) {
-                    snprintf(formatted_message, sizeof(formatted_message), "%s:%s:%s:%s", MSG_TYPE_COMMAND, "leave", "", "");
-                } else if (strcmp(raw_input, "/list") == 0) {
-                    snprintf(formatted_message, sizeof(formatted_message), "%s:%s:%s:%s", MSG_TYPE_COMMAND, "list", "", "");
-                } else if (strcmp(raw_input, "/users") == 0) {
-                    snprintf(formatted_message, sizeof(formatted_message), "%s:%s:%s:%s", MSG_TYPE_COMMAND, "users", "", "");
+            // 완성된 줄들의 요청은 모아서 한 번의 write 로 보냄
+            char batch[BUFFER_SIZE * 8];
+            size_t batch_len = 0;
+            size_t off = 0;
+            int quit = 0;
+            while (!quit && off < stdin_len) {
+                char *line = stdin_buf + off;
+                char *nl = memchr(line, '\n', stdin_len - off);
+                size_t end;
+                if (nl != NULL) {
+                    end = nl - stdin_buf;
+                } else if (eof || (off == 0 && stdin_len == sizeof(stdin_buf) - 1)) {
+                    end = stdin_len; // 입력이 끝났거나 줄바꿈 없이 버퍼가 가득 참: 남은 것을 한 줄로
                 } else {
-                    printf("[%s][클라이언트] 알 수 없는 명령어: %s\n", get_current_time_str(), raw_input);
-                    continue; // 서버로 전송하지 않음
+                    break;           // 나머지는 다음 read 에서 줄이 완성될 때까지 보관
                 }
-            } else if (strncmp(raw_input, "!whisper ", 9) == 0) {
-                char target_nickname[MAX_NICKNAME_LEN + 1];
-                char whisper_content[BUFFER_SIZE];
-                
-                // !whisper [상대방 닉네임] [메시지] 파싱
-                // sscanf 대신 sscanf_s (Windows) 또는 더 견고한 파싱 (Linux) 필요
-                // 여기서는 간단하게 공백으로 구분하여 파싱
-                char *token = strtok(raw_input + 9, " ");
-                if (token != NULL) {
-                    strncpy(target_nickname, token, MAX_NICKNAME_LEN);
-                    target_nickname[MAX_NICKNAME_LEN] = '\0';
-
-                    char *content_start = raw_input + 9 + strlen(token) + 1; // 닉네임 뒤의 공백까지 건너뛰기
-                    if (strlen(content_start) > 0) {
-                        strncpy(whisper_content, content_start, BUFFER_SIZE - 1);
-                        whisper_content[BUFFER_SIZE - 1] = '\0';
-                        snprintf(formatted_message, sizeof(formatted_message), "%s:%s:%s:%s", MSG_TYPE_WHISPER, current_nickname, target_nickname, whisper_content);
-                    } else {
-                        printf("[%s][클라이언트] 오류: 귓속말 내용이 비어 있습니다. 사용법: !whisper [상대방닉네임] [메시지]\n", get_current_time_str());
-                        continue;
+                stdin_buf[end] = '\0';
+                off = end < stdin_len ? end + 1 : stdin_len;
+                if (batch_len > sizeof(batch) - BUFFER_SIZE * 3) {
+                    if (write_all(client_socket, batch, batch_len) == -1) {
+                        perror("메시지 전송 실패");
+                        quit = 1;
+                        break;
                     }
-                } else {
-                    printf("[%s][클라이언트] 오류: 귓속말 대상 닉네임이 지정되지 않았습니다. 사용법: !whisper [상대방닉네임] [메시지]\n", get_current_time_str());
-                    continue;
+                    batch_len = 0;
                 }
-
-            }
-            else {
-                // 일반 채팅 메시지
-                snprintf(formatted_message, sizeof(formatted_message), "%s:%s:%s:%s", MSG_TYPE_CHAT, current_nickname, current_room, raw_input);
+                quit = queue_input_line(line, batch, &batch_len, sizeof(batch)) < 0;
             }
+            memmove(stdin_buf, stdin_buf + off, stdin_len - off);
+            stdin_len -= off;
 
             // 서버로 메시지 전송
-            bytes_sent = write(client_socket, formatted_message, strlen(formatted_message));
-            if (bytes_sent == -1) {
+            if (batch_len > 0 && write_all(client_socket, batch, batch_len) == -1) {
                 perror("메시지 전송 실패");
                 break;
             }
+            if (quit) {
+                break;
+            }
+            if (eof) {
+                printf("[%s][클라이언트] 입력 종료. 클라이언트 종료.\n", get_current_time_str());
+                break;
+            }
         }
 
         // 2. 서버로부터 메시지 수신 처리
-        if (fds[1].revents & POLLIN) {
-            bytes_received = read(client_socket, buffer, sizeof(buffer) - 1);
+        if (fds[1].revents & (POLLIN | POLLHUP | POLLERR)) {
+            unsigned char net_buf[RX_BUFFER_SIZE]; // 압축 모드: 레코드 바이트 (풀린 텍스트는 rx_buf 로)
+            int ret;
+            if (compressed) {
+                bytes_received = read(client_socket, net_buf, sizeof(net_buf));
+            } else {
+                bytes_received = read(client_socket, rx_buf + rx_len, sizeof(rx_buf) - 1 - rx_len);
+            }
             if (bytes_received > 0) {
-                buffer[bytes_received] = '\0';
-                printf("%s", buffer); // 서버에서 보낸 메시지를 그대로 출력
-
-                // 서버 응답을 기반으로 클라이언트 상태 업데이트 (닉네임, 방 이름 등)
-                // 예: [서버] 닉네임이 '새닉네임'(으)로 변경되었습니다.
-                if (strstr(buffer, "[서버] 닉네임이 '") != NULL && strstr(buffer, "'(으)로 변경되었습니다.") != NULL) {
-                    char *start = strstr(buffer, "[서버] 닉네임이 '") + strlen("[서버] 닉네임이 '");
-                    char *end = strstr(start, "'(으)로 변경되었습니다.");
-                    if (start && end) {
-                        *end = '\0'; // 닉네임 부분만 남기도록 NULL 종료
-                        strncpy(current_nickname, start, MAX_NICKNAME_LEN);
-                        current_nickname[MAX_NICKNAME_LEN] = '\0';
-                    }
-                } else if (strstr(buffer, "[INFO] ") != NULL && strstr(buffer, " 님이 방 '") != NULL && strstr(buffer, "'에 입장했습니다.\n") != NULL) {
-                     char *start = strstr(buffer, " 님이 방 '") + strlen(" 님이 방 '");
-                     char *end = strstr(start, "'에 입장했습니다.\n");
-                     // 현재 클라이언트가 보낸 입장 메시지인 경우에만 룸 이름 업데이트
-                     // (다른 유저의 입장 메시지와 구분하기 위해 추가적인 로직 필요할 수 있음)
-                     // 여기서는 단순히 'general'이 아닌 방으로 입장 시 업데이트
-                     if (start && end) {
-                        char entered_room[MAX_ROOMNAME_LEN + 1];
-                        size_t len = end - start;
-                        if (len < MAX_ROOMNAME_LEN + 1) {
-                            strncpy(entered_room, start, len);
-                            entered_room[len] = '\0';
-                            if (strcmp(entered_room, "general") != 0 && strcmp(entered_room, current_room) != 0) { // 이미 같은 방이 아니면 업데이트
-                                strncpy(current_room, entered_room, MAX_ROOMNAME_LEN);
-                                current_room[MAX_ROOMNAME_LEN] = '\0';
-                            }
-                        }
+                if (compressed) {
+                    ret = process_records(client_socket, net_buf, bytes_received);
+                } else {
+                    rx_len += bytes_received;
+                    ret = process_server_bytes(client_socket);
+                    if (ret == 0 && compressed && rx_len > 0) {
+                        // COMPRESS_ACK 뒤에 같은 read 로 온 바이트는 이미 레코드
+                        size_t n = rx_len;
+                        memcpy(net_buf, rx_buf, n);
+                        rx_len = 0;
+                        ret = process_records(client_socket, net_buf, n);
                     }
-                } else if (strstr(buffer, "[서버] 방을 떠나 'general' 방으로 이동했습니다.\n") != NULL) {
-                    strncpy(current_room, "general", MAX_ROOMNAME_LEN);
-                    current_room[MAX_ROOMNAME_LEN] = '\0';
                 }
-
-            } else if (bytes_received == 0) {
-                printf("[%s][클라이언트] 서버 연결이 종료되었습니다.\n", get_current_time_str());
-                break; // 서버 연결 종료
+                if (ret < 0) {
+                    printf("[%s][클라이언트] 서버 데이터 처리 중 오류가 발생했습니다.\n", get_current_time_str());
+                    break;
+                }
             } else {
-                perror("서버로부터 메시지 수신 실패");
+                if (bytes_received == 0) {
+                    printf("[%s][클라이언트] 서버 연결이 종료되었습니다.\n", get_current_time_str());
+                } else {
+                    perror("서버로부터 메시지 수신 실패");
+                }
+                if (session_token[0] == '\0') {
+                    break; // 이어받을 세션이 없음
+                }
+                // 연결이 끊김: 다시 접속해서 닉네임/방과 놓친 메시지를 이어받음
+                int was_compressed = compressed;
+                close(client_socket);
+                reset_connection_state();
+                client_socket = reconnect_and_resume(&server_addr, was_compressed);
+                if (client_socket == -1) {
+                    printf("[%s][클라이언트] 재접속하지 못해 종료합니다.\n", get_current_time_str());
+                    break;
+                }
+                fds[1].fd = client_socket;
+                continue;
+            }
+        }
+
+        // 3. 파일 조각 전송 (조각 하나씩 보내고 다시 poll 로 돌아가 채팅 입출력 처리)
+        if (out_xfer.sending && (fds[1].revents & POLLOUT)) {
+            if (send_next_chunk(client_socket) < 0) {
+                perror("파일 전송 실패");
                 break;
             }
         }
     }
 
+    if (compressed_in > 0) {
+        printf("[%s][클라이언트] 압축 수신: %llu 바이트 -> %llu 바이트로 풀림 (%.1f%%)\n", get_current_time_str(),
+               compressed_in, inflated_in, inflated_in ? 100.0 * compressed_in / inflated_in : 0.0);
+    }
+    reset_connection_state();
     close(client_socket);
     return 0;
 }
@@ -0,0 +1,68 @@
+// chat_compress.h
+// 서버 -> 클라이언트 스트림 압축 (연결별 선택, raw deflate). 서버(자식 프로세스)와 클라이언트가 함께 사용
+//
+// 협상: 클라이언트가 COMPRESS_REQUEST 줄을 보내면 자식이 줄 경계에서 평문 COMPRESS_ACK 줄로 응답하고,
+// 그 뒤부터 서버 -> 클라이언트 바이트는 레코드 [타입 1바이트][길이 4바이트 big-endian][본문] 의 연속이 된다.
+//   'Z': deflate 스트림 조각. 자식 루프 한 바퀴(배치)마다 Z_SYNC_FLUSH 로 끝나므로 받는 즉시 모두 풀 수 있고,
+//        압축 창(최근 32KB)은 연결이 끝날 때까지 이어져 앞 메시지의 시각/닉네임/문구를 다시 참조함
+//   'R': 압축하지 않은 원본 바이트 (파일 전송 XDATA 조각 본문, splice 로 그대로 보냄)
+// 예전 서버는 COMPRESS_REQUEST 를 알 수 없는 명령어로 답하므로 클라이언트는 평문으로 계속 동작함.
+// 양쪽 모두 같은 미리 정한 사전으로 시작해 연결 직후의 짧은 메시지부터 반복 문구를 줄인다.
+// 사전을 바꾸면 COMPRESS_REQUEST 의 방식 이름도 바꿔서, 옛 사전을 쓰는 상대와는 평문으로 동작하게 한다.
+//
+// 사용 시 -lz 로 빌드해야 함
+#ifndef CHAT_COMPRESS_H
+#define CHAT_COMPRESS_H
+
+#include <stdint.h>
+#include <string.h>
+#include <zlib.h>
+
+#define COMPRESS_REQUEST "CMD:compress:deflate2:" // 2: 연도를 뺀 사전
+#define COMPRESS_ACK "ZLIB:on"
+#define COMPRESS_RECORD_HDR 5
+#define COMPRESS_RECORD_DEFLATE 'Z'
+#define COMPRESS_RECORD_RAW 'R'
+#define COMPRESS_LEVEL 6
+#define COMPRESS_WINDOW_BITS (-15)  // raw deflate (zlib 헤더/체크섬 없음, 사전은 양쪽이 미리 설정)
+
+// 서버가 보내는 문구 중 자주 나오는 것 (뒤쪽일수록 가까운 거리로 참조되므로 흔한 것을 뒤에).
+// 시각 "[YYYY-MM-DD HH:MM:SS]" 는 해가 바뀌어도 맞도록 숫자 없이 둘레 문자만 넣음
+static const char compress_dictionary[] =
+    "현재 개설된 채팅방 목록 (현재 사용자: 의 현재 사용자 목록 명):\n - "
+    "[서버] 오류: 채팅방 이미 존재합니다. 존재하지 않습니다. "
+    "님, 채팅 서버에 오신 것을 환영합니다! 현재 방: general\n"
+    " 님이 입장했습니다.\n 님이 방을 나갔습니다.\n 님이 방 ''에 입장했습니다.\n"
+    "[서버] 닉네임이 ''(으)로 변경되었습니다.\n (으)로 닉네임을 변경했습니다.\n"
+    "[귓속말 from [귓속말 to "
+    "][INFO] ][서버] :general] \n[";
+
+static inline void compress_put_record_hdr(unsigned char *p, char type, uint32_t len) {
+    p[0] = (unsigned char)type;
+    p[1] = (unsigned char)(len >> 24);
+    p[2] = (unsigned char)(len >> 16);
+    p[3] = (unsigned char)(len >> 8);
+    p[4] = (unsigned char)len;
+}
+
+static inline uint32_t compress_get_record_len(const unsigned char *p) {
+    return ((uint32_t)p[1] << 24) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 8) | p[4];
+}
+
+static inline int compress_deflate_init(z_stream *zs) {
+    memset(zs, 0, sizeof(*zs));
+    if (deflateInit2(zs, COMPRESS_LEVEL, Z_DEFLATED, COMPRESS_WINDOW_BITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return -1;
+    }
+    return deflateSetDictionary(zs, (const Bytef *)compress_dictionary, sizeof(compress_dictionary) - 1) == Z_OK ? 0 : -1;
+}
+
+static inline int compress_inflate_init(z_stream *zs) {
+    memset(zs, 0, sizeof(*zs));
+    if (inflateInit2(zs, COMPRESS_WINDOW_BITS) != Z_OK) {
+        return -1;
+    }
+    return inflateSetDictionary(zs, (const Bytef *)compress_dictionary, sizeof(compress_dictionary) - 1) == Z_OK ? 0 : -1;
+}
+
+#endif // CHAT_COMPRESS_H
@@ -1,9 +1,13 @@
+// 빌드: gcc -o server2 chat_server2.c -pthread -lz
+// 디버그 로그 포함 빌드: gcc -DLOG_COMPILE_LEVEL=LOG_LEVEL_DEBUG -o server2 chat_server2.c -pthread -lz
+#define _GNU_SOURCE // splice, F_SETPIPE_SZ, accept4
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h> // TCP_NODELAY
 #include <arpa/inet.h>
 #include <sys/wait.h>
 #include <signal.h>
@@ -11,13 +15,80 @@
 #include <fcntl.h> // fcntl을 사용하여 논블로킹 모드 설정
 #include <sys/stat.h> // umask를 위해
 #include <time.h> // 시간 기록을 위해
+#include <stdint.h>
+#include <endian.h> // htobe64 (연합 프레임의 순번)
+#include <poll.h>
+#include <sys/ioctl.h> // FIONREAD
+#include <sys/random.h> // getrandom (세션 토큰)
+#include <dirent.h> // 파일 전송 디렉터리 정리
+#include "work_steal_pool.h" // 읽기 전용 명령 처리를 위한 작업 훔치기 스레드 풀
+#include "mpsc_queue.h" // 워커가 만든 응답을 라우터에게 넘기는 큐
+#include "../common/cmd_table.h" // 메시지 타입/명령어 완전 해시 디스패치 테이블
+#include "log.h" // 레벨별 로그 (CHAT_LOG_LEVEL, CHAT_LOG_FILE)
+#include "metrics.h" // 허브 부하 지표 (127.0.0.1:METRICS_PORT/metrics, Prometheus 텍스트 형식)
+#include "hdr_histogram.h" // 단계별 메시지 지연 시간 분포
+#include "chat_compress.h" // 연결별 서버 -> 클라이언트 deflate 압축 (협상 후 사용)
+#include "rate_limit.h" // 클라이언트별 토큰 버킷 (초당 메시지 수/바이트 수)
+#include "timing_wheel.h" // 연결별 유휴 타임아웃/하트비트 타이머
+#include "hash_ring.h" // 서버 간 연합: 방 이름 -> 홈 노드 (일관 해싱)
+#include "nick_dir.h" // 방 샤딩: 샤드 사이에 공유하는 닉네임 디렉터리와 방 순번 epoch
 
-#define PORT 8080
+#define PORT 8080               // 클라이언트 접속 포트 기본값 (CHAT_PORT)
 #define MAX_CLIENTS 10          // 최대 동시 접속 클라이언트 수
 #define BUFFER_SIZE 1024        // 통신 버퍼 크기 (각 메시지 부분의 최대 크기)
 #define MAX_ROOMS 5             // 최대 채팅방 수
 #define MAX_NICKNAME_LEN 31     // 닉네임 최대 길이 (NULL 포함)
 #define MAX_ROOMNAME_LEN 31     // 채팅방 이름 최대 길이 (NULL 포함)
+#define COMMAND_WORKERS 4       // 읽기 전용 명령(/list, /users)을 처리할 워커 스레드 수
+#define METRICS_PORT 9180       // 지표 엔드포인트 포트 기본값 (루프백 전용, CHAT_METRICS_PORT)
+#define SLOW_MESSAGE_MS 50      // 수신부터 전달 완료까지 이보다 오래 걸린 메시지는 로그로 남김
+#define RX_BUF_SIZE 4096        // 자식 -> 부모 파이프 재조립 버퍼 크기
+#define MAX_TRANSFERS 8         // 동시에 제안/진행 중일 수 있는 파일 전송 수
+#define MAX_FILENAME_LEN 255
+#define XFER_PIPE_SIZE (1024 * 1024) // 파일 전송 FIFO 용량 (F_SETPIPE_SZ, 실패하면 기본 64KB)
+#define XFER_SPLICE_MAX (256 * 1024) // 자식 루프 한 번에 splice 할 최대 바이트
+#define CLIENT_WRITE_TIMEOUT_MS 1000 // 클라이언트 소켓 송신 버퍼가 찰 때 기다리는 최대 시간
+#define CLIENT_OUT_CHUNK (16 * 1024) // 허브 -> 자식 파이프 송신 대기열의 조각 크기
+#define CLIENT_OUT_MAX (1024 * 1024) // 자식 하나에 쌓아 둘 수 있는 최대 바이트. 넘으면 그 연결을 끊음
+#define XFER_CTRL_MARK '\x01'   // 부모 -> 자식 파이프에서 클라이언트로 보내지 않는 내부 제어 줄의 첫 바이트
+#define COMPRESS_OUT_SIZE 8192  // 자식의 압축 출력 버퍼 (Z 레코드 하나의 최대 크기)
+#define COMPRESS_REPORT_MS 1000 // 자식이 허브에 압축 통계를 보고하는 주기
+#define ZSTAT_MAX_VALUE (1LL << 40) // 보고 한 번의 값 상한 (한 주기에 1TiB/1100초를 넘으면 잘못된 보고)
+#define ROOM_HISTORY_LEN 64     // 방마다 보관하는 최근 메시지 수 (재접속한 클라이언트가 놓친 메시지 복구용)
+#define HISTORY_LINE_MAX (BUFFER_SIZE + 128) // 보관하는 메시지 한 줄의 최대 길이 (시각/닉네임 포함)
+#define MAX_DETACHED_SESSIONS MAX_CLIENTS    // 연결이 끊긴 뒤 재접속을 기다리는 세션 수
+#define SESSION_RESUME_SEC 60   // 연결이 끊긴 세션을 이어받을 수 있는 시간
+#define LISTEN_BACKLOG 1024     // listen() 대기열 기본 길이 (CHAT_LISTEN_BACKLOG 로 변경, 커널이 somaxconn 으로 제한)
+#define ACCEPT_BATCH_MAX 64     // select 한 번 깨어날 때 accept 하는 최대 연결 수 (파이프 처리가 밀리지 않도록)
+#define RATE_MSGS 20            // 클라이언트당 초당 CHAT/WHISPER 수 기본값 (CHAT_RATE_MSGS, 0=제한 없음)
+#define RATE_MSGS_BURST 40      // 한꺼번에 보낼 수 있는 메시지 수 기본값 (CHAT_RATE_MSGS_BURST)
+#define RATE_BYTES 16384        // 클라이언트당 초당 CHAT/WHISPER 바이트 기본값 (CHAT_RATE_BYTES, 0=제한 없음)
+#define RATE_BYTES_BURST 32768  // 한꺼번에 보낼 수 있는 바이트 기본값 (CHAT_RATE_BYTES_BURST)
+#define RATE_MAX_DELAY_MS 2000  // 한도를 넘은 메시지를 붙잡아 두는 최대 시간. 더 기다려야 하면 거절
+#define TIMER_TICK_MS 100       // 타이밍 휠 틱 길이
+#define IDLE_TIMEOUT_SEC 30     // 이 시간 동안 클라이언트가 보낸 것이 없으면 PING (CHAT_IDLE_SEC, 0=하트비트 안 함)
+#define PING_TIMEOUT_SEC 10     // PING 후 이 시간 안에 아무것도 오지 않으면 죽은 연결로 보고 자식 종료 (CHAT_PING_TIMEOUT_SEC)
+#define FED_MAX_NODES 8         // 연합할 수 있는 최대 노드 수 (자신 포함, CHAT_PEERS)
+#define FED_VNODES 64           // 노드마다 해시 링에 올리는 가상 노드 수
+#define FED_OUT_BUF (512 * 1024) // 피어 링크마다 모아 두었다가 한 번에 보내는 송신 버퍼
+#define FED_IN_BUF (64 * 1024)  // 피어 링크 수신 재조립 버퍼
+#define FED_MAX_BODY (BUFFER_SIZE * 8) // 연합 프레임 본문(방 이름 + 메시지) 최대 길이
+#define FED_RETRY_MS 1000       // 끊긴 피어 링크를 다시 연결하는 간격
+#define SHARD_LINK_PORT 9400    // 방 샤드끼리 잇는 루프백 링크의 첫 포트 (샤드 i 는 +i, CHAT_SHARD_PORT)
+#define SHARD_RESTART_SEC 1     // 죽은 샤드를 다시 띄우기 전에 기다리는 시간
+
+// 서버 간 연합 링크 프레임 타입 (fed_frame_hdr_t.type)
+#define FED_HELLO           'H'         // 링크를 연 노드가 처음 보냄 (헤더의 node 로 누구인지 알림)
+#define FED_SUBSCRIBE       'S'         // 이 방에 우리 노드 사용자가 있음: 방 메시지를 보내 달라 (홈 노드에게)
+#define FED_UNSUBSCRIBE     'U'         // 이 방에 우리 노드 사용자가 없어짐
+#define FED_PUBLISH         'P'         // 우리 노드 사용자가 보낸 방 메시지: 순번을 매겨 퍼뜨려 달라 (홈 노드에게)
+#define FED_DELIVER         'D'         // 홈 노드가 순번을 매긴 방 메시지 (구독한 노드에게)
+#define FED_WHISPER         'W'         // 다른 샤드에 있는 클라이언트에게 갈 귓속말 (방 이름 칸에 대상 닉네임)
+
+// 허브 <-> 클라이언트 프로세스 생성기 메시지 타입 (spawn_msg_t.type)
+#define SPAWN_REQUEST       'S'         // 허브 -> 생성기: 자식을 만들어 달라 (FD 3개를 SCM_RIGHTS 로 함께 보냄)
+#define SPAWN_FORKED        'F'         // 생성기 -> 허브: 만든 자식의 pid (실패면 -1 과 errno)
+#define SPAWN_EXITED        'X'         // 생성기 -> 허브: 자식이 끝나 회수함
 
 // 메시지 타입 정의 (프로토콜)
 #define MSG_TYPE_CHAT       "CHAT"      // 일반 채팅 메시지
@@ -26,6 +97,75 @@
 #define MSG_TYPE_JOIN       "JOIN"      // 채팅방 입장 알림
 #define MSG_TYPE_LEAVE      "LEAVE"     // 채팅방 퇴장 알림
 #define MSG_TYPE_INFO       "INFO"      // 서버 정보 메시지 (예: 명령어 결과, 오류)
+#define MSG_TYPE_XFER       "XFER"      // 파일 전송 제어 (자식 -> 허브: 완료/실패 보고, 허브 -> 클라이언트: 시작/종료 알림)
+#define MSG_TYPE_XDATA      "XDATA"     // 파일 조각 헤더 XDATA:[전송번호]:[길이]\n 뒤에 길이만큼 원본 바이트
+#define MSG_TYPE_ZSTAT      "ZSTAT"     // 자식 -> 허브 압축 통계 ZSTAT:[평문 바이트]:[압축 바이트]:[압축 시간 ns] (지난 보고 이후 증가분)
+#define MSG_TYPE_PONG       "PONG"      // EVENT_PING 에 대한 클라이언트의 답 PONG:[번호]::
+
+// 클라이언트 상태 변경 이벤트 줄: [EVENT_MARK][타입 바이트][값]\n
+// 사람이 읽는 안내 문구와 따로 보내므로 클라이언트는 문구를 해석하지 않고 타입 바이트로 분기함
+#define EVENT_MARK          '\x02'
+#define EVENT_NICK_ACK      'N'         // 서버가 확정한 내 닉네임
+#define EVENT_ROOM_CHANGED  'R'         // 내가 지금 있는 방. 값: [방 이름]:[그 방의 마지막 순번]
+#define EVENT_ROOM_MESSAGE  'Q'         // 방 메시지. 값: [순번] [메시지] (순번은 방마다 증가, 연합이면 상위 32비트가 홈의 epoch)
+#define EVENT_SESSION       'T'         // 재접속 시 CMD:resume 으로 보낼 세션 토큰 (16진수)
+#define EVENT_REPLY         'A'         // 요청 ID가 붙은 요청의 응답 한 줄. 값: [요청 ID] [응답 줄]
+#define EVENT_REPLY_DONE    'D'         // 그 요청의 응답이 모두 나갔음. 값: [요청 ID]
+#define EVENT_PING          'P'         // 연결 확인. 값: [번호]. 클라이언트는 PONG:[번호]:: 로 답함
+
+// 요청 상관 ID: 클라이언트가 [TYPE]#[ID]:... 처럼 타입 뒤에 ID를 붙이면 (예: CMD#17:users::)
+// 그 요청을 처리하며 보낸 클라이언트에게 가는 응답 줄마다 ID를 붙이고 끝에 EVENT_REPLY_DONE 을 보낸다.
+// 응답을 기다리지 않고 명령을 여러 개 이어 보내도(파이프라이닝) 응답을 요청별로 모을 수 있음
+#define MAX_REPLY_SIZE (ROOM_HISTORY_LEN * (HISTORY_LINE_MAX + 24) + BUFFER_SIZE * 4) // ID를 붙인 응답 최대 크기
+
+// 허브가 처리하는 메시지 타입과 CMD 명령어 목록
+// 새 타입/명령어는 여기 한 곳에만 X(이름, 핸들러)로 추가하면 디스패치 테이블에 자동 등록됨
+#define MESSAGE_TYPES(X) \
+    X(MSG_TYPE_CHAT,    msg_chat)    \
+    X(MSG_TYPE_COMMAND, msg_command) \
+    X(MSG_TYPE_WHISPER, msg_whisper) \
+    X(MSG_TYPE_XFER,    msg_xfer)    \
+    X(MSG_TYPE_ZSTAT,   msg_zstat)   \
+    X(MSG_TYPE_PONG,    msg_pong)
+
+#define SERVER_COMMANDS(X)            \
+    X("add",      cmd_add)            \
+    X("rm",       cmd_rm)             \
+    X("join",     cmd_join)           \
+    X("leave",    cmd_leave)          \
+    X("list",     cmd_list)           \
+    X("users",    cmd_users)          \
+    X("nickname", cmd_nickname)       \
+    X("sendfile", cmd_sendfile)       \
+    X("accept",   cmd_accept)         \
+    X("reject",   cmd_reject)         \
+    X("resume",   cmd_resume)
+
+// 연결별 하트비트 상태. clients[] 는 퇴장 시 당겨지며 복사되므로 휠에 연결된 타이머는
+// 여기 따로 두고 (주소가 바뀌지 않음) client_info_t 는 포인터만 가짐
+typedef struct {
+    tw_timer_t timer;
+    pid_t pid;                      // 0이면 빈 칸
+    uint64_t last_rx_ms;            // 클라이언트가 마지막으로 보낸 메시지를 허브가 받은 시각
+    uint64_t ping_sent_ms;          // 0이 아니면 PING 을 보내고 답을 기다리는 중
+    uint32_t ping_seq;
+} heartbeat_t;
+
+// 허브 -> 자식 파이프에 아직 쓰지 못한 바이트. 자식이 느린 클라이언트에 막혀 파이프가 가득 차면
+// 여기 쌓아 두고 select 가 쓰기 가능을 알릴 때 이어서 씀 (허브는 자식 파이프에서 블록되지 않음).
+// 워커에게 넘긴 명령의 응답은 넘긴 시점에 빈 조각(pending)으로 자리를 잡아 두어,
+// 그 뒤에 라우터가 보내는 것이 응답보다 먼저 나가지 않게 함
+typedef struct out_chunk {
+    struct out_chunk *next;
+    size_t len;                     // data 에 채운 바이트
+    size_t off;                     // 그중 이미 쓴 바이트
+    size_t cap;
+    int pending;                    // 워커가 채우는 중 (대기열은 여기서 멈춤)
+    int abandoned;                  // 채우는 중에 클라이언트가 나감: 완료 알림이 오면 버림
+    pid_t owner;                    // pending 조각의 클라이언트
+    mpsc_node_t done;               // 워커 -> 라우터 완료 알림 (worker_replies)
+    char data[];
+} out_chunk_t;
 
 // 클라이언트 정보를 저장할 구조체
 typedef struct {
@@ -34,41 +174,248 @@ typedef struct {
     int pipe_write_fd;              // 부모 -> 자식 파이프의 쓰기 FD (부모용)
     char nickname[MAX_NICKNAME_LEN + 1]; // 클라이언트 닉네임
     char room_name[MAX_ROOMNAME_LEN + 1]; // 현재 참여 중인 채팅방 이름
+    char rx_buf[RX_BUF_SIZE];       // 파이프에서 읽었지만 아직 완성되지 않은 프레임
+    size_t rx_len;
+    uint64_t session_token;         // 재접속 시 이 연결의 닉네임/방을 이어받는 데 쓰는 토큰
+    token_bucket_t msg_bucket;      // CHAT/WHISPER 초당 메시지 수 한도
+    token_bucket_t byte_bucket;     // CHAT/WHISPER 초당 바이트 수 한도
+    char held_buf[RX_BUF_SIZE];     // 한도를 넘어 붙잡아 둔 CHAT/WHISPER 와 그 뒤에 온 프레임 (rx_buf 와 같은 형식, 도착 순서대로)
+    size_t held_len;
+    uint64_t held_until_ms;         // 붙잡은 첫 프레임을 다시 시도할 시각 (rate_limit_now_ms 기준)
+    int limit_notice_sent;          // 이번 한도 초과 구간에 거절 안내를 보냈는지
+    heartbeat_t *hb;                // 유휴 타임아웃/하트비트 (heartbeats[] 의 한 칸)
+    out_chunk_t *out_head;          // 파이프에 아직 쓰지 못한 응답 (없으면 NULL, 도착 순서대로)
+    out_chunk_t *out_tail;
+    size_t out_queued;              // 대기열에 남은 바이트
+    int out_closed;                 // 쓰기 오류/한도 초과로 더는 쓰지 않음 (자식 종료를 기다리는 중)
 } client_info_t;
 
+// 자식 -> 부모 파이프 프레임 헤더. 헤더 + 메시지를 write 한 번으로 보내며
+// 전체 크기가 PIPE_BUF 이하이므로 다른 쓰기와 섞이지 않음
+#define PIPE_FRAME_INTERNAL 0x1     // 자식이 스스로 만든 보고 (XFER, ZSTAT). 없으면 클라이언트가 보낸 줄
+typedef struct {
+    uint32_t len;                   // 뒤따르는 메시지 길이
+    uint32_t flags;                 // PIPE_FRAME_*
+    uint64_t recv_ns;               // 자식이 클라이언트 소켓에서 읽은 시각 (CLOCK_MONOTONIC)
+} pipe_frame_hdr_t;
+
+// 허브와 클라이언트 프로세스 생성기가 주고받는 메시지 (SOCK_SEQPACKET 이라 한 번에 하나씩 옴)
+typedef struct {
+    char type;                      // SPAWN_REQUEST, SPAWN_FORKED, SPAWN_EXITED
+    pid_t pid;
+    int err;                        // SPAWN_FORKED 실패 시 fork 의 errno
+} spawn_msg_t;
+
+// 서버 간 연합 링크 프레임 헤더. 본문은 방 이름(room_len 바이트) + 메시지
+typedef struct {
+    uint32_t len;                   // 본문 길이 (네트워크 바이트 순서)
+    uint8_t type;                   // FED_HELLO, FED_SUBSCRIBE, ...
+    uint8_t room_len;
+    uint16_t node;                  // 보낸 노드 번호 (네트워크 바이트 순서)
+    uint64_t seq;                   // FED_DELIVER 의 방 순번 (빅 엔디언)
+} fed_frame_hdr_t;
+
+// 연합 피어. 링크는 방향별로 하나씩이라 내가 연결한 out_fd 로는 보내기만 하고 (끊김 확인용으로만 읽음),
+// 상대가 연결해 온 링크(fed_inbound_t)로 받기만 함
+typedef struct {
+    char name[64];                  // CHAT_PEERS 에 적힌 "호스트:포트" (해시 링의 키)
+    struct sockaddr_in addr;
+    int out_fd;                     // -1 이면 끊김
+    int connecting;                 // 논블로킹 connect 진행 중
+    uint64_t retry_ms;              // 끊겨 있으면 다음 연결 시도 시각
+    char out_buf[FED_OUT_BUF];      // 보낼 프레임 (메인 루프 한 바퀴 동안 모은 것)
+    size_t out_len;
+} fed_peer_t;
+
+typedef struct {
+    int fd;                         // -1 이면 빈 칸
+    int node;                       // FED_HELLO 를 받기 전에는 -1
+    char in_buf[FED_IN_BUF];
+    size_t in_len;
+} fed_inbound_t;
+
 // 채팅방 정보를 저장할 구조체
 typedef struct {
     char name[MAX_ROOMNAME_LEN + 1];
     int client_count;
+    uint64_t last_seq;              // 이 방에 마지막으로 보낸 메시지의 순번
+    int history;                    // room_histories 인덱스
+    uint64_t history_floor;         // 기록에 있을 수 있는 가장 작은 순번 (홈이 아닌 노드가 중간부터 받기 시작한 경우)
+    int home_node;                  // 순번과 기록을 맡는 노드 (연합하지 않으면 항상 자기 자신)
+    uint32_t remote_subscribers;    // 홈인 방을 구독한 다른 노드들 (비트 = 노드 번호)
 } chat_room_t;
 
+// 방의 최근 메시지 기록 (순번 seq 인 메시지는 lines[seq % ROOM_HISTORY_LEN]).
+// 방 수만큼 미리 잡아 두고 칸을 돌려 써서, 방을 만들고 지울 때 큰 버퍼를 할당/해제하지 않음
+typedef struct {
+    int in_use;
+    char lines[ROOM_HISTORY_LEN][HISTORY_LINE_MAX];
+} room_history_t;
+
+// 연결이 끊긴 클라이언트의 상태. SESSION_RESUME_SEC 안에 같은 토큰으로 CMD:resume 하면 이어받음
+typedef struct {
+    uint64_t token;                 // 0이면 빈 칸
+    char nickname[MAX_NICKNAME_LEN + 1];
+    char room_name[MAX_ROOMNAME_LEN + 1];
+    time_t detached_at;
+} detached_session_t;
+
 client_info_t clients[MAX_CLIENTS]; // 연결된 클라이언트 정보 배열
 int client_count = 0;               // 현재 연결된 클라이언트 수
+// 클라이언트별 전송 한도 (init_rate_limits 에서 환경 변수로 덮어씀)
+uint32_t rate_msgs = RATE_MSGS, rate_msgs_burst = RATE_MSGS_BURST;
+uint32_t rate_bytes = RATE_BYTES, rate_bytes_burst = RATE_BYTES_BURST;
+// 하트비트 (init_heartbeats 에서 환경 변수로 덮어씀, idle_timeout_ms 가 0이면 끔)
+timing_wheel_t hub_timers;
+heartbeat_t heartbeats[MAX_CLIENTS];
+uint64_t idle_timeout_ms = IDLE_TIMEOUT_SEC * 1000ULL, ping_timeout_ms = PING_TIMEOUT_SEC * 1000ULL;
+
+// 서버 간 연합 (init_federation 에서 CHAT_PEERS, CHAT_NODE_ID 로 설정, fed_node_count 가 0이면 혼자 동작)
+int fed_node_count = 0;
+int fed_self = 0;                  // 자기 노드 번호
+uint32_t fed_epoch = 0;            // 이 노드가 매기는 방 순번의 상위 32비트 (다시 시작할 때마다 커짐, 혼자 동작이면 0)
+                                   // 연합 노드는 시작 시각(초), 방 샤드는 nick_dir 에 남긴 시작 횟수
+int fed_listen_fd = -1;
+fed_peer_t fed_peers[FED_MAX_NODES];
+fed_inbound_t fed_inbound[FED_MAX_NODES * 2]; // 재시작한 피어의 새 링크가 옛 링크보다 먼저 올 수 있어 넉넉히
+hash_ring_t fed_ring;
+nick_dir_t *nick_dir = NULL;       // 방 샤딩일 때만 (샤드 번호 = fed_self)
+
+// 클라이언트 자식을 대신 fork 하는 생성기 프로세스 (spawner_start)
+int spawner_fd = -1;               // 생성기와의 소켓 (허브 쪽)
+pid_t spawner_pid = -1;
+int spawner_lost = 0;              // 생성기가 죽어 허브도 끝내는 중 (종료 코드를 실패로)
 
 chat_room_t chat_rooms[MAX_ROOMS]; // 채팅방 정보 배열
 int room_count = 0;                // 현재 개설된 채팅방 수
+room_history_t room_histories[MAX_ROOMS];
+detached_session_t detached_sessions[MAX_DETACHED_SESSIONS];
+
+// 파일 전송 (허브는 협상과 FIFO 준비만 하고, 데이터는 두 자식 프로세스가 FIFO로 직접 주고받음)
+typedef enum { XFER_FREE, XFER_OFFERED, XFER_ACTIVE } xfer_state_t;
+
+typedef struct {
+    xfer_state_t state;
+    int id;
+    pid_t sender_pid;
+    pid_t receiver_pid;
+    long long size;
+    char name[MAX_FILENAME_LEN + 1];  // 경로 없는 파일 이름
+    char fifo_path[128];
+} file_transfer_t;
+
+file_transfer_t transfers[MAX_TRANSFERS];
+int next_transfer_id = 1;
+char xfer_dir[64];                 // 전송용 FIFO를 만드는 디렉터리 (비어 있으면 파일 전송 불가)
+char xfer_base_dir[48];            // 샤딩 시 감독이 만든 상위 디렉터리 (샤드마다 그 아래 shard<번호>)
+
+// 핸들러에 넘기는 파싱된 메시지 정보
+struct cmd_ctx {
+    pid_t sender_pid;
+    const char *nickname;          // 보낸 클라이언트의 (서버가 알고 있는) 닉네임
+    const char *room;              // 보낸 클라이언트의 현재 방
+    const char *type;
+    const char *arg1;
+    const char *arg2;
+    const char *content;
+    char *out;                     // 응답 작성용 버퍼
+    size_t out_size;
+};
+
+MESSAGE_TYPES(CMD_TABLE_DECLARE_HANDLER)
+SERVER_COMMANDS(CMD_TABLE_DECLARE_HANDLER)
+
+static const cmd_entry_t message_type_entries[] = { MESSAGE_TYPES(CMD_TABLE_ENTRY) };
+static const cmd_entry_t command_entries[] = { SERVER_COMMANDS(CMD_TABLE_ENTRY) };
+cmd_table_t message_type_table;    // 메시지 타입 -> 핸들러
+cmd_table_t command_table;         // CMD 명령어 -> 핸들러
+
+ws_pool_t command_pool;            // 읽기 전용 명령 처리용 스레드 풀
+int command_pool_ready = 0;        // 풀 생성 성공 여부 (실패 시 라우터에서 직접 처리)
+
+// 허브 지표 id (init_metrics에서 등록). 메시지 수는 타입별로 집계하고,
+// 배열의 마지막 칸은 수신 쪽은 알 수 없는 타입/형식 오류, 송신 쪽은 서버 알림(INFO)
+#define MESSAGE_TYPE_COUNT (sizeof(message_type_entries) / sizeof(message_type_entries[0]))
+int metric_connections, metric_rooms;
+int metric_accepts, metric_accept_errors, metric_accept_rejects, metric_accept_batches, metric_forks, metric_fork_failures;
+int metric_bytes_in, metric_bytes_out, metric_out_queued;
+int metric_compress_plain, metric_compress_wire, metric_compress_us;
+int metric_messages_in[MESSAGE_TYPE_COUNT + 1];
+int metric_rate_delayed, metric_rate_rejected, metric_forged_reports;
+int metric_pings, metric_idle_kills, metric_out_overflows;
+int metric_fed_links, metric_fed_connects, metric_fed_frames_out, metric_fed_frames_in, metric_fed_batches, metric_fed_dropped;
+int metric_messages_out[MESSAGE_TYPE_COUNT + 1];
+int command_type_index;            // message_type_entries 에서 CMD 의 위치
+static _Thread_local int current_out_type = MESSAGE_TYPE_COUNT; // 지금 보내는 응답을 집계할 타입
+// 라우터가 처리 중인 요청의 상관 ID (0이면 ID 없음)와 보낸 클라이언트.
+// 응답을 워커가 보내는 명령이면 deferred 를 세우고, 완료 줄도 워커가 보냄
+uint32_t current_request_id = 0;
+pid_t current_request_pid = -1;
+int current_request_deferred = 0;
 
 // ===========================================
 // 함수 선언
 // ===========================================
 void daemonize();
 void sigchld_handler(int signo);
+void hub_stop_handler(int signo); // SIGTERM/SIGINT: 정리 후 종료
+void reap_children(void); // SIGCHLD 이후 메인 루프에서 종료된 자식 회수
 void set_nonblocking(int fd); // 파일 디스크립터를 논블로킹으로 설정하는 함수
 
 // 클라이언트 처리 (자식 프로세스)
 void handle_client_child_process(int client_fd, int parent_to_child_read_fd, int child_to_parent_write_fd);
 // 부모 프로세스 로직
 void parent_main_loop(int server_socket);
+int env_int(const char *name, int default_value, int min_value, int max_value);
+int listen_backlog_from_env(void);
+void init_rate_limits(void);
+void init_heartbeats(void);
+heartbeat_t *heartbeat_start(pid_t pid);
+void heartbeat_stop(heartbeat_t *hb);
+// 서버 간 연합
+int init_federation(const char *peers, int self);
+int run_shard_supervisor(int shards);
+int fed_home_node(const char *room_name);
+int fed_send(int node, char type, const char *room, uint64_t seq, const char *data, size_t len);
+void fed_room_added(int room_idx);
+void fed_room_removed(int room_idx);
+int fed_fill_fd_sets(fd_set *read_fds, fd_set *write_fds, int max_fd);
+int fed_timeout_ms(uint64_t now_ms, int max_ms);
+void fed_reconnect_links(uint64_t now_ms);
+void fed_handle_io(fd_set *read_fds, fd_set *write_fds);
+void fed_flush_links(void);
+void fed_close_in_child(void);
+void accept_pending_connections(int server_socket);
+int spawner_start(int server_socket); // 스레드를 만들기 전에 호출
+void spawner_read_events(void); // 생성기가 보낸 자식 종료 알림 처리
+void start_client_handler(int client_fd, const struct sockaddr_in *client_addr);
 void add_client_to_list(pid_t pid, int pipe_read_fd, int pipe_write_fd, const char* initial_nickname, const char* initial_room);
 void remove_client_from_list(pid_t pid);
 // process_message_from_child 함수의 선언을 변경합니다 (sender_pipe_read_fd를 int 타입으로 받도록).
-void process_message_from_child(const char *message, int sender_pipe_read_fd); 
+// recv_ns: 자식이 소켓에서 메시지를 읽은 시각 (지연 시간 추적용)
+void process_message_from_child(const char *message, int sender_pipe_read_fd, uint64_t recv_ns);
+int init_dispatch_tables(void); // 메시지 타입/명령어 해시 테이블 생성
+int init_metrics(void); // 허브 지표 등록
+int init_file_transfer(int shard); // 파일 전송용 FIFO 디렉터리 생성
+void cleanup_file_transfer(void); // 종료 시 남은 FIFO 와 디렉터리 삭제
+void cancel_transfers_of_client(pid_t pid); // 나간 클라이언트가 낀 파일 전송 정리
 
 // 메시지 전송 및 브로드캐스트
 void send_message_to_client_by_pid(pid_t target_pid, const char *message);
 void send_message_to_client_by_nickname(const char *nickname, const char *message);
+void send_state_event(pid_t target_pid, char type); // EVENT_NICK_ACK, EVENT_ROOM_CHANGED, EVENT_SESSION
 void broadcast_message_in_room(const char *room, const char *message, pid_t sender_pid);
 void broadcast_message_to_all_clients(const char *message, int sender_pipe_read_fd); // 디버깅용 또는 서버 전체 공지용
+void hub_out_flush(client_info_t *c); // 파이프가 가득 차 쌓아 둔 송신 대기열을 이어서 씀
+void drain_worker_replies(void); // 워커 스레드가 만든 응답을 클라이언트에게 보냄
+static void out_queue_free(client_info_t *c);
+
+// 재접속 (세션 이어받기)
+void detach_session(const client_info_t *client);
+int room_has_detached_session(const char *room_name);
+int room_is_held(int room_idx); // 로컬 사용자가 없어도 남겨 둘 방인지
+void expire_detached_sessions(void);
+void replay_room_history(pid_t target_pid, const char *room_name, uint64_t after_seq);
 
 // 채팅방 관리
 int add_room(const char *room_name);
@@ -79,8 +426,16 @@ int leave_room(pid_t pid);
 void get_room_list_message(char *buffer, size_t buf_size);
 void get_users_in_room_message(const char *room_name, char *buffer, size_t buf_size);
 
+// 읽기 전용 명령을 스레드 풀로 넘김 (라우터는 상태 스냅샷만 만들고 바로 복귀)
+void offload_room_list(pid_t sender_pid);
+void offload_users_in_room(pid_t sender_pid, const char *room_name);
+
+// 요청 ID가 붙은 응답 만들기 (워커 스레드에서도 호출)
+size_t format_reply(uint32_t request_id, const char *message, int done, char *out, size_t out_size);
+
 // 유틸리티
 char* get_current_time_str();
+char* format_time_str(char *buf, size_t buf_size); // 스레드 안전 버전
 
 // ===========================================
 // 데몬화 함수
@@ -130,14 +485,35 @@ void daemonize() {
 
 // ===========================================
 // SIGCHLD 시그널 핸들러
+// 클라이언트 자식은 생성기 프로세스의 자식이므로 생성기가 회수해서 SPAWN_EXITED 로 알려 줌.
+// 허브의 자식은 생성기뿐이며, 여기서는 표시만 하고 회수는 메인 루프의 reap_children() 에서 함
+// (생성기 안에서는 ppoll 이 깨어나는 데만 씀)
 // ===========================================
+volatile sig_atomic_t child_exit_pending = 0;
+
 void sigchld_handler(int signo) {
+    child_exit_pending = 1;
+}
+
+// SIGTERM/SIGINT: 메인 루프를 끝내고 파일 전송 디렉터리 등을 정리한 뒤 종료
+volatile sig_atomic_t hub_stop_requested = 0;
+
+void hub_stop_handler(int signo) {
+    hub_stop_requested = 1;
+}
+
+void reap_children(void) {
     pid_t pid;
     int status;
+    child_exit_pending = 0;
     // Non-blocking waitpid로 종료된 모든 자식 프로세스 처리
     while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
-        printf("[%s][서버] 자식 프로세스 %d 종료 처리됨.\n", get_current_time_str(), pid);
-        remove_client_from_list(pid); // clients 배열에서 해당 클라이언트 정보 제거
+        if (pid == spawner_pid) {
+            LOG_ERROR("[서버] 클라이언트 프로세스 생성기(PID %d)가 종료되었습니다 (상태 0x%x).", pid, status);
+            spawner_pid = -1;
+            spawner_lost = 1;
+            hub_stop_requested = 1; // 새 연결을 받을 수 없으므로 정리하고 끝냄 (샤딩이면 감독이 다시 띄움)
+        }
     }
 }
 
@@ -147,11 +523,11 @@ void sigchld_handler(int signo) {
 void set_nonblocking(int fd) {
     int flags = fcntl(fd, F_GETFL, 0);
     if (flags == -1) {
-        perror("fcntl F_GETFL 실패");
+        LOG_ERROR("[서버] fcntl F_GETFL 실패: %s", strerror(errno));
         exit(EXIT_FAILURE);
     }
     if (fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1) {
-        perror("fcntl F_SETFL O_NONBLOCK 실패");
+        LOG_ERROR("[서버] fcntl F_SETFL O_NONBLOCK 실패: %s", strerror(errno));
         exit(EXIT_FAILURE);
     }
 }
@@ -161,10 +537,16 @@ void set_nonblocking(int fd) {
 // ===========================================
 char* get_current_time_str() {
     static char time_str[30];
+    return format_time_str(time_str, sizeof(time_str));
+}
+
+// 워커 스레드에서는 정적 버퍼를 공유하면 안 되므로 호출자 버퍼에 기록
+char* format_time_str(char *buf, size_t buf_size) {
     time_t now = time(NULL);
-    struct tm *t = localtime(&now);
-    strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M:%S", t);
-    return time_str;
+    struct tm t;
+    localtime_r(&now, &t);
+    strftime(buf, buf_size, "%Y-%m-%d %H:%M:%S", &t);
+    return buf;
 }
 
 // ===========================================
@@ -172,7 +554,7 @@ char* get_current_time_str() {
 // ===========================================
 void add_client_to_list(pid_t pid, int pipe_read_fd, int pipe_write_fd, const char* initial_nickname, const char* initial_room) {
     if (client_count >= MAX_CLIENTS) {
-        fprintf(stderr, "[%s][서버] 클라이언트 목록이 가득 찼습니다.\n", get_current_time_str());
+        LOG_WARN("[서버] 클라이언트 목록이 가득 찼습니다.");
         return;
     }
     clients[client_count].pid = pid;
@@ -182,33 +564,59 @@ void add_client_to_list(pid_t pid, int pipe_read_fd, int pipe_write_fd, const ch
     clients[client_count].nickname[MAX_NICKNAME_LEN] = '\0';
     strncpy(clients[client_count].room_name, initial_room, MAX_ROOMNAME_LEN);
     clients[client_count].room_name[MAX_ROOMNAME_LEN] = '\0';
+    clients[client_count].rx_len = 0;
+    uint64_t now_ms = rate_limit_now_ms();
+    token_bucket_init(&clients[client_count].msg_bucket, rate_msgs, rate_msgs_burst, now_ms);
+    token_bucket_init(&clients[client_count].byte_bucket, rate_bytes, rate_bytes_burst, now_ms);
+    clients[client_count].held_len = 0;
+    clients[client_count].limit_notice_sent = 0;
+    clients[client_count].hb = heartbeat_start(pid);
+    clients[client_count].out_head = clients[client_count].out_tail = NULL;
+    clients[client_count].out_queued = 0;
+    clients[client_count].out_closed = 0;
+    if (getrandom(&clients[client_count].session_token, sizeof(uint64_t), GRND_NONBLOCK) != sizeof(uint64_t)) {
+        clients[client_count].session_token = ((uint64_t)time(NULL) << 32) ^ ((uint64_t)pid << 8) ^ (uint64_t)clock();
+    }
+    if (clients[client_count].session_token == 0) {
+        clients[client_count].session_token = 1; // 0은 빈 칸 표시
+    }
     client_count++;
+    metrics_inc(metric_connections);
 }
 
 void remove_client_from_list(pid_t pid) {
     for (int i = 0; i < client_count; i++) {
         if (clients[i].pid == pid) {
-            printf("[%s][서버] 클라이언트 %s(%d) 퇴장 처리.\n", get_current_time_str(), clients[i].nickname, pid);
+            LOG_INFO("[서버] 클라이언트 %s(%d) 퇴장 처리.", clients[i].nickname, pid);
+            cancel_transfers_of_client(pid);
+            if (nick_dir != NULL) {
+                nick_dir_release(nick_dir, pid);
+            }
+            detach_session(&clients[i]); // 방 정리보다 먼저 (재접속을 기다리는 방은 남겨 둠)
             // 해당 클라이언트가 속한 방의 사용자 수 감소
             int room_idx = find_room_index(clients[i].room_name);
             if (room_idx != -1) {
                 chat_rooms[room_idx].client_count--;
                 // 방에 남은 사용자가 없다면 방 자동 삭제 (선택 사항)
-                if (chat_rooms[room_idx].client_count == 0 && strcmp(chat_rooms[room_idx].name, "general") != 0) {
-                    printf("[%s][서버] 채팅방 '%s'에 더 이상 사용자가 없어 삭제합니다.\n", get_current_time_str(), chat_rooms[room_idx].name);
+                if (chat_rooms[room_idx].client_count == 0 && strcmp(chat_rooms[room_idx].name, "general") != 0 &&
+                    !room_is_held(room_idx)) {
+                    LOG_INFO("[서버] 채팅방 '%s'에 더 이상 사용자가 없어 삭제합니다.", chat_rooms[room_idx].name);
                     remove_room(chat_rooms[room_idx].name);
                 }
             }
 
             close(clients[i].pipe_read_fd);
             close(clients[i].pipe_write_fd);
+            out_queue_free(&clients[i]); // 자식이 끝났으므로 못 보낸 것은 버림
+            heartbeat_stop(clients[i].hb);
 
             // 배열에서 제거 (마지막 요소를 현재 위치로 이동)
             for (int j = i; j < client_count - 1; j++) {
                 clients[j] = clients[j+1];
             }
             client_count--;
-            printf("[%s][서버] 클라이언트 정보 제거 완료. 현재 클라이언트 수: %d\n", get_current_time_str(), client_count);
+            metrics_add(metric_connections, -1);
+            LOG_INFO("[서버] 클라이언트 정보 제거 완료. 현재 클라이언트 수: %d", client_count);
             break;
         }
     }
@@ -236,8 +644,21 @@ int add_room(const char *room_name) {
     strncpy(chat_rooms[room_count].name, room_name, MAX_ROOMNAME_LEN);
     chat_rooms[room_count].name[MAX_ROOMNAME_LEN] = '\0';
     chat_rooms[room_count].client_count = 0;
+    chat_rooms[room_count].last_seq = 0;
+    chat_rooms[room_count].history_floor = 1;
+    chat_rooms[room_count].home_node = fed_home_node(room_name);
+    chat_rooms[room_count].remote_subscribers = 0;
+    for (int h = 0; h < MAX_ROOMS; h++) { // 방 수와 기록 칸 수가 같으므로 항상 빈 칸이 있음
+        if (!room_histories[h].in_use) {
+            room_histories[h].in_use = 1;
+            chat_rooms[room_count].history = h;
+            break;
+        }
+    }
     room_count++;
-    printf("[%s][서버] 채팅방 '%s' 생성 완료. (총 %d개)\n", get_current_time_str(), room_name, room_count);
+    metrics_inc(metric_rooms);
+    LOG_INFO("[서버] 채팅방 '%s' 생성 완료. (총 %d개)", room_name, room_count);
+    fed_room_added(room_count - 1);
     return 0;
 }
 
@@ -249,16 +670,19 @@ int remove_room(const char *room_name) {
     if (idx == -1) {
         return -1; // 존재하지 않는 방
     }
-    if (chat_rooms[idx].client_count > 0) {
-        return -2; // 방에 사용자가 남아있음
+    if (chat_rooms[idx].client_count > 0 || chat_rooms[idx].remote_subscribers != 0) {
+        return -2; // 방에 사용자가 남아있음 (다른 노드의 사용자 포함)
     }
 
+    fed_room_removed(idx);
+    room_histories[chat_rooms[idx].history].in_use = 0;
     // 배열에서 제거 (마지막 요소를 현재 위치로 이동)
     for (int i = idx; i < room_count - 1; i++) {
         chat_rooms[i] = chat_rooms[i+1];
     }
     room_count--;
-    printf("[%s][서버] 채팅방 '%s' 삭제 완료. (총 %d개)\n", get_current_time_str(), room_name, room_count);
+    metrics_add(metric_rooms, -1);
+    LOG_INFO("[서버] 채팅방 '%s' 삭제 완료. (총 %d개)", room_name, room_count);
     return 0;
 }
 
@@ -276,8 +700,9 @@ int join_room(pid_t pid, const char *room_name) {
     if (old_room_idx != -1) {
         chat_rooms[old_room_idx].client_count--;
         // 이전 방이 비었고 일반 방이 아니면 삭제 (선택 사항)
-        if (chat_rooms[old_room_idx].client_count == 0 && strcmp(chat_rooms[old_room_idx].name, "general") != 0) {
-            printf("[%s][서버] 이전 방 '%s'에 더 이상 사용자가 없어 삭제합니다.\n", get_current_time_str(), chat_rooms[old_room_idx].name);
+        if (chat_rooms[old_room_idx].client_count == 0 && strcmp(chat_rooms[old_room_idx].name, "general") != 0 &&
+            !room_is_held(old_room_idx)) {
+            LOG_INFO("[서버] 이전 방 '%s'에 더 이상 사용자가 없어 삭제합니다.", chat_rooms[old_room_idx].name);
             remove_room(chat_rooms[old_room_idx].name);
         }
     }
@@ -296,7 +721,7 @@ int join_room(pid_t pid, const char *room_name) {
     clients[client_idx].room_name[MAX_ROOMNAME_LEN] = '\0';
     chat_rooms[new_room_idx].client_count++;
 
-    printf("[%s][서버] 클라이언트 %s(%d)가 방 '%s'으로 이동했습니다.\n", get_current_time_str(), clients[client_idx].nickname, pid, room_name);
+    LOG_INFO("[서버] 클라이언트 %s(%d)가 방 '%s'으로 이동했습니다.", clients[client_idx].nickname, pid, room_name);
     return 0;
 }
 
@@ -317,8 +742,9 @@ int leave_room(pid_t pid) {
     if (old_room_idx != -1) {
         chat_rooms[old_room_idx].client_count--;
         // 이전 방이 비었고 일반 방이 아니면 삭제 (선택 사항)
-        if (chat_rooms[old_room_idx].client_count == 0 && strcmp(chat_rooms[old_room_idx].name, "general") != 0) {
-            printf("[%s][서버] 방 '%s'에 더 이상 사용자가 없어 삭제합니다.\n", get_current_time_str(), chat_rooms[old_room_idx].name);
+        if (chat_rooms[old_room_idx].client_count == 0 && strcmp(chat_rooms[old_room_idx].name, "general") != 0 &&
+            !room_is_held(old_room_idx)) {
+            LOG_INFO("[서버] 방 '%s'에 더 이상 사용자가 없어 삭제합니다.", chat_rooms[old_room_idx].name);
             remove_room(chat_rooms[old_room_idx].name);
         }
     }
@@ -327,10 +753,110 @@ int leave_room(pid_t pid) {
     clients[client_idx].room_name[MAX_ROOMNAME_LEN] = '\0';
     chat_rooms[find_room_index("general")].client_count++; // 일반방 사용자 수 증가
 
-    printf("[%s][서버] 클라이언트 %s(%d)가 방을 떠나 'general' 방으로 이동했습니다.\n", get_current_time_str(), clients[client_idx].nickname, pid);
+    LOG_INFO("[서버] 클라이언트 %s(%d)가 방을 떠나 'general' 방으로 이동했습니다.", clients[client_idx].nickname, pid);
+    return 0;
+}
+
+// ===========================================
+// 재접속 세션 (부모 프로세스)
+// ===========================================
+// 나간 클라이언트의 닉네임/방을 보관. 칸이 모자라면 가장 오래된 세션을 덮어씀
+void detach_session(const client_info_t *client) {
+    detached_session_t *slot = &detached_sessions[0];
+    for (int i = 0; i < MAX_DETACHED_SESSIONS; i++) {
+        if (detached_sessions[i].token == 0) {
+            slot = &detached_sessions[i];
+            break;
+        }
+        if (detached_sessions[i].detached_at < slot->detached_at) {
+            slot = &detached_sessions[i];
+        }
+    }
+    slot->token = client->session_token;
+    strncpy(slot->nickname, client->nickname, MAX_NICKNAME_LEN);
+    slot->nickname[MAX_NICKNAME_LEN] = '\0';
+    strncpy(slot->room_name, client->room_name, MAX_ROOMNAME_LEN);
+    slot->room_name[MAX_ROOMNAME_LEN] = '\0';
+    slot->detached_at = time(NULL);
+}
+
+int room_has_detached_session(const char *room_name) {
+    for (int i = 0; i < MAX_DETACHED_SESSIONS; i++) {
+        if (detached_sessions[i].token != 0 && strcmp(detached_sessions[i].room_name, room_name) == 0) {
+            return 1;
+        }
+    }
     return 0;
 }
 
+// 재접속을 기다리는 세션이 있거나, 홈인 방을 다른 노드가 구독 중이면 비어 있어도 지우지 않음
+int room_is_held(int room_idx) {
+    return chat_rooms[room_idx].remote_subscribers != 0 || room_has_detached_session(chat_rooms[room_idx].name);
+}
+
+// 기다리는 시간이 지난 세션을 지우고, 그 세션 때문에 남겨 둔 빈 방도 정리
+void expire_detached_sessions(void) {
+    time_t now = time(NULL);
+    for (int i = 0; i < MAX_DETACHED_SESSIONS; i++) {
+        detached_session_t *ds = &detached_sessions[i];
+        if (ds->token == 0 || now - ds->detached_at < SESSION_RESUME_SEC) {
+            continue;
+        }
+        LOG_DEBUG("[서버] %s 의 재접속 대기 세션 만료.", ds->nickname);
+        ds->token = 0;
+        int room_idx = find_room_index(ds->room_name);
+        if (room_idx != -1 && chat_rooms[room_idx].client_count == 0 && strcmp(ds->room_name, "general") != 0 &&
+            !room_is_held(room_idx)) {
+            LOG_INFO("[서버] 재접속을 기다리던 방 '%s'에 사용자가 없어 삭제합니다.", ds->room_name);
+            remove_room(ds->room_name);
+        }
+    }
+}
+
+// after_seq 다음부터 방의 마지막 메시지까지를 한 번의 쓰기로 다시 보냄.
+// 기록에서 밀려난 메시지가 있으면 그 개수를 먼저 알림. after_seq 가 지금 순번 epoch 의 것이 아니면
+// (방의 홈이 다시 시작했거나 방이 새로 만들어짐) 기록이 초기화됐다고 알리고 남아 있는 것부터 보냄
+void replay_room_history(pid_t target_pid, const char *room_name, uint64_t after_seq) {
+    static char batch[ROOM_HISTORY_LEN * (HISTORY_LINE_MAX + 24) + BUFFER_SIZE];
+    int room_idx = find_room_index(room_name);
+    if (room_idx == -1 || after_seq == chat_rooms[room_idx].last_seq) {
+        return; // 놓친 메시지 없음
+    }
+    chat_room_t *r = &chat_rooms[room_idx];
+    uint64_t epoch_first = (r->last_seq & ~0xffffffffULL) | 1; // 지금 epoch 의 첫 순번
+    uint64_t first = after_seq + 1;
+    size_t len = 0;
+    if (after_seq > r->last_seq || first < epoch_first) {
+        if (after_seq != 0) {
+            len += snprintf(batch, sizeof(batch), "[%s][서버] 방 '%s'의 기록이 초기화되어 끊겨 있던 동안의 메시지 일부를 복구하지 못했을 수 있습니다.\n",
+                            get_current_time_str(), room_name);
+        }
+        first = epoch_first;
+    }
+    if (first > r->last_seq) { // 초기화 뒤로 아직 메시지가 없음
+        if (len > 0) {
+            send_message_to_client_by_pid(target_pid, batch);
+        }
+        return;
+    }
+    uint64_t oldest = r->last_seq > ROOM_HISTORY_LEN ? r->last_seq - ROOM_HISTORY_LEN + 1 : 1;
+    if (oldest < r->history_floor) {
+        oldest = r->history_floor;
+    }
+    if (first < oldest) {
+        len += snprintf(batch + len, sizeof(batch) - len, "[%s][서버] 보관 범위를 넘어 메시지 %llu개는 복구하지 못했습니다.\n",
+                        get_current_time_str(), (unsigned long long)(oldest - first));
+        first = oldest;
+    }
+    for (uint64_t seq = first; seq <= r->last_seq; seq++) {
+        len += snprintf(batch + len, sizeof(batch) - len, "%c%c%llu %s", EVENT_MARK, EVENT_ROOM_MESSAGE,
+                        (unsigned long long)seq, room_histories[r->history].lines[seq % ROOM_HISTORY_LEN]);
+    }
+    send_message_to_client_by_pid(target_pid, batch);
+    LOG_INFO("[서버] 클라이언트 %d 에게 방 '%s' 메시지 %llu~%llu 재전송.", target_pid, room_name,
+             (unsigned long long)first, (unsigned long long)r->last_seq);
+}
+
 void get_room_list_message(char *buffer, size_t buf_size) {
     char temp[BUFFER_SIZE];
     snprintf(buffer, buf_size, "[%s][서버] 현재 개설된 채팅방 목록 (%d개):\n", get_current_time_str(), room_count);
@@ -358,463 +884,3283 @@ void get_users_in_room_message(const char *room_name, char *buffer, size_t buf_s
 }
 
 // ===========================================
-// 메시지 전송 및 브로드캐스트 (부모 프로세스)
+// 읽기 전용 명령 오프로딩 (부모 프로세스)
 // ===========================================
-void send_message_to_client_by_pid(pid_t target_pid, const char *message) {
-    for (int i = 0; i < client_count; i++) {
-        if (clients[i].pid == target_pid) {
-            write(clients[i].pipe_write_fd, message, strlen(message));
-            return;
-        }
+// 라우터는 명령이 도착한 시점의 상태를 복사해 두고, 응답 문자열 생성과 전송은 워커가 한다.
+// 상태를 바꾸는 명령(add/rm/join/leave/nickname)은 계속 라우터에서 순서대로 처리되므로,
+// 스냅샷은 항상 "그 명령 직전까지의 변경이 모두 반영된" 상태가 된다.
+// 응답 문자열은 워커가 만들지만 파이프에 쓰는 일은 라우터가 한다 (자식 파이프와 송신 대기열은 라우터
+// 스레드만 만짐). 라우터는 명령을 넘길 때 그 클라이언트의 송신 대기열 끝에 응답 자리(out_reserve)를
+// 잡아 두고, 워커는 그 자리를 채운 뒤 worker_replies 에 넣고 깨우기 파이프에 1바이트를 쓴다.
+// 그래서 응답은 명령 뒤에 라우터가 보낸 채팅/알림보다 항상 먼저 나감
+typedef struct {
+    out_chunk_t *slot;              // 응답을 채울 자리
+    uint32_t request_id;            // 0이 아니면 응답에 ID와 완료 줄을 붙임
+    int room_count;
+    chat_room_t rooms[MAX_ROOMS];
+} room_list_task_t;
+
+typedef struct {
+    out_chunk_t *slot;
+    uint32_t request_id;
+    int room_exists;
+    int room_client_count;
+    int member_count;
+    char room_name[MAX_ROOMNAME_LEN + 1];
+    char members[MAX_CLIENTS][MAX_NICKNAME_LEN + 1];
+} users_task_t;
+
+#define WORKER_REPLY_MAX (BUFFER_SIZE * 8) // 응답 자리 하나의 크기 (ID를 붙인 응답 포함)
+
+mpsc_queue_t worker_replies;       // 채운 응답 자리 (워커 -> 라우터, 소비자는 라우터 하나)
+int worker_wake_pipe[2] = { -1, -1 }; // 워커가 [1]에 써서 select 중인 라우터를 깨움 (양쪽 다 논블로킹)
+
+static out_chunk_t *out_reserve(pid_t pid, size_t cap);
+
+// 명령을 워커로 넘길 때 그 요청의 ID를 가져감 (라우터는 완료 줄을 보내지 않음)
+static uint32_t defer_request(pid_t pid) {
+    if (current_request_id == 0 || pid != current_request_pid) {
+        return 0;
     }
-    printf("[%s][서버] 메시지 전송 실패: PID %d를 가진 클라이언트를 찾을 수 없습니다.\n", get_current_time_str(), target_pid);
+    current_request_deferred = 1;
+    return current_request_id;
 }
 
-void send_message_to_client_by_nickname(const char *nickname, const char *message) {
-    for (int i = 0; i < client_count; i++) {
-        if (strcmp(clients[i].nickname, nickname) == 0) {
-            write(clients[i].pipe_write_fd, message, strlen(message));
-            return;
-        }
+// 워커의 응답 작성. 요청 ID가 있으면 줄마다 ID를 붙이고 완료 줄까지 한 번에 채움
+static void reply_from_worker(out_chunk_t *slot, uint32_t request_id, const char *message) {
+    if (request_id == 0) {
+        size_t len = strlen(message);
+        slot->len = len < slot->cap ? len : slot->cap;
+        memcpy(slot->data, message, slot->len);
+    } else {
+        slot->len = format_reply(request_id, message, 1, slot->data, slot->cap);
+    }
+    mpsc_queue_push(&worker_replies, &slot->done);
+    char one = 1;
+    if (write(worker_wake_pipe[1], &one, 1) < 0) {
+        // EAGAIN: 아직 읽지 않은 깨우기 바이트가 가득함 = 라우터가 곧 깨어남
     }
-    printf("[%s][서버] 메시지 전송 실패: 닉네임 '%s'를 가진 클라이언트를 찾을 수 없습니다.\n", get_current_time_str(), nickname);
 }
 
-void broadcast_message_in_room(const char *room, const char *message, pid_t sender_pid) {
-    for (int i = 0; i < client_count; i++) {
-        if (strcmp(clients[i].room_name, room) == 0) {
-            // 보낸 클라이언트에게도 다시 보냄 (선택 사항, 필요 시 sender_pid와 비교하여 제외)
-            send_message_to_client_by_pid(clients[i].pid, message);
-        }
+static void room_list_task_run(void *arg) {
+    room_list_task_t *task = arg;
+    char buffer[BUFFER_SIZE * 4];
+    char temp[BUFFER_SIZE];
+    char now[30];
+
+    snprintf(buffer, sizeof(buffer), "[%s][서버] 현재 개설된 채팅방 목록 (%d개):\n",
+             format_time_str(now, sizeof(now)), task->room_count);
+    for (int i = 0; i < task->room_count; i++) {
+        snprintf(temp, sizeof(temp), " - %s (현재 사용자: %d)\n", task->rooms[i].name, task->rooms[i].client_count);
+        strncat(buffer, temp, sizeof(buffer) - strlen(buffer) - 1);
     }
+    reply_from_worker(task->slot, task->request_id, buffer);
+    free(task);
 }
 
-void broadcast_message_to_all_clients(const char *message, int sender_pipe_read_fd) {
-    for (int i = 0; i < client_count; i++) {
-        // 메시지를 보낸 자식에게는 다시 보내지 않음 (디버깅 편의를 위해 주석 처리)
-        // if (clients[i].pipe_read_fd == sender_pipe_read_fd) {
-        //     continue;
-        // }
-        write(clients[i].pipe_write_fd, message, strlen(message));
+static void users_task_run(void *arg) {
+    users_task_t *task = arg;
+    char buffer[BUFFER_SIZE * 4];
+    char temp[BUFFER_SIZE];
+    char now[30];
+
+    format_time_str(now, sizeof(now));
+    if (!task->room_exists) {
+        snprintf(buffer, sizeof(buffer), "[%s][서버] 방 '%s'은 존재하지 않습니다.\n", now, task->room_name);
+    } else {
+        snprintf(buffer, sizeof(buffer), "[%s][서버] 방 '%s'의 현재 사용자 목록 (%d명):\n", now, task->room_name, task->room_client_count);
+        for (int i = 0; i < task->member_count; i++) {
+            snprintf(temp, sizeof(temp), " - %s\n", task->members[i]);
+            strncat(buffer, temp, sizeof(buffer) - strlen(buffer) - 1);
+        }
     }
+    reply_from_worker(task->slot, task->request_id, buffer);
+    free(task);
 }
 
-// ===========================================
-// 메시지 처리 및 라우팅 (부모 프로세스)
-// ===========================================
-void process_message_from_child(const char *raw_message, int sender_pipe_read_fd) {
-    // 경고 해결: temp_buffer 크기 조정
-    char type[BUFFER_SIZE];
-    char arg1[BUFFER_SIZE];
-    char arg2[BUFFER_SIZE];
-    char content[BUFFER_SIZE];
-    // BUFFER_SIZE (1024) * 4 로 충분히 크게 설정 (경고 메시지에 따르면 3077 바이트까지 필요할 수 있음)
-    char temp_buffer[BUFFER_SIZE * 4];
-    char client_nickname[MAX_NICKNAME_LEN + 1];
-    char client_room[MAX_ROOMNAME_LEN + 1];
-    pid_t sender_pid = -1;
-    // 보낸 클라이언트의 정보 찾기
-    for(int i = 0; i < client_count; i++) {
-        if (clients[i].pipe_read_fd == sender_pipe_read_fd) {
-            sender_pid = clients[i].pid;
-            strncpy(client_nickname, clients[i].nickname, MAX_NICKNAME_LEN);
-            client_nickname[MAX_NICKNAME_LEN] = '\0';
-            strncpy(client_room, clients[i].room_name, MAX_ROOMNAME_LEN);
-            client_room[MAX_ROOMNAME_LEN] = '\0';
-            break;
-        }
+// 풀에 넣지 못하면 (풀 없음 / 메모리 부족) 라우터에서 바로 실행
+static void run_offloaded(void (*fn)(void *), void *task) {
+    if (!command_pool_ready || ws_pool_submit(&command_pool, fn, task) != 0) {
+        fn(task);
     }
+}
 
-    if (sender_pid == -1) {
-        fprintf(stderr, "[%s][서버] 알 수 없는 발신자로부터 메시지 수신: %s\n", get_current_time_str(), raw_message);
+void offload_room_list(pid_t sender_pid) {
+    room_list_task_t *task = malloc(sizeof(*task));
+    if (task == NULL || (task->slot = out_reserve(sender_pid, WORKER_REPLY_MAX)) == NULL) {
+        free(task);
         return;
     }
+    task->request_id = defer_request(sender_pid);
+    task->room_count = room_count;
+    memcpy(task->rooms, chat_rooms, sizeof(chat_rooms[0]) * room_count);
+    run_offloaded(room_list_task_run, task);
+}
 
-    // 메시지 파싱: [TYPE]:[ARG1]:[ARG2]:[CONTENT] 형식
-    // sscanf의 반환 값으로 파싱된 필드 수를 확인하여 유효성 검사 강화
-    int parsed = sscanf(raw_message, "%[^:]:%[^:]:%[^:]:%[^\n]", type, arg1, arg2, content);
-    
-    // --- 파싱 오류를 보정하는 로직 추가 (이전 대화에서 제안된 것) ---
-    if (parsed < 4) {
-        if (sscanf(raw_message, "%[^:]:%[^:]:%[^:]:", type, arg1, arg2) == 3) {
-            content[0] = '\0';
-        } else if (sscanf(raw_message, "%[^:]:%[^:]:", type, arg1) == 2) {
-             arg2[0] = '\0';
-             content[0] = '\0';
-        } else {
-            snprintf(temp_buffer, sizeof(temp_buffer), "[%s][서버] 잘못된 메시지 형식입니다: %s\n", get_current_time_str(), raw_message);
-            send_message_to_client_by_pid(sender_pid, temp_buffer);
-            return;
-        }
+void offload_users_in_room(pid_t sender_pid, const char *room_name) {
+    users_task_t *task = malloc(sizeof(*task));
+    if (task == NULL || (task->slot = out_reserve(sender_pid, WORKER_REPLY_MAX)) == NULL) {
+        free(task);
+        return;
     }
-    // --- 파싱 오류 보정 로직 끝 ---
-
-    // 각 필드의 NULL 종료 보장 (sscanf가 %[^:]를 사용할 경우 자동으로 NULL 종료되지만, 안전을 위해)
-    type[sizeof(type) - 1] = '\0';
-    arg1[sizeof(arg1) - 1] = '\0';
-    arg2[sizeof(arg2) - 1] = '\0';
-    content[sizeof(content) - 1] = '\0';
-
-    // --- 디버그 출력 추가 시작 ---
-    printf("[%s][서버 DEBUG] 수신된 원본 메시지: '%s'\n", get_current_time_str(), raw_message);
-    printf("[%s][서버 DEBUG] 파싱 결과: 타입='%s', Arg1='%s', Arg2='%s', 내용='%s'\n",
-           get_current_time_str(), type, arg1, arg2, content);
-    printf("[%s][서버 DEBUG] Arg1의 길이: %zu\n", get_current_time_str(), strlen(arg1));
-    for (size_t i = 0; i <= strlen(arg1); ++i) { // 널 문자까지 확인
-        printf("[%s][서버 DEBUG] Arg1[%zu]: '%c' (ASCII: %d)\n", get_current_time_str(), i, arg1[i] == '\0' ? 'N' : arg1[i], (int)arg1[i]);
-    }
-    // --- 디버그 출력 추가 끝 ---
-
-
-    if (strcmp(type, MSG_TYPE_CHAT) == 0) {
-        // 일반 채팅 메시지: CHAT:[nickname]:[room_name]:[message]
-        // 클라이언트에서 nickname과 room_name을 명시적으로 보냄
-        snprintf(temp_buffer, sizeof(temp_buffer), "[%s][%s:%s] %s\n", get_current_time_str(), arg1, arg2, content);
-        broadcast_message_in_room(arg2, temp_buffer, sender_pid);
-    } else if (strcmp(type, MSG_TYPE_COMMAND) == 0) {
-        // 서버 명령어: CMD:[command_name]:[arg]:[content] (arg와 content는 명령어에 따라 사용)
-        // 여기서 모든 명령어에 대해 arg1을 슬래시 없는 형태로 비교하도록 수정해야 합니다.
-        if (strcmp(arg1, "add") == 0) { // /add [방이름]
-            int res = add_room(arg2);
-            if (res == 0) {
-                snprintf(temp_buffer, sizeof(temp_buffer), "[%s][서버] 채팅방 '%s'이(가) 생성되었습니다.\n", get_current_time_str(), arg2);
-            } else if (res == -1) {
-                snprintf(temp_buffer, sizeof(temp_buffer), "[%s][서버] 오류: 채팅방 '%s'은(는) 이미 존재합니다.\n", get_current_time_str(), arg2);
-            } else { // -2
-                snprintf(temp_buffer, sizeof(temp_buffer), "[%s][서버] 오류: 최대 채팅방 개수를 초과했습니다.\n", get_current_time_str());
-            }
-            send_message_to_client_by_pid(sender_pid, temp_buffer);
-        } else if (strcmp(arg1, "rm") == 0) { // /rm [방이름]
-            int res = remove_room(arg2);
-            if (res == 0) {
-                snprintf(temp_buffer, sizeof(temp_buffer), "[%s][서버] 채팅방 '%s'이(가) 삭제되었습니다.\n", get_current_time_str(), arg2);
-            } else if (res == -1) {
-                snprintf(temp_buffer, sizeof(temp_buffer), "[%s][서버] 오류: 채팅방 '%s'은(는) 존재하지 않습니다.\n", get_current_time_str(), arg2);
-            } else if (res == -2) {
-                snprintf(temp_buffer, sizeof(temp_buffer), "[%s][서버] 오류: 채팅방 '%s'에 사용자가 남아있어 삭제할 수 없습니다.\n", get_current_time_str(), arg2);
-            } else { // -3
-                snprintf(temp_buffer, sizeof(temp_buffer), "[%s][서버] 오류: 기본 채팅방 'general'은 삭제할 수 없습니다.\n", get_current_time_str());
-            }
-            send_message_to_client_by_pid(sender_pid, temp_buffer);
-        } else if (strcmp(arg1, "join") == 0) { // /join [방이름]
-            int res = join_room(sender_pid, arg2);
-            if (res == 0) {
-                // 이전 방에 나갔음을 알림
-                snprintf(temp_buffer, sizeof(temp_buffer), "[%s][INFO] %s 님이 방을 나갔습니다.\n", get_current_time_str(), client_nickname);
-                broadcast_message_in_room(client_room, temp_buffer, sender_pid); // 이전 방에 알림
-                
-                // 새 방에 들어왔음을 알림
-                snprintf(temp_buffer, sizeof(temp_buffer), "[%s][INFO] %s 님이 방 '%s'에 입장했습니다.\n", get_current_time_str(), client_nickname, arg2);
-                send_message_to_client_by_pid(sender_pid, temp_buffer); // 자신에게 입장 알림
-                broadcast_message_in_room(arg2, temp_buffer, sender_pid); // 새 방에 알림
-            } else if (res == -1) {
-                snprintf(temp_buffer, sizeof(temp_buffer), "[%s][서버] 오류: 클라이언트 정보를 찾을 수 없습니다.\n", get_current_time_str());
-                send_message_to_client_by_pid(sender_pid, temp_buffer);
-            } else { // -2
-                snprintf(temp_buffer, sizeof(temp_buffer), "[%s][서버] 오류: 방 생성 또는 입장 실패. (방 개수 초과 등)\n", get_current_time_str());
-                send_message_to_client_by_pid(sender_pid, temp_buffer);
-            }
-        } else if (strcmp(arg1, "leave") == 0) { // /leave
-            int res = leave_room(sender_pid);
-            if (res == 0) {
-                 snprintf(temp_buffer, sizeof(temp_buffer), "[%s][INFO] %s 님이 방을 나갔습니다.\n", get_current_time_str(), client_nickname);
-                broadcast_message_in_room(client_room, temp_buffer, sender_pid); // 이전 방에 알림
-
-                snprintf(temp_buffer, sizeof(temp_buffer), "[%s][서버] 방을 떠나 'general' 방으로 이동했습니다.\n", get_current_time_str());
-                send_message_to_client_by_pid(sender_pid, temp_buffer);
-            } else if (res == -1) {
-                snprintf(temp_buffer, sizeof(temp_buffer), "[%s][서버] 오류: 클라이언트 정보를 찾을 수 없습니다.\n", get_current_time_str());
-                send_message_to_client_by_pid(sender_pid, temp_buffer);
-            } else { // -2
-                snprintf(temp_buffer, sizeof(temp_buffer), "[%s][서버] 오류: 'general' 방에서는 나갈 수 없습니다.\n", get_current_time_str());
-                send_message_to_client_by_pid(sender_pid, temp_buffer);
-            }
-        } else if (strcmp(arg1, "list") == 0) { // /list
-            get_room_list_message(temp_buffer, sizeof(temp_buffer));
-            send_message_to_client_by_pid(sender_pid, temp_buffer);
-        } else if (strcmp(arg1, "users") == 0) { // /users
-            get_users_in_room_message(client_room, temp_buffer, sizeof(temp_buffer));
-            send_message_to_client_by_pid(sender_pid, temp_buffer);
-        } else if (strcmp(arg1, "nickname") == 0) { // /nickname [새 닉네임]
-            char old_nickname[MAX_NICKNAME_LEN + 1];
-            strncpy(old_nickname, client_nickname, MAX_NICKNAME_LEN);
-
-            // 닉네임 중복 확인
-            int is_duplicate = 0;
-            for(int i = 0; i < client_count; i++) {
-                if (clients[i].pid != sender_pid && strcmp(clients[i].nickname, arg2) == 0) {
-                    is_duplicate = 1;
-                    break;
-                }
-            }
-
-            if (is_duplicate) {
-                snprintf(temp_buffer, sizeof(temp_buffer), "[%s][서버] 오류: 닉네임 '%s'은(는) 이미 사용 중입니다.\n", get_current_time_str(), arg2);
-                send_message_to_client_by_pid(sender_pid, temp_buffer);
-            } else {
-                for(int i = 0; i < client_count; i++) {
-                    if (clients[i].pid == sender_pid) {
-                        strncpy(clients[i].nickname, arg2, MAX_NICKNAME_LEN);
-                        clients[i].nickname[MAX_NICKNAME_LEN] = '\0';
-                        break;
-                    }
-                }
-                snprintf(temp_buffer, sizeof(temp_buffer), "[%s][서버] 닉네임이 '%s'(으)로 변경되었습니다.\n", get_current_time_str(), arg2);
-                send_message_to_client_by_pid(sender_pid, temp_buffer);
-
-                // 방에 닉네임 변경 알림
-                snprintf(temp_buffer, sizeof(temp_buffer), "[%s][INFO] %s 님이 %s (으)로 닉네임을 변경했습니다.\n", get_current_time_str(), old_nickname, arg2);
-                broadcast_message_in_room(client_room, temp_buffer, sender_pid);
-            }
-        } else {
-            snprintf(temp_buffer, sizeof(temp_buffer), "[%s][서버] 알 수 없는 명령어입니다: %s\n", get_current_time_str(), arg1);
-            send_message_to_client_by_pid(sender_pid, temp_buffer);
+    task->request_id = defer_request(sender_pid);
+    strncpy(task->room_name, room_name, MAX_ROOMNAME_LEN);
+    task->room_name[MAX_ROOMNAME_LEN] = '\0';
+    int room_idx = find_room_index(room_name);
+    task->room_exists = (room_idx != -1);
+    task->room_client_count = task->room_exists ? chat_rooms[room_idx].client_count : 0;
+    task->member_count = 0;
+    for (int i = 0; i < client_count && task->member_count < MAX_CLIENTS; i++) {
+        if (strcmp(clients[i].room_name, room_name) == 0) {
+            memcpy(task->members[task->member_count++], clients[i].nickname, MAX_NICKNAME_LEN + 1);
         }
-    } else if (strcmp(type, MSG_TYPE_WHISPER) == 0) {
-        // 귓속말: WHISPER:[sender_nickname]:[target_nickname]:[message]
-        // sender_nickname은 클라이언트가 보낸 것이고, 실제로는 서버가 sender_pid로 찾아야 안전
-        snprintf(temp_buffer, sizeof(temp_buffer), "[%s][귓속말 from %s] %s\n", get_current_time_str(), client_nickname, content);
-        send_message_to_client_by_nickname(arg2, temp_buffer); // arg2가 대상 닉네임
-        // 보낸 사람에게도 성공 메시지 (선택 사항)
-        snprintf(temp_buffer, sizeof(temp_buffer), "[%s][귓속말 to %s] %s\n", get_current_time_str(), arg2, content);
-        send_message_to_client_by_pid(sender_pid, temp_buffer);
-    } else {
-        snprintf(temp_buffer, sizeof(temp_buffer), "[%s][서버] 알 수 없는 메시지 타입입니다: %s\n", get_current_time_str(), type);
-        send_message_to_client_by_pid(sender_pid, temp_buffer);
     }
+    run_offloaded(users_task_run, task);
 }
 
 // ===========================================
-// 자식 프로세스: 클라이언트와의 통신 처리 (fork() 이후 실행)
+// 메시지 지연 시간 추적 (부모 프로세스)
 // ===========================================
-void handle_client_child_process(int client_fd, int parent_to_child_read_fd, int child_to_parent_write_fd) {
-    char buffer[BUFFER_SIZE];
-    ssize_t bytes_read;
+// 메시지 하나가 거치는 단계별 소요 시간을 메시지 타입별 히스토그램에 기록한다.
+//   queue : 자식의 소켓 수신 -> 허브가 파이프에서 꺼냄
+//   parse : 파싱 + 타입 조회
+//   route : 핸들러 시작 -> 첫 번째 전달 write 시작
+//   fanout: 첫 번째 전달 write 시작 -> 마지막 write 완료
+//   total : 소켓 수신 -> 마지막 write 완료 (전달이 없으면 핸들러 종료까지)
+// 워커 풀로 넘어간 명령의 응답은 라우터 밖에서 쓰이므로 route/fanout에 포함되지 않음.
+// SIGUSR1을 받으면 백분위 요약을 로그로 남기고, 지표 엔드포인트에서는 summary로 노출함.
+enum { STAGE_QUEUE, STAGE_PARSE, STAGE_ROUTE, STAGE_FANOUT, STAGE_TOTAL, STAGE_COUNT };
+static const char *stage_names[STAGE_COUNT] = { "queue", "parse", "route", "fanout", "total" };
 
-    // 클라이언트 소켓과 부모로부터의 파이프를 논블로킹으로 설정
-    set_nonblocking(client_fd);
-    set_nonblocking(parent_to_child_read_fd);
+typedef struct {
+    uint64_t recv_ns;
+    uint64_t hub_rx_ns;
+    uint64_t parsed_ns;
+    uint64_t first_write_ns;        // 0이면 아직 전달 없음
+    uint64_t last_write_ns;
+} msg_trace_t;
 
-    printf("[%s][자식 %d] 클라이언트 핸들링 시작. FD: %d, 부모->자식 파이프 읽기 FD: %d, 자식->부모 파이프 쓰기 FD: %d\n", get_current_time_str(), getpid(), client_fd, parent_to_child_read_fd, child_to_parent_write_fd);
+static hdr_histogram_t latency_hist[MESSAGE_TYPE_COUNT][STAGE_COUNT];
+static _Thread_local msg_trace_t *current_trace; // 라우터가 처리 중인 메시지 (워커 스레드에서는 항상 NULL)
+volatile sig_atomic_t latency_dump_requested = 0;
 
-    // 자식 프로세스는 서버 리스닝 소켓을 닫음 (부모가 관리)
-    //close(client_fd); // 클라이언트 소켓은 이미 부모가 accept해서 넘겨줬으므로, 자식은 복사본을 받아서 사용합니다.
+static inline uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
 
-    // 자식 프로세스는 자신에게 필요 없는 파이프 끝을 닫음
-    // 부모->자식 파이프의 쓰기 끝은 부모가 가짐, 자식은 읽기 끝만 사용
-    close(parent_to_child_read_fd + 1); // pipe[1]
-    // 자식->부모 파이프의 읽기 끝은 부모가 가짐, 자식은 쓰기 끝만 사용
-    close(child_to_parent_write_fd - 1); // pipe[0]
+void sigusr1_handler(int signo) {
+    latency_dump_requested = 1;
+}
 
-    while (1) {
-        // 1. 클라이언트로부터 메시지 수신 시도
-        bytes_read = read(client_fd, buffer, sizeof(buffer) - 1);
-        if (bytes_read > 0) {
-            buffer[bytes_read] = '\0'; // 문자열 널 종료
-            // 클라이언트 메시지를 부모에게 전달 (프로토콜 유지)
-            write(child_to_parent_write_fd, buffer, bytes_read);
-        } else if (bytes_read == 0) {
-            printf("[%s][자식 %d] 클라이언트 %d 연결 종료.\n", get_current_time_str(), getpid(), client_fd);
-            break; // 클라이언트 연결 종료
-        } else if (bytes_read == -1 && (errno != EAGAIN && errno != EWOULDBLOCK)) {
-            perror("[%s][자식] 클라이언트 read 에러");
-            break;
-        }
+static void trace_finish(const msg_trace_t *t, int type_index, const char *raw_message) {
+    hdr_histogram_t *h = latency_hist[type_index];
+    uint64_t end_ns = t->first_write_ns ? t->last_write_ns : monotonic_ns();
 
-        // 2. 부모 프로세스로부터 메시지 수신 시도
-        bytes_read = read(parent_to_child_read_fd, buffer, sizeof(buffer) - 1);
-        if (bytes_read > 0) {
-            buffer[bytes_read] = '\0'; // 문자열 널 종료
-            // 부모로부터 받은 메시지를 클라이언트에게 직접 전송
-            write(client_fd, buffer, bytes_read);
-        } else if (bytes_read == -1 && (errno != EAGAIN && errno != EWOULDBLOCK)) {
-            perror("[%s][자식] 부모 파이프 read 에러");
-            break;
+    hdr_record(&h[STAGE_QUEUE], t->hub_rx_ns - t->recv_ns);
+    hdr_record(&h[STAGE_PARSE], t->parsed_ns - t->hub_rx_ns);
+    if (t->first_write_ns) {
+        hdr_record(&h[STAGE_ROUTE], t->first_write_ns - t->parsed_ns);
+        hdr_record(&h[STAGE_FANOUT], t->last_write_ns - t->first_write_ns);
+    }
+    hdr_record(&h[STAGE_TOTAL], end_ns - t->recv_ns);
+
+    if (end_ns - t->recv_ns > SLOW_MESSAGE_MS * 1000000ULL) {
+        LOG_RATELIMITED(LOG_LEVEL_WARN, 1000,
+                        "[서버] 느린 메시지 %.3fms (queue %.3f, parse %.3f, route %.3f, fanout %.3f): %.60s",
+                        (end_ns - t->recv_ns) / 1e6, (t->hub_rx_ns - t->recv_ns) / 1e6,
+                        (t->parsed_ns - t->hub_rx_ns) / 1e6,
+                        t->first_write_ns ? (t->first_write_ns - t->parsed_ns) / 1e6 : 0.0,
+                        t->first_write_ns ? (t->last_write_ns - t->first_write_ns) / 1e6 : 0.0, raw_message);
+    }
+}
+
+// SIGUSR1: 타입/단계별 p50/p99/p999 (마이크로초)를 로그로 남김
+void dump_latency_report(void) {
+    LOG_INFO("[서버] 메시지 지연 시간 (us) - 타입/단계: 개수 p50 p99 p999 max");
+    for (size_t t = 0; t < MESSAGE_TYPE_COUNT; t++) {
+        for (int s = 0; s < STAGE_COUNT; s++) {
+            hdr_histogram_t *h = &latency_hist[t][s];
+            if (hdr_count(h) == 0) {
+                continue;
+            }
+            LOG_INFO("[서버]   %-7s %-6s: %8lu %9.1f %9.1f %9.1f %9.1f",
+                     message_type_entries[t].name, stage_names[s], (unsigned long)hdr_count(h),
+                     hdr_value_at_percentile(h, 50.0) / 1e3, hdr_value_at_percentile(h, 99.0) / 1e3,
+                     hdr_value_at_percentile(h, 99.9) / 1e3,
+                     atomic_load_explicit(&h->max, memory_order_relaxed) / 1e3);
         }
-        usleep(100); // CPU 과부하 방지를 위해 잠시 대기 (100 마이크로초)
     }
+}
 
-    close(client_fd);
-    close(parent_to_child_read_fd);
-    close(child_to_parent_write_fd);
-    printf("[%s][자식 %d] 핸들링 종료, 프로세스 종료.\n", get_current_time_str(), getpid());
-    exit(EXIT_SUCCESS);
+// 지표 엔드포인트용 summary (초 단위)
+static size_t latency_collector(char *buf, size_t size) {
+    static const double quantiles[] = { 0.5, 0.99, 0.999 };
+    size_t len = snprintf(buf, size,
+                          "# HELP chat_message_latency_seconds Per-stage message latency in the hub.\n"
+                          "# TYPE chat_message_latency_seconds summary\n");
+    for (size_t t = 0; t < MESSAGE_TYPE_COUNT && len < size; t++) {
+        for (int s = 0; s < STAGE_COUNT && len < size; s++) {
+            hdr_histogram_t *h = &latency_hist[t][s];
+            const char *type = message_type_entries[t].name;
+            for (size_t q = 0; q < sizeof(quantiles) / sizeof(quantiles[0]) && len < size; q++) {
+                len += snprintf(buf + len, size - len,
+                                "chat_message_latency_seconds{type=\"%s\",stage=\"%s\",quantile=\"%g\"} %.9f\n",
+                                type, stage_names[s], quantiles[q],
+                                hdr_value_at_percentile(h, quantiles[q] * 100.0) / 1e9);
+            }
+            if (len < size) {
+                len += snprintf(buf + len, size - len,
+                                "chat_message_latency_seconds_sum{type=\"%s\",stage=\"%s\"} %.9f\n"
+                                "chat_message_latency_seconds_count{type=\"%s\",stage=\"%s\"} %lu\n",
+                                type, stage_names[s], atomic_load_explicit(&h->sum, memory_order_relaxed) / 1e9,
+                                type, stage_names[s], (unsigned long)hdr_count(h));
+            }
+        }
+    }
+    return len < size ? len : size - 1;
 }
 
 // ===========================================
-// 메인 함수
+// 메시지 전송 및 브로드캐스트 (부모 프로세스)
 // ===========================================
-int main() {
-    daemonize(); // 서버를 데몬 프로세스로 동작
+// 자식 파이프는 논블로킹이고 라우터 스레드만 쓴다. 대기열이 비어 있으면 바로 쓰고, 파이프가 가득 차
+// 쓰지 못한 나머지는 대기열 뒤에 붙여 두었다가 select 가 쓰기 가능을 알리면 hub_out_flush 가 이어서 씀.
+// 자식이 한참 못 읽으면 (느린 클라이언트) CLIENT_OUT_MAX 에서 그 연결만 끊고 허브는 계속 돈다
+static void out_queue_free(client_info_t *c) {
+    out_chunk_t *chunk = c->out_head;
+    while (chunk != NULL) {
+        out_chunk_t *next = chunk->next;
+        if (chunk->pending) {
+            chunk->abandoned = 1; // 워커가 아직 쓰는 중: drain_worker_replies 에서 해제
+        } else {
+            free(chunk);
+        }
+        chunk = next;
+    }
+    metrics_add(metric_out_queued, -(long)c->out_queued);
+    c->out_head = c->out_tail = NULL;
+    c->out_queued = 0;
+}
 
-    int server_socket;
-    struct sockaddr_in server_addr;
+// 더는 이 자식에게 쓰지 않고 끝냄 (자식이 끝나면 reap_children -> remove_client_from_list 가 정리)
+static void out_queue_close(client_info_t *c) {
+    out_queue_free(c);
+    c->out_closed = 1;
+    kill(c->pid, SIGTERM);
+}
 
-    // 1. 소켓 생성
-    server_socket = socket(AF_INET, SOCK_STREAM, 0);
-    if (server_socket == -1) {
-        perror("서버 소켓 생성 실패");
-        exit(EXIT_FAILURE);
+// 파이프가 받는 만큼 씀. 쓴 바이트 수, 파이프가 닫혔거나 오류면 -1
+static ssize_t out_write(client_info_t *c, const char *data, size_t len) {
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = write(c->pipe_write_fd, data + done, len - done);
+        if (n > 0) {
+            done += n;
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        } else {
+            LOG_RATELIMITED(LOG_LEVEL_WARN, 1000, "[서버] 클라이언트 %s(%d) 파이프 쓰기 실패: %s",
+                            c->nickname, c->pid, strerror(errno));
+            return -1;
+        }
     }
+    metrics_add(metric_bytes_out, done);
+    return done;
+}
 
-    // SO_REUSEADDR 옵션 설정 (서버 재시작 시 바인딩 에러 방지)
-    int opt = 1;
-    if (setsockopt(server_socket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
-        perror("setsockopt SO_REUSEADDR 실패");
-        close(server_socket);
-        exit(EXIT_FAILURE);
+static int out_enqueue(client_info_t *c, const char *data, size_t len) {
+    if (c->out_queued + len > CLIENT_OUT_MAX) {
+        LOG_RATELIMITED(LOG_LEVEL_WARN, 1000, "[서버] 클라이언트 %s(%d)에게 보낼 데이터가 %zu바이트 밀려 연결을 끊습니다.",
+                        c->nickname, c->pid, c->out_queued);
+        metrics_inc(metric_out_overflows);
+        return -1;
     }
+    while (len > 0) {
+        out_chunk_t *tail = c->out_tail;
+        if (tail == NULL || tail->pending || tail->len == tail->cap) {
+            size_t cap = len > CLIENT_OUT_CHUNK ? len : CLIENT_OUT_CHUNK;
+            out_chunk_t *chunk = malloc(sizeof(*chunk) + cap);
+            if (chunk == NULL) {
+                LOG_ERROR("[서버] 클라이언트 %s(%d) 송신 대기열 메모리 할당 실패", c->nickname, c->pid);
+                return -1;
+            }
+            chunk->next = NULL;
+            chunk->len = chunk->off = 0;
+            chunk->cap = cap;
+            chunk->pending = chunk->abandoned = 0;
+            if (tail != NULL) {
+                tail->next = chunk;
+            } else {
+                c->out_head = chunk;
+            }
+            c->out_tail = tail = chunk;
+        }
+        size_t n = tail->cap - tail->len < len ? tail->cap - tail->len : len;
+        memcpy(tail->data + tail->len, data, n);
+        tail->len += n;
+        data += n;
+        len -= n;
+        c->out_queued += n;
+        metrics_add(metric_out_queued, n);
+    }
+    return 0;
+}
+
+// 워커가 채울 응답 자리를 대기열 끝에 잡아 둠. 닫힌 연결이거나 메모리가 없으면 NULL
+static out_chunk_t *out_reserve(pid_t pid, size_t cap) {
+    client_info_t *c = NULL;
+    for (int i = 0; i < client_count; i++) {
+        if (clients[i].pid == pid) {
+            c = &clients[i];
+            break;
+        }
+    }
+    if (c == NULL || c->out_closed) {
+        return NULL;
+    }
+    out_chunk_t *chunk = malloc(sizeof(*chunk) + cap);
+    if (chunk == NULL) {
+        return NULL;
+    }
+    chunk->next = NULL;
+    chunk->len = chunk->off = 0;
+    chunk->cap = cap;
+    chunk->pending = 1;
+    chunk->abandoned = 0;
+    chunk->owner = pid;
+    if (c->out_tail != NULL) {
+        c->out_tail->next = chunk;
+    } else {
+        c->out_head = chunk;
+    }
+    c->out_tail = chunk;
+    return chunk;
+}
+
+// 한 클라이언트에게 보내고 송신 지표를 집계 (라우터 스레드 전용).
+// 지연 시간 추적의 fanout 은 파이프에 쓰거나 대기열에 넣은 시각까지
+static void hub_write(client_info_t *c, const char *message, size_t len) {
+    msg_trace_t *trace = current_trace;
+    if (c->out_closed) {
+        return;
+    }
+    if (trace && trace->first_write_ns == 0) {
+        trace->first_write_ns = monotonic_ns();
+    }
+    metrics_inc(metric_messages_out[current_out_type]);
+    ssize_t done = 0;
+    if (c->out_head == NULL) {
+        done = out_write(c, message, len);
+    }
+    if (done < 0 || ((size_t)done < len && out_enqueue(c, message + done, len - done) != 0)) {
+        out_queue_close(c);
+    }
+    if (trace) {
+        trace->last_write_ns = monotonic_ns();
+    }
+}
+
+// select 가 쓰기 가능을 알린 자식 파이프에 대기열을 이어서 씀 (아직 채워지지 않은 응답 자리에서 멈춤)
+void hub_out_flush(client_info_t *c) {
+    while (c->out_head != NULL && !c->out_head->pending) {
+        out_chunk_t *chunk = c->out_head;
+        ssize_t n = out_write(c, chunk->data + chunk->off, chunk->len - chunk->off);
+        if (n < 0) {
+            out_queue_close(c);
+            return;
+        }
+        chunk->off += n;
+        c->out_queued -= n;
+        metrics_add(metric_out_queued, -n);
+        if (chunk->off < chunk->len) {
+            return; // 파이프가 다시 가득 참
+        }
+        c->out_head = chunk->next;
+        if (c->out_head == NULL) {
+            c->out_tail = NULL;
+        }
+        free(chunk);
+    }
+}
+
+// 워커가 채운 응답 자리를 보낼 수 있게 하고 그 클라이언트의 대기열을 이어서 씀
+void drain_worker_replies(void) {
+    char wake[64];
+    while (read(worker_wake_pipe[0], wake, sizeof(wake)) > 0) {
+    }
+    mpsc_node_t *node;
+    while ((node = mpsc_queue_pop(&worker_replies)) != NULL) {
+        out_chunk_t *chunk = mpsc_container_of(node, out_chunk_t, done);
+        if (chunk->abandoned) {
+            free(chunk); // 그 사이 나간 클라이언트의 응답
+            continue;
+        }
+        chunk->pending = 0;
+        for (int i = 0; i < client_count; i++) {
+            if (clients[i].pid == chunk->owner) {
+                metrics_inc(metric_messages_out[command_type_index]);
+                clients[i].out_queued += chunk->len;
+                metrics_add(metric_out_queued, chunk->len);
+                hub_out_flush(&clients[i]);
+                break;
+            }
+        }
+    }
+}
+
+void send_message_to_client_by_pid(pid_t target_pid, const char *message) {
+    for (int i = 0; i < client_count; i++) {
+        if (clients[i].pid == target_pid) {
+            if (current_request_id != 0 && target_pid == current_request_pid) {
+                static char reply[MAX_REPLY_SIZE]; // 라우터 스레드 전용
+                size_t len = format_reply(current_request_id, message, 0, reply, sizeof(reply));
+                hub_write(&clients[i], reply, len);
+                return;
+            }
+            hub_write(&clients[i], message, strlen(message));
+            return;
+        }
+    }
+    LOG_RATELIMITED(LOG_LEVEL_WARN, 1000, "[서버] 메시지 전송 실패: PID %d를 가진 클라이언트를 찾을 수 없습니다.", target_pid);
+}
+
+// message 의 각 줄 앞에 [EVENT_MARK][EVENT_REPLY][요청 ID] 를 붙임. 이벤트 줄(방 메시지, 상태 변경)과
+// 파일 전송 제어 줄(자식이 가로채는 XPIPE, 클라이언트가 처리하는 XFER)은 그대로 두고,
+// done 이면 끝에 완료 줄을 붙임. out 이 모자라면 들어가는 줄까지만 담음
+size_t format_reply(uint32_t request_id, const char *message, int done, char *out, size_t out_size) {
+    size_t len = 0;
+    while (*message != '\0') {
+        const char *nl = strchr(message, '\n');
+        size_t line_len = nl ? (size_t)(nl - message) + 1 : strlen(message);
+        int passthrough = message[0] == EVENT_MARK || message[0] == XFER_CTRL_MARK ||
+                          strncmp(message, MSG_TYPE_XFER ":", sizeof(MSG_TYPE_XFER)) == 0;
+        int n = passthrough
+            ? snprintf(out + len, out_size - len, "%.*s", (int)line_len, message)
+            : snprintf(out + len, out_size - len, "%c%c%u %.*s%s", EVENT_MARK, EVENT_REPLY, request_id,
+                       (int)line_len, message, nl ? "" : "\n");
+        if (n < 0 || (size_t)n >= out_size - len) {
+            break;
+        }
+        len += n;
+        message += line_len;
+    }
+    if (done) {
+        int n = snprintf(out + len, out_size - len, "%c%c%u\n", EVENT_MARK, EVENT_REPLY_DONE, request_id);
+        if (n > 0 && (size_t)n < out_size - len) {
+            len += n;
+        }
+    }
+    out[len] = '\0';
+    return len;
+}
+
+// 한 클라이언트에게 상태 변경 이벤트 줄을 보냄. 값은 허브가 알고 있는 그 클라이언트의 현재 상태
+void send_state_event(pid_t target_pid, char type) {
+    char line[MAX_NICKNAME_LEN + MAX_ROOMNAME_LEN + 32];
+    for (int i = 0; i < client_count; i++) {
+        if (clients[i].pid != target_pid) {
+            continue;
+        }
+        if (type == EVENT_NICK_ACK) {
+            snprintf(line, sizeof(line), "%c%c%s\n", EVENT_MARK, type, clients[i].nickname);
+        } else if (type == EVENT_ROOM_CHANGED) {
+            int room_idx = find_room_index(clients[i].room_name);
+            snprintf(line, sizeof(line), "%c%c%s:%llu\n", EVENT_MARK, type, clients[i].room_name,
+                     room_idx != -1 ? (unsigned long long)chat_rooms[room_idx].last_seq : 0ULL);
+        } else { // EVENT_SESSION
+            snprintf(line, sizeof(line), "%c%c%016llx\n", EVENT_MARK, type, (unsigned long long)clients[i].session_token);
+        }
+        hub_write(&clients[i], line, strlen(line));
+        return;
+    }
+}
+
+void send_message_to_client_by_nickname(const char *nickname, const char *message) {
+    for (int i = 0; i < client_count; i++) {
+        if (strcmp(clients[i].nickname, nickname) == 0) {
+            hub_write(&clients[i], message, strlen(message));
+            return;
+        }
+    }
+    LOG_RATELIMITED(LOG_LEVEL_WARN, 1000, "[서버] 메시지 전송 실패: 닉네임 '%s'를 가진 클라이언트를 찾을 수 없습니다.", nickname);
+}
+
+// 순번 seq 인 방 메시지를 기록에 남기고 이 노드에 있는 그 방 사용자에게 EVENT_ROOM_MESSAGE 줄로 보냄
+// (홈 노드는 seq 를 직접 매기고, 다른 노드는 홈이 매긴 seq 를 그대로 씀)
+static void deliver_room_message(int room_idx, uint64_t seq, const char *message) {
+    char line[BUFFER_SIZE * 4 + 32];
+    chat_room_t *r = &chat_rooms[room_idx];
+    if (seq <= r->last_seq) {
+        return; // 이미 받은 순번 (링크 재연결 직후 겹친 전달)
+    }
+    if (seq != r->last_seq + 1) {
+        r->history_floor = seq; // 중간부터 받기 시작함 (구독 직후나 링크 재연결 뒤): 그 앞 칸은 이 방 기록이 아님
+    }
+    r->last_seq = seq;
+    char *slot = room_histories[r->history].lines[seq % ROOM_HISTORY_LEN];
+    size_t len = snprintf(slot, HISTORY_LINE_MAX, "%s", message);
+    if (len >= HISTORY_LINE_MAX) {
+        slot[HISTORY_LINE_MAX - 2] = '\n'; // 잘렸어도 한 줄로 끝나게
+    }
+    snprintf(line, sizeof(line), "%c%c%llu %s", EVENT_MARK, EVENT_ROOM_MESSAGE, (unsigned long long)seq, message);
+    for (int i = 0; i < client_count; i++) {
+        if (strcmp(clients[i].room_name, r->name) == 0) {
+            // 보낸 클라이언트에게도 다시 보냄 (선택 사항, 필요 시 sender_pid와 비교하여 제외)
+            send_message_to_client_by_pid(clients[i].pid, line);
+        }
+    }
+}
+
+// 홈 노드에서 방 메시지에 다음 순번을 매겨 로컬 사용자에게 보내고, 구독한 노드마다 한 번씩 전달.
+// 순번은 (fed_epoch << 32) | 방 안 번호라서, 홈이 다시 시작해 방 기록을 잃어도 줄어들지 않음
+static void publish_in_room(int room_idx, const char *message) {
+    chat_room_t *r = &chat_rooms[room_idx];
+    uint64_t seq = r->last_seq + 1;
+    if ((r->last_seq >> 32) < fed_epoch) {
+        seq = ((uint64_t)fed_epoch << 32) | 1;
+    }
+    deliver_room_message(room_idx, seq, message);
+    if (r->remote_subscribers == 0) {
+        return;
+    }
+    size_t len = strlen(message);
+    for (int node = 0; node < fed_node_count; node++) {
+        if ((r->remote_subscribers & (1u << node)) && fed_send(node, FED_DELIVER, r->name, seq, message, len) != 0) {
+            metrics_inc(metric_fed_dropped);
+        }
+    }
+}
+
+// 방 메시지는 순번을 붙여 기록에 남기고 EVENT_ROOM_MESSAGE 줄로 보냄 (재접속 시 놓친 범위를 다시 보내기 위해)
+// 홈이 다른 노드인 방이면 홈으로 넘기고, 홈이 순번을 매겨 되돌려 주면(FED_DELIVER) 그때 보냄.
+// 홈과의 링크가 끊겨 있으면 순번을 매길 곳이 없으므로 보내지 않고 보낸 사람에게 알림
+void broadcast_message_in_room(const char *room, const char *message, pid_t sender_pid) {
+    int room_idx = find_room_index(room);
+    if (room_idx == -1) {
+        for (int i = 0; i < client_count; i++) {
+            if (strcmp(clients[i].room_name, room) == 0) {
+                send_message_to_client_by_pid(clients[i].pid, message);
+            }
+        }
+        return;
+    }
+    chat_room_t *r = &chat_rooms[room_idx];
+    if (r->home_node == fed_self) {
+        publish_in_room(room_idx, message);
+        return;
+    }
+    if (fed_send(r->home_node, FED_PUBLISH, r->name, 0, message, strlen(message)) != 0) {
+        char notice[BUFFER_SIZE];
+        metrics_inc(metric_fed_dropped);
+        snprintf(notice, sizeof(notice), "[%s][서버] 방 '%s'을(를) 맡은 노드와 연결이 끊겨 메시지를 보내지 못했습니다. 잠시 후 다시 시도하세요.\n",
+                 get_current_time_str(), r->name);
+        send_message_to_client_by_pid(sender_pid, notice);
+    }
+}
+
+void broadcast_message_to_all_clients(const char *message, int sender_pipe_read_fd) {
+    for (int i = 0; i < client_count; i++) {
+        // 메시지를 보낸 자식에게는 다시 보내지 않음 (디버깅 편의를 위해 주석 처리)
+        // if (clients[i].pipe_read_fd == sender_pipe_read_fd) {
+        //     continue;
+        // }
+        hub_write(&clients[i], message, strlen(message));
+    }
+}
+
+// ===========================================
+// 메시지 처리 및 라우팅 (부모 프로세스)
+// ===========================================
+void process_message_from_child(const char *raw_message, int sender_pipe_read_fd, uint64_t recv_ns) {
+    msg_trace_t trace = { .recv_ns = recv_ns, .hub_rx_ns = monotonic_ns() };
+    // 경고 해결: temp_buffer 크기 조정
+    char type[BUFFER_SIZE];
+    char arg1[BUFFER_SIZE];
+    char arg2[BUFFER_SIZE];
+    char content[BUFFER_SIZE];
+    // BUFFER_SIZE (1024) * 4 로 충분히 크게 설정 (경고 메시지에 따르면 3077 바이트까지 필요할 수 있음)
+    char temp_buffer[BUFFER_SIZE * 4];
+    char client_nickname[MAX_NICKNAME_LEN + 1];
+    char client_room[MAX_ROOMNAME_LEN + 1];
+    pid_t sender_pid = -1;
+    // 보낸 클라이언트의 정보 찾기
+    for(int i = 0; i < client_count; i++) {
+        if (clients[i].pipe_read_fd == sender_pipe_read_fd) {
+            sender_pid = clients[i].pid;
+            strncpy(client_nickname, clients[i].nickname, MAX_NICKNAME_LEN);
+            client_nickname[MAX_NICKNAME_LEN] = '\0';
+            strncpy(client_room, clients[i].room_name, MAX_ROOMNAME_LEN);
+            client_room[MAX_ROOMNAME_LEN] = '\0';
+            break;
+        }
+    }
+
+    if (sender_pid == -1) {
+        LOG_RATELIMITED(LOG_LEVEL_WARN, 1000, "[서버] 알 수 없는 발신자로부터 메시지 수신: %s", raw_message);
+        return;
+    }
+
+    // 메시지 파싱: [TYPE]:[ARG1]:[ARG2]:[CONTENT] 형식
+    // sscanf의 반환 값으로 파싱된 필드 수를 확인하여 유효성 검사 강화
+    int parsed = sscanf(raw_message, "%[^:]:%[^:]:%[^:]:%[^\n]", type, arg1, arg2, content);
+    
+    // --- 파싱 오류를 보정하는 로직 추가 (이전 대화에서 제안된 것) ---
+    if (parsed < 4) {
+        if (sscanf(raw_message, "%[^:]:%[^:]:%[^:]:", type, arg1, arg2) == 3) {
+            content[0] = '\0';
+        } else if (sscanf(raw_message, "%[^:]:%[^:]:", type, arg1) == 2) {
+             arg2[0] = '\0';
+             content[0] = '\0';
+        } else {
+            metrics_inc(metric_messages_in[MESSAGE_TYPE_COUNT]);
+            snprintf(temp_buffer, sizeof(temp_buffer), "[%s][서버] 잘못된 메시지 형식입니다: %s\n", get_current_time_str(), raw_message);
+            send_message_to_client_by_pid(sender_pid, temp_buffer);
+            return;
+        }
+    }
+    // --- 파싱 오류 보정 로직 끝 ---
+
+    // 각 필드의 NULL 종료 보장 (sscanf가 %[^:]를 사용할 경우 자동으로 NULL 종료되지만, 안전을 위해)
+    type[sizeof(type) - 1] = '\0';
+    arg1[sizeof(arg1) - 1] = '\0';
+    arg2[sizeof(arg2) - 1] = '\0';
+    content[sizeof(content) - 1] = '\0';
+
+    // 타입 뒤의 요청 ID (CMD#17 -> 타입 CMD, ID 17)
+    char *id_mark = strchr(type, '#');
+    if (id_mark != NULL) {
+        *id_mark = '\0';
+        current_request_id = (uint32_t)strtoul(id_mark + 1, NULL, 10);
+        current_request_pid = sender_pid;
+        current_request_deferred = 0;
+    }
+
+    // 메시지마다 실행되는 경로이므로 DEBUG 레벨일 때만 (기본 빌드에서는 코드째 제거됨)
+    LOG_DEBUG("[서버] 수신된 원본 메시지: '%s'", raw_message);
+    LOG_DEBUG("[서버] 파싱 결과: 타입='%s', Arg1='%s', Arg2='%s', 내용='%s'", type, arg1, arg2, content);
+    if (LOG_ENABLED(LOG_LEVEL_DEBUG)) {
+        size_t arg1_len = strlen(arg1);
+        LOG_DEBUG("[서버] Arg1의 길이: %zu", arg1_len);
+        for (size_t i = 0; i <= arg1_len; ++i) { // 널 문자까지 확인
+            LOG_DEBUG("[서버] Arg1[%zu]: '%c' (ASCII: %d)", i, arg1[i] == '\0' ? 'N' : arg1[i], (int)arg1[i]);
+        }
+    }
+
+
+    struct cmd_ctx ctx = {
+        .sender_pid = sender_pid,
+        .nickname = client_nickname,
+        .room = client_room,
+        .type = type,
+        .arg1 = arg1,
+        .arg2 = arg2,
+        .content = content,
+        .out = temp_buffer,
+        .out_size = sizeof(temp_buffer),
+    };
+    const cmd_entry_t *entry = cmd_table_lookup(&message_type_table, type);
+    if (entry != NULL) {
+        int type_index = entry - message_type_entries;
+        metrics_inc(metric_messages_in[type_index]);
+        trace.parsed_ns = monotonic_ns();
+        current_out_type = type_index;
+        current_trace = &trace;
+        entry->handler(&ctx);
+        current_trace = NULL;
+        current_out_type = MESSAGE_TYPE_COUNT;
+        trace_finish(&trace, type_index, raw_message);
+    } else {
+        metrics_inc(metric_messages_in[MESSAGE_TYPE_COUNT]);
+        snprintf(temp_buffer, sizeof(temp_buffer), "[%s][서버] 알 수 없는 메시지 타입입니다: %s\n", get_current_time_str(), type);
+        send_message_to_client_by_pid(sender_pid, temp_buffer);
+    }
+    if (current_request_id != 0) {
+        if (!current_request_deferred) {
+            char done[32];
+            snprintf(done, sizeof(done), "%c%c%u\n", EVENT_MARK, EVENT_REPLY_DONE, current_request_id);
+            current_request_id = 0; // 완료 줄 자체에는 ID를 다시 붙이지 않음
+            send_message_to_client_by_pid(sender_pid, done);
+        }
+        current_request_id = 0;
+        current_request_pid = -1;
+    }
+}
+
+// ===========================================
+// 메시지 타입 / 명령어 핸들러 (부모 프로세스)
+// ===========================================
+// 시작 시 한 번 완전 해시 테이블을 만든다. 실패하면 서버를 띄우지 않음.
+int init_dispatch_tables(void) {
+    if (cmd_table_build(&message_type_table, message_type_entries,
+                        sizeof(message_type_entries) / sizeof(message_type_entries[0])) != 0) {
+        return -1;
+    }
+    if (cmd_table_build(&command_table, command_entries,
+                        sizeof(command_entries) / sizeof(command_entries[0])) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+// 스크레이프 시점에 풀에서 직접 읽는 값
+static long command_queue_depth(void) {
+    return command_pool_ready ? ws_pool_pending(&command_pool) : 0;
+}
+
+static long command_tasks_executed(void) {
+    long n = 0;
+    for (int i = 0; command_pool_ready && i < command_pool.nworkers; i++) {
+        n += atomic_load_explicit(&command_pool.workers[i].executed, memory_order_relaxed);
+    }
+    return n;
+}
+
+// 허브 지표 등록. 같은 이름(family)은 연속으로 등록해야 HELP/TYPE이 한 번만 출력됨
+int init_metrics(void) {
+    static char in_labels[MESSAGE_TYPE_COUNT + 1][48];
+    static char out_labels[MESSAGE_TYPE_COUNT + 1][48];
+
+    metric_connections = metrics_register(METRIC_GAUGE, "chat_connections", NULL, "Connected clients.");
+    metric_rooms = metrics_register(METRIC_GAUGE, "chat_rooms", NULL, "Open chat rooms.");
+    metric_accepts = metrics_register(METRIC_COUNTER, "chat_accepts_total", NULL, "Accepted connections.");
+    metric_accept_errors = metrics_register(METRIC_COUNTER, "chat_accept_errors_total", NULL, "Failed accept() calls.");
+    metric_accept_rejects = metrics_register(METRIC_COUNTER, "chat_accept_rejects_total", NULL, "Connections closed before fork because the client list was full.");
+    metric_accept_batches = metrics_register(METRIC_COUNTER, "chat_accept_batches_total", NULL, "Listening socket wakeups that accepted at least one connection.");
+    metric_forks = metrics_register(METRIC_COUNTER, "chat_forks_total", NULL, "Forked client handler processes.");
+    metric_fork_failures = metrics_register(METRIC_COUNTER, "chat_fork_failures_total", NULL, "Failed pipe()/fork() calls.");
+    for (size_t i = 0; i <= MESSAGE_TYPE_COUNT; i++) {
+        snprintf(in_labels[i], sizeof(in_labels[i]), "type=\"%s\"",
+                 i < MESSAGE_TYPE_COUNT ? message_type_entries[i].name : "unknown");
+        metric_messages_in[i] = metrics_register(METRIC_COUNTER, "chat_messages_in_total", in_labels[i],
+                                                 "Messages received from clients by type.");
+    }
+    for (size_t i = 0; i <= MESSAGE_TYPE_COUNT; i++) {
+        snprintf(out_labels[i], sizeof(out_labels[i]), "type=\"%s\"",
+                 i < MESSAGE_TYPE_COUNT ? message_type_entries[i].name : MSG_TYPE_INFO);
+        metric_messages_out[i] = metrics_register(METRIC_COUNTER, "chat_messages_out_total", out_labels[i],
+                                                  "Messages written to clients by the type that caused them.");
+    }
+    metric_rate_delayed = metrics_register(METRIC_COUNTER, "chat_rate_limited_total", "action=\"delayed\"",
+                                           "CHAT/WHISPER messages over the per-client rate limit.");
+    metric_rate_rejected = metrics_register(METRIC_COUNTER, "chat_rate_limited_total", "action=\"rejected\"",
+                                            "CHAT/WHISPER messages over the per-client rate limit.");
+    metric_forged_reports = metrics_register(METRIC_COUNTER, "chat_forged_reports_total", NULL,
+                                             "Client lines dropped for using an internal child report type (XFER, ZSTAT).");
+    metric_pings = metrics_register(METRIC_COUNTER, "chat_pings_total", NULL, "Heartbeat PINGs sent to idle clients.");
+    metric_idle_kills = metrics_register(METRIC_COUNTER, "chat_idle_disconnects_total", NULL,
+                                         "Clients disconnected for not answering a PING.");
+    metric_out_overflows = metrics_register(METRIC_COUNTER, "chat_client_out_overflows_total", NULL,
+                                            "Clients disconnected because too much output was queued for them.");
+    metric_fed_links = metrics_register(METRIC_GAUGE, "chat_fed_links_up", NULL, "Connected outgoing links to federation peers.");
+    metric_fed_connects = metrics_register(METRIC_COUNTER, "chat_fed_link_connects_total", NULL,
+                                           "Outgoing federation links established.");
+    metric_fed_frames_out = metrics_register(METRIC_COUNTER, "chat_fed_frames_total", "dir=\"out\"",
+                                             "Frames on federation links.");
+    metric_fed_frames_in = metrics_register(METRIC_COUNTER, "chat_fed_frames_total", "dir=\"in\"",
+                                            "Frames on federation links.");
+    metric_fed_batches = metrics_register(METRIC_COUNTER, "chat_fed_batches_total", NULL,
+                                          "Writes on federation links (frames out / batches = frames per write).");
+    metric_fed_dropped = metrics_register(METRIC_COUNTER, "chat_fed_dropped_total", NULL,
+                                          "Room messages not passed to a home or subscribed node because the link was down or full.");
+    metric_bytes_in = metrics_register(METRIC_COUNTER, "chat_bytes_in_total", NULL, "Bytes read from client pipes.");
+    metric_bytes_out = metrics_register(METRIC_COUNTER, "chat_bytes_out_total", NULL, "Bytes written to client pipes.");
+    metric_out_queued = metrics_register(METRIC_GAUGE, "chat_client_out_queued_bytes", NULL,
+                                         "Bytes waiting in per-client output queues because a pipe was full.");
+    metric_compress_plain = metrics_register(METRIC_COUNTER, "chat_compress_plain_bytes_total", NULL,
+                                             "Bytes given to per-connection compressors (wire/plain = compression ratio).");
+    metric_compress_wire = metrics_register(METRIC_COUNTER, "chat_compress_wire_bytes_total", NULL,
+                                            "Compressed bytes including record headers written to clients.");
+    metric_compress_us = metrics_register(METRIC_COUNTER, "chat_compress_microseconds_total", NULL,
+                                          "Time client handler processes spent in deflate.");
+    metrics_register_callback(METRIC_GAUGE, "chat_command_queue_depth", NULL, "Commands waiting in the worker pool.",
+                              command_queue_depth);
+    if (metrics_register_callback(METRIC_COUNTER, "chat_command_tasks_executed_total", NULL, "Commands run by pool workers.",
+                                  command_tasks_executed) < 0) {
+        return -1; // 마지막 등록이 성공했다면 앞의 등록도 모두 성공한 것
+    }
+    if (metrics_register_collector(latency_collector) != 0) {
+        return -1;
+    }
+    command_type_index = cmd_table_lookup(&message_type_table, MSG_TYPE_COMMAND) - message_type_entries;
+    return 0;
+}
+
+// 일반 채팅 메시지: CHAT:[nickname]:[room_name]:[message]
+// 클라이언트에서 nickname과 room_name을 명시적으로 보냄
+static void msg_chat(struct cmd_ctx *ctx) {
+    snprintf(ctx->out, ctx->out_size, "[%s][%s:%s] %s\n", get_current_time_str(), ctx->arg1, ctx->arg2, ctx->content);
+    broadcast_message_in_room(ctx->arg2, ctx->out, ctx->sender_pid);
+}
+
+// 서버 명령어: CMD:[command_name]:[arg]:[content] (arg와 content는 명령어에 따라 사용)
+// arg1은 슬래시 없는 명령어 이름이며, 명령어 테이블에서 해시 한 번으로 핸들러를 찾음
+static void msg_command(struct cmd_ctx *ctx) {
+    const cmd_entry_t *entry = cmd_table_lookup(&command_table, ctx->arg1);
+    if (entry != NULL) {
+        entry->handler(ctx);
+    } else {
+        snprintf(ctx->out, ctx->out_size, "[%s][서버] 알 수 없는 명령어입니다: %s\n", get_current_time_str(), ctx->arg1);
+        send_message_to_client_by_pid(ctx->sender_pid, ctx->out);
+    }
+}
+
+// 귓속말: WHISPER:[sender_nickname]:[target_nickname]:[message]
+// sender_nickname은 클라이언트가 보낸 것이고, 실제로는 서버가 sender_pid로 찾아야 안전
+static void msg_whisper(struct cmd_ctx *ctx) {
+    snprintf(ctx->out, ctx->out_size, "[%s][귓속말 from %s] %s\n", get_current_time_str(), ctx->nickname, ctx->content);
+    // 방 샤딩: 대상이 다른 샤드에 있으면 닉네임 디렉터리가 알려 준 샤드로 넘김
+    int shard = nick_dir != NULL ? nick_dir_lookup(nick_dir, ctx->arg2) : -1;
+    if (shard >= 0 && shard != fed_self) {
+        if (fed_send(shard, FED_WHISPER, ctx->arg2, 0, ctx->out, strlen(ctx->out)) != 0) {
+            metrics_inc(metric_fed_dropped);
+        }
+    } else {
+        send_message_to_client_by_nickname(ctx->arg2, ctx->out); // arg2가 대상 닉네임
+    }
+    // 보낸 사람에게도 성공 메시지 (선택 사항)
+    snprintf(ctx->out, ctx->out_size, "[%s][귓속말 to %s] %s\n", get_current_time_str(), ctx->arg2, ctx->content);
+    send_message_to_client_by_pid(ctx->sender_pid, ctx->out);
+}
+
+static void cmd_add(struct cmd_ctx *ctx) { // /add [방이름]
+    int res = add_room(ctx->arg2);
+    if (res == 0) {
+        snprintf(ctx->out, ctx->out_size, "[%s][서버] 채팅방 '%s'이(가) 생성되었습니다.\n", get_current_time_str(), ctx->arg2);
+    } else if (res == -1) {
+        snprintf(ctx->out, ctx->out_size, "[%s][서버] 오류: 채팅방 '%s'은(는) 이미 존재합니다.\n", get_current_time_str(), ctx->arg2);
+    } else { // -2
+        snprintf(ctx->out, ctx->out_size, "[%s][서버] 오류: 최대 채팅방 개수를 초과했습니다.\n", get_current_time_str());
+    }
+    send_message_to_client_by_pid(ctx->sender_pid, ctx->out);
+}
+
+static void cmd_rm(struct cmd_ctx *ctx) { // /rm [방이름]
+    int res = remove_room(ctx->arg2);
+    if (res == 0) {
+        snprintf(ctx->out, ctx->out_size, "[%s][서버] 채팅방 '%s'이(가) 삭제되었습니다.\n", get_current_time_str(), ctx->arg2);
+    } else if (res == -1) {
+        snprintf(ctx->out, ctx->out_size, "[%s][서버] 오류: 채팅방 '%s'은(는) 존재하지 않습니다.\n", get_current_time_str(), ctx->arg2);
+    } else if (res == -2) {
+        snprintf(ctx->out, ctx->out_size, "[%s][서버] 오류: 채팅방 '%s'에 사용자가 남아있어 삭제할 수 없습니다.\n", get_current_time_str(), ctx->arg2);
+    } else { // -3
+        snprintf(ctx->out, ctx->out_size, "[%s][서버] 오류: 기본 채팅방 'general'은 삭제할 수 없습니다.\n", get_current_time_str());
+    }
+    send_message_to_client_by_pid(ctx->sender_pid, ctx->out);
+}
+
+static void cmd_join(struct cmd_ctx *ctx) { // /join [방이름]
+    int res = join_room(ctx->sender_pid, ctx->arg2);
+    if (res == 0) {
+        // 이전 방에 나갔음을 알림
+        snprintf(ctx->out, ctx->out_size, "[%s][INFO] %s 님이 방을 나갔습니다.\n", get_current_time_str(), ctx->nickname);
+        broadcast_message_in_room(ctx->room, ctx->out, ctx->sender_pid); // 이전 방에 알림
+
+        // 새 방에 들어왔음을 알림
+        snprintf(ctx->out, ctx->out_size, "[%s][INFO] %s 님이 방 '%s'에 입장했습니다.\n", get_current_time_str(), ctx->nickname, ctx->arg2);
+        send_message_to_client_by_pid(ctx->sender_pid, ctx->out); // 자신에게 입장 알림
+        broadcast_message_in_room(ctx->arg2, ctx->out, ctx->sender_pid); // 새 방에 알림
+        send_state_event(ctx->sender_pid, EVENT_ROOM_CHANGED);
+    } else if (res == -1) {
+        snprintf(ctx->out, ctx->out_size, "[%s][서버] 오류: 클라이언트 정보를 찾을 수 없습니다.\n", get_current_time_str());
+        send_message_to_client_by_pid(ctx->sender_pid, ctx->out);
+    } else { // -2
+        snprintf(ctx->out, ctx->out_size, "[%s][서버] 오류: 방 생성 또는 입장 실패. (방 개수 초과 등)\n", get_current_time_str());
+        send_message_to_client_by_pid(ctx->sender_pid, ctx->out);
+    }
+}
+
+static void cmd_leave(struct cmd_ctx *ctx) { // /leave
+    int res = leave_room(ctx->sender_pid);
+    if (res == 0) {
+        snprintf(ctx->out, ctx->out_size, "[%s][INFO] %s 님이 방을 나갔습니다.\n", get_current_time_str(), ctx->nickname);
+        broadcast_message_in_room(ctx->room, ctx->out, ctx->sender_pid); // 이전 방에 알림
+
+        snprintf(ctx->out, ctx->out_size, "[%s][서버] 방을 떠나 'general' 방으로 이동했습니다.\n", get_current_time_str());
+        send_message_to_client_by_pid(ctx->sender_pid, ctx->out);
+        send_state_event(ctx->sender_pid, EVENT_ROOM_CHANGED);
+    } else if (res == -1) {
+        snprintf(ctx->out, ctx->out_size, "[%s][서버] 오류: 클라이언트 정보를 찾을 수 없습니다.\n", get_current_time_str());
+        send_message_to_client_by_pid(ctx->sender_pid, ctx->out);
+    } else { // -2
+        snprintf(ctx->out, ctx->out_size, "[%s][서버] 오류: 'general' 방에서는 나갈 수 없습니다.\n", get_current_time_str());
+        send_message_to_client_by_pid(ctx->sender_pid, ctx->out);
+    }
+}
+
+static void cmd_list(struct cmd_ctx *ctx) { // /list (워커 스레드에서 응답 생성)
+    offload_room_list(ctx->sender_pid);
+}
+
+static void cmd_users(struct cmd_ctx *ctx) { // /users (워커 스레드에서 응답 생성)
+    offload_users_in_room(ctx->sender_pid, ctx->room);
+}
+
+static void cmd_nickname(struct cmd_ctx *ctx) { // /nickname [새 닉네임]
+    char old_nickname[MAX_NICKNAME_LEN + 1];
+    strncpy(old_nickname, ctx->nickname, MAX_NICKNAME_LEN);
+    old_nickname[MAX_NICKNAME_LEN] = '\0';
+
+    // 닉네임 중복 확인 (방 샤딩이면 다른 샤드의 클라이언트도: 디렉터리에 등록까지 한 번에)
+    int is_duplicate = 0;
+    for(int i = 0; i < client_count; i++) {
+        if (clients[i].pid != ctx->sender_pid && strcmp(clients[i].nickname, ctx->arg2) == 0) {
+            is_duplicate = 1;
+            break;
+        }
+    }
+    if (!is_duplicate && nick_dir != NULL && nick_dir_claim(nick_dir, ctx->arg2, fed_self, ctx->sender_pid) != 0) {
+        is_duplicate = 1;
+    }
+
+    if (is_duplicate) {
+        snprintf(ctx->out, ctx->out_size, "[%s][서버] 오류: 닉네임 '%s'은(는) 이미 사용 중입니다.\n", get_current_time_str(), ctx->arg2);
+        send_message_to_client_by_pid(ctx->sender_pid, ctx->out);
+    } else {
+        for(int i = 0; i < client_count; i++) {
+            if (clients[i].pid == ctx->sender_pid) {
+                strncpy(clients[i].nickname, ctx->arg2, MAX_NICKNAME_LEN);
+                clients[i].nickname[MAX_NICKNAME_LEN] = '\0';
+                break;
+            }
+        }
+        snprintf(ctx->out, ctx->out_size, "[%s][서버] 닉네임이 '%s'(으)로 변경되었습니다.\n", get_current_time_str(), ctx->arg2);
+        send_message_to_client_by_pid(ctx->sender_pid, ctx->out);
+        send_state_event(ctx->sender_pid, EVENT_NICK_ACK);
+
+        // 방에 닉네임 변경 알림
+        snprintf(ctx->out, ctx->out_size, "[%s][INFO] %s 님이 %s (으)로 닉네임을 변경했습니다.\n", get_current_time_str(), old_nickname, ctx->arg2);
+        broadcast_message_in_room(ctx->room, ctx->out, ctx->sender_pid);
+    }
+}
+
+// 재접속한 클라이언트가 연결 직후 보냄: CMD:resume:[세션 토큰]:[그 방에서 마지막으로 받은 순번]
+// 닉네임과 방을 되돌리고, 끊겨 있던 동안의 방 메시지를 한 번에 다시 보냄
+static void cmd_resume(struct cmd_ctx *ctx) {
+    uint64_t token = strtoull(ctx->arg2, NULL, 16);
+    uint64_t last_seq = strtoull(ctx->content, NULL, 10);
+    detached_session_t session;
+    int found = 0;
+    for (int i = 0; token != 0 && i < MAX_DETACHED_SESSIONS; i++) {
+        if (detached_sessions[i].token == token) {
+            session = detached_sessions[i];
+            detached_sessions[i].token = 0;
+            found = 1;
+            break;
+        }
+    }
+    if (!found) {
+        snprintf(ctx->out, ctx->out_size, "[%s][서버] 이전 세션이 만료되어 새 세션으로 시작합니다.\n", get_current_time_str());
+        send_message_to_client_by_pid(ctx->sender_pid, ctx->out);
+        return;
+    }
+
+    // 닉네임: 그사이 다른 사람이 가져갔으면 현재 닉네임 유지
+    int nickname_taken = 0;
+    for (int i = 0; i < client_count; i++) {
+        if (clients[i].pid != ctx->sender_pid && strcmp(clients[i].nickname, session.nickname) == 0) {
+            nickname_taken = 1;
+        }
+    }
+    if (!nickname_taken && nick_dir != NULL && nick_dir_claim(nick_dir, session.nickname, fed_self, ctx->sender_pid) != 0) {
+        nickname_taken = 1;
+    }
+    for (int i = 0; i < client_count && !nickname_taken; i++) {
+        if (clients[i].pid == ctx->sender_pid) {
+            snprintf(clients[i].nickname, sizeof(clients[i].nickname), "%s", session.nickname);
+        }
+    }
+    if (nickname_taken) {
+        snprintf(ctx->out, ctx->out_size, "[%s][서버] 닉네임 '%s'은(는) 이미 사용 중이라 되찾지 못했습니다.\n", get_current_time_str(), session.nickname);
+        send_message_to_client_by_pid(ctx->sender_pid, ctx->out);
+    }
+    send_state_event(ctx->sender_pid, EVENT_NICK_ACK);
+
+    // 방: 기다리는 동안 남겨 둔 방으로 (general 이면 이미 들어가 있음)
+    if (strcmp(session.room_name, ctx->room) != 0 && join_room(ctx->sender_pid, session.room_name) != 0) {
+        strncpy(session.room_name, ctx->room, MAX_ROOMNAME_LEN);
+        session.room_name[MAX_ROOMNAME_LEN] = '\0';
+    }
+    replay_room_history(ctx->sender_pid, session.room_name, last_seq);
+    send_state_event(ctx->sender_pid, EVENT_ROOM_CHANGED);
+
+    const char *nickname = nickname_taken ? ctx->nickname : session.nickname;
+    snprintf(ctx->out, ctx->out_size, "[%s][INFO] %s 님이 다시 접속했습니다.\n", get_current_time_str(), nickname);
+    broadcast_message_in_room(session.room_name, ctx->out, ctx->sender_pid);
+    LOG_INFO("[서버] 클라이언트 %d 세션 재개: %s, 방 '%s'", ctx->sender_pid, nickname, session.room_name);
+}
+
+// ===========================================
+// 파일 전송 (부모 프로세스)
+// ===========================================
+// 1. 보내는 쪽: CMD:sendfile:[받는 닉네임]:[크기] [파일이름]  -> 받는 쪽에 제안 알림
+// 2. 받는 쪽:   CMD:accept:[전송번호]:  (또는 CMD:reject:[전송번호]:)
+// 3. 허브가 FIFO를 만들고 두 자식에게 내부 제어 줄로 경로를 알림. 클라이언트에는 XFER:start / XFER:go
+// 4. 보내는 클라이언트는 XDATA 조각을 sendfile로 보내고, 보내는 쪽 자식이 소켓 -> FIFO로 splice,
+//    받는 쪽 자식이 FIFO -> 소켓으로 splice 하며 XDATA 조각을 다시 붙여 보냄 (허브는 데이터를 만지지 않음)
+// 5. 받는 쪽 자식이 크기만큼 보내면 XFER:done:[전송번호] 로 보고 -> 양쪽에 XFER:end:[전송번호]:done
+// 어느 한쪽이 나가거나 /reject 하면 XFER:end:[전송번호]:cancelled
+// 디렉터리 안의 파일(FIFO)을 모두 지우고, remove_dir 이면 디렉터리도 지움
+static void remove_dir_entries(const char *dir, int remove_dir) {
+    DIR *d = opendir(dir);
+    if (d != NULL) {
+        struct dirent *e;
+        while ((e = readdir(d)) != NULL) {
+            if (strcmp(e->d_name, ".") != 0 && strcmp(e->d_name, "..") != 0) {
+                unlinkat(dirfd(d), e->d_name, 0);
+            }
+        }
+        closedir(d);
+    }
+    if (remove_dir) {
+        rmdir(dir);
+    }
+}
+
+// 샤드(shard >= 0)는 감독이 만든 상위 디렉터리 아래 자기 디렉터리를 씀. 죽었다 다시 뜬 샤드면
+// 이전 프로세스가 남긴 FIFO 를 비우고 그대로 씀 (샤드마다 재시작할 때마다 새 디렉터리가 쌓이지 않음)
+int init_file_transfer(int shard) {
+    if (xfer_base_dir[0] != '\0' && shard >= 0) {
+        snprintf(xfer_dir, sizeof(xfer_dir), "%s/shard%d", xfer_base_dir, shard);
+        if (mkdir(xfer_dir, 0700) != 0) {
+            if (errno != EEXIST) {
+                xfer_dir[0] = '\0';
+                return -1;
+            }
+            remove_dir_entries(xfer_dir, 0);
+        }
+        return 0;
+    }
+    snprintf(xfer_dir, sizeof(xfer_dir), "/tmp/chat2_xfer.XXXXXX");
+    if (mkdtemp(xfer_dir) == NULL) { // 0700으로 만들어짐
+        xfer_dir[0] = '\0';
+        return -1;
+    }
+    return 0;
+}
+
+// 진행 중인 전송의 FIFO 와 전송 디렉터리를 지움 (전송이 끝날 때는 finish_transfer 가 FIFO 를 지움)
+void cleanup_file_transfer(void) {
+    if (xfer_dir[0] == '\0') {
+        return;
+    }
+    for (int i = 0; i < MAX_TRANSFERS; i++) {
+        if (transfers[i].state == XFER_ACTIVE) {
+            unlink(transfers[i].fifo_path);
+        }
+    }
+    remove_dir_entries(xfer_dir, 1);
+    xfer_dir[0] = '\0';
+}
+
+static file_transfer_t *find_transfer(int id) {
+    for (int i = 0; i < MAX_TRANSFERS; i++) {
+        if (transfers[i].state != XFER_FREE && transfers[i].id == id) {
+            return &transfers[i];
+        }
+    }
+    return NULL;
+}
+
+static int client_has_transfer(pid_t pid) {
+    for (int i = 0; i < MAX_TRANSFERS; i++) {
+        if (transfers[i].state != XFER_FREE && (transfers[i].sender_pid == pid || transfers[i].receiver_pid == pid)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// 전송을 끝내고 슬롯을 비움. gone_pid 는 이미 나간 쪽 (그쪽 파이프에는 쓰지 않음)
+static void finish_transfer(file_transfer_t *t, const char *status, pid_t gone_pid) {
+    char line[64];
+    pid_t sides[2] = { t->sender_pid, t->receiver_pid };
+
+    for (int i = 0; i < 2; i++) {
+        if (sides[i] == gone_pid) {
+            continue;
+        }
+        if (t->state == XFER_ACTIVE && strcmp(status, "done") != 0) {
+            // 자식이 FIFO를 닫고, 보내는 쪽 자식은 이미 오고 있는 조각을 버리도록
+            snprintf(line, sizeof(line), "%cXCANCEL:%d\n", XFER_CTRL_MARK, t->id);
+            send_message_to_client_by_pid(sides[i], line);
+        }
+        snprintf(line, sizeof(line), "XFER:end:%d:%s\n", t->id, status);
+        send_message_to_client_by_pid(sides[i], line);
+    }
+    if (t->state == XFER_ACTIVE) {
+        unlink(t->fifo_path);
+    }
+    LOG_INFO("[서버] 파일 전송 #%d '%s' (%lld 바이트) 종료: %s", t->id, t->name, t->size, status);
+    t->state = XFER_FREE;
+}
+
+void cancel_transfers_of_client(pid_t pid) {
+    for (int i = 0; i < MAX_TRANSFERS; i++) {
+        if (transfers[i].state != XFER_FREE && (transfers[i].sender_pid == pid || transfers[i].receiver_pid == pid)) {
+            finish_transfer(&transfers[i], "cancelled", pid);
+        }
+    }
+}
+
+// 제안을 받지 못함: 오류 설명과 함께, 아직 전송 번호를 모르는 보내는 쪽 클라이언트가 파일을 닫도록 XFER:end:0
+static void refuse_sendfile(struct cmd_ctx *ctx) {
+    send_message_to_client_by_pid(ctx->sender_pid, ctx->out);
+    send_message_to_client_by_pid(ctx->sender_pid, "XFER:end:0:failed\n");
+}
+
+static void cmd_sendfile(struct cmd_ctx *ctx) { // /sendfile [닉네임] [경로] (클라이언트가 크기와 파일 이름만 보냄)
+    long long size = -1;
+    char name[MAX_FILENAME_LEN + 1] = "";
+    pid_t target_pid = -1;
+
+    if (sscanf(ctx->content, "%lld %255[^\n]", &size, name) != 2 || size < 0 ||
+        strchr(name, '/') != NULL || strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+        snprintf(ctx->out, ctx->out_size, "[%s][서버] 오류: 잘못된 파일 전송 요청입니다.\n", get_current_time_str());
+        refuse_sendfile(ctx);
+        return;
+    }
+    for (int i = 0; i < client_count; i++) {
+        if (strcmp(clients[i].nickname, ctx->arg2) == 0) {
+            target_pid = clients[i].pid;
+            break;
+        }
+    }
+    if (target_pid == -1 || target_pid == ctx->sender_pid) {
+        snprintf(ctx->out, ctx->out_size, "[%s][서버] 오류: 파일을 받을 사용자 '%s'을(를) 찾을 수 없습니다.\n", get_current_time_str(), ctx->arg2);
+        refuse_sendfile(ctx);
+        return;
+    }
+    if (xfer_dir[0] == '\0' || client_has_transfer(ctx->sender_pid) || client_has_transfer(target_pid)) {
+        snprintf(ctx->out, ctx->out_size, "[%s][서버] 오류: 지금은 파일을 보낼 수 없습니다. (진행 중인 전송이 있거나 서버가 파일 전송을 지원하지 않음)\n", get_current_time_str());
+        refuse_sendfile(ctx);
+        return;
+    }
+    file_transfer_t *t = NULL;
+    for (int i = 0; i < MAX_TRANSFERS && t == NULL; i++) {
+        if (transfers[i].state == XFER_FREE) {
+            t = &transfers[i];
+        }
+    }
+    if (t == NULL) {
+        snprintf(ctx->out, ctx->out_size, "[%s][서버] 오류: 동시에 진행할 수 있는 파일 전송 수(%d)를 초과했습니다.\n", get_current_time_str(), MAX_TRANSFERS);
+        refuse_sendfile(ctx);
+        return;
+    }
+
+    t->state = XFER_OFFERED;
+    t->id = next_transfer_id++;
+    t->sender_pid = ctx->sender_pid;
+    t->receiver_pid = target_pid;
+    t->size = size;
+    strncpy(t->name, name, MAX_FILENAME_LEN);
+    t->name[MAX_FILENAME_LEN] = '\0';
+
+    snprintf(ctx->out, ctx->out_size, "[%s][서버] %s 님이 파일 '%s' (%lld 바이트)을(를) 보내려고 합니다. 받으려면 /accept %d, 거절하려면 /reject %d\n",
+             get_current_time_str(), ctx->nickname, t->name, size, t->id, t->id);
+    send_message_to_client_by_pid(target_pid, ctx->out);
+    snprintf(ctx->out, ctx->out_size, "[%s][서버] %s 님에게 파일 '%s' 전송을 제안했습니다. (전송 번호 %d)\n",
+             get_current_time_str(), ctx->arg2, t->name, t->id);
+    send_message_to_client_by_pid(ctx->sender_pid, ctx->out);
+}
+
+static void cmd_accept(struct cmd_ctx *ctx) { // /accept [전송번호]
+    file_transfer_t *t = find_transfer(atoi(ctx->arg2));
+    if (t == NULL || t->state != XFER_OFFERED || t->receiver_pid != ctx->sender_pid) {
+        snprintf(ctx->out, ctx->out_size, "[%s][서버] 오류: 수락할 수 있는 파일 전송 '%s'이(가) 없습니다.\n", get_current_time_str(), ctx->arg2);
+        send_message_to_client_by_pid(ctx->sender_pid, ctx->out);
+        return;
+    }
+    snprintf(t->fifo_path, sizeof(t->fifo_path), "%s/xfer%d", xfer_dir, t->id);
+    if (mkfifo(t->fifo_path, 0600) != 0) {
+        LOG_ERROR("[서버] 파일 전송 FIFO '%s' 생성 실패: %s", t->fifo_path, strerror(errno));
+        finish_transfer(t, "failed", -1);
+        return;
+    }
+    t->state = XFER_ACTIVE;
+
+    // 순서 중요: 받는 쪽 클라이언트는 XFER:start 를 먼저 받아 파일을 열고, 자식은 그 다음 제어 줄을 처리한 뒤
+    // XDATA 조각을 보내기 시작함. 보내는 쪽 자식은 FIFO를 연 뒤에 클라이언트가 XFER:go 를 받음
+    snprintf(ctx->out, ctx->out_size, "XFER:start:%d:%lld:%s\n", t->id, t->size, t->name);
+    send_message_to_client_by_pid(t->receiver_pid, ctx->out);
+    snprintf(ctx->out, ctx->out_size, "%cXPIPE:%d:r:%lld:%s\n", XFER_CTRL_MARK, t->id, t->size, t->fifo_path);
+    send_message_to_client_by_pid(t->receiver_pid, ctx->out);
+    snprintf(ctx->out, ctx->out_size, "%cXPIPE:%d:w:%lld:%s\n", XFER_CTRL_MARK, t->id, t->size, t->fifo_path);
+    send_message_to_client_by_pid(t->sender_pid, ctx->out);
+    snprintf(ctx->out, ctx->out_size, "XFER:go:%d:%lld\n", t->id, t->size);
+    send_message_to_client_by_pid(t->sender_pid, ctx->out);
+    LOG_INFO("[서버] 파일 전송 #%d '%s' (%lld 바이트) 시작: %d -> %d", t->id, t->name, t->size, t->sender_pid, t->receiver_pid);
+}
+
+static void cmd_reject(struct cmd_ctx *ctx) { // /reject [전송번호] (진행 중인 전송은 양쪽 모두 취소 가능)
+    file_transfer_t *t = find_transfer(atoi(ctx->arg2));
+    if (t == NULL || (t->receiver_pid != ctx->sender_pid && (t->state != XFER_ACTIVE || t->sender_pid != ctx->sender_pid))) {
+        snprintf(ctx->out, ctx->out_size, "[%s][서버] 오류: 취소할 수 있는 파일 전송 '%s'이(가) 없습니다.\n", get_current_time_str(), ctx->arg2);
+        send_message_to_client_by_pid(ctx->sender_pid, ctx->out);
+        return;
+    }
+    finish_transfer(t, t->state == XFER_OFFERED ? "rejected" : "cancelled", -1);
+}
+
+// 자식 프로세스의 전송 보고: XFER:done:[전송번호] (받는 쪽 자식), XFER:fail:[전송번호] (FIFO 열기 실패 등)
+static void msg_xfer(struct cmd_ctx *ctx) {
+    file_transfer_t *t = find_transfer(atoi(ctx->arg2));
+    if (t == NULL || t->state != XFER_ACTIVE) {
+        return; // 이미 취소된 전송
+    }
+    if (strcmp(ctx->arg1, "done") == 0 && t->receiver_pid == ctx->sender_pid) {
+        finish_transfer(t, "done", -1);
+    } else if (strcmp(ctx->arg1, "fail") == 0 && (t->receiver_pid == ctx->sender_pid || t->sender_pid == ctx->sender_pid)) {
+        finish_transfer(t, "failed", -1);
+    }
+}
+
+// 보고 값 하나를 읽음. 숫자가 아니거나 음수이거나 ZSTAT_MAX_VALUE 를 넘으면 -1
+static long long parse_zstat_value(const char *text) {
+    char *end;
+    errno = 0;
+    long long value = strtoll(text, &end, 10);
+    if (end == text || *end != '\0' || errno != 0 || value < 0 || value > ZSTAT_MAX_VALUE) {
+        return -1;
+    }
+    return value;
+}
+
+// 자식 프로세스의 압축 통계 보고: ZSTAT:[평문 바이트]:[압축 바이트]:[압축 시간 ns]
+static void msg_zstat(struct cmd_ctx *ctx) {
+    long long plain = parse_zstat_value(ctx->arg1);
+    long long wire = parse_zstat_value(ctx->arg2);
+    long long ns = parse_zstat_value(ctx->content);
+    if (plain < 0 || wire < 0 || ns < 0) {
+        LOG_RATELIMITED(LOG_LEVEL_WARN, 1000, "[서버] 클라이언트 %d 자식의 압축 통계 보고가 올바르지 않아 버립니다.", ctx->sender_pid);
+        return;
+    }
+    metrics_add(metric_compress_plain, plain);
+    metrics_add(metric_compress_wire, wire);
+    metrics_add(metric_compress_us, ns / 1000);
+}
+
+// 하트비트 답: PONG:[번호]:: 도착 자체가 활동으로 기록되므로 (drain_frames_from_child) 더 할 일은 없음
+static void msg_pong(struct cmd_ctx *ctx) {
+}
+
+// ===========================================
+// 자식 프로세스: 클라이언트와의 통신 처리 (fork() 이후 실행)
+// ===========================================
+// 헤더 + 메시지를 한 번의 write로 보냄 (BUFFER_SIZE + 헤더 < PIPE_BUF 라서 블로킹 파이프에는
+// 전부 쓰이거나 전혀 쓰이지 않음). flags 는 PIPE_FRAME_*. 실패하면 -1
+static int send_frame_to_parent(int fd, const char *message, size_t len, uint64_t recv_ns, uint32_t flags) {
+    char frame[sizeof(pipe_frame_hdr_t) + BUFFER_SIZE];
+    pipe_frame_hdr_t hdr = { .len = (uint32_t)len, .flags = flags, .recv_ns = recv_ns };
+    memcpy(frame, &hdr, sizeof(hdr));
+    memcpy(frame + sizeof(hdr), message, len);
+    ssize_t n;
+    do {
+        n = write(fd, frame, sizeof(hdr) + len);
+    } while (n < 0 && errno == EINTR);
+    if (n != (ssize_t)(sizeof(hdr) + len)) {
+        LOG_RATELIMITED(LOG_LEVEL_WARN, 1000, "[자식 %d] 부모 파이프 쓰기 실패 (%zd/%zu 바이트): %s", getpid(),
+                        n, sizeof(hdr) + len, n < 0 ? strerror(errno) : "일부만 씀");
+        return -1;
+    }
+    return 0;
+}
+
+// 자식 프로세스의 파일 전송 상태. 보내는 쪽(w)은 클라이언트 소켓 -> FIFO, 받는 쪽(r)은 FIFO -> 클라이언트 소켓
+typedef struct {
+    int id;                         // 0이면 진행 중인 전송 없음
+    int role;                       // 'w' 또는 'r'
+    int fifo_fd;
+    long long size;                 // 전체 크기
+    long long done;                 // w: FIFO에 넣은 바이트, r: 클라이언트로 보낸 바이트
+    long long in_remaining;         // 클라이언트가 보낸 현재 XDATA 조각 중 아직 소켓에 남은 바이트
+    int chunk_to_fifo;              // 그 조각을 FIFO에 넣는지 (0이면 진행 중인 전송이 아니므로 읽어서 버림)
+    long long out_remaining;        // r: 현재 XDATA 조각 중 아직 클라이언트로 보내지 않은 바이트
+    size_t pending_len;             // w: 헤더와 함께 read 로 읽혀 아직 FIFO에 넣지 못한 조각 바이트
+    char pending[BUFFER_SIZE];
+    int at_line_start;              // 클라이언트로 보낸 마지막 바이트가 '\n' 인지 (XDATA 조각은 줄 경계에서만 시작)
+    size_t ctrl_len;                // 부모가 보낸 내부 제어 줄 조각
+    char ctrl[256];
+} child_xfer_t;
+
+static void xfer_close(child_xfer_t *xs) {
+    if (xs->fifo_fd >= 0) {
+        close(xs->fifo_fd);
+    }
+    xs->fifo_fd = -1;
+    xs->id = 0;
+    xs->pending_len = 0;
+    xs->chunk_to_fifo = 0;
+}
+
+// 자식 -> 클라이언트 출력. 압축을 켜면 배치(루프 한 바퀴) 동안 보낼 바이트를 deflate 스트림에 넣고
+// 배치 끝에 Z_SYNC_FLUSH 로 Z 레코드를 보냄. 압축 창은 연결 동안 유지됨 (chat_compress.h 참고)
+typedef struct {
+    int requested;                  // 클라이언트가 COMPRESS_REQUEST 를 보냄 (줄 경계에서 켬)
+    int enabled;
+    z_stream zs;
+    size_t batch_plain;             // 이번 배치에서 deflate 에 넣고 아직 flush 하지 않은 평문 바이트
+    uint64_t plain_bytes;           // 누적 통계 (압축을 켠 뒤부터)
+    uint64_t wire_bytes;            // Z/R 레코드 헤더 포함 (R 레코드 본문은 제외)
+    uint64_t compress_ns;
+    uint64_t reported_plain, reported_wire, reported_ns; // 허브에 이미 보고한 값
+    uint64_t last_report_ns;
+    unsigned char out[COMPRESS_OUT_SIZE];
+} client_out_t;
+
+// XDATA:[전송번호]:[길이] 줄이면 조각 수신을 시작하고 1을 반환 (진행 중인 전송이 아니면 그 조각은 버림)
+static int xfer_begin_chunk(child_xfer_t *xs, const char *line) {
+    int id;
+    long long len;
+    if (strncmp(line, MSG_TYPE_XDATA ":", sizeof(MSG_TYPE_XDATA)) != 0 ||
+        sscanf(line + sizeof(MSG_TYPE_XDATA), "%d:%lld", &id, &len) != 2 || len < 0) {
+        return 0;
+    }
+    xs->chunk_to_fifo = (xs->id == id && xs->role == 'w' && xs->fifo_fd >= 0);
+    xs->in_remaining = len;
+    return 1;
+}
+
+// 클라이언트 -> 자식 수신 상태. chat_client.c 는 write 한 번에 메시지 하나를 '\n' 없이 보내지만,
+// 부하 생성기처럼 메시지를 '\n'으로 끝내는 클라이언트는 한 번의 read에 여러 메시지가 섞여 오거나
+// 메시지가 두 read로 나뉘어 올 수 있으므로, 처음 '\n'을 본 뒤부터는 줄 단위로 잘라 전달한다.
+// 줄 단위 모드에서 XDATA 헤더 줄이 오면 뒤따르는 바이트는 줄로 자르지 않고 파일 전송 쪽으로 넘긴다.
+typedef struct {
+    int line_mode;
+    size_t partial_len;
+    char partial[BUFFER_SIZE];      // 아직 '\n'이 오지 않은 줄 조각
+} client_rx_t;
+
+static void forward_client_bytes(client_rx_t *rx, child_xfer_t *xs, client_out_t *co, int fd, const char *data, size_t len, uint64_t recv_ns) {
+    if (!rx->line_mode && memchr(data, '\n', len) == NULL) {
+        send_frame_to_parent(fd, data, len, recv_ns, 0);
+        return;
+    }
+    rx->line_mode = 1;
+    while (len > 0) {
+        if (xs->in_remaining > 0) {
+            // 조각 본문: 진행 중인 전송이면 FIFO에 넣을 때까지 보관 (호출 전 pending 은 항상 비어 있음)
+            size_t take = (long long)len < xs->in_remaining ? len : (size_t)xs->in_remaining;
+            if (xs->chunk_to_fifo) {
+                memcpy(xs->pending + xs->pending_len, data, take);
+                xs->pending_len += take;
+            }
+            xs->in_remaining -= take;
+            data += take;
+            len -= take;
+            continue;
+        }
+        const char *nl = memchr(data, '\n', len);
+        size_t chunk = nl ? (size_t)(nl - data) : len;
+        size_t room = sizeof(rx->partial) - 1 - rx->partial_len;
+        size_t copy = chunk < room ? chunk : room; // 너무 긴 줄은 잘라냄
+        memcpy(rx->partial + rx->partial_len, data, copy);
+        rx->partial_len += copy;
+        if (nl == NULL) {
+            break;
+        }
+        if (rx->partial_len > 0) {
+            rx->partial[rx->partial_len] = '\0';
+            if (strcmp(rx->partial, COMPRESS_REQUEST) == 0) {
+                co->requested = 1; // 허브까지 가지 않고 자식이 처리
+            } else if (!xfer_begin_chunk(xs, rx->partial)) {
+                send_frame_to_parent(fd, rx->partial, rx->partial_len, recv_ns, 0);
+            }
+        }
+        rx->partial_len = 0;
+        data += chunk + 1;
+        len -= chunk + 1;
+    }
+}
+
+// 논블로킹 클라이언트 소켓에 끝까지 씀. 송신 버퍼가 차 있으면 잠시 기다림
+// (중간에 잘리면 뒤따르는 XDATA 조각이 줄 중간에 끼어들게 되므로)
+// -1 이면 일부만 쓰였을 수 있어 줄/레코드 경계가 깨졌으므로 호출자는 연결을 닫아야 함
+static int write_to_client(int fd, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n > 0) {
+            data += n;
+            len -= n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            struct pollfd pfd = { .fd = fd, .events = POLLOUT };
+            if (poll(&pfd, 1, CLIENT_WRITE_TIMEOUT_MS) > 0) {
+                continue;
+            }
+        }
+        return -1;
+    }
+    return 0;
+}
+
+// 압축 스트림에 data 를 넣고 (flush 가 Z_SYNC_FLUSH 이면 배치를 끝냄) 나온 만큼 Z 레코드로 보냄
+static int client_out_deflate(client_out_t *co, int fd, const char *data, size_t len, int flush) {
+    int ret = 0;
+    co->zs.next_in = (Bytef *)data;
+    co->zs.avail_in = (uInt)len;
+    do {
+        co->zs.next_out = co->out + COMPRESS_RECORD_HDR;
+        co->zs.avail_out = sizeof(co->out) - COMPRESS_RECORD_HDR;
+        uint64_t start_ns = monotonic_ns();
+        int zret = deflate(&co->zs, flush);
+        co->compress_ns += monotonic_ns() - start_ns;
+        if (zret == Z_STREAM_ERROR) {
+            ret = -1;
+            break;
+        }
+        size_t produced = sizeof(co->out) - COMPRESS_RECORD_HDR - co->zs.avail_out;
+        if (produced > 0) {
+            compress_put_record_hdr(co->out, COMPRESS_RECORD_DEFLATE, (uint32_t)produced);
+            co->wire_bytes += COMPRESS_RECORD_HDR + produced;
+            if (write_to_client(fd, (const char *)co->out, COMPRESS_RECORD_HDR + produced) < 0) {
+                ret = -1;
+                break;
+            }
+        }
+    } while (co->zs.avail_in > 0 || co->zs.avail_out == 0);
+    co->plain_bytes += len;
+    return ret;
+}
+
+// 클라이언트에게 보낼 바이트. 압축 중이면 배치에 넣기만 하고 실제 전송은 client_out_flush 에서
+static int client_out_send(client_out_t *co, int fd, const char *data, size_t len) {
+    if (!co->enabled) {
+        return write_to_client(fd, data, len);
+    }
+    co->batch_plain += len;
+    return client_out_deflate(co, fd, data, len, Z_NO_FLUSH);
+}
+
+// 배치 끝: 쌓인 압축 데이터를 클라이언트가 바로 풀 수 있도록 내보냄
+static int client_out_flush(client_out_t *co, int fd) {
+    if (!co->enabled || co->batch_plain == 0) {
+        return 0;
+    }
+    co->batch_plain = 0;
+    return client_out_deflate(co, fd, NULL, 0, Z_SYNC_FLUSH);
+}
+
+// 뒤따르는 len 바이트를 압축하지 않고 보낼 준비 (압축 중이면 배치를 끝내고 R 레코드 헤더를 씀)
+static int client_out_raw(client_out_t *co, int fd, size_t len) {
+    unsigned char hdr[COMPRESS_RECORD_HDR];
+    if (!co->enabled) {
+        return 0;
+    }
+    if (client_out_flush(co, fd) < 0) {
+        return -1;
+    }
+    compress_put_record_hdr(hdr, COMPRESS_RECORD_RAW, (uint32_t)len);
+    co->wire_bytes += sizeof(hdr);
+    return write_to_client(fd, (const char *)hdr, sizeof(hdr));
+}
+
+// 평문 COMPRESS_ACK 줄로 응답하고 압축을 켬. 줄 경계에서만 호출해야 함. 쓰기 실패 시 -1
+static int client_out_enable(client_out_t *co, int fd) {
+    co->requested = 0;
+    if (compress_deflate_init(&co->zs) != 0) {
+        LOG_ERROR("[자식 %d] deflate 초기화 실패. 압축 없이 계속합니다.", getpid());
+        deflateEnd(&co->zs);
+        return 0;
+    }
+    if (write_to_client(fd, COMPRESS_ACK "\n", sizeof(COMPRESS_ACK)) < 0) {
+        deflateEnd(&co->zs);
+        return -1;
+    }
+    co->enabled = 1;
+    co->last_report_ns = monotonic_ns();
+    LOG_DEBUG("[자식 %d] 클라이언트 %d 압축 사용 시작.", getpid(), fd);
+    return 0;
+}
+
+// 지난 보고 이후 증가분을 허브 지표로 보고 (force 가 아니면 COMPRESS_REPORT_MS 마다)
+static void client_out_report(client_out_t *co, int parent_fd, int force) {
+    char report[96];
+    uint64_t now = monotonic_ns();
+    if (!co->enabled || co->plain_bytes == co->reported_plain ||
+        (!force && now - co->last_report_ns < COMPRESS_REPORT_MS * 1000000ULL)) {
+        return;
+    }
+    snprintf(report, sizeof(report), MSG_TYPE_ZSTAT ":%llu:%llu:%llu",
+             (unsigned long long)(co->plain_bytes - co->reported_plain),
+             (unsigned long long)(co->wire_bytes - co->reported_wire),
+             (unsigned long long)(co->compress_ns - co->reported_ns));
+    send_frame_to_parent(parent_fd, report, strlen(report), now, PIPE_FRAME_INTERNAL);
+    co->reported_plain = co->plain_bytes;
+    co->reported_wire = co->wire_bytes;
+    co->reported_ns = co->compress_ns;
+    co->last_report_ns = now;
+}
+
+// 부모가 보낸 내부 제어 줄 처리
+//   XPIPE:[전송번호]:[w|r]:[크기]:[FIFO 경로]  전송 시작
+//   XCANCEL:[전송번호]                         전송 취소
+static void handle_xfer_control(child_xfer_t *xs, const char *line, int parent_fd) {
+    int id;
+    char role;
+    long long size;
+    char path[128];
+    char report[64];
+
+    if (sscanf(line, "XPIPE:%d:%c:%lld:%127[^\n]", &id, &role, &size, path) == 4) {
+        xfer_close(xs);
+        // 양쪽 모두 O_RDWR 로 열어서 상대가 아직 열지 않았어도 막히지 않음 (끝은 크기로 판단)
+        xs->fifo_fd = open(path, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+        if (xs->fifo_fd < 0) {
+            LOG_ERROR("[자식 %d] 파일 전송 FIFO 열기 실패: %s", getpid(), strerror(errno));
+            snprintf(report, sizeof(report), MSG_TYPE_XFER ":fail:%d:", id);
+            send_frame_to_parent(parent_fd, report, strlen(report), monotonic_ns(), PIPE_FRAME_INTERNAL);
+            return;
+        }
+        if (role == 'w') {
+            fcntl(xs->fifo_fd, F_SETPIPE_SZ, XFER_PIPE_SIZE); // 실패하면 기본 크기로 진행
+        }
+        xs->id = id;
+        xs->role = role;
+        xs->size = size;
+        xs->done = 0;
+        xs->out_remaining = 0;
+        if (role == 'w' && size == 0) {
+            xfer_close(xs); // 보낼 것이 없음
+        }
+    } else if (sscanf(line, "XCANCEL:%d", &id) == 1 && xs->id == id) {
+        xfer_close(xs); // 보내는 쪽은 이미 오고 있는 조각 본문을 in_remaining 만큼 읽어서 버림
+    }
+}
+
+// 부모 -> 자식 바이트: 내부 제어 줄은 처리만 하고, 나머지는 그대로 클라이언트에게. 쓰기 실패 시 -1
+static int forward_parent_bytes(child_xfer_t *xs, client_out_t *co, int client_fd, int parent_fd, const char *data, size_t len) {
+    while (len > 0) {
+        const char *nl = memchr(data, '\n', len);
+        if (xs->ctrl_len > 0 || (xs->at_line_start && data[0] == XFER_CTRL_MARK)) {
+            size_t chunk = nl ? (size_t)(nl - data) : len;
+            size_t room = sizeof(xs->ctrl) - 1 - xs->ctrl_len;
+            size_t copy = chunk < room ? chunk : room;
+            memcpy(xs->ctrl + xs->ctrl_len, data, copy);
+            xs->ctrl_len += copy;
+            if (nl == NULL) {
+                return 0; // 제어 줄의 나머지는 다음 read 에서
+            }
+            xs->ctrl[xs->ctrl_len] = '\0';
+            handle_xfer_control(xs, xs->ctrl + 1, parent_fd);
+            xs->ctrl_len = 0;
+            data += chunk + 1;
+            len -= chunk + 1;
+            continue;
+        }
+        size_t chunk = nl ? (size_t)(nl - data) + 1 : len;
+        if (client_out_send(co, client_fd, data, chunk) < 0) {
+            return -1;
+        }
+        xs->at_line_start = (nl != NULL);
+        data += chunk;
+        len -= chunk;
+    }
+    return 0;
+}
+
+// 보내는 쪽: 보관해 둔 바이트와 소켓에 남은 조각 본문을 FIFO로. 클라이언트 연결이 끊기면 -1
+static int xfer_pump_from_client(child_xfer_t *xs, int client_fd) {
+    if (xs->pending_len > 0) {
+        ssize_t n = write(xs->fifo_fd, xs->pending, xs->pending_len);
+        if (n < 0) {
+            return 0; // FIFO가 가득 참 (받는 쪽이 느림)
+        }
+        memmove(xs->pending, xs->pending + n, xs->pending_len - n);
+        xs->pending_len -= n;
+        xs->done += n;
+    }
+    if (xs->pending_len == 0 && xs->in_remaining > 0) {
+        size_t want = xs->in_remaining < XFER_SPLICE_MAX ? (size_t)xs->in_remaining : XFER_SPLICE_MAX;
+        ssize_t n;
+        if (xs->chunk_to_fifo) {
+            n = splice(client_fd, NULL, xs->fifo_fd, NULL, want, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        } else {
+            char discard[BUFFER_SIZE]; // 취소된 전송의 남은 조각
+            n = read(client_fd, discard, want < sizeof(discard) ? want : sizeof(discard));
+        }
+        if (n == 0) {
+            return -1;
+        }
+        if (n < 0) {
+            return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? 0 : -1;
+        }
+        xs->in_remaining -= n;
+        if (xs->chunk_to_fifo) {
+            xs->done += n;
+        }
+    }
+    if (xs->id != 0 && xs->role == 'w' && xs->done >= xs->size && xs->pending_len == 0 && xs->in_remaining == 0) {
+        xfer_close(xs); // 다 넣었음. 남은 데이터는 받는 쪽이 연 FIFO에 그대로 남아 있음
+    }
+    return 0;
+}
+
+// 받는 쪽: FIFO에 쌓인 만큼 XDATA 조각으로 만들어 클라이언트에게 splice.
+// 헤더를 다 못 썼거나 소켓 오류면 -1 (조각 경계가 깨졌으므로 연결을 닫아야 함)
+static int xfer_pump_to_client(child_xfer_t *xs, client_out_t *co, int client_fd, int parent_fd) {
+    if (xs->out_remaining == 0 && xs->at_line_start && xs->done < xs->size) {
+        int avail = 0;
+        struct pollfd pfd = { .fd = client_fd, .events = POLLOUT };
+        if (ioctl(xs->fifo_fd, FIONREAD, &avail) == 0 && avail > 0 && poll(&pfd, 1, 0) > 0) {
+            char header[64];
+            long long len = avail < xs->size - xs->done ? avail : xs->size - xs->done;
+            int header_len = snprintf(header, sizeof(header), MSG_TYPE_XDATA ":%d:%lld\n", xs->id, len);
+            // 압축 중이면 헤더 줄은 Z 레코드로, 조각 본문은 R 레코드로 (본문은 그대로 splice)
+            if (client_out_send(co, client_fd, header, header_len) < 0 || client_out_raw(co, client_fd, len) < 0) {
+                return -1;
+            }
+            xs->out_remaining = len;
+        }
+    }
+    if (xs->out_remaining > 0) {
+        size_t want = xs->out_remaining < XFER_SPLICE_MAX ? (size_t)xs->out_remaining : XFER_SPLICE_MAX;
+        ssize_t n = splice(xs->fifo_fd, NULL, client_fd, NULL, want, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (n > 0) {
+            xs->out_remaining -= n;
+            xs->done += n;
+        } else if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+            return -1;
+        }
+    }
+    if (xs->out_remaining == 0 && xs->done >= xs->size) {
+        char report[64];
+        snprintf(report, sizeof(report), MSG_TYPE_XFER ":done:%d:", xs->id);
+        send_frame_to_parent(parent_fd, report, strlen(report), monotonic_ns(), PIPE_FRAME_INTERNAL);
+        xfer_close(xs);
+    }
+    return 0;
+}
+
+void handle_client_child_process(int client_fd, int parent_to_child_read_fd, int child_to_parent_write_fd) {
+    char buffer[BUFFER_SIZE];
+    ssize_t bytes_read;
+    client_rx_t rx = { 0 };
+    child_xfer_t xs = { .fifo_fd = -1, .at_line_start = 1 };
+    static client_out_t co; // 압축 출력 버퍼가 크므로 스택 대신 (자식마다 한 번만 씀)
+    int write_failed = 0;   // 클라이언트에게 쓰다 실패함: 줄/레코드 경계가 깨졌으므로 더 쓰지 않고 닫음
+
+    // 클라이언트 소켓과 부모로부터의 파이프를 논블로킹으로 설정
+    set_nonblocking(client_fd);
+    set_nonblocking(parent_to_child_read_fd);
+    // 작은 응답이 Nagle 알고리즘 때문에 클라이언트의 지연 ACK(~40ms)를 기다리지 않도록
+    int nodelay = 1;
+    setsockopt(client_fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
+    LOG_DEBUG("[자식 %d] 클라이언트 핸들링 시작. FD: %d, 부모->자식 파이프 읽기 FD: %d, 자식->부모 파이프 쓰기 FD: %d", getpid(), client_fd, parent_to_child_read_fd, child_to_parent_write_fd);
+
+    // 파이프의 다른 끝은 허브만 가지고 있음 (생성기가 이 두 끝과 소켓만 넘겨받아 fork 함)
+
+    while (1) {
+        // 1. 클라이언트로부터 메시지 수신 시도 (파일 조각 본문을 받는 중이면 FIFO로 splice)
+        if (xs.pending_len > 0 || xs.in_remaining > 0) {
+            if (xfer_pump_from_client(&xs, client_fd) < 0) {
+                LOG_INFO("[자식 %d] 파일 전송 중 클라이언트 %d 연결 종료.", getpid(), client_fd);
+                break;
+            }
+        } else {
+            bytes_read = read(client_fd, buffer, sizeof(buffer) - 1);
+            if (bytes_read > 0) {
+                // 클라이언트 메시지를 수신 시각과 함께 프레임으로 부모에게 전달
+                forward_client_bytes(&rx, &xs, &co, child_to_parent_write_fd, buffer, bytes_read, monotonic_ns());
+            } else if (bytes_read == 0) {
+                LOG_INFO("[자식 %d] 클라이언트 %d 연결 종료.", getpid(), client_fd);
+                break; // 클라이언트 연결 종료
+            } else if (bytes_read == -1 && (errno != EAGAIN && errno != EWOULDBLOCK)) {
+                LOG_ERROR("[자식 %d] 클라이언트 read 에러: %s", getpid(), strerror(errno));
+                break;
+            }
+        }
+
+        // 2. 받는 쪽 파일 전송: FIFO -> 클라이언트
+        if (xs.id != 0 && xs.role == 'r' && xfer_pump_to_client(&xs, &co, client_fd, child_to_parent_write_fd) < 0) {
+            write_failed = 1;
+            break;
+        }
+
+        // 3. 부모 프로세스로부터 메시지 수신 시도 (XDATA 조각을 보내는 중에는 끼어들지 않도록 미룸)
+        if (xs.out_remaining == 0) {
+            bytes_read = read(parent_to_child_read_fd, buffer, sizeof(buffer) - 1);
+            if (bytes_read > 0) {
+                // 부모로부터 받은 메시지를 클라이언트에게 직접 전송 (내부 제어 줄은 제외)
+                if (forward_parent_bytes(&xs, &co, client_fd, child_to_parent_write_fd, buffer, bytes_read) < 0) {
+                    write_failed = 1;
+                    break;
+                }
+            } else if (bytes_read == -1 && (errno != EAGAIN && errno != EWOULDBLOCK)) {
+                LOG_ERROR("[자식 %d] 부모 파이프 read 에러: %s", getpid(), strerror(errno));
+                break;
+            }
+        }
+
+        // 4. 압축: 이번 배치를 내보내고, 요청이 왔으면 줄 경계에서 켬
+        if (client_out_flush(&co, client_fd) < 0) {
+            write_failed = 1;
+            break;
+        }
+        if (co.requested && xs.at_line_start && xs.out_remaining == 0) {
+            if (co.enabled) {
+                co.requested = 0; // 이미 켜져 있음
+            } else if (client_out_enable(&co, client_fd) < 0) {
+                write_failed = 1;
+                break;
+            }
+        }
+        client_out_report(&co, child_to_parent_write_fd, 0);
+        if (xs.pending_len == 0 && xs.in_remaining == 0 && xs.out_remaining == 0) {
+            usleep(100); // CPU 과부하 방지를 위해 잠시 대기 (100 마이크로초). XDATA 조각을 옮기는 중에는 쉬지 않음
+        }
+    }
+
+    if (write_failed) {
+        LOG_INFO("[자식 %d] 클라이언트 %d 에게 보내지 못해 (끊김 또는 %dms 동안 받지 않음) 연결을 닫습니다.",
+                 getpid(), client_fd, CLIENT_WRITE_TIMEOUT_MS);
+    }
+    xfer_close(&xs);
+    if (co.enabled) {
+        if (!write_failed) {
+            client_out_flush(&co, client_fd);
+        }
+        client_out_report(&co, child_to_parent_write_fd, 1);
+        LOG_INFO("[자식 %d] 압축 통계: 평문 %llu 바이트 -> %llu 바이트 (%.1f%%), deflate %.3f ms", getpid(),
+                 (unsigned long long)co.plain_bytes, (unsigned long long)co.wire_bytes,
+                 co.plain_bytes ? 100.0 * co.wire_bytes / co.plain_bytes : 0.0, co.compress_ns / 1e6);
+        deflateEnd(&co.zs);
+    }
+    close(client_fd);
+    close(parent_to_child_read_fd);
+    close(child_to_parent_write_fd);
+    LOG_DEBUG("[자식 %d] 핸들링 종료, 프로세스 종료.", getpid());
+    exit(EXIT_SUCCESS);
+}
+
+// ===========================================
+// 방 샤딩 감독 프로세스 (CHAT_SHARDS > 1)
+// 허브 하나가 모든 방의 메시지를 한 select 루프에서 처리하면 붐비는 방이 다른 방까지 밀어내므로,
+// 허브를 샤드 프로세스 여러 개로 나누고 방마다 해시로 주인 샤드를 정한다. 샤드끼리는 서버 간 연합을
+// 루프백 링크로 그대로 씀 (방 주인 = 홈 노드). 클라이언트 포트는 샤드마다 SO_REUSEPORT 로 열어
+// 커널이 연결을 샤드에 나눠 주고, 귓속말과 닉네임 중복 확인은 공유 메모리 닉네임 디렉터리로 샤드를 넘나듦.
+// 감독 프로세스는 샤드를 fork 한 뒤 기다리기만 하고, 샤드가 죽으면 그 샤드의 닉네임을 비우고 다시 띄움.
+// 샤드 프로세스에서만 샤드 번호를 들고 돌아옴.
+// ===========================================
+static volatile sig_atomic_t supervisor_stop = 0;
+
+static void supervisor_signal_handler(int signo) {
+    (void)signo;
+    supervisor_stop = 1;
+}
+
+int run_shard_supervisor(int shards) {
+    pid_t shard_pids[FED_MAX_NODES] = { 0 };
+    char shard_dir[sizeof(xfer_dir)];
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = supervisor_signal_handler; // SA_RESTART 없이: waitpid 를 깨워 종료 플래그를 보게 함
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGTERM, &sa, 0);
+    sigaction(SIGINT, &sa, 0);
+
+    // 파일 전송 FIFO 의 상위 디렉터리. 샤드는 이 아래 shard<번호> 를 쓰고, 감독이 끝날 때 통째로 지움
+    snprintf(xfer_base_dir, sizeof(xfer_base_dir), "/tmp/chat2_xfer.XXXXXX");
+    if (mkdtemp(xfer_base_dir) == NULL) {
+        LOG_WARN("[감독] 파일 전송 디렉터리 생성 실패: %s", strerror(errno));
+        xfer_base_dir[0] = '\0'; // 샤드마다 따로 만듦
+    }
+
+    while (!supervisor_stop) {
+        for (int i = 0; i < shards; i++) {
+            if (shard_pids[i] != 0) {
+                continue;
+            }
+            pid_t pid = fork();
+            if (pid == 0) {
+                signal(SIGTERM, SIG_DFL);
+                signal(SIGINT, SIG_DFL);
+                return i;
+            }
+            if (pid < 0) {
+                LOG_ERROR("[감독] 샤드 %d fork 실패: %s", i, strerror(errno));
+            } else {
+                shard_pids[i] = pid;
+                LOG_INFO("[감독] 샤드 %d 시작 (PID %d).", i, pid);
+            }
+        }
+
+        int status;
+        pid_t pid = waitpid(-1, &status, 0);
+        if (pid < 0) {
+            if (errno != EINTR) {
+                sleep(SHARD_RESTART_SEC); // 모든 fork 가 실패함 (ECHILD): 잠시 뒤 다시 시도
+            }
+            continue;
+        }
+        for (int i = 0; i < shards; i++) {
+            if (shard_pids[i] == pid) {
+                shard_pids[i] = 0;
+                nick_dir_release_shard(nick_dir, i);
+                if (xfer_base_dir[0] != '\0') {
+                    // 죽은 샤드가 남긴 FIFO 를 지움 (SIGKILL 등으로 스스로 정리하지 못함)
+                    snprintf(shard_dir, sizeof(shard_dir), "%s/shard%d", xfer_base_dir, i);
+                    remove_dir_entries(shard_dir, 1);
+                }
+                LOG_WARN("[감독] 샤드 %d(PID %d)가 종료되었습니다 (상태 0x%x). %d초 뒤 다시 시작합니다.",
+                         i, pid, status, SHARD_RESTART_SEC);
+                sleep(SHARD_RESTART_SEC);
+            }
+        }
+    }
+
+    for (int i = 0; i < shards; i++) {
+        if (shard_pids[i] != 0) {
+            kill(shard_pids[i], SIGTERM);
+        }
+    }
+    while (waitpid(-1, NULL, 0) > 0 || errno == EINTR) {
+    }
+    if (xfer_base_dir[0] != '\0') {
+        for (int i = 0; i < shards; i++) {
+            snprintf(shard_dir, sizeof(shard_dir), "%s/shard%d", xfer_base_dir, i);
+            remove_dir_entries(shard_dir, 1);
+        }
+        rmdir(xfer_base_dir);
+    }
+    LOG_INFO("[감독] 샤드를 모두 종료했습니다.");
+    exit(EXIT_SUCCESS);
+}
+
+// ===========================================
+// 메인 함수
+// ===========================================
+int main() {
+    log_init();  // 설정 오류가 터미널에 보이고 상대 경로 CHAT_LOG_FILE 이 chdir("/") 전에 열리도록 먼저 호출
+    daemonize(); // 서버를 데몬 프로세스로 동작
+    log_disable_if_devnull(); // CHAT_LOG_FILE 이 없으면 이제 /dev/null 이므로 로그를 끔
+
+    // 한 호스트에서 여러 인스턴스(연합 노드)를 띄울 수 있도록 포트는 환경 변수로 바꿀 수 있음
+    int port = env_int("CHAT_PORT", PORT, 1, 65535);
+    int metrics_port = env_int("CHAT_METRICS_PORT", METRICS_PORT, 1, 65535);
+    const char *peers = getenv("CHAT_PEERS");
+    int node_id = -1; // CHAT_NODE_ID 에서 읽음
+
+    // 방 샤딩: 여기서 감독 프로세스가 샤드를 띄우고, 아래는 샤드마다 실행됨
+    int shards = env_int("CHAT_SHARDS", 1, 1, FED_MAX_NODES);
+    static char shard_peers[FED_MAX_NODES * 24];
+    if (shards > 1) {
+        if (peers != NULL && *peers != '\0') {
+            LOG_ERROR("[서버] CHAT_SHARDS 와 CHAT_PEERS 는 함께 쓸 수 없습니다.");
+            exit(EXIT_FAILURE);
+        }
+        int link_port = env_int("CHAT_SHARD_PORT", SHARD_LINK_PORT, 1, 65535 - FED_MAX_NODES);
+        size_t len = 0;
+        for (int i = 0; i < shards; i++) {
+            len += snprintf(shard_peers + len, sizeof(shard_peers) - len, "%s127.0.0.1:%d", i ? "," : "", link_port + i);
+        }
+        nick_dir = nick_dir_create(MAX_CLIENTS * shards); // fork 전에 만들어야 모든 샤드가 공유
+        if (nick_dir == NULL) {
+            LOG_ERROR("[서버] 닉네임 디렉터리 생성 실패: %s", strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        node_id = run_shard_supervisor(shards);
+        peers = shard_peers;
+        metrics_port += node_id;
+    }
+    int server_socket;
+    struct sockaddr_in server_addr;
+
+    // 1. 소켓 생성
+    server_socket = socket(AF_INET, SOCK_STREAM, 0);
+    if (server_socket == -1) {
+        LOG_ERROR("[서버] 서버 소켓 생성 실패: %s", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    // SO_REUSEADDR 옵션 설정 (서버 재시작 시 바인딩 에러 방지)
+    int opt = 1;
+    if (setsockopt(server_socket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
+        LOG_ERROR("[서버] setsockopt SO_REUSEADDR 실패: %s", strerror(errno));
+        close(server_socket);
+        exit(EXIT_FAILURE);
+    }
+    // 방 샤딩: 샤드마다 같은 포트에 리스닝 소켓을 열고 커널이 새 연결을 샤드들에 나눠 줌
+    if (shards > 1 && setsockopt(server_socket, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0) {
+        LOG_ERROR("[서버] setsockopt SO_REUSEPORT 실패: %s", strerror(errno));
+        close(server_socket);
+        exit(EXIT_FAILURE);
+    }
+
+    // 서버 주소 구조체 초기화
+    memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_addr.s_addr = INADDR_ANY; // 모든 IP 주소로부터의 연결 허용
+    server_addr.sin_port = htons(port);       // 포트 번호 설정
+
+    // 2. 소켓에 주소 바인딩
+    if (bind(server_socket, (struct sockaddr *)&server_addr, sizeof(server_addr)) == -1) {
+        LOG_ERROR("[서버] 소켓 바인딩 실패: %s", strerror(errno));
+        close(server_socket);
+        exit(EXIT_FAILURE);
+    }
+
+    // 3. 연결 대기: 재접속이 몰릴 때 SYN이 버려지지 않도록 대기열을 넉넉히 잡고,
+    //    리스닝 소켓을 논블로킹으로 두어 select가 깨울 때마다 쌓인 연결을 한꺼번에 accept
+    int backlog = listen_backlog_from_env();
+    if (listen(server_socket, backlog) == -1) {
+        LOG_ERROR("[서버] 연결 대기 실패: %s", strerror(errno));
+        close(server_socket);
+        exit(EXIT_FAILURE);
+    }
+    set_nonblocking(server_socket);
+    LOG_INFO("[서버] 연결 대기열 길이: %d", backlog);
+
+    // SIGCHLD 시그널 핸들러 설정 (허브의 자식인 생성기가 죽은 것을 알아채기 위해)
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = sigchld_handler;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_RESTART | SA_NOCLDSTOP; // SA_NOCLDSTOP: 자식이 중지될 때 SIGCHLD 생성 안 함
+    if (sigaction(SIGCHLD, &sa, 0) == -1) {
+        LOG_ERROR("[서버] sigaction 실패: %s", strerror(errno));
+        close(server_socket);
+        exit(EXIT_FAILURE);
+    }
+
+    // SIGUSR1: 메시지 지연 시간 백분위 요약을 로그로 남김 (kill -USR1 <서버 PID>)
+    sa.sa_handler = sigusr1_handler;
+    sa.sa_flags = SA_RESTART;
+    if (sigaction(SIGUSR1, &sa, 0) == -1) {
+        LOG_ERROR("[서버] sigaction 실패: %s", strerror(errno));
+        close(server_socket);
+        exit(EXIT_FAILURE);
+    }
+
+    // SIGTERM/SIGINT: 메인 루프를 빠져나와 정리한 뒤 종료 (SA_RESTART 없이: select 를 깨움)
+    sa.sa_handler = hub_stop_handler;
+    sa.sa_flags = 0;
+    sigaction(SIGTERM, &sa, 0);
+    sigaction(SIGINT, &sa, 0);
+
+    // 허브는 막 끊긴 자식의 파이프나 거절하는 클라이언트 소켓에 쓸 수 있음 (재접속 폭주 때 흔함).
+    // SIGPIPE 기본 동작은 허브 전체를 죽이므로 무시하고 write 의 EPIPE 로 처리 (자식은 fork 후 기본값으로 되돌림)
+    signal(SIGPIPE, SIG_IGN);
+
+    // 메시지 타입/명령어 디스패치 테이블 생성
+    if (init_dispatch_tables() != 0) {
+        LOG_ERROR("[서버] 명령어 해시 테이블 생성 실패.");
+        exit(EXIT_FAILURE);
+    }
+    if (init_metrics() != 0) {
+        LOG_ERROR("[서버] 지표 등록 실패.");
+        exit(EXIT_FAILURE);
+    }
+
+    // 파일 전송은 없어도 채팅은 동작하므로 실패해도 계속 진행 (/sendfile 만 거절됨)
+    if (init_file_transfer(node_id) != 0) {
+        LOG_WARN("[서버] 파일 전송 디렉터리 생성 실패: %s", strerror(errno));
+    }
+
+    init_rate_limits();
+    init_heartbeats();
+    if (init_federation(peers, node_id) != 0) { // 방마다 홈 노드를 정하므로 첫 방을 만들기 전에
+        exit(EXIT_FAILURE);
+    }
+
+    // 초기 채팅방 'general' 생성
+    if (add_room("general") != 0) {
+        LOG_ERROR("[서버] 'general' 방 생성에 실패했습니다.");
+        exit(EXIT_FAILURE);
+    }
+
+    // 클라이언트 자식을 fork 할 생성기는 스레드(명령 풀, 지표 엔드포인트)를 만들기 전에 띄움
+    if (spawner_start(server_socket) != 0) {
+        LOG_ERROR("[서버] 클라이언트 프로세스 생성기 시작 실패: %s", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    // 읽기 전용 명령용 스레드 풀 시작 (daemonize 이후에 만들어야 스레드가 살아남음)
+    // 워커는 응답을 큐에 넣고 깨우기 파이프로 라우터를 깨움. 파이프가 없으면 풀 없이 라우터에서 처리
+    mpsc_queue_init(&worker_replies);
+    if (pipe2(worker_wake_pipe, O_NONBLOCK) != 0) {
+        LOG_WARN("[서버] 워커 깨우기 파이프 생성 실패: %s", strerror(errno));
+        worker_wake_pipe[0] = worker_wake_pipe[1] = -1;
+    } else if (ws_pool_init(&command_pool, COMMAND_WORKERS) == 0) {
+        command_pool_ready = 1;
+    } else {
+        LOG_WARN("[서버] 명령 처리 스레드 풀 생성 실패. 라우터에서 직접 처리합니다.");
+    }
+
+    // 지표 엔드포인트는 없어도 채팅은 동작하므로 실패해도 계속 진행
+    if (metrics_serve_start(metrics_port) != 0) {
+        LOG_WARN("[서버] 지표 엔드포인트(127.0.0.1:%d) 시작 실패: %s", metrics_port, strerror(errno));
+    }
+
+    LOG_INFO("[서버] 채팅 서버가 %d 포트에서 대기 중입니다...", port);
+
+    parent_main_loop(server_socket); // 부모 프로세스의 메인 루프 시작 (SIGTERM/SIGINT 를 받으면 돌아옴)
+
+    // 클라이언트 자식들도 끝냄 (허브가 없으면 채팅이 전달되지 않으므로 연결을 끊어 재접속하게 함)
+    for (int i = 0; i < client_count; i++) {
+        kill(clients[i].pid, SIGTERM);
+    }
+    cleanup_file_transfer();
+    if (command_pool_ready) {
+        ws_pool_shutdown(&command_pool);
+    }
+    if (spawner_fd >= 0) {
+        close(spawner_fd); // 생성기는 소켓이 닫히면 끝남
+    }
+    close(server_socket);
+    LOG_INFO("[서버] 서버 종료.");
+    return spawner_lost ? EXIT_FAILURE : 0;
+}
+
+// ===========================================
+// 클라이언트별 전송 한도 (허브가 방 전체로 퍼뜨리기 전에 확인)
+// 한 클라이언트가 큰 파일을 붙여 넣으면 그 CHAT 들이 broadcast_message_in_room 을 독차지해서
+// 다른 방의 메시지까지 밀리므로, CHAT/WHISPER 는 메시지 수와 바이트 수 버킷을 모두 통과해야 처리함.
+// 모자라면 held_buf 에 붙잡아 두었다가 버킷이 차면 도착 순서대로 처리하고 (지연),
+// held_buf 가 가득 찼거나 RATE_MAX_DELAY_MS 보다 오래 기다려야 하면 버리고 안내를 보냄 (거절).
+// 명령(CMD), 하트비트 답(PONG), 자식 내부 보고(XFER, ZSTAT)는 퍼지지 않으므로 한도를 적용하지 않지만, 붙잡아 둔
+// 프레임이 있는 동안에는 클라이언트가 보낸 순서를 지키기 위해 함께 뒤에 붙여 두었다가 차례가 오면
+// 토큰 없이 처리함. 명령은 버릴 수 없으므로 held_buf 에 자리가 없으면 붙잡아 둔 CHAT/WHISPER 를
+// 거절하고 명령들은 순서대로 바로 처리함.
+// ===========================================
+void init_rate_limits(void) {
+    rate_msgs = env_int("CHAT_RATE_MSGS", RATE_MSGS, 0, TOKEN_BUCKET_MAX);
+    rate_msgs_burst = env_int("CHAT_RATE_MSGS_BURST", RATE_MSGS_BURST, 1, TOKEN_BUCKET_MAX);
+    rate_bytes = env_int("CHAT_RATE_BYTES", RATE_BYTES, 0, TOKEN_BUCKET_MAX);
+    rate_bytes_burst = env_int("CHAT_RATE_BYTES_BURST", RATE_BYTES_BURST, 1, TOKEN_BUCKET_MAX);
+    LOG_INFO("[서버] 클라이언트당 전송 한도: 초당 %u개(최대 %u개 몰아서), 초당 %u바이트(최대 %u바이트 몰아서) (0=제한 없음)",
+             rate_msgs, rate_msgs_burst, rate_bytes, rate_bytes_burst);
+}
+
+// 자식만 보낼 수 있는 보고 (PIPE_FRAME_INTERNAL 없이 오면 클라이언트가 보낸 줄이므로 버림)
+static int is_internal_report_type(const char *message) {
+    return strncmp(message, MSG_TYPE_ZSTAT ":", sizeof(MSG_TYPE_ZSTAT)) == 0 ||
+           strncmp(message, MSG_TYPE_XFER ":", sizeof(MSG_TYPE_XFER)) == 0;
+}
+
+static int is_rate_limited_type(const char *message) {
+    return strncmp(message, MSG_TYPE_CHAT ":", sizeof(MSG_TYPE_CHAT)) == 0 ||
+           strncmp(message, MSG_TYPE_WHISPER ":", sizeof(MSG_TYPE_WHISPER)) == 0;
+}
+
+// 두 버킷에서 len 바이트짜리 메시지 하나를 꺼낼 수 있으면 꺼내고 0, 아니면 기다릴 ms
+static uint64_t rate_limit_admit(client_info_t *c, size_t len, uint64_t now_ms) {
+    uint64_t wait_msgs = token_bucket_wait_ms(&c->msg_bucket, 1, now_ms);
+    uint64_t wait_bytes = token_bucket_wait_ms(&c->byte_bucket, (uint32_t)len, now_ms);
+    uint64_t wait = wait_msgs > wait_bytes ? wait_msgs : wait_bytes;
+    if (wait == 0) {
+        token_bucket_take(&c->msg_bucket, 1);
+        token_bucket_take(&c->byte_bucket, (uint32_t)len);
+    }
+    return wait;
+}
+
+static void rate_limit_reject(client_info_t *c) {
+    metrics_inc(metric_rate_rejected);
+    if (c->limit_notice_sent) {
+        return; // 한도를 넘는 동안 안내는 한 번만
+    }
+    c->limit_notice_sent = 1;
+    LOG_RATELIMITED(LOG_LEVEL_WARN, 1000, "[서버] 클라이언트 %s(%d)가 전송 한도를 넘어 메시지를 거절합니다.", c->nickname, c->pid);
+    char notice[256];
+    snprintf(notice, sizeof(notice), "[%s][서버] 메시지를 너무 빨리 보내고 있어 일부를 보내지 못했습니다. (한도: 초당 %u개, %u바이트)\n",
+             get_current_time_str(), rate_msgs, rate_bytes);
+    send_message_to_client_by_pid(c->pid, notice);
+}
+
+static client_info_t *find_client_by_pipe(int pipe_read_fd) {
+    for (int i = 0; i < client_count; i++) {
+        if (clients[i].pipe_read_fd == pipe_read_fd) {
+            return &clients[i];
+        }
+    }
+    return NULL;
+}
+
+static void hold_frame(client_info_t *c, const pipe_frame_hdr_t *hdr, const char *message, size_t len) {
+    memcpy(c->held_buf + c->held_len, hdr, sizeof(*hdr));
+    memcpy(c->held_buf + c->held_len + sizeof(*hdr), message, len);
+    ((pipe_frame_hdr_t *)(c->held_buf + c->held_len))->len = (uint32_t)len; // 잘린 길이로 저장
+    c->held_len += sizeof(*hdr) + len;
+}
+
+// 붙잡아 둔 프레임을 앞에서부터 처리. admit 이면 CHAT/WHISPER 는 버킷이 허락하는 만큼만 처리하고
+// 모자라면 멈춤 (기다릴 ms 를 반환), 아니면 CHAT/WHISPER 는 거절하고 나머지는 모두 처리.
+// 처리하면서 clients[] 가 당겨질 수 있으므로 FD로 다시 찾고, 클라이언트가 없어졌으면 0
+static uint64_t run_held_frames(int pipe_read_fd, int admit, uint64_t now_ms) {
+    char message[BUFFER_SIZE];
+    client_info_t *c = find_client_by_pipe(pipe_read_fd);
+    size_t off = 0;
+    uint64_t wait = 0;
+    while (c != NULL && off < c->held_len) {
+        pipe_frame_hdr_t hdr;
+        memcpy(&hdr, c->held_buf + off, sizeof(hdr));
+        memcpy(message, c->held_buf + off + sizeof(hdr), hdr.len);
+        message[hdr.len] = '\0';
+        int limited = is_rate_limited_type(message);
+        if (limited && admit) {
+            wait = rate_limit_admit(c, hdr.len, now_ms);
+            if (wait != 0) {
+                break;
+            }
+        }
+        off += sizeof(hdr) + hdr.len;
+        if (limited && !admit) {
+            rate_limit_reject(c);
+            continue;
+        }
+        process_message_from_child(message, pipe_read_fd, hdr.recv_ns);
+        c = find_client_by_pipe(pipe_read_fd);
+    }
+    if (c != NULL) {
+        memmove(c->held_buf, c->held_buf + off, c->held_len - off);
+        c->held_len -= off;
+        c->held_until_ms = now_ms + wait;
+    }
+    return wait;
+}
+
+// 자식이 보낸 프레임 하나를 지금 처리해도 되는지. 1이면 처리, 0이면 붙잡았거나 거절함
+static int rate_limit_frame(client_info_t *c, const pipe_frame_hdr_t *hdr, const char *message, size_t len) {
+    int limited = is_rate_limited_type(message);
+    if (c->held_len == 0) {
+        if (!limited) {
+            return 1;
+        }
+        uint64_t now_ms = rate_limit_now_ms();
+        uint64_t wait = rate_limit_admit(c, len, now_ms);
+        if (wait == 0) {
+            c->limit_notice_sent = 0;
+            return 1;
+        }
+        if (wait > RATE_MAX_DELAY_MS || sizeof(*hdr) + len > sizeof(c->held_buf)) {
+            rate_limit_reject(c);
+            return 0;
+        }
+        c->held_until_ms = now_ms + wait;
+        hold_frame(c, hdr, message, len);
+        metrics_inc(metric_rate_delayed);
+        return 0;
+    }
+    // 붙잡아 둔 것이 있으면 종류와 상관없이 순서를 지키기 위해 뒤에 붙임
+    if (c->held_len + sizeof(*hdr) + len > sizeof(c->held_buf)) {
+        if (limited) {
+            rate_limit_reject(c);
+            return 0;
+        }
+        run_held_frames(c->pipe_read_fd, 0, rate_limit_now_ms()); // 명령은 버리지 않음
+        return 1;
+    }
+    hold_frame(c, hdr, message, len);
+    if (limited) {
+        metrics_inc(metric_rate_delayed);
+    }
+    return 0;
+}
+
+// 시간이 된 클라이언트의 붙잡아 둔 프레임을 버킷이 허락하는 만큼 처리
+static void release_held_frames(uint64_t now_ms) {
+    for (int i = 0; i < client_count; i++) {
+        if (clients[i].held_len != 0 && now_ms >= clients[i].held_until_ms) {
+            run_held_frames(clients[i].pipe_read_fd, 1, now_ms);
+        }
+    }
+}
+
+// select 타임아웃: 붙잡아 둔 프레임을 다시 시도할 가장 이른 시각까지 (없으면 max_ms)
+static int rate_limit_timeout_ms(uint64_t now_ms, int max_ms) {
+    int timeout = max_ms;
+    for (int i = 0; i < client_count; i++) {
+        if (clients[i].held_len == 0) continue;
+        uint64_t left = clients[i].held_until_ms > now_ms ? clients[i].held_until_ms - now_ms : 0;
+        if (left < (uint64_t)timeout) timeout = (int)left;
+    }
+    return timeout;
+}
+
+// ===========================================
+// 유휴 타임아웃 / 하트비트
+// 반쯤 열린 TCP 연결(클라이언트 쪽이 사라졌는데 FIN/RST 가 오지 않은 경우)은 자식이 read 에서
+// 아무것도 받지 못할 뿐이라 자식, 파이프, clients[] 칸이 영원히 남는다. 그래서 허브가 연결마다
+// 타이머 하나를 타이밍 휠(hub_timers)에 두고:
+// - idle_timeout_ms 동안 클라이언트가 보낸 것이 없으면 PING 이벤트를 보내고 ping_timeout_ms 를 기다림
+// - 그 안에 무엇이든(PONG 포함) 오면 다시 유휴 대기, 오지 않으면 자식을 SIGTERM 으로 종료
+//   (생성기가 회수해 SPAWN_EXITED 로 알려 오면 세션은 재접속 대기로 남음)
+// 메시지가 올 때마다 타이머를 옮기지 않고 last_rx_ms 만 적어 두었다가, 타이머가 만료될 때
+// 그 사이에 활동이 있었으면 남은 시간만큼 다시 거는 방식이라 메시지 경로의 비용은 대입 한 번.
+// ===========================================
+void init_heartbeats(void) {
+    idle_timeout_ms = env_int("CHAT_IDLE_SEC", IDLE_TIMEOUT_SEC, 0, 86400) * 1000ULL;
+    ping_timeout_ms = env_int("CHAT_PING_TIMEOUT_SEC", PING_TIMEOUT_SEC, 1, 3600) * 1000ULL;
+    tw_init(&hub_timers, TIMER_TICK_MS, rate_limit_now_ms());
+    if (idle_timeout_ms == 0) {
+        LOG_INFO("[서버] 하트비트를 사용하지 않습니다 (CHAT_IDLE_SEC=0).");
+    } else {
+        LOG_INFO("[서버] 하트비트: %llu초 동안 조용하면 PING, %llu초 안에 답이 없으면 연결 종료",
+                 (unsigned long long)(idle_timeout_ms / 1000), (unsigned long long)(ping_timeout_ms / 1000));
+    }
+}
+
+static void heartbeat_expired(tw_timer_t *t) {
+    heartbeat_t *hb = tw_container_of(t, heartbeat_t, timer);
+    uint64_t now_ms = rate_limit_now_ms();
+
+    if (hb->ping_sent_ms != 0) {
+        if (hb->last_rx_ms >= hb->ping_sent_ms) {
+            hb->ping_sent_ms = 0; // 답(또는 다른 메시지)이 왔음: 다시 유휴 대기
+        } else {
+            LOG_WARN("[서버] 클라이언트 PID %d가 %llu초 동안 PING 에 답하지 않아 연결을 끊습니다.",
+                     hb->pid, (unsigned long long)(ping_timeout_ms / 1000));
+            metrics_inc(metric_idle_kills);
+            kill(hb->pid, SIGTERM); // 자식이 끝나면 reap_children -> remove_client_from_list 가 정리
+            return;
+        }
+    }
+
+    uint64_t idle = now_ms - hb->last_rx_ms;
+    if (idle < idle_timeout_ms) {
+        tw_add(&hub_timers, &hb->timer, idle_timeout_ms - idle); // 그 사이에 활동이 있었음
+        return;
+    }
+
+    char ping[32];
+    hb->ping_seq++;
+    hb->ping_sent_ms = now_ms;
+    snprintf(ping, sizeof(ping), "%c%c%u\n", EVENT_MARK, EVENT_PING, hb->ping_seq);
+    send_message_to_client_by_pid(hb->pid, ping);
+    metrics_inc(metric_pings);
+    tw_add(&hub_timers, &hb->timer, ping_timeout_ms);
+}
+
+heartbeat_t *heartbeat_start(pid_t pid) {
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        heartbeat_t *hb = &heartbeats[i];
+        if (hb->pid != 0) continue;
+        hb->pid = pid;
+        hb->last_rx_ms = rate_limit_now_ms();
+        hb->ping_sent_ms = 0;
+        hb->ping_seq = 0;
+        tw_timer_init(&hb->timer, heartbeat_expired);
+        if (idle_timeout_ms != 0) {
+            tw_add(&hub_timers, &hb->timer, idle_timeout_ms);
+        }
+        return hb;
+    }
+    return NULL; // clients[] 와 크기가 같으므로 일어나지 않음
+}
+
+void heartbeat_stop(heartbeat_t *hb) {
+    if (hb == NULL) return;
+    tw_cancel(&hub_timers, &hb->timer);
+    hb->pid = 0;
+}
+
+// ===========================================
+// 서버 간 연합: 여러 chat_server2 인스턴스가 방을 나눠 맡음
+// CHAT_PEERS="주소:포트,주소:포트,..." 에 모든 노드의 연합 링크 주소를 (모든 노드에서 같은 순서로) 적고
+// CHAT_NODE_ID 로 그중 자기 번호(0부터)를 주면 켜진다. 없으면 지금처럼 혼자 동작.
+// - 방마다 홈 노드를 일관 해싱(hash_ring.h)으로 정함. 모든 노드가 같은 목록으로 같은 링을 만드므로
+//   묻지 않아도 홈이 일치하고, 노드를 하나 더해도 약 1/N 의 방만 홈이 바뀜
+// - 홈 노드가 그 방의 순번과 기록을 맡음. 다른 노드는 로컬에 있는 방을 홈에 구독(FED_SUBSCRIBE)하고
+//   로컬 사용자의 방 메시지를 홈으로 넘김(FED_PUBLISH). 홈은 순번을 매겨 자기 사용자에게 보내고
+//   구독한 노드마다 한 번씩 전달(FED_DELIVER)하며, 각 노드가 자기 사용자에게 퍼뜨림.
+//   그래서 방마다 순서는 홈 한 곳에서 정해지고, 사용자 수만큼의 팬아웃은 노드들이 나눠 짐
+// - 링크는 노드 쌍마다 방향별로 하나씩 (내가 연결한 링크로 보내고, 상대가 연결해 온 링크로 받음).
+//   프레임은 피어별 송신 버퍼에 모았다가 메인 루프 한 바퀴에 send 한 번으로 보냄 (배치)
+// - 링크가 끊기면 FED_RETRY_MS 마다 다시 연결하고 HELLO 뒤에 구독을 다시 보냄. 끊긴 동안
+//   홈이 다른 노드인 방의 메시지는 보내지 않고 보낸 사람에게 알림 (순번은 홈만 매김)
+// - 방 순번의 상위 32비트는 홈의 fed_epoch (시작 시각). 홈이 다시 시작해도 순번이 줄지 않으므로
+//   다른 노드는 이미 받은 순번 이하의 전달을 버리고, 재접속한 클라이언트는 기록 초기화를 알 수 있음
+// 귓속말, /users, /list, 입장 알림은 지금처럼 노드 안에서만 동작함 (방 샤딩이면 귓속말은
+// 닉네임 디렉터리로 대상 샤드를 찾아 FED_WHISPER 로 넘김).
+// 링크에는 인증이 없으므로 CHAT_PEERS 의 자기 주소는 노드끼리만 닿는 주소(루프백, 내부망)로 둘 것.
+// ===========================================
+// peers 는 CHAT_PEERS 형식, self 가 음수면 CHAT_NODE_ID 에서 읽음 (방 샤딩은 둘 다 직접 넘김)
+int init_federation(const char *peers, int self) {
+    const char *names[FED_MAX_NODES];
+    char list[FED_MAX_NODES * 64];
+    char *save = NULL;
+    int count = 0;
+
+    for (int i = 0; i < FED_MAX_NODES * 2; i++) {
+        fed_inbound[i].fd = -1;
+    }
+    if (peers == NULL || *peers == '\0') {
+        return 0; // 혼자 동작: 모든 방의 홈이 자기 자신
+    }
+
+    snprintf(list, sizeof(list), "%s", peers);
+    for (char *tok = strtok_r(list, ",", &save); tok != NULL; tok = strtok_r(NULL, ",", &save)) {
+        if (count == FED_MAX_NODES) {
+            LOG_ERROR("[서버] CHAT_PEERS 노드가 최대 %d개를 넘습니다.", FED_MAX_NODES);
+            return -1;
+        }
+        fed_peer_t *p = &fed_peers[count];
+        char *colon = strrchr(tok, ':');
+        int port = colon != NULL ? atoi(colon + 1) : 0;
+        snprintf(p->name, sizeof(p->name), "%s", tok);
+        if (colon != NULL) {
+            *colon = '\0';
+        }
+        memset(&p->addr, 0, sizeof(p->addr));
+        p->addr.sin_family = AF_INET;
+        p->addr.sin_port = htons(port);
+        if (port < 1 || port > 65535 || inet_pton(AF_INET, tok, &p->addr.sin_addr) <= 0) {
+            LOG_ERROR("[서버] CHAT_PEERS 항목 '%s'이(가) 올바르지 않습니다 (IPv4 주소:포트).", p->name);
+            return -1;
+        }
+        p->out_fd = -1;
+        p->connecting = 0;
+        p->retry_ms = 0;
+        p->out_len = 0;
+        names[count++] = p->name;
+    }
+    fed_self = self >= 0 ? self : env_int("CHAT_NODE_ID", -1, 0, count - 1);
+    if (fed_self < 0) {
+        LOG_ERROR("[서버] CHAT_PEERS 를 쓰려면 CHAT_NODE_ID(0~%d)가 필요합니다.", count - 1);
+        return -1;
+    }
+    if (hash_ring_build(&fed_ring, names, count, FED_VNODES) != 0) {
+        LOG_ERROR("[서버] 연합 해시 링 생성 실패.");
+        return -1;
+    }
+
+    // 다른 노드가 연결해 오는 링크용 리스닝 소켓 (CHAT_PEERS 의 자기 주소에만 바인딩)
+    fed_listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    int opt = 1;
+    if (fed_listen_fd == -1 ||
+        setsockopt(fed_listen_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0 ||
+        bind(fed_listen_fd, (struct sockaddr *)&fed_peers[fed_self].addr, sizeof(fed_peers[fed_self].addr)) == -1 ||
+        listen(fed_listen_fd, FED_MAX_NODES * 2) == -1) {
+        LOG_ERROR("[서버] 연합 링크 포트(%s) 준비 실패: %s", fed_peers[fed_self].name, strerror(errno));
+        return -1;
+    }
+    fed_node_count = count;
+
+    if (nick_dir != NULL) {
+        fed_epoch = nick_dir_next_epoch(nick_dir, fed_self); // 방 샤딩: 감독과 공유하는 메모리에 남은 값을 이어 씀
+    } else {
+        // 같은 초 안에 다시 시작하면 옛 순번과 겹치므로 다음 초가 될 때까지 기다림
+        time_t started = time(NULL);
+        while (time(NULL) == started) {
+            usleep(10000);
+        }
+        fed_epoch = (uint32_t)time(NULL);
+    }
+    LOG_INFO("[서버] 연합 노드 %d/%d (%s) 로 동작합니다 (순번 epoch %u).", fed_self, fed_node_count, fed_peers[fed_self].name, fed_epoch);
+    return 0;
+}
+
+int fed_home_node(const char *room_name) {
+    return fed_node_count == 0 ? fed_self : hash_ring_lookup(&fed_ring, room_name);
+}
+
+// 프레임을 피어의 송신 버퍼에 넣음 (실제 전송은 fed_flush_links). 링크가 없거나 버퍼가 가득 차면 -1
+int fed_send(int node, char type, const char *room, uint64_t seq, const char *data, size_t len) {
+    fed_peer_t *p = &fed_peers[node];
+    size_t room_len = strlen(room);
+    fed_frame_hdr_t hdr;
+
+    if (p->out_fd < 0 || p->connecting || room_len > MAX_ROOMNAME_LEN || room_len + len > FED_MAX_BODY) {
+        return -1;
+    }
+    if (p->out_len + sizeof(hdr) + room_len + len > sizeof(p->out_buf)) {
+        LOG_RATELIMITED(LOG_LEVEL_WARN, 1000, "[서버] 노드 %d(%s) 링크의 송신 버퍼가 가득 차서 프레임을 버립니다.", node, p->name);
+        return -1;
+    }
+    hdr.len = htonl(room_len + len);
+    hdr.type = type;
+    hdr.room_len = room_len;
+    hdr.node = htons(fed_self);
+    hdr.seq = htobe64(seq);
+    memcpy(p->out_buf + p->out_len, &hdr, sizeof(hdr));
+    memcpy(p->out_buf + p->out_len + sizeof(hdr), room, room_len);
+    if (len > 0) {
+        memcpy(p->out_buf + p->out_len + sizeof(hdr) + room_len, data, len);
+    }
+    p->out_len += sizeof(hdr) + room_len + len;
+    metrics_inc(metric_fed_frames_out);
+    return 0;
+}
+
+// 홈이 다른 노드인 방이 생기거나 없어지면 구독을 알림 (링크가 끊겨 있으면 재연결 때 다시 구독)
+void fed_room_added(int room_idx) {
+    if (fed_node_count > 0 && chat_rooms[room_idx].home_node != fed_self) {
+        fed_send(chat_rooms[room_idx].home_node, FED_SUBSCRIBE, chat_rooms[room_idx].name, 0, NULL, 0);
+    }
+}
+
+void fed_room_removed(int room_idx) {
+    if (fed_node_count > 0 && chat_rooms[room_idx].home_node != fed_self) {
+        fed_send(chat_rooms[room_idx].home_node, FED_UNSUBSCRIBE, chat_rooms[room_idx].name, 0, NULL, 0);
+    }
+}
+
+// 구독을 지우고, 이 노드에 사용자도 없는 방이면 정리
+static void fed_drop_subscriber(int room_idx, int node) {
+    chat_room_t *r = &chat_rooms[room_idx];
+    r->remote_subscribers &= ~(1u << node);
+    if (r->client_count == 0 && strcmp(r->name, "general") != 0 && !room_is_held(room_idx)) {
+        char name[MAX_ROOMNAME_LEN + 1];
+        snprintf(name, sizeof(name), "%s", r->name); // remove_room 이 배열을 당기므로 이름을 복사해 둠
+        LOG_INFO("[서버] 방 '%s'을(를) 구독하는 노드도 사용자도 없어 삭제합니다.", name);
+        remove_room(name);
+    }
+}
+
+static void fed_link_up(int node) {
+    fed_peer_t *p = &fed_peers[node];
+    p->connecting = 0;
+    metrics_inc(metric_fed_connects);
+    metrics_add(metric_fed_links, 1);
+    LOG_INFO("[서버] 노드 %d(%s)로 가는 링크가 연결되었습니다.", node, p->name);
+    fed_send(node, FED_HELLO, "", 0, NULL, 0);
+    // 끊겨 있던 동안 만든 방도 있으므로 그 노드가 홈인 방을 모두 다시 구독 (홈에서는 중복 구독이 무해함)
+    for (int i = 0; i < room_count; i++) {
+        if (chat_rooms[i].home_node == node) {
+            fed_send(node, FED_SUBSCRIBE, chat_rooms[i].name, 0, NULL, 0);
+        }
+    }
+}
+
+// 보내던 프레임은 버림 (홈으로 가던 방 메시지라면 유실, 재연결 뒤의 메시지부터 다시 전달됨)
+static void fed_link_down(int node, const char *reason) {
+    fed_peer_t *p = &fed_peers[node];
+    if (!p->connecting) {
+        metrics_add(metric_fed_links, -1);
+    }
+    close(p->out_fd);
+    p->out_fd = -1;
+    p->connecting = 0;
+    p->out_len = 0;
+    p->retry_ms = rate_limit_now_ms() + FED_RETRY_MS;
+    LOG_RATELIMITED(LOG_LEVEL_WARN, 1000, "[서버] 노드 %d(%s)로 가는 링크 끊김: %s", node, p->name, reason);
+}
 
-    // 서버 주소 구조체 초기화
-    memset(&server_addr, 0, sizeof(server_addr));
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_addr.s_addr = INADDR_ANY; // 모든 IP 주소로부터의 연결 허용
-    server_addr.sin_port = htons(PORT);       // 포트 번호 설정
-
-    // 2. 소켓에 주소 바인딩
-    if (bind(server_socket, (struct sockaddr *)&server_addr, sizeof(server_addr)) == -1) {
-        perror("소켓 바인딩 실패");
-        close(server_socket);
-        exit(EXIT_FAILURE);
+// 끊긴 링크를 FED_RETRY_MS 마다 논블로킹 connect 로 다시 연결 (완료는 fed_handle_io 에서 확인)
+void fed_reconnect_links(uint64_t now_ms) {
+    for (int node = 0; node < fed_node_count; node++) {
+        fed_peer_t *p = &fed_peers[node];
+        if (node == fed_self || p->out_fd >= 0 || now_ms < p->retry_ms) {
+            continue;
+        }
+        p->retry_ms = now_ms + FED_RETRY_MS;
+        int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd == -1) {
+            continue;
+        }
+        int one = 1; // 배치는 송신 버퍼에서 이미 모으므로 Nagle 로 더 기다리지 않음
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        p->out_fd = fd;
+        p->out_len = 0;
+        p->connecting = 1;
+        if (connect(fd, (struct sockaddr *)&p->addr, sizeof(p->addr)) == 0) {
+            fed_link_up(node);
+        } else if (errno != EINPROGRESS) {
+            fed_link_down(node, strerror(errno));
+        }
     }
+}
 
-    // 3. 연결 대기 (최대 10개의 동시 연결 요청 대기)
-    if (listen(server_socket, MAX_CLIENTS) == -1) {
-        perror("연결 대기 실패");
-        close(server_socket);
-        exit(EXIT_FAILURE);
+// select 타임아웃: 끊긴 링크가 있으면 다음 재연결 시각까지
+int fed_timeout_ms(uint64_t now_ms, int max_ms) {
+    for (int node = 0; node < fed_node_count; node++) {
+        const fed_peer_t *p = &fed_peers[node];
+        if (node == fed_self || p->out_fd >= 0) {
+            continue;
+        }
+        if (p->retry_ms <= now_ms) {
+            return 0;
+        }
+        if (p->retry_ms - now_ms < (uint64_t)max_ms) {
+            max_ms = (int)(p->retry_ms - now_ms);
+        }
     }
+    return max_ms;
+}
 
-    // SIGCHLD 시그널 핸들러 설정 (좀비 프로세스 방지)
-    struct sigaction sa;
-    memset(&sa, 0, sizeof(sa));
-    sa.sa_handler = sigchld_handler;
-    sigemptyset(&sa.sa_mask);
-    sa.sa_flags = SA_RESTART | SA_NOCLDSTOP; // SA_NOCLDSTOP: 자식이 중지될 때 SIGCHLD 생성 안 함
-    if (sigaction(SIGCHLD, &sa, 0) == -1) {
-        perror("sigaction 실패");
-        close(server_socket);
-        exit(EXIT_FAILURE);
+static void fed_close_inbound(fed_inbound_t *in) {
+    int node = in->node;
+    close(in->fd);
+    in->fd = -1;
+    in->node = -1;
+    in->in_len = 0;
+    if (node < 0) {
+        return;
     }
+    LOG_WARN("[서버] 노드 %d(%s)에서 오는 링크가 끊겨 그 노드의 구독을 정리합니다.", node, fed_peers[node].name);
+    for (int i = room_count - 1; i >= 0; i--) { // 뒤에서부터: 방이 지워지면 뒤 칸이 당겨짐
+        if (chat_rooms[i].remote_subscribers & (1u << node)) {
+            fed_drop_subscriber(i, node);
+        }
+    }
+}
 
-    // 초기 채팅방 'general' 생성
-    if (add_room("general") != 0) {
-        fprintf(stderr, "[%s][서버] 'general' 방 생성에 실패했습니다.\n", get_current_time_str());
-        exit(EXIT_FAILURE);
+// 받은 프레임 하나 처리. 형식이 틀리면 -1 (링크를 닫음)
+static int fed_handle_frame(fed_inbound_t *in, const fed_frame_hdr_t *hdr, const char *body, size_t body_len) {
+    static char message[FED_MAX_BODY + 1]; // 라우터 스레드 전용
+    char room[MAX_ROOMNAME_LEN + 1];
+    int node = ntohs(hdr->node);
+
+    if (node >= fed_node_count || node == fed_self || (in->node != -1 && in->node != node) ||
+        hdr->room_len > MAX_ROOMNAME_LEN || hdr->room_len > body_len) {
+        return -1;
     }
+    memcpy(room, body, hdr->room_len);
+    room[hdr->room_len] = '\0';
+    memcpy(message, body + hdr->room_len, body_len - hdr->room_len);
+    message[body_len - hdr->room_len] = '\0';
+    metrics_inc(metric_fed_frames_in);
 
-    printf("[%s][서버] 채팅 서버가 %d 포트에서 대기 중입니다...\n", get_current_time_str(), PORT);
+    if (hdr->type == FED_HELLO) {
+        // 재시작한 노드의 새 링크가 옛 링크의 끊김보다 먼저 보이면, 옛 링크를 먼저 닫아 그 구독을 정리
+        // (새 링크의 구독은 HELLO 뒤에 오므로 지워지지 않음)
+        for (int i = 0; i < FED_MAX_NODES * 2; i++) {
+            if (&fed_inbound[i] != in && fed_inbound[i].fd >= 0 && fed_inbound[i].node == node) {
+                fed_close_inbound(&fed_inbound[i]);
+            }
+        }
+        in->node = node;
+        LOG_INFO("[서버] 노드 %d(%s)에서 오는 링크가 연결되었습니다.", node, fed_peers[node].name);
+        return 0;
+    }
+    if (in->node == -1) {
+        return -1; // HELLO 전에 온 프레임
+    }
 
-    parent_main_loop(server_socket); // 부모 프로세스의 메인 루프 시작
+    if (hdr->type == FED_WHISPER) {
+        send_message_to_client_by_nickname(room, message); // 그사이 나갔으면 경고만 남김
+        return 0;
+    }
 
-    close(server_socket);
-    printf("[%s][서버] 서버 종료.\n", get_current_time_str());
+    int room_idx = find_room_index(room);
+    switch (hdr->type) {
+    case FED_SUBSCRIBE:
+        if (room_idx == -1 && add_room(room) == 0) {
+            room_idx = find_room_index(room);
+        }
+        if (room_idx == -1) {
+            LOG_WARN("[서버] 노드 %d가 구독한 방 '%s'을(를) 만들 수 없습니다 (최대 %d개).", node, room, MAX_ROOMS);
+            break;
+        }
+        if (chat_rooms[room_idx].home_node != fed_self) {
+            LOG_RATELIMITED(LOG_LEVEL_WARN, 1000, "[서버] 노드 %d가 이 노드가 홈이 아닌 방 '%s'을(를) 구독합니다 (노드마다 CHAT_PEERS 가 다른지 확인).",
+                            node, room);
+        }
+        chat_rooms[room_idx].remote_subscribers |= 1u << node;
+        break;
+    case FED_UNSUBSCRIBE:
+        if (room_idx != -1) {
+            fed_drop_subscriber(room_idx, node);
+        }
+        break;
+    case FED_PUBLISH:
+        if (room_idx == -1) {
+            LOG_RATELIMITED(LOG_LEVEL_WARN, 1000, "[서버] 노드 %d가 보낸 방 '%s' 메시지를 버립니다 (방 없음).", node, room);
+            metrics_inc(metric_fed_dropped);
+            break;
+        }
+        publish_in_room(room_idx, message);
+        break;
+    case FED_DELIVER:
+        if (room_idx != -1) { // 구독을 막 끊은 방이면 없을 수 있음
+            deliver_room_message(room_idx, be64toh(hdr->seq), message);
+        }
+        break;
+    default:
+        return -1;
+    }
     return 0;
 }
 
+static void fed_read_inbound(fed_inbound_t *in) {
+    ssize_t n = recv(in->fd, in->in_buf + in->in_len, sizeof(in->in_buf) - in->in_len, 0);
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+        return;
+    }
+    if (n <= 0) {
+        fed_close_inbound(in);
+        return;
+    }
+    in->in_len += n;
+
+    size_t off = 0;
+    while (in->in_len - off >= sizeof(fed_frame_hdr_t)) {
+        fed_frame_hdr_t hdr;
+        memcpy(&hdr, in->in_buf + off, sizeof(hdr));
+        size_t body_len = ntohl(hdr.len);
+        if (body_len > FED_MAX_BODY) {
+            LOG_WARN("[서버] 연합 링크에서 잘못된 프레임 길이(%zu)를 받아 링크를 닫습니다.", body_len);
+            fed_close_inbound(in);
+            return;
+        }
+        if (in->in_len - off < sizeof(hdr) + body_len) {
+            break; // 나머지는 다음 recv 에서
+        }
+        if (fed_handle_frame(in, &hdr, in->in_buf + off + sizeof(hdr), body_len) != 0) {
+            LOG_WARN("[서버] 연합 링크에서 잘못된 프레임(타입 %d)을 받아 링크를 닫습니다.", hdr.type);
+            fed_close_inbound(in);
+            return;
+        }
+        off += sizeof(hdr) + body_len;
+    }
+    memmove(in->in_buf, in->in_buf + off, in->in_len - off);
+    in->in_len -= off;
+}
+
+static void fed_accept_links(void) {
+    while (1) {
+        int fd = accept4(fed_listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        fed_inbound_t *in = NULL;
+        for (int i = 0; i < FED_MAX_NODES * 2 && in == NULL; i++) {
+            if (fed_inbound[i].fd < 0) {
+                in = &fed_inbound[i];
+            }
+        }
+        if (in == NULL) {
+            LOG_WARN("[서버] 연합 링크 칸이 가득 차서 새 링크를 닫습니다.");
+            close(fd);
+            continue;
+        }
+        in->fd = fd;
+        in->node = -1;
+        in->in_len = 0;
+    }
+}
+
+int fed_fill_fd_sets(fd_set *read_fds, fd_set *write_fds, int max_fd) {
+    if (fed_node_count == 0) {
+        return max_fd;
+    }
+    FD_SET(fed_listen_fd, read_fds);
+    if (fed_listen_fd > max_fd) max_fd = fed_listen_fd;
+    for (int node = 0; node < fed_node_count; node++) {
+        const fed_peer_t *p = &fed_peers[node];
+        if (p->out_fd < 0) {
+            continue;
+        }
+        if (!p->connecting) {
+            FD_SET(p->out_fd, read_fds); // 상대는 이 링크로 보내지 않으므로 읽힐 때는 끊김(EOF/RST)
+        }
+        if (p->connecting || p->out_len > 0) {
+            FD_SET(p->out_fd, write_fds);
+        }
+        if (p->out_fd > max_fd) max_fd = p->out_fd;
+    }
+    for (int i = 0; i < FED_MAX_NODES * 2; i++) {
+        if (fed_inbound[i].fd >= 0) {
+            FD_SET(fed_inbound[i].fd, read_fds);
+            if (fed_inbound[i].fd > max_fd) max_fd = fed_inbound[i].fd;
+        }
+    }
+    return max_fd;
+}
+
+void fed_handle_io(fd_set *read_fds, fd_set *write_fds) {
+    if (fed_node_count == 0) {
+        return;
+    }
+    if (FD_ISSET(fed_listen_fd, read_fds)) {
+        fed_accept_links();
+    }
+    for (int node = 0; node < fed_node_count; node++) {
+        fed_peer_t *p = &fed_peers[node];
+        if (p->out_fd < 0) {
+            continue;
+        }
+        if (p->connecting) {
+            if (FD_ISSET(p->out_fd, write_fds)) {
+                int err = 0;
+                socklen_t err_len = sizeof(err);
+                getsockopt(p->out_fd, SOL_SOCKET, SO_ERROR, &err, &err_len);
+                if (err != 0) {
+                    fed_link_down(node, strerror(err));
+                } else {
+                    fed_link_up(node);
+                }
+            }
+        } else if (FD_ISSET(p->out_fd, read_fds)) {
+            char scratch[256];
+            ssize_t n = recv(p->out_fd, scratch, sizeof(scratch), 0);
+            if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+                fed_link_down(node, n == 0 ? "상대가 링크를 닫음" : strerror(errno));
+            }
+        }
+    }
+    for (int i = 0; i < FED_MAX_NODES * 2; i++) {
+        if (fed_inbound[i].fd >= 0 && FD_ISSET(fed_inbound[i].fd, read_fds)) {
+            fed_read_inbound(&fed_inbound[i]);
+        }
+    }
+}
+
+// 메인 루프 한 바퀴 동안 피어별로 모은 프레임을 send 한 번으로 보냄. 다 못 보낸 나머지는
+// write_fds 로 쓸 수 있게 될 때를 기다렸다가 다음 바퀴에 이어서 보냄
+void fed_flush_links(void) {
+    for (int node = 0; node < fed_node_count; node++) {
+        fed_peer_t *p = &fed_peers[node];
+        if (p->out_fd < 0 || p->connecting || p->out_len == 0) {
+            continue;
+        }
+        ssize_t n = send(p->out_fd, p->out_buf, p->out_len, MSG_NOSIGNAL);
+        if (n > 0) {
+            metrics_inc(metric_fed_batches);
+            memmove(p->out_buf, p->out_buf + n, p->out_len - n);
+            p->out_len -= n;
+        } else if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+            fed_link_down(node, strerror(errno));
+        }
+    }
+}
+
+// 자식이 링크를 쥐고 있으면 허브가 닫아도 상대에게 끊김이 보이지 않으므로 fork 직후 닫음
+void fed_close_in_child(void) {
+    if (fed_listen_fd >= 0) {
+        close(fed_listen_fd);
+    }
+    for (int node = 0; node < fed_node_count; node++) {
+        if (fed_peers[node].out_fd >= 0) {
+            close(fed_peers[node].out_fd);
+        }
+    }
+    for (int i = 0; i < FED_MAX_NODES * 2; i++) {
+        if (fed_inbound[i].fd >= 0) {
+            close(fed_inbound[i].fd);
+        }
+    }
+}
+
 // ===========================================
 // 부모 프로세스 메인 루프
 // ===========================================
+// 재조립 버퍼에서 완성된 프레임을 모두 처리하고 남은 조각은 앞으로 당겨 둠
+static void drain_frames_from_child(int idx) {
+    char message[BUFFER_SIZE];
+    // 퇴장(remove_client_from_list)은 메인 루프가 생성기의 SPAWN_EXITED 를 읽을 때만 일어나므로
+    // 프레임을 처리하는 동안 clients[] 는 당겨지지 않음: 버퍼를 그 자리에서 읽음
+    client_info_t *c = &clients[idx];
+    const char *frames = c->rx_buf;
+    size_t frames_len = c->rx_len;
+    size_t off = 0;
+
+    uint64_t now_ms = rate_limit_now_ms();
+    while (frames_len - off >= sizeof(pipe_frame_hdr_t)) {
+        pipe_frame_hdr_t hdr;
+        memcpy(&hdr, frames + off, sizeof(hdr));
+        if (frames_len - off - sizeof(hdr) < hdr.len) {
+            break; // 아직 다 오지 않음
+        }
+        size_t len = hdr.len < sizeof(message) ? hdr.len : sizeof(message) - 1;
+        memcpy(message, frames + off + sizeof(hdr), len);
+        message[len] = '\0';
+        off += sizeof(hdr) + hdr.len;
+        if (!(hdr.flags & PIPE_FRAME_INTERNAL) && is_internal_report_type(message)) {
+            // 클라이언트가 자식 보고를 흉내 낸 줄: 지표나 전송 상태를 바꾸지 못하게 버림
+            metrics_inc(metric_forged_reports);
+            LOG_RATELIMITED(LOG_LEVEL_WARN, 1000, "[서버] 클라이언트 %s(%d)가 보낸 내부 보고 형식의 줄을 버립니다.",
+                            c->nickname, c->pid);
+            continue;
+        }
+        // 자식이 스스로 보내는 압축 통계는 클라이언트가 살아 있다는 뜻이 아님
+        if (c->hb != NULL && strncmp(message, MSG_TYPE_ZSTAT ":", sizeof(MSG_TYPE_ZSTAT)) != 0) {
+            c->hb->last_rx_ms = now_ms;
+        }
+        if (!rate_limit_frame(c, &hdr, message, len)) {
+            continue; // 한도 초과: 붙잡아 두었거나 거절함
+        }
+        process_message_from_child(message, c->pipe_read_fd, hdr.recv_ns);
+    }
+    memmove(c->rx_buf, frames + off, frames_len - off);
+    c->rx_len = frames_len - off;
+}
+
 void parent_main_loop(int server_socket) {
     int max_fd;
-    fd_set read_fds;
-    char buffer[BUFFER_SIZE];
+    fd_set read_fds, write_fds;
+
+    while (!hub_stop_requested) {
+        fed_flush_links(); // 지난 바퀴에 피어별로 모은 연합 프레임을 한 번에 보냄
 
-    while (1) {
         FD_ZERO(&read_fds);
+        FD_ZERO(&write_fds);
         FD_SET(server_socket, &read_fds); // 서버 소켓을 select 대상에 추가
-        max_fd = server_socket;
+        max_fd = fed_fill_fd_sets(&read_fds, &write_fds, server_socket);
+
+        if (spawner_fd != -1) {
+            FD_SET(spawner_fd, &read_fds);
+            if (spawner_fd > max_fd) {
+                max_fd = spawner_fd;
+            }
+        }
+        if (worker_wake_pipe[0] != -1) {
+            FD_SET(worker_wake_pipe[0], &read_fds);
+            if (worker_wake_pipe[0] > max_fd) {
+                max_fd = worker_wake_pipe[0];
+            }
+        }
 
-        // 모든 클라이언트 파이프의 읽기 FD를 select 대상에 추가
+        // 모든 클라이언트 파이프의 읽기 FD를 select 대상에 추가 (보낼 것이 밀려 있으면 쓰기 FD도)
         for (int i = 0; i < client_count; i++) {
             FD_SET(clients[i].pipe_read_fd, &read_fds);
             if (clients[i].pipe_read_fd > max_fd) {
                 max_fd = clients[i].pipe_read_fd;
             }
+            if (clients[i].out_head != NULL && !clients[i].out_head->pending) {
+                FD_SET(clients[i].pipe_write_fd, &write_fds);
+                if (clients[i].pipe_write_fd > max_fd) {
+                    max_fd = clients[i].pipe_write_fd;
+                }
+            }
         }
 
-        // select 호출: 이벤트 발생 대기
-        int activity = select(max_fd + 1, &read_fds, NULL, NULL, NULL);
-        if ((activity < 0) && (errno != EINTR)) { // EINTR은 시그널에 의해 인터럽트된 경우
-            perror("select 오류");
+        // select 호출: 이벤트 발생 대기 (재접속 대기 세션 만료 확인 주기 1초,
+        // 붙잡아 둔 메시지, 하트비트 타이머, 연합 링크 재연결이 더 빨리 돌아오면 그때까지)
+        uint64_t now_ms = rate_limit_now_ms();
+        int timeout_ms = fed_timeout_ms(now_ms, tw_next_timeout_ms(&hub_timers, now_ms, rate_limit_timeout_ms(now_ms, 1000)));
+        struct timeval tick = { .tv_sec = timeout_ms / 1000, .tv_usec = (timeout_ms % 1000) * 1000 };
+        int activity = select(max_fd + 1, &read_fds, &write_fds, NULL, &tick);
+        now_ms = rate_limit_now_ms();
+        release_held_frames(now_ms);
+        tw_advance(&hub_timers, now_ms);
+        fed_reconnect_links(now_ms);
+        if (child_exit_pending) {
+            reap_children();
+        }
+        expire_detached_sessions();
+        if (latency_dump_requested) {
+            latency_dump_requested = 0;
+            dump_latency_report();
+        }
+        if (activity < 0) {
+            // EINTR은 시그널에 의해 인터럽트된 경우. 이때 fd_set 내용은 믿을 수 없으므로
+            // (그대로 두면 accept/read가 블록될 수 있음) 다시 select부터 시작
+            if (errno != EINTR) {
+                LOG_ERROR("[서버] select 오류: %s", strerror(errno));
+            }
             continue;
         }
 
+        // 끝난 자식 정리 (새 연결을 받기 전에)
+        if (spawner_fd != -1 && FD_ISSET(spawner_fd, &read_fds)) {
+            spawner_read_events();
+        }
+
         // 서버 소켓에 새 연결 요청이 있는지 확인
-        if (FD_ISSET(server_socket, &read_fds)) {
-            struct sockaddr_in client_addr;
-            socklen_t client_len = sizeof(client_addr);
-            int client_fd = accept(server_socket, (struct sockaddr *)&client_addr, &client_len);
-            if (client_fd == -1) {
-                perror("accept 실패");
-                continue;
-            }
+        if (!hub_stop_requested && FD_ISSET(server_socket, &read_fds)) {
+            accept_pending_connections(server_socket);
+        }
 
-            printf("[%s][서버] 새 클라이언트 연결: %s:%d (FD: %d)\n",
-                   get_current_time_str(), inet_ntoa(client_addr.sin_addr), ntohs(client_addr.sin_port), client_fd);
+        // 연합 링크: 다른 노드의 구독/방 메시지 처리, 연결 완료/끊김 확인
+        fed_handle_io(&read_fds, &write_fds);
 
-            // 파이프 생성 (부모-자식 간 통신용)
-            int parent_to_child_pipe[2]; // 부모가 자식에게 쓸 때 사용 (부모 쓰기, 자식 읽기)
-            int child_to_parent_pipe[2]; // 자식이 부모에게 쓸 때 사용 (자식 쓰기, 부모 읽기)
+        // 파이프가 비워진 자식에게 밀린 응답을 이어서 씀 (새로 보낼 것보다 먼저)
+        for (int i = 0; i < client_count; i++) {
+            if (clients[i].out_head != NULL && FD_ISSET(clients[i].pipe_write_fd, &write_fds)) {
+                hub_out_flush(&clients[i]);
+            }
+        }
 
-            if (pipe(parent_to_child_pipe) == -1 || pipe(child_to_parent_pipe) == -1) {
-                perror("파이프 생성 실패");
-                close(client_fd);
-                continue;
+        // 각 클라이언트 파이프에서 메시지가 있는지 확인
+        for (int i = 0; i < client_count; i++) {
+            if (FD_ISSET(clients[i].pipe_read_fd, &read_fds)) {
+                client_info_t *c = &clients[i];
+                ssize_t bytes_read = read(c->pipe_read_fd, c->rx_buf + c->rx_len, sizeof(c->rx_buf) - c->rx_len);
+                if (bytes_read > 0) {
+                    metrics_add(metric_bytes_in, bytes_read);
+                    c->rx_len += bytes_read;
+                    drain_frames_from_child(i);
+                } else if (bytes_read == 0 || (bytes_read == -1 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+                    // 파이프 닫힘 또는 오류 (자식 프로세스 종료)
+                    // 생성기가 자식을 회수해 SPAWN_EXITED 를 보내면 spawner_read_events() 가 목록에서 지움.
+                    // 그 전까지는 select가 계속 깨우므로 호출 위치 단위로 출력 제한
+                    LOG_RATELIMITED(LOG_LEVEL_INFO, 1000, "[서버] 클라이언트 파이프 FD %d에서 읽기 오류 또는 EOF. 클라이언트 PID: %d",
+                                    clients[i].pipe_read_fd, clients[i].pid);
+                }
             }
+        }
 
-            pid_t pid = fork();
-            if (pid < 0) {
-                perror("fork 실패");
-                close(client_fd);
-                close(parent_to_child_pipe[0]); close(parent_to_child_pipe[1]);
-                close(child_to_parent_pipe[0]); close(child_to_parent_pipe[1]);
+        // 워커가 끝낸 명령 응답 (풀 없이 라우터에서 바로 실행한 것도 같은 길로 옴)
+        drain_worker_replies();
+    }
+}
+
+// ===========================================
+// 정수 환경 변수 읽기: 없으면 기본값, 숫자가 아니거나 범위를 벗어나면 경고 후 기본값
+// ===========================================
+int env_int(const char *name, int default_value, int min_value, int max_value) {
+    const char *env = getenv(name);
+    if (env == NULL || *env == '\0') {
+        return default_value;
+    }
+    char *end;
+    long v = strtol(env, &end, 10);
+    if (*end != '\0' || v < min_value || v > max_value) {
+        LOG_WARN("[서버] %s 값 '%s'이(가) 올바르지 않아 기본값 %d을(를) 사용합니다.", name, env, default_value);
+        return default_value;
+    }
+    return (int)v;
+}
+
+// ===========================================
+// 연결 대기열 길이: CHAT_LISTEN_BACKLOG (없거나 잘못되면 LISTEN_BACKLOG)
+// 커널은 net.core.somaxconn 보다 큰 값을 조용히 잘라내므로 그 경우 로그로 알림
+// ===========================================
+int listen_backlog_from_env(void) {
+    int backlog = env_int("CHAT_LISTEN_BACKLOG", LISTEN_BACKLOG, 1, 65535);
+
+    FILE *f = fopen("/proc/sys/net/core/somaxconn", "r");
+    if (f != NULL) {
+        int somaxconn;
+        if (fscanf(f, "%d", &somaxconn) == 1 && somaxconn < backlog) {
+            LOG_WARN("[서버] 연결 대기열 %d이(가) net.core.somaxconn=%d 으로 제한됩니다.", backlog, somaxconn);
+        }
+        fclose(f);
+    }
+    return backlog;
+}
+
+// ===========================================
+// 리스닝 소켓에 쌓인 연결을 EAGAIN 이 날 때까지 accept (select 한 번 깨어날 때마다)
+// 한 번에 하나씩만 받으면 접속이 몰릴 때 대기열이 차서 SYN이 버려짐.
+// ACCEPT_BATCH_MAX 개를 받으면 나머지는 다음 select 에서 받아 클라이언트 파이프 처리가 밀리지 않게 함
+// ===========================================
+void accept_pending_connections(int server_socket) {
+    int accepted = 0;
+
+    while (accepted < ACCEPT_BATCH_MAX) {
+        struct sockaddr_in client_addr;
+        socklen_t client_len = sizeof(client_addr);
+        // 자식은 어차피 소켓을 논블로킹으로 쓰고, 자식이 실행하는 다른 프로그램은 없지만
+        // fcntl 시스템 콜 두 번을 아끼고 fd 누수를 막기 위해 accept4 로 한 번에 설정
+        int client_fd = accept4(server_socket, (struct sockaddr *)&client_addr, &client_len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (client_fd == -1) {
+            if (errno == EINTR) {
                 continue;
             }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                // ECONNABORTED(대기 중 클라이언트가 끊음), EMFILE 등: 이번 배치는 여기서 끝냄
+                LOG_ERROR("[서버] accept 실패: %s", strerror(errno));
+                metrics_inc(metric_accept_errors);
+            }
+            break;
+        }
+        metrics_inc(metric_accepts);
+        accepted++;
+
+        // 목록이 가득 찼으면 fork 하기 전에 거절 (fork 한 뒤에는 목록에 넣지 못한 자식이 남음)
+        if (client_count >= MAX_CLIENTS) {
+            static const char full_msg[] = "[서버] 접속자가 가득 찼습니다. 잠시 후 다시 시도하세요.\n";
+            LOG_RATELIMITED(LOG_LEVEL_WARN, 1000, "[서버] 클라이언트 목록이 가득 차서 %s:%d 연결을 거절합니다.",
+                            inet_ntoa(client_addr.sin_addr), ntohs(client_addr.sin_port));
+            metrics_inc(metric_accept_rejects);
+            send(client_fd, full_msg, sizeof(full_msg) - 1, MSG_NOSIGNAL); // 갓 연결된 소켓이라 송신 버퍼는 비어 있음
+            close(client_fd);
+            continue;
+        }
 
-            if (pid == 0) { // 자식 프로세스
-                // 자식 프로세스는 부모의 읽기 파이프 (child_to_parent_pipe[0])를 닫고
-                // 부모의 쓰기 파이프 (parent_to_child_pipe[1])를 닫음.
-                close(child_to_parent_pipe[0]); // 자식이 부모에게 쓸 것이므로 부모 파이프의 읽기 끝은 필요 없음
-                close(parent_to_child_pipe[1]); // 부모가 자식에게 쓸 것이므로 부모 파이프의 쓰기 끝은 필요 없음
+        start_client_handler(client_fd, &client_addr);
+    }
 
-                handle_client_child_process(client_fd, parent_to_child_pipe[0], child_to_parent_pipe[1]);
-                // handle_client_child_process는 내부에서 exit(EXIT_SUCCESS)를 호출함.
-            } else { // 부모 프로세스
-                // 부모 프로세스는 자식의 쓰기 파이프 (child_to_parent_pipe[1])를 닫고
-                // 부모의 읽기 파이프 (parent_to_child_pipe[0])를 닫음.
-                close(child_to_parent_pipe[1]); // 부모가 자식으로부터 읽을 것이므로 자식 파이프의 쓰기 끝은 필요 없음
-                close(parent_to_child_pipe[0]); // 부모가 자식에게 쓸 것이므로 부모 파이프의 읽기 끝은 필요 없음
+    if (accepted > 0) {
+        metrics_inc(metric_accept_batches);
+        LOG_DEBUG("[서버] 한 번에 연결 %d개 accept", accepted);
+    }
+}
+
+// ===========================================
+// 클라이언트 프로세스 생성기 (허브 대신 fork)
+// 허브에는 명령 처리 워커와 지표 스레드가 있어서 허브가 직접 fork 하면 다른 스레드가 쥐고 있던
+// 락(malloc, stdio 등)이 잠긴 채로 자식에 복사되어 자식이 멈출 수 있다. 그래서 스레드를 만들기 전에
+// 스레드 없는 생성기를 하나 띄워 두고, 허브는 클라이언트 소켓과 자식이 쓸 파이프 끝을 SCM_RIGHTS 로
+// 넘겨 fork 를 맡긴다. 자식의 종료도 생성기가 회수해서 같은 소켓으로 알려 준다 (SPAWN_EXITED).
+// 한 소켓으로 차례대로 오므로 어떤 자식의 SPAWN_EXITED 가 그 SPAWN_FORKED 보다 먼저 오는 일은 없음
+// ===========================================
+static int spawn_send(int fd, const spawn_msg_t *msg, const int *fds, int nfds) {
+    struct iovec iov = { .iov_base = (void *)msg, .iov_len = sizeof(*msg) };
+    union {
+        char buf[CMSG_SPACE(sizeof(int) * 3)];
+        struct cmsghdr align;
+    } ctrl;
+    struct msghdr mh;
+    memset(&mh, 0, sizeof(mh));
+    mh.msg_iov = &iov;
+    mh.msg_iovlen = 1;
+    if (nfds > 0) {
+        memset(&ctrl, 0, sizeof(ctrl));
+        mh.msg_control = ctrl.buf;
+        mh.msg_controllen = CMSG_SPACE(sizeof(int) * nfds);
+        struct cmsghdr *cm = CMSG_FIRSTHDR(&mh);
+        cm->cmsg_level = SOL_SOCKET;
+        cm->cmsg_type = SCM_RIGHTS;
+        cm->cmsg_len = CMSG_LEN(sizeof(int) * nfds);
+        memcpy(CMSG_DATA(cm), fds, sizeof(int) * nfds);
+    }
+    ssize_t n;
+    do {
+        n = sendmsg(fd, &mh, MSG_NOSIGNAL);
+    } while (n < 0 && errno == EINTR);
+    return n == (ssize_t)sizeof(*msg) ? 0 : -1;
+}
+
+// 메시지 하나와 함께 온 FD 를 fds[] 에 최대 *nfds 개 받음 (넘치는 FD 는 닫음).
+// 1: 받음, 0: 상대가 닫음, -1: 오류 (flags 에 MSG_DONTWAIT 이면 받을 것이 없을 때 EAGAIN)
+static int spawn_recv(int fd, spawn_msg_t *msg, int *fds, int *nfds, int flags) {
+    struct iovec iov = { .iov_base = msg, .iov_len = sizeof(*msg) };
+    union {
+        char buf[CMSG_SPACE(sizeof(int) * 3)];
+        struct cmsghdr align;
+    } ctrl;
+    struct msghdr mh;
+    memset(&mh, 0, sizeof(mh));
+    mh.msg_iov = &iov;
+    mh.msg_iovlen = 1;
+    mh.msg_control = ctrl.buf;
+    mh.msg_controllen = sizeof(ctrl.buf);
+    ssize_t n;
+    do {
+        n = recvmsg(fd, &mh, flags);
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0) {
+        return (int)n;
+    }
+    int max = *nfds;
+    *nfds = 0;
+    for (struct cmsghdr *cm = CMSG_FIRSTHDR(&mh); cm != NULL; cm = CMSG_NXTHDR(&mh, cm)) {
+        if (cm->cmsg_level != SOL_SOCKET || cm->cmsg_type != SCM_RIGHTS) {
+            continue;
+        }
+        int count = (cm->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        for (int i = 0; i < count; i++) {
+            int received;
+            memcpy(&received, CMSG_DATA(cm) + i * sizeof(int), sizeof(int));
+            if (*nfds < max) {
+                fds[(*nfds)++] = received;
+            } else {
+                close(received);
+            }
+        }
+    }
+    if (n != (ssize_t)sizeof(*msg)) {
+        errno = EPROTO;
+        return -1;
+    }
+    return 1;
+}
 
-                // 클라이언트 정보 목록에 추가
-                add_client_to_list(pid, child_to_parent_pipe[0], parent_to_child_pipe[1], "guest", "general");
+// 생성기 프로세스 본체: 허브의 요청마다 fork 하고, 끝난 자식을 회수해 알림. 허브가 소켓을 닫으면 끝남
+static void spawner_main(int sock) {
+    sigset_t chld, old_mask, wait_mask;
+    sigemptyset(&chld);
+    sigaddset(&chld, SIGCHLD);
+    // SIGCHLD 는 ppoll 안에서만 받음 (회수와 요청 처리 사이에 놓치지 않도록)
+    sigprocmask(SIG_BLOCK, &chld, &old_mask);
+    wait_mask = old_mask;
+    sigdelset(&wait_mask, SIGCHLD);
+    // pkill 처럼 이름으로 보낸 종료 시그널은 무시하고 허브가 소켓을 닫을 때 끝냄
+    // (허브보다 먼저 죽으면 허브가 생성기를 잃은 것으로 보고 실패로 끝남)
+    signal(SIGTERM, SIG_IGN);
+    signal(SIGINT, SIG_IGN);
 
-                // 새 클라이언트에게 환영 메시지 전송
-                snprintf(buffer, sizeof(buffer), "[%s][서버] user%d님, 채팅 서버에 오신 것을 환영합니다! 현재 방: general\n", get_current_time_str(), (int)pid);
-                send_message_to_client_by_pid(pid, buffer);
+    for (;;) {
+        struct pollfd pfd = { .fd = sock, .events = POLLIN };
+        int ready = ppoll(&pfd, 1, NULL, &wait_mask);
 
-                // 모든 클라이언트에게 입장 알림
-                snprintf(buffer, sizeof(buffer), "[%s][INFO] user%d 님이 입장했습니다.\n", get_current_time_str(), (int)pid);
-                broadcast_message_to_all_clients(buffer, child_to_parent_pipe[0]); // 메시지 보낸 파이프는 제외
+        pid_t pid;
+        int status;
+        while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+            spawn_msg_t done = { .type = SPAWN_EXITED, .pid = pid };
+            if (spawn_send(sock, &done, NULL, 0) != 0) {
+                _exit(EXIT_SUCCESS);
             }
         }
+        if (ready <= 0) {
+            continue; // SIGCHLD (EINTR)
+        }
 
-        // 각 클라이언트 파이프에서 메시지가 있는지 확인
-        for (int i = 0; i < client_count; i++) {
-            if (FD_ISSET(clients[i].pipe_read_fd, &read_fds)) {
-                ssize_t bytes_read = read(clients[i].pipe_read_fd, buffer, sizeof(buffer) - 1);
-                if (bytes_read > 0) {
-                    buffer[bytes_read] = '\0'; // 널 종료
-                    process_message_from_child(buffer, clients[i].pipe_read_fd);
-                } else if (bytes_read == 0 || (bytes_read == -1 && errno != EAGAIN && errno != EWOULDBLOCK)) {
-                    // 파이프 닫힘 또는 오류 (자식 프로세스 종료)
-                    printf("[%s][서버] 클라이언트 파이프 FD %d에서 읽기 오류 또는 EOF. 클라이언트 PID: %d\n",
-                           get_current_time_str(), clients[i].pipe_read_fd, clients[i].pid);
-                    // 시그널 핸들러가 이미 remove_client_from_list를 호출하므로 여기서는 중복 호출하지 않습니다.
-                    // 다만, 즉시 종료되지 않고 여기서 에러가 발생한 경우 해당 클라이언트 FD는 다음 select에서 제외되어야 합니다.
-                    // (select 루프의 시작 부분에서 FD_ZERO와 FD_SET이 이를 처리합니다.)
-                }
+        spawn_msg_t req;
+        int fds[3];
+        int nfds = 3;
+        int rc = spawn_recv(sock, &req, fds, &nfds, 0);
+        if (rc == 0 || (rc < 0 && errno != EPROTO)) {
+            _exit(EXIT_SUCCESS); // 허브가 끝남
+        }
+        spawn_msg_t reply = { .type = SPAWN_FORKED, .pid = -1, .err = EINVAL };
+        if (rc > 0 && req.type == SPAWN_REQUEST && nfds == 3) {
+            reply.pid = fork();
+            reply.err = reply.pid < 0 ? errno : 0;
+            if (reply.pid == 0) { // 클라이언트 자식 프로세스
+                sigprocmask(SIG_SETMASK, &old_mask, NULL);
+                signal(SIGPIPE, SIG_DFL);
+                signal(SIGTERM, SIG_DFL); // 하트비트 시간 초과와 허브 종료 때 SIGTERM 으로 끝냄
+                signal(SIGINT, SIG_DFL);
+                close(sock);
+                handle_client_child_process(fds[0], fds[1], fds[2]);
+                // handle_client_child_process는 내부에서 exit(EXIT_SUCCESS)를 호출함.
             }
         }
+        for (int i = 0; i < nfds; i++) {
+            close(fds[i]); // 자식에게 넘겼으므로 생성기에는 필요 없음
+        }
+        if (spawn_send(sock, &reply, NULL, 0) != 0) {
+            _exit(EXIT_SUCCESS);
+        }
+    }
+}
+
+// 생성기 시작. 명령 풀/지표 스레드를 만들기 전, 연합 링크와 리스닝 소켓을 연 뒤에 호출 (생성기에서 닫음)
+int spawner_start(int server_socket) {
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv) != 0) {
+        return -1;
+    }
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(sv[0]);
+        close(sv[1]);
+        return -1;
+    }
+    if (pid == 0) {
+        close(sv[0]);
+        close(server_socket);
+        fed_close_in_child();
+        spawner_main(sv[1]);
+    }
+    close(sv[1]);
+    spawner_fd = sv[0];
+    spawner_pid = pid;
+    return 0;
+}
+
+static void spawner_link_lost(void) {
+    LOG_ERROR("[서버] 클라이언트 프로세스 생성기와의 연결이 끊겼습니다. 서버를 종료합니다.");
+    close(spawner_fd);
+    spawner_fd = -1;
+    spawner_lost = 1;
+    hub_stop_requested = 1;
+}
+
+static void spawner_handle_msg(const spawn_msg_t *msg) {
+    if (msg->type == SPAWN_EXITED) {
+        LOG_INFO("[서버] 자식 프로세스 %d 종료 처리됨.", msg->pid);
+        remove_client_from_list(msg->pid); // clients 배열에서 해당 클라이언트 정보 제거
+    }
+}
+
+void spawner_read_events(void) {
+    for (;;) {
+        spawn_msg_t msg;
+        int nfds = 0;
+        int rc = spawn_recv(spawner_fd, &msg, NULL, &nfds, MSG_DONTWAIT);
+        if (rc < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return;
+        }
+        if (rc <= 0) {
+            spawner_link_lost();
+            return;
+        }
+        spawner_handle_msg(&msg);
+    }
+}
+
+// 생성기에 fork 를 맡기고 자식 pid 를 받음. 실패하면 -1 (errno 설정)
+static pid_t spawn_client(int client_fd, int parent_to_child_read_fd, int child_to_parent_write_fd) {
+    int fds[3] = { client_fd, parent_to_child_read_fd, child_to_parent_write_fd };
+    spawn_msg_t msg = { .type = SPAWN_REQUEST };
+    if (spawner_fd < 0) {
+        errno = ECHILD;
+        return -1;
+    }
+    if (spawn_send(spawner_fd, &msg, fds, 3) != 0) {
+        spawner_link_lost();
+        errno = ECHILD;
+        return -1;
+    }
+    for (;;) {
+        int nfds = 0;
+        if (spawn_recv(spawner_fd, &msg, NULL, &nfds, 0) <= 0) {
+            spawner_link_lost();
+            errno = ECHILD;
+            return -1;
+        }
+        if (msg.type == SPAWN_FORKED) {
+            errno = msg.err;
+            return msg.pid;
+        }
+        spawner_handle_msg(&msg); // 기다리는 사이에 온 종료 알림
+    }
+}
+
+// ===========================================
+// accept 한 연결에 파이프 두 개를 만들고 (생성기를 통해) 자식 프로세스를 띄워 목록에 등록
+// ===========================================
+void start_client_handler(int client_fd, const struct sockaddr_in *client_addr) {
+    char buffer[BUFFER_SIZE];
+
+    LOG_INFO("[서버] 새 클라이언트 연결: %s:%d (FD: %d)",
+           inet_ntoa(client_addr->sin_addr), ntohs(client_addr->sin_port), client_fd);
+
+    // 파이프 생성 (부모-자식 간 통신용)
+    int parent_to_child_pipe[2]; // 부모가 자식에게 쓸 때 사용 (부모 쓰기, 자식 읽기)
+    int child_to_parent_pipe[2]; // 자식이 부모에게 쓸 때 사용 (자식 쓰기, 부모 읽기)
+
+    if (pipe(parent_to_child_pipe) == -1) {
+        LOG_ERROR("[서버] 파이프 생성 실패: %s", strerror(errno));
+        metrics_inc(metric_fork_failures);
+        close(client_fd);
+        return;
+    }
+    if (pipe(child_to_parent_pipe) == -1) {
+        LOG_ERROR("[서버] 파이프 생성 실패: %s", strerror(errno));
+        metrics_inc(metric_fork_failures);
+        close(client_fd);
+        close(parent_to_child_pipe[0]); close(parent_to_child_pipe[1]);
+        return;
     }
+
+    pid_t pid = spawn_client(client_fd, parent_to_child_pipe[0], child_to_parent_pipe[1]);
+    int spawn_errno = errno;
+    // 자식에게 넘긴 끝은 허브에 필요 없음. 클라이언트 소켓도 허브가 쥐고 있으면 자식이 죽어도
+    // 연결이 닫히지 않아 클라이언트가 끊김을 알 수 없음
+    close(client_fd);
+    close(parent_to_child_pipe[0]);
+    close(child_to_parent_pipe[1]);
+    if (pid < 0) {
+        LOG_ERROR("[서버] fork 실패: %s", strerror(spawn_errno));
+        metrics_inc(metric_fork_failures);
+        close(parent_to_child_pipe[1]);
+        close(child_to_parent_pipe[0]);
+        return;
+    }
+    metrics_inc(metric_forks);
+    // 자식이 느린 클라이언트에 막혀 파이프가 가득 차도 허브가 멈추지 않도록 (못 쓴 것은 송신 대기열로)
+    set_nonblocking(parent_to_child_pipe[1]);
+
+    // 클라이언트 정보 목록에 추가
+    add_client_to_list(pid, child_to_parent_pipe[0], parent_to_child_pipe[1], "guest", "general");
+
+    // 새 클라이언트에게 환영 메시지 전송
+    snprintf(buffer, sizeof(buffer), "[%s][서버] user%d님, 채팅 서버에 오신 것을 환영합니다! 현재 방: general\n", get_current_time_str(), (int)pid);
+    send_message_to_client_by_pid(pid, buffer);
+    // 클라이언트의 닉네임/방 상태를 서버가 아는 값으로 맞춤
+    send_state_event(pid, EVENT_NICK_ACK);
+    send_state_event(pid, EVENT_ROOM_CHANGED);
+    send_state_event(pid, EVENT_SESSION);
+
+    // 모든 클라이언트에게 입장 알림
+    snprintf(buffer, sizeof(buffer), "[%s][INFO] user%d 님이 입장했습니다.\n", get_current_time_str(), (int)pid);
+    broadcast_message_to_all_clients(buffer, child_to_parent_pipe[0]); // 메시지 보낸 파이프는 제외
 }
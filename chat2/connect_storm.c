@@ -0,0 +1,183 @@
+// connect_storm.c
+// 재접속 폭주 흉내: 연결을 한꺼번에 많이 열어 서버가 얼마나 빨리 accept 하는지 잰다.
+//
+// 동시에 최대 -b 개의 논블로킹 connect 를 걸어 두고, 서버가 보낸 첫 바이트(chat_server2 의 환영
+// 메시지나 "가득 찼습니다" 안내, 17/chat_server 의 닉네임 요청)가 올 때까지의 시간을 잰 뒤 바로 닫는다.
+// connect() 자체는 커널이 SYN-ACK 만 보내면 끝나므로, accept 되어 처리된 시점은 첫 바이트로 판단한다.
+// 대기열(listen backlog)이 넘쳐 SYN이 버려지면 클라이언트가 1초 뒤에 다시 보내므로
+// 지연 시간 분포에 1초 이상 걸린 연결(syn_retry)로 드러난다.
+//
+// 빌드: gcc -O2 -o connect_storm connect_storm.c
+// 실행: ./connect_storm [-h 호스트] [-p 포트] [-n 전체 연결 수] [-b 동시 연결 수] [-t 첫 바이트 대기(ms)]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include "hdr_histogram.h"
+
+#define MAX_INFLIGHT 1024
+#define SYN_RETRY_NS 900000000ULL   // 이보다 오래 걸린 연결은 SYN 재전송(초기 RTO 1초)을 겪은 것으로 봄
+
+typedef struct {
+    const char *host;
+    int port;
+    int total;                      // 전체 연결 수
+    int inflight;                   // 동시에 열어 두는 연결 수
+    int timeout_ms;                 // 첫 바이트를 기다리는 최대 시간
+} storm_config_t;
+
+typedef struct {
+    int fd;
+    uint64_t start_ns;
+} storm_conn_t;
+
+static storm_conn_t conns[MAX_INFLIGHT];
+static struct pollfd pfds[MAX_INFLIGHT];
+static hdr_histogram_t accept_latency;
+
+static unsigned long started, served, resets, timeouts, connect_errors, syn_retries;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "사용법: %s [-h 호스트] [-p 포트] [-n 전체 연결 수] [-b 동시 연결 수(최대 %d)] [-t 첫 바이트 대기(ms)]\n",
+            prog, MAX_INFLIGHT);
+    exit(1);
+}
+
+// 논블로킹 connect 시작. 실패하면 -1 (로컬 포트 부족 등)
+static int start_connect(storm_conn_t *c, const struct sockaddr_in *addr) {
+    c->fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (c->fd < 0) {
+        return -1;
+    }
+    c->start_ns = now_ns();
+    if (connect(c->fd, (const struct sockaddr *)addr, sizeof(*addr)) < 0 && errno != EINPROGRESS) {
+        close(c->fd);
+        c->fd = -1;
+        return -1;
+    }
+    started++;
+    return 0;
+}
+
+// 연결이 읽을 수 있게 됨: 첫 바이트면 accept 된 것, EOF/RST 면 서버가 받지 못하고 끊은 것
+static void finish_conn(storm_conn_t *c, uint64_t now) {
+    char buf[256];
+    ssize_t n = read(c->fd, buf, sizeof(buf));
+    if (n > 0) {
+        uint64_t elapsed = now - c->start_ns;
+        hdr_record(&accept_latency, elapsed);
+        served++;
+        if (elapsed >= SYN_RETRY_NS) {
+            syn_retries++;
+        }
+    } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        return; // connect 완료(POLLOUT 없이 깨어난 경우): 계속 기다림
+    } else {
+        resets++;
+    }
+    close(c->fd);
+    c->fd = -1;
+}
+
+static void print_report(const storm_config_t *cfg, double elapsed) {
+    printf("# host=%s port=%d connections=%d inflight=%d timeout=%dms\n",
+           cfg->host, cfg->port, cfg->total, cfg->inflight, cfg->timeout_ms);
+    printf("started=%lu served=%lu resets=%lu timeouts=%lu connect_errors=%lu syn_retry=%lu\n",
+           started, served, resets, timeouts, connect_errors, syn_retries);
+    printf("elapsed=%.3fs accept_rate=%.1f conn/s\n", elapsed, served / elapsed);
+    printf("first_byte_latency_us p50=%.1f p90=%.1f p99=%.1f p999=%.1f max=%.1f\n",
+           hdr_value_at_percentile(&accept_latency, 50.0) / 1e3,
+           hdr_value_at_percentile(&accept_latency, 90.0) / 1e3,
+           hdr_value_at_percentile(&accept_latency, 99.0) / 1e3,
+           hdr_value_at_percentile(&accept_latency, 99.9) / 1e3,
+           atomic_load(&accept_latency.max) / 1e3);
+}
+
+int main(int argc, char *argv[]) {
+    storm_config_t cfg = { "127.0.0.1", 8080, 2000, 256, 3000 };
+    int opt;
+    while ((opt = getopt(argc, argv, "h:p:n:b:t:")) != -1) {
+        switch (opt) {
+        case 'h': cfg.host = optarg; break;
+        case 'p': cfg.port = atoi(optarg); break;
+        case 'n': cfg.total = atoi(optarg); break;
+        case 'b': cfg.inflight = atoi(optarg); break;
+        case 't': cfg.timeout_ms = atoi(optarg); break;
+        default: usage(argv[0]);
+        }
+    }
+    if (cfg.total < 1 || cfg.inflight < 1 || cfg.inflight > MAX_INFLIGHT || cfg.timeout_ms < 1) {
+        usage(argv[0]);
+    }
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(cfg.port);
+    if (inet_pton(AF_INET, cfg.host, &addr.sin_addr) <= 0) {
+        fprintf(stderr, "잘못된 주소: %s\n", cfg.host);
+        return 1;
+    }
+
+    for (int i = 0; i < cfg.inflight; i++) {
+        conns[i].fd = -1;
+    }
+
+    uint64_t begin = now_ns();
+    uint64_t timeout_ns = (uint64_t)cfg.timeout_ms * 1000000ULL;
+    int active = 0;
+    while (1) {
+        // 빈 자리를 새 연결로 채움 (전체 수에 닿을 때까지)
+        for (int i = 0; i < cfg.inflight && (int)(started + connect_errors) < cfg.total; i++) {
+            if (conns[i].fd >= 0) continue;
+            if (start_connect(&conns[i], &addr) != 0) {
+                connect_errors++;
+            }
+        }
+
+        active = 0;
+        for (int i = 0; i < cfg.inflight; i++) {
+            pfds[i].fd = conns[i].fd; // 음수 fd 는 poll 이 건너뜀
+            pfds[i].events = POLLIN;
+            pfds[i].revents = 0;
+            if (conns[i].fd >= 0) active++;
+        }
+        if (active == 0) {
+            break;
+        }
+
+        if (poll(pfds, cfg.inflight, 10) < 0) {
+            if (errno == EINTR) continue;
+            perror("poll");
+            return 1;
+        }
+
+        uint64_t now = now_ns();
+        for (int i = 0; i < cfg.inflight; i++) {
+            if (conns[i].fd < 0) continue;
+            if (pfds[i].revents & (POLLIN | POLLERR | POLLHUP)) {
+                finish_conn(&conns[i], now);
+            } else if (now - conns[i].start_ns >= timeout_ns) {
+                timeouts++;
+                close(conns[i].fd);
+                conns[i].fd = -1;
+            }
+        }
+    }
+
+    print_report(&cfg, (now_ns() - begin) / 1e9);
+    return 0;
+}
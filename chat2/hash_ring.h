@@ -0,0 +1,92 @@
+// hash_ring.h
+// 일관 해싱 링: 키(방 이름)를 맡을 노드를 고름
+//
+// 노드마다 가상 노드 vnodes 개를 "노드 이름#번호" 의 해시 위치에 올려 두고, 키의 해시에서
+// 시계 방향으로 처음 만나는 점의 노드를 고른다.
+// - 노드 이름 목록이 같으면 어느 프로세스에서 만들어도 같은 링이 되므로 노드끼리 묻지 않아도 답이 같음
+// - 노드가 하나 늘거나 빠지면 그 노드 몫(약 1/N)의 키만 주인이 바뀜 (해시 % N 은 거의 전부 바뀜)
+// - 가상 노드가 많을수록 노드별 몫이 고르게 나뉨
+// 조회는 키 해시 한 번 + 점 배열 이진 탐색이라 메시지마다 불러도 부담이 없다.
+#ifndef HASH_RING_H
+#define HASH_RING_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#define HASH_RING_MAX_POINTS 1024    // 노드 수 * 가상 노드 수의 상한
+
+typedef struct {
+    uint32_t hash;
+    int node;
+} hash_ring_point_t;
+
+typedef struct {
+    int count;
+    hash_ring_point_t points[HASH_RING_MAX_POINTS]; // hash 오름차순
+} hash_ring_t;
+
+// FNV-1a 뒤에 murmur3 의 fmix32 로 한 번 더 섞음
+// (FNV-1a 만으로는 끝 바이트만 다른 "room1", "room2" 의 상위 비트가 비슷해 링의 한쪽에 몰림)
+static inline uint32_t hash_ring_hash(const void *data, size_t len) {
+    const unsigned char *p = data;
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h ^= p[i];
+        h *= 16777619u;
+    }
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    return h;
+}
+
+static inline int hash_ring_point_cmp(const void *a, const void *b) {
+    const hash_ring_point_t *pa = a, *pb = b;
+    if (pa->hash != pb->hash) {
+        return pa->hash < pb->hash ? -1 : 1;
+    }
+    return pa->node - pb->node; // 해시가 겹쳐도 모든 프로세스에서 같은 순서가 되도록
+}
+
+// names[i] 가 노드 i 의 이름. 점 수가 HASH_RING_MAX_POINTS 를 넘으면 -1
+static inline int hash_ring_build(hash_ring_t *r, const char *const *names, int nodes, int vnodes) {
+    char key[128];
+    if (nodes < 1 || vnodes < 1 || nodes * vnodes > HASH_RING_MAX_POINTS) {
+        return -1;
+    }
+    r->count = 0;
+    for (int n = 0; n < nodes; n++) {
+        for (int v = 0; v < vnodes; v++) {
+            int len = snprintf(key, sizeof(key), "%s#%d", names[n], v);
+            r->points[r->count].hash = hash_ring_hash(key, len < (int)sizeof(key) ? (size_t)len : sizeof(key) - 1);
+            r->points[r->count].node = n;
+            r->count++;
+        }
+    }
+    qsort(r->points, r->count, sizeof(r->points[0]), hash_ring_point_cmp);
+    return 0;
+}
+
+// 키를 맡을 노드 번호 (링이 비어 있으면 -1)
+static inline int hash_ring_lookup(const hash_ring_t *r, const char *key) {
+    if (r->count == 0) {
+        return -1;
+    }
+    uint32_t h = hash_ring_hash(key, strlen(key));
+    int lo = 0, hi = r->count; // hash >= h 인 첫 점
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (r->points[mid].hash < h) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return r->points[lo == r->count ? 0 : lo].node;
+}
+
+#endif // HASH_RING_H
@@ -0,0 +1,90 @@
+// hdr_histogram.h
+// HDR(High Dynamic Range) 방식의 지연 시간 히스토그램 (나노초 단위)
+//
+// 2의 거듭제곱 구간 [2^k, 2^(k+1)) 마다 2^HDR_SUB_BITS 개의 같은 폭 칸을 두므로
+// 1ns ~ 2^HDR_MAX_BITS ns(약 18분) 범위 전체에서 상대 오차가 1/2^HDR_SUB_BITS (0.8%) 이하.
+// 기록은 인덱스 계산 + 카운터 증가뿐이라 메시지마다 호출해도 부담이 없다.
+// - hdr_record 는 히스토그램 하나당 한 스레드만 호출 (라우터 스레드)
+// - 백분위 조회는 다른 스레드(지표 엔드포인트)에서 동시에 해도 됨 (약간 어긋난 값일 수 있음)
+#ifndef HDR_HISTOGRAM_H
+#define HDR_HISTOGRAM_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+#define HDR_SUB_BITS 7
+#define HDR_SUB_COUNT (1 << HDR_SUB_BITS)
+#define HDR_MAX_BITS 40
+#define HDR_BUCKETS ((HDR_MAX_BITS - HDR_SUB_BITS + 1) * HDR_SUB_COUNT)
+
+typedef struct {
+    _Atomic uint64_t counts[HDR_BUCKETS];
+    _Atomic uint64_t total;         // 기록된 값 개수
+    _Atomic uint64_t sum;           // 기록된 값의 합 (평균/Prometheus _sum 용)
+    _Atomic uint64_t max;
+} hdr_histogram_t;
+
+static inline int hdr_index(uint64_t v) {
+    if (v >= (1ULL << HDR_MAX_BITS)) {
+        return HDR_BUCKETS - 1;
+    }
+    if (v < HDR_SUB_COUNT) {
+        return (int)v;              // 작은 값은 1ns 단위로 정확히
+    }
+    int k = 63 - __builtin_clzll(v); // v 의 최상위 비트 위치
+    int shift = k - HDR_SUB_BITS;
+    return ((shift + 1) << HDR_SUB_BITS) + (int)((v >> shift) - HDR_SUB_COUNT);
+}
+
+// 칸 하나에 들어가는 가장 큰 값
+static inline uint64_t hdr_bucket_upper(int idx) {
+    if (idx < HDR_SUB_COUNT) {
+        return (uint64_t)idx;
+    }
+    int shift = (idx >> HDR_SUB_BITS) - 1;
+    uint64_t lower = (uint64_t)(HDR_SUB_COUNT + (idx & (HDR_SUB_COUNT - 1))) << shift;
+    return lower + (1ULL << shift) - 1;
+}
+
+static inline void hdr_add(_Atomic uint64_t *p, uint64_t v) {
+    // 기록하는 스레드가 하나뿐이므로 RMW 명령 대신 load + store
+    atomic_store_explicit(p, atomic_load_explicit(p, memory_order_relaxed) + v, memory_order_relaxed);
+}
+
+static inline void hdr_record(hdr_histogram_t *h, uint64_t v) {
+    hdr_add(&h->counts[hdr_index(v)], 1);
+    hdr_add(&h->sum, v);
+    if (v > atomic_load_explicit(&h->max, memory_order_relaxed)) {
+        atomic_store_explicit(&h->max, v, memory_order_relaxed);
+    }
+    atomic_store_explicit(&h->total, atomic_load_explicit(&h->total, memory_order_relaxed) + 1,
+                          memory_order_release);
+}
+
+static inline uint64_t hdr_count(hdr_histogram_t *h) {
+    return atomic_load_explicit(&h->total, memory_order_acquire);
+}
+
+// percentile (0~100) 위치의 값. 기록이 없으면 0
+static inline uint64_t hdr_value_at_percentile(hdr_histogram_t *h, double percentile) {
+    uint64_t total = hdr_count(h);
+    if (total == 0) {
+        return 0;
+    }
+    uint64_t target = (uint64_t)(percentile / 100.0 * total + 0.5);
+    if (target < 1) target = 1;
+    if (target > total) target = total;
+
+    uint64_t seen = 0;
+    uint64_t max = atomic_load_explicit(&h->max, memory_order_relaxed);
+    for (int i = 0; i < HDR_BUCKETS; i++) {
+        seen += atomic_load_explicit(&h->counts[i], memory_order_relaxed);
+        if (seen >= target) {
+            uint64_t v = hdr_bucket_upper(i);
+            return v < max ? v : max;
+        }
+    }
+    return max;
+}
+
+#endif // HDR_HISTOGRAM_H
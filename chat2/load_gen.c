@@ -0,0 +1,399 @@
+// load_gen.c
+// chat_server2.c 용 부하 생성기: 클라이언트 N개를 한 프로세스에서 흉내낸다.
+//
+// 각 클라이언트는 닉네임(lg<번호>)을 정하고 방 하나에 들어간 뒤 정해진 속도로
+// CHAT 메시지를 보내고, 일부는 WHISPER 로 다른 클라이언트에게 보낸다.
+// 메시지 본문에 "LG <클라이언트> <순번> <보낸 시각(ns)>" 을 넣어 두고, 같은 방으로 되돌아온
+// 자기 메시지(에코)를 받으면 보낸 시각과의 차이를 지연 시간 히스토그램에 기록한다.
+// churn 을 주면 클라이언트마다 그 간격으로 다른 방으로 옮겨 다닌다 (CMD:join).
+// 메시지는 '\n' 으로 끝내므로 서버 자식 프로세스가 줄 단위로 나눠 허브에 넘긴다.
+// query 를 주면 클라이언트마다 1초에 한 번 /users, /list 명령 N개를 요청 ID(CMD#[ID]:)를 붙여 한 번에
+// 보내고(파이프라이닝), 각 요청의 완료 줄(EVENT_REPLY_DONE)까지 걸린 시간을 따로 기록한다.
+//
+// 서버는 MAX_CLIENTS(10)명, MAX_ROOMS(5)개까지만 받으므로 기본값은 그 안에서 잡았다.
+// 허브의 클라이언트별 전송 한도(기본 초당 20개, CHAT_RATE_MSGS)를 넘는 -R 을 주면 넘친 메시지는
+// 지연되거나 거절되어 에코가 줄어든다 (허브 지표 chat_rate_limited_total 참고).
+// 연합한 여러 노드에 하나씩 붙여 같은 방을 나눠 쓸 때는 -i 로 클라이언트 번호가 겹치지 않게 해야
+// 다른 노드의 같은 번호 클라이언트 메시지를 자기 에코로 세지 않는다 (예: -i 0, -i 100, -i 200).
+//
+// 빌드: gcc -O2 -o load_gen load_gen.c
+// 실행: ./load_gen [-h 호스트] [-p 포트] [-c 클라이언트 수] [-r 방 수] [-s 메시지 크기]
+//                  [-R 클라이언트당 초당 메시지] [-d 시간(초)] [-j 방 이동 간격(초, 0=안 함)]
+//                  [-w 귓속말 비율(0~1)] [-q 초당 파이프라이닝 명령 수(0=안 함)] [-i 첫 클라이언트 번호]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "hdr_histogram.h"
+
+#define MAX_LOAD_CLIENTS 256
+#define MAX_MESSAGE_SIZE 900        // 서버 자식의 줄 버퍼(1024)보다 작게
+#define RX_BUF_SIZE 8192
+#define TX_BUF_SIZE 8192
+#define QUERY_SLOTS 64              // 클라이언트당 응답을 기다리는 명령 수 (한 번에 보내는 최대 개수)
+
+// 서버의 요청 완료 이벤트 줄: [EVENT_MARK][EVENT_REPLY_DONE][요청 ID]
+#define EVENT_MARK          '\x02'
+#define EVENT_REPLY_DONE    'D'
+#define EVENT_PING          'P'         // 허브의 연결 확인: PONG:[번호]:: 로 답해야 끊기지 않음
+
+typedef struct {
+    int fd;
+    int id;
+    int room;                       // 현재 방 번호 (room<번호>)
+    unsigned long seq;              // 다음에 보낼 메시지 순번
+    uint64_t next_send_ns;
+    uint64_t next_churn_ns;
+    uint64_t next_query_ns;
+    unsigned int next_request_id;
+    uint64_t query_sent_ns[QUERY_SLOTS]; // 요청 ID % QUERY_SLOTS 별 보낸 시각 (0: 기다리는 요청 없음)
+    char rx[RX_BUF_SIZE];
+    size_t rx_len;
+    char tx[TX_BUF_SIZE];
+    size_t tx_len;
+} load_client_t;
+
+typedef struct {
+    const char *host;
+    int port;
+    int clients;
+    int rooms;
+    int message_size;
+    double rate;                    // 클라이언트당 초당 메시지 수
+    int duration;
+    double churn;                   // 방 이동 간격 (초)
+    double whisper_ratio;
+    int queries;                    // 클라이언트당 1초마다 한 번에 보내는 명령 수
+    int first_id;                   // 첫 클라이언트 번호 (닉네임 lg<번호>, 방 room<번호 % 방 수>)
+} load_config_t;
+
+static load_client_t lc[MAX_LOAD_CLIENTS];
+static hdr_histogram_t echo_latency;
+static hdr_histogram_t cmd_latency;
+
+static unsigned long sent_chat, sent_whisper, dropped, echoes, deliveries, room_changes;
+static unsigned long sent_cmds, cmd_replies;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "사용법: %s [-h 호스트] [-p 포트] [-c 클라이언트 수] [-r 방 수] [-s 메시지 크기]\n"
+                    "          [-R 클라이언트당 초당 메시지] [-d 시간(초)] [-j 방 이동 간격(초)] [-w 귓속말 비율]\n"
+                    "          [-q 초당 파이프라이닝 명령 수] [-i 첫 클라이언트 번호]\n", prog);
+    exit(1);
+}
+
+// 보낼 데이터를 클라이언트 송신 버퍼에 추가. 가득 차 있으면 버리고 0 반환
+static int queue_send(load_client_t *c, const char *msg, size_t len) {
+    if (c->tx_len + len > sizeof(c->tx)) {
+        dropped++;
+        return 0;
+    }
+    memcpy(c->tx + c->tx_len, msg, len);
+    c->tx_len += len;
+    return 1;
+}
+
+static void flush_send(load_client_t *c) {
+    while (c->tx_len > 0) {
+        ssize_t n = write(c->fd, c->tx, c->tx_len);
+        if (n <= 0) {
+            return; // EAGAIN: POLLOUT 을 기다림
+        }
+        memmove(c->tx, c->tx + n, c->tx_len - n);
+        c->tx_len -= n;
+    }
+}
+
+static void send_command(load_client_t *c, const char *cmd, const char *arg) {
+    char msg[128];
+    int len = snprintf(msg, sizeof(msg), "CMD:%s:%s:\n", cmd, arg);
+    queue_send(c, msg, len);
+}
+
+// /users, /list 를 번갈아 n개 요청 ID를 붙여 송신 버퍼에 넣음 (한 번의 write 로 나감)
+static void send_query_burst(load_client_t *c, int n) {
+    char msg[64];
+    for (int k = 0; k < n; k++) {
+        unsigned int id = ++c->next_request_id;
+        int len = snprintf(msg, sizeof(msg), "CMD#%u:%s::\n", id, (k & 1) ? "list" : "users");
+        if (queue_send(c, msg, len)) {
+            c->query_sent_ns[id % QUERY_SLOTS] = now_ns();
+            sent_cmds++;
+        }
+    }
+}
+
+static void send_chat(load_client_t *c, const load_config_t *cfg, int whisper) {
+    char msg[MAX_MESSAGE_SIZE + 128];
+    char padding[MAX_MESSAGE_SIZE + 1];
+    char body[64];
+    int body_len = snprintf(body, sizeof(body), "LG %d %lu %llu", c->id, c->seq, (unsigned long long)now_ns());
+    int pad = cfg->message_size - body_len - 1;
+    if (pad < 0) pad = 0;
+    memset(padding, 'x', pad);
+    padding[pad] = '\0';
+
+    int len;
+    if (whisper) {
+        int target = cfg->first_id + rand() % cfg->clients;
+        len = snprintf(msg, sizeof(msg), "WHISPER:lg%d:lg%d:%s %s\n", c->id, target, body, padding);
+    } else {
+        len = snprintf(msg, sizeof(msg), "CHAT:lg%d:room%d:%s %s\n", c->id, c->room, body, padding);
+    }
+    if (queue_send(c, msg, len)) {
+        c->seq++;
+        if (whisper) sent_whisper++; else sent_chat++;
+    }
+}
+
+// 받은 한 줄 처리: 방 메시지 "[시간][lgN:roomM] LG N seq ns ..." 중 자기 것이면 지연 기록
+static void handle_line(load_client_t *c, const char *line, uint64_t recv_ns) {
+    if (line[0] == EVENT_MARK && line[1] == EVENT_PING) {
+        char pong[64];
+        int len = snprintf(pong, sizeof(pong), "PONG:%.*s::\n", (int)strcspn(line + 2, "\n"), line + 2);
+        queue_send(c, pong, len); // 보내기는 루프의 flush_send 가 함
+        return;
+    }
+    if (line[0] == EVENT_MARK && line[1] == EVENT_REPLY_DONE) {
+        unsigned int id = strtoul(line + 2, NULL, 10);
+        uint64_t *sent = &c->query_sent_ns[id % QUERY_SLOTS];
+        if (*sent != 0) {
+            cmd_replies++;
+            hdr_record(&cmd_latency, recv_ns - *sent);
+            *sent = 0;
+        }
+        return;
+    }
+    const char *tag = strstr(line, "] LG ");
+    if (tag == NULL) {
+        return;
+    }
+    deliveries++;
+    if (strstr(line, "[귓속말") != NULL) {
+        return; // 귓속말은 방 에코가 아님
+    }
+    int id;
+    unsigned long seq;
+    unsigned long long sent_ns;
+    if (sscanf(tag + 2, "LG %d %lu %llu", &id, &seq, &sent_ns) == 3 && id == c->id) {
+        echoes++;
+        hdr_record(&echo_latency, recv_ns - sent_ns);
+    }
+}
+
+static int handle_readable(load_client_t *c) {
+    ssize_t n = read(c->fd, c->rx + c->rx_len, sizeof(c->rx) - c->rx_len - 1);
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+        return -1;
+    }
+    if (n < 0) {
+        return 0;
+    }
+    uint64_t recv_ns = now_ns();
+    c->rx_len += n;
+    c->rx[c->rx_len] = '\0';
+
+    char *start = c->rx;
+    char *nl;
+    while ((nl = strchr(start, '\n')) != NULL) {
+        *nl = '\0';
+        handle_line(c, start, recv_ns);
+        start = nl + 1;
+    }
+    c->rx_len -= start - c->rx;
+    memmove(c->rx, start, c->rx_len);
+    if (c->rx_len == sizeof(c->rx) - 1) {
+        c->rx_len = 0; // 줄바꿈 없이 버퍼가 가득 찬 경우 버림
+    }
+    return 0;
+}
+
+static int connect_client(load_client_t *c, const load_config_t *cfg, int id) {
+    struct sockaddr_in addr;
+    memset(c, 0, sizeof(*c));
+    c->id = id;
+    c->room = id % cfg->rooms;
+    c->fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (c->fd < 0) {
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(cfg->port);
+    if (inet_pton(AF_INET, cfg->host, &addr.sin_addr) <= 0 ||
+        connect(c->fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(c->fd);
+        return -1;
+    }
+    fcntl(c->fd, F_SETFL, fcntl(c->fd, F_GETFL, 0) | O_NONBLOCK);
+    int one = 1; // 작은 메시지가 Nagle 알고리즘에 묶여 지연 측정이 부풀려지지 않도록
+    setsockopt(c->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    char arg[32];
+    snprintf(arg, sizeof(arg), "lg%d", id);
+    send_command(c, "nickname", arg);
+    snprintf(arg, sizeof(arg), "room%d", c->room);
+    send_command(c, "join", arg);
+    flush_send(c);
+    return 0;
+}
+
+// 처리율은 전송 구간(duration) 기준. 끝난 뒤 에코를 기다린 시간은 포함하지 않음
+static void print_report(const load_config_t *cfg) {
+    double elapsed = cfg->duration;
+    printf("# clients=%d rooms=%d size=%d rate=%.1f/s/client churn=%.1fs whisper=%.2f duration=%ds\n",
+           cfg->clients, cfg->rooms, cfg->message_size, cfg->rate, cfg->churn, cfg->whisper_ratio, cfg->duration);
+    printf("sent_chat=%lu sent_whisper=%lu dropped=%lu room_changes=%lu\n",
+           sent_chat, sent_whisper, dropped, room_changes);
+    printf("echoes=%lu deliveries=%lu\n", echoes, deliveries);
+    printf("send_rate=%.1f msg/s delivery_rate=%.1f msg/s\n",
+           (sent_chat + sent_whisper) / elapsed, deliveries / elapsed);
+    printf("echo_latency_us p50=%.1f p90=%.1f p99=%.1f p999=%.1f max=%.1f\n",
+           hdr_value_at_percentile(&echo_latency, 50.0) / 1e3,
+           hdr_value_at_percentile(&echo_latency, 90.0) / 1e3,
+           hdr_value_at_percentile(&echo_latency, 99.0) / 1e3,
+           hdr_value_at_percentile(&echo_latency, 99.9) / 1e3,
+           atomic_load(&echo_latency.max) / 1e3);
+    if (cfg->queries > 0) {
+        printf("sent_cmds=%lu cmd_replies=%lu (burst=%d/s/client)\n", sent_cmds, cmd_replies, cfg->queries);
+        printf("cmd_latency_us p50=%.1f p90=%.1f p99=%.1f p999=%.1f max=%.1f\n",
+               hdr_value_at_percentile(&cmd_latency, 50.0) / 1e3,
+               hdr_value_at_percentile(&cmd_latency, 90.0) / 1e3,
+               hdr_value_at_percentile(&cmd_latency, 99.0) / 1e3,
+               hdr_value_at_percentile(&cmd_latency, 99.9) / 1e3,
+               atomic_load(&cmd_latency.max) / 1e3);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    load_config_t cfg = { "127.0.0.1", 8080, 8, 3, 64, 10.0, 10, 0.0, 0.0, 0, 0 };
+    int opt;
+    while ((opt = getopt(argc, argv, "h:p:c:r:s:R:d:j:w:q:i:")) != -1) {
+        switch (opt) {
+        case 'h': cfg.host = optarg; break;
+        case 'p': cfg.port = atoi(optarg); break;
+        case 'c': cfg.clients = atoi(optarg); break;
+        case 'r': cfg.rooms = atoi(optarg); break;
+        case 's': cfg.message_size = atoi(optarg); break;
+        case 'R': cfg.rate = atof(optarg); break;
+        case 'd': cfg.duration = atoi(optarg); break;
+        case 'j': cfg.churn = atof(optarg); break;
+        case 'w': cfg.whisper_ratio = atof(optarg); break;
+        case 'q': cfg.queries = atoi(optarg); break;
+        case 'i': cfg.first_id = atoi(optarg); break;
+        default: usage(argv[0]);
+        }
+    }
+    if (cfg.clients < 1 || cfg.clients > MAX_LOAD_CLIENTS || cfg.rooms < 1 || cfg.rate <= 0 ||
+        cfg.message_size < 1 || cfg.message_size > MAX_MESSAGE_SIZE || cfg.duration < 1 ||
+        cfg.queries < 0 || cfg.queries > QUERY_SLOTS || cfg.first_id < 0) {
+        usage(argv[0]);
+    }
+    srand(getpid());
+
+    for (int i = 0; i < cfg.clients; i++) {
+        if (connect_client(&lc[i], &cfg, cfg.first_id + i) != 0) {
+            perror("서버 연결 실패");
+            return 1;
+        }
+    }
+    usleep(200000); // 닉네임/방 설정이 먼저 처리되도록
+
+    uint64_t interval_ns = (uint64_t)(1e9 / cfg.rate);
+    uint64_t start = now_ns();
+    uint64_t end = start + (uint64_t)cfg.duration * 1000000000ULL;
+    for (int i = 0; i < cfg.clients; i++) {
+        // 전송 시각을 간격 안에서 고르게 흩어 놓음
+        lc[i].next_send_ns = start + interval_ns * i / cfg.clients;
+        lc[i].next_churn_ns = cfg.churn > 0 ? start + (uint64_t)(cfg.churn * 1e9 * (i + 1) / cfg.clients) : UINT64_MAX;
+        lc[i].next_query_ns = cfg.queries > 0 ? start + 1000000000ULL * i / cfg.clients : UINT64_MAX;
+    }
+
+    struct pollfd pfds[MAX_LOAD_CLIENTS];
+    int alive = cfg.clients;
+    uint64_t now;
+    while ((now = now_ns()) < end + 500000000ULL && alive > 0) { // 끝난 뒤 0.5초 동안 남은 에코 수신
+        uint64_t next = end + 500000000ULL;
+        for (int i = 0; i < cfg.clients; i++) {
+            load_client_t *c = &lc[i];
+            if (c->fd < 0) {
+                continue;
+            }
+            if (now < end) {
+                while (c->next_send_ns <= now) {
+                    send_chat(c, &cfg, (double)rand() / RAND_MAX < cfg.whisper_ratio);
+                    c->next_send_ns += interval_ns;
+                }
+                if (c->next_churn_ns <= now) {
+                    char arg[32];
+                    c->room = (c->room + 1) % cfg.rooms;
+                    snprintf(arg, sizeof(arg), "room%d", c->room);
+                    send_command(c, "join", arg);
+                    room_changes++;
+                    c->next_churn_ns += (uint64_t)(cfg.churn * 1e9);
+                }
+                if (c->next_query_ns <= now) {
+                    send_query_burst(c, cfg.queries);
+                    c->next_query_ns += 1000000000ULL;
+                }
+                if (c->next_send_ns < next) next = c->next_send_ns;
+                if (c->next_churn_ns < next) next = c->next_churn_ns;
+                if (c->next_query_ns < next) next = c->next_query_ns;
+            }
+            flush_send(c);
+        }
+
+        int n = 0;
+        for (int i = 0; i < cfg.clients; i++) {
+            if (lc[i].fd < 0) {
+                continue;
+            }
+            pfds[n].fd = lc[i].fd;
+            pfds[n].events = POLLIN | (lc[i].tx_len > 0 ? POLLOUT : 0);
+            pfds[n].revents = 0;
+            n++;
+        }
+        now = now_ns();
+        int timeout_ms = next > now ? (int)((next - now) / 1000000) : 0;
+        if (poll(pfds, n, timeout_ms) < 0 && errno != EINTR) {
+            perror("poll 에러");
+            break;
+        }
+        for (int k = 0, i = 0; k < n; k++, i++) {
+            while (lc[i].fd != pfds[k].fd) i++;
+            if (pfds[k].revents & (POLLIN | POLLHUP | POLLERR)) {
+                if (handle_readable(&lc[i]) != 0) {
+                    fprintf(stderr, "클라이언트 lg%d: 서버 연결 종료\n", lc[i].id);
+                    close(lc[i].fd);
+                    lc[i].fd = -1;
+                    alive--;
+                    continue;
+                }
+            }
+            if (pfds[k].revents & POLLOUT) {
+                flush_send(&lc[i]);
+            }
+        }
+    }
+
+    print_report(&cfg);
+    for (int i = 0; i < cfg.clients; i++) {
+        if (lc[i].fd >= 0) {
+            close(lc[i].fd);
+        }
+    }
+    return 0;
+}
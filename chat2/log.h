@@ -0,0 +1,162 @@
+// log.h
+// 컴파일 타임 + 런타임 레벨 게이트를 가진 로그 매크로
+//
+// - LOG_COMPILE_LEVEL 보다 상세한 레벨의 호출은 조건이 상수 0이 되어 코드째 사라짐
+//   (기본값 LOG_LEVEL_INFO, 디버그 빌드: -DLOG_COMPILE_LEVEL=LOG_LEVEL_DEBUG)
+// - 런타임 레벨(log_runtime_level)보다 상세한 호출은 인자를 평가하지도, 포맷하지도 않음
+// - LOG_RATELIMITED 는 호출 위치마다 interval_ms 에 한 번만 출력하고, 생략된 횟수를 함께 출력
+// - 한 줄을 write() 한 번으로 내보내므로 여러 프로세스/스레드가 같은 파일에 써도 줄이 섞이지 않음
+//
+// 환경 변수 (log_init 에서 읽음)
+//   CHAT_LOG_LEVEL = error | warn | info | debug | off (그 밖의 값은 stderr 에 알리고 기본값 유지)
+//   CHAT_LOG_FILE  = 로그 파일 경로 (없으면 stderr. daemonize 이후라면 /dev/null 이므로 로그 끔)
+// 데몬은 daemonize() 전에 log_init 을 불러야 잘못된 설정이 터미널에 보이고, 상대 경로가
+// 실행한 디렉터리 기준으로 열림. daemonize() 뒤에는 log_disable_if_devnull() 을 다시 부름
+#ifndef CHAT_LOG_H
+#define CHAT_LOG_H
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stdlib.h>
+#include <strings.h>
+#include <time.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+
+#define LOG_LEVEL_OFF   -1
+#define LOG_LEVEL_ERROR  0
+#define LOG_LEVEL_WARN   1
+#define LOG_LEVEL_INFO   2
+#define LOG_LEVEL_DEBUG  3
+
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL LOG_LEVEL_INFO
+#endif
+
+static int log_runtime_level = LOG_LEVEL_INFO;
+static int log_fd = STDERR_FILENO;
+
+#define LOG_ENABLED(level) ((level) <= LOG_COMPILE_LEVEL && (level) <= log_runtime_level)
+
+#define LOG_AT(level, ...)                          \
+    do {                                            \
+        if (LOG_ENABLED(level)) {                   \
+            log_write((level), 0, __VA_ARGS__);     \
+        }                                           \
+    } while (0)
+
+#define LOG_ERROR(...) LOG_AT(LOG_LEVEL_ERROR, __VA_ARGS__)
+#define LOG_WARN(...)  LOG_AT(LOG_LEVEL_WARN, __VA_ARGS__)
+#define LOG_INFO(...)  LOG_AT(LOG_LEVEL_INFO, __VA_ARGS__)
+#define LOG_DEBUG(...) LOG_AT(LOG_LEVEL_DEBUG, __VA_ARGS__)
+
+// 핫 패스용: 호출 위치마다 interval_ms 안에 한 번만 출력
+#define LOG_RATELIMITED(level, interval_ms, ...)                                \
+    do {                                                                        \
+        if (LOG_ENABLED(level)) {                                               \
+            static long log_rl_last_ms_ = -1000000000L;                         \
+            static long log_rl_suppressed_ = 0;                                 \
+            long log_rl_now_ = log_coarse_ms();                                 \
+            if (log_rl_now_ - log_rl_last_ms_ >= (interval_ms)) {               \
+                log_write((level), log_rl_suppressed_, __VA_ARGS__);            \
+                log_rl_last_ms_ = log_rl_now_;                                  \
+                log_rl_suppressed_ = 0;                                         \
+            } else {                                                            \
+                log_rl_suppressed_++;                                           \
+            }                                                                   \
+        }                                                                       \
+    } while (0)
+
+// 저렴한 단조 시계 (밀리초, 정밀도는 틱 단위)
+static inline long log_coarse_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return ts.tv_sec * 1000L + ts.tv_nsec / 1000000L;
+}
+
+static const char *log_level_name(int level) {
+    switch (level) {
+    case LOG_LEVEL_ERROR: return "ERROR";
+    case LOG_LEVEL_WARN:  return "WARN";
+    case LOG_LEVEL_INFO:  return "INFO";
+    default:              return "DEBUG";
+    }
+}
+
+__attribute__((format(printf, 3, 4)))
+static void log_write(int level, long suppressed, const char *fmt, ...) {
+    char line[2048];
+    char now[32];
+    time_t t = time(NULL);
+    struct tm tm;
+    localtime_r(&t, &tm);
+    strftime(now, sizeof(now), "%Y-%m-%d %H:%M:%S", &tm);
+
+    int len = snprintf(line, sizeof(line), "[%s][%s] ", now, log_level_name(level));
+    va_list ap;
+    va_start(ap, fmt);
+    len += vsnprintf(line + len, sizeof(line) - len, fmt, ap);
+    va_end(ap);
+    if (len > (int)sizeof(line) - 64) {
+        len = sizeof(line) - 64; // 잘린 경우에도 접미사와 개행을 붙일 공간 확보
+    }
+    if (suppressed > 0) {
+        len += snprintf(line + len, sizeof(line) - len, " (이전 %ld건 생략)", suppressed);
+    }
+    line[len++] = '\n';
+    write(log_fd, line, len);
+}
+
+// 알 수 없는 이름이면 -2
+static int log_parse_level(const char *s) {
+    if (strcasecmp(s, "error") == 0) return LOG_LEVEL_ERROR;
+    if (strcasecmp(s, "warn") == 0)  return LOG_LEVEL_WARN;
+    if (strcasecmp(s, "info") == 0)  return LOG_LEVEL_INFO;
+    if (strcasecmp(s, "debug") == 0) return LOG_LEVEL_DEBUG;
+    if (strcasecmp(s, "off") == 0)   return LOG_LEVEL_OFF;
+    return -2;
+}
+
+// 출력 대상이 /dev/null 인지 (그렇다면 포맷 비용을 아예 내지 않도록 로그를 끔)
+static int log_fd_is_devnull(int fd) {
+    struct stat st;
+    return fstat(fd, &st) == 0 && S_ISCHR(st.st_mode) &&
+           major(st.st_rdev) == 1 && minor(st.st_rdev) == 3;
+}
+
+static void log_disable_if_devnull(void) {
+    if (log_fd_is_devnull(log_fd)) {
+        log_runtime_level = LOG_LEVEL_OFF;
+    }
+}
+
+// 환경 변수에서 레벨과 출력 파일을 읽음. 설정 오류는 stderr 에 알리고 기본값으로 계속함
+static void log_init(void) {
+    const char *level = getenv("CHAT_LOG_LEVEL");
+    const char *path = getenv("CHAT_LOG_FILE");
+
+    if (level != NULL) {
+        int parsed = log_parse_level(level);
+        if (parsed == -2) {
+            fprintf(stderr, "CHAT_LOG_LEVEL=%s 을(를) 알 수 없어 %s 레벨로 기록합니다 (error|warn|info|debug|off)\n",
+                    level, log_level_name(log_runtime_level));
+        } else {
+            log_runtime_level = parsed;
+        }
+    }
+    if (path != NULL) {
+        int fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if (fd >= 0) {
+            log_fd = fd;
+        } else {
+            fprintf(stderr, "CHAT_LOG_FILE=%s 을(를) 열 수 없습니다: %s\n", path, strerror(errno));
+        }
+    }
+    log_disable_if_devnull();
+}
+
+#endif // CHAT_LOG_H
@@ -0,0 +1,238 @@
+// metrics.h
+// 스레드별 샤드에 누적하는 카운터/게이지 레지스트리 + Prometheus 텍스트 형식 HTTP 엔드포인트
+//
+// - 값 갱신(metrics_add/metrics_inc)은 자기 스레드 샤드에 relaxed atomic 더하기 한 번.
+//   다른 스레드와 캐시 라인을 공유하지 않으므로 경쟁이 없고, 시그널 핸들러에서 호출해도 안전
+// - 스크레이프 시 모든 샤드를 더해서 출력 (락 없음, 순간적으로 약간 어긋난 값일 수 있음)
+// - 게이지도 샤드별 증감(+1/-1)의 합으로 표현. 이미 다른 구조(스레드 풀 등)가 세고 있는 값은
+//   metrics_register_callback 으로 스크레이프 시점에 함수를 호출해 읽음
+// - 히스토그램 요약처럼 여러 줄짜리 지표는 metrics_register_collector 로 직접 출력
+// - 등록(metrics_register*)은 metrics_serve_start 전에 메인 스레드에서 모두 끝내야 함
+// - 엔드포인트는 127.0.0.1 에만 바인딩하며, 전용 스레드가 요청을 하나씩 처리함
+//   예) curl http://127.0.0.1:9180/metrics
+// - fork 한 자식은 metrics_close_listener() 로 상속받은 리스닝 소켓을 닫아야 함
+//
+// 사용 시 -pthread 로 빌드해야 함
+#ifndef CHAT_METRICS_H
+#define CHAT_METRICS_H
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define METRICS_MAX 64              // 등록 가능한 시계열 수
+#define METRICS_MAX_SHARDS 32       // 샤드 수 (초과한 스레드는 마지막 샤드를 공유)
+#define METRICS_RENDER_SIZE 32768   // 스크레이프 응답 본문 최대 크기
+
+typedef enum { METRIC_COUNTER, METRIC_GAUGE } metric_kind_t;
+
+typedef struct {
+    metric_kind_t kind;
+    const char *name;               // 시계열 이름 (같은 이름을 연속으로 등록하면 한 family)
+    const char *labels;             // 예: type="CHAT" (없으면 NULL)
+    const char *help;
+    long (*read_fn)(void);          // 콜백 지표면 스크레이프 시 호출
+} metric_desc_t;
+
+typedef struct {
+    _Atomic long v[METRICS_MAX];
+} __attribute__((aligned(64))) metrics_shard_t;
+
+static metric_desc_t metrics_desc[METRICS_MAX];
+static atomic_int metrics_count;
+static metrics_shard_t metrics_shards[METRICS_MAX_SHARDS];
+static atomic_int metrics_shard_next;
+static _Thread_local metrics_shard_t *metrics_my_shard;
+static int metrics_listen_fd = -1;
+
+// 스레드가 처음 값을 갱신할 때 샤드 하나를 배정
+static metrics_shard_t *metrics_attach_thread(void) {
+    int idx = atomic_fetch_add_explicit(&metrics_shard_next, 1, memory_order_relaxed);
+    if (idx >= METRICS_MAX_SHARDS) {
+        idx = METRICS_MAX_SHARDS - 1;
+    }
+    metrics_my_shard = &metrics_shards[idx];
+    return metrics_my_shard;
+}
+
+static inline void metrics_add(int id, long delta) {
+    metrics_shard_t *shard = metrics_my_shard;
+    if (shard == NULL) {
+        shard = metrics_attach_thread();
+    }
+    atomic_fetch_add_explicit(&shard->v[id], delta, memory_order_relaxed);
+}
+
+static inline void metrics_inc(int id) {
+    metrics_add(id, 1);
+}
+
+static inline long metrics_value(int id) {
+    long sum = 0;
+    for (int i = 0; i < METRICS_MAX_SHARDS; i++) {
+        sum += atomic_load_explicit(&metrics_shards[i].v[id], memory_order_relaxed);
+    }
+    return sum;
+}
+
+// 시계열 등록. 성공 시 id, 가득 차면 -1
+static int metrics_register_desc(metric_desc_t desc) {
+    int id = atomic_load_explicit(&metrics_count, memory_order_relaxed);
+    if (id >= METRICS_MAX) {
+        return -1;
+    }
+    metrics_desc[id] = desc;
+    atomic_store_explicit(&metrics_count, id + 1, memory_order_release);
+    return id;
+}
+
+static inline int metrics_register(metric_kind_t kind, const char *name, const char *labels, const char *help) {
+    metric_desc_t desc = { kind, name, labels, help, NULL };
+    return metrics_register_desc(desc);
+}
+
+static inline int metrics_register_callback(metric_kind_t kind, const char *name, const char *labels, const char *help,
+                                            long (*read_fn)(void)) {
+    metric_desc_t desc = { kind, name, labels, help, read_fn };
+    return metrics_register_desc(desc);
+}
+
+// 요약(summary)처럼 여러 줄을 직접 만들어야 하는 지표용: 스크레이프마다 buf 에 써 넣고
+// 길이를 반환 (size 미만이어야 함)
+typedef size_t (*metrics_collector_fn)(char *buf, size_t size);
+
+#define METRICS_MAX_COLLECTORS 4
+static metrics_collector_fn metrics_collectors[METRICS_MAX_COLLECTORS];
+static atomic_int metrics_collector_count;
+
+static int metrics_register_collector(metrics_collector_fn fn) {
+    int n = atomic_load_explicit(&metrics_collector_count, memory_order_relaxed);
+    if (n >= METRICS_MAX_COLLECTORS) {
+        return -1;
+    }
+    metrics_collectors[n] = fn;
+    atomic_store_explicit(&metrics_collector_count, n + 1, memory_order_release);
+    return 0;
+}
+
+// Prometheus 텍스트 형식(0.0.4)으로 buf 에 기록하고 길이를 반환
+static size_t metrics_render(char *buf, size_t size) {
+    int count = atomic_load_explicit(&metrics_count, memory_order_acquire);
+    size_t len = 0;
+    for (int id = 0; id < count && len < size; id++) {
+        const metric_desc_t *d = &metrics_desc[id];
+        if (id == 0 || strcmp(metrics_desc[id - 1].name, d->name) != 0) {
+            len += snprintf(buf + len, size - len, "# HELP %s %s\n# TYPE %s %s\n",
+                            d->name, d->help, d->name, d->kind == METRIC_COUNTER ? "counter" : "gauge");
+            if (len >= size) {
+                break;
+            }
+        }
+        long value = d->read_fn ? d->read_fn() : metrics_value(id);
+        if (d->labels) {
+            len += snprintf(buf + len, size - len, "%s{%s} %ld\n", d->name, d->labels, value);
+        } else {
+            len += snprintf(buf + len, size - len, "%s %ld\n", d->name, value);
+        }
+    }
+    int collectors = atomic_load_explicit(&metrics_collector_count, memory_order_acquire);
+    for (int i = 0; i < collectors && len < size; i++) {
+        len += metrics_collectors[i](buf + len, size - len);
+    }
+    return len < size ? len : size - 1;
+}
+
+static void *metrics_serve_main(void *arg) {
+    int listen_fd = *(int *)arg;
+    static char body[METRICS_RENDER_SIZE];
+    char request[1024];
+    char header[256];
+
+    for (;;) {
+        int fd = accept(listen_fd, NULL, NULL);
+        if (fd < 0) {
+            continue;
+        }
+        struct timeval tv = { 1, 0 }; // 요청을 보내지 않는 연결이 스레드를 붙잡지 않도록
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        ssize_t n = read(fd, request, sizeof(request) - 1);
+        if (n <= 0) {
+            close(fd);
+            continue;
+        }
+        request[n] = '\0';
+
+        size_t body_len;
+        const char *status;
+        if (strncmp(request, "GET /metrics", 12) == 0 || strncmp(request, "GET / ", 6) == 0) {
+            status = "200 OK";
+            body_len = metrics_render(body, sizeof(body));
+        } else {
+            status = "404 Not Found";
+            body_len = snprintf(body, sizeof(body), "not found\n");
+        }
+        int header_len = snprintf(header, sizeof(header),
+                                  "HTTP/1.0 %s\r\n"
+                                  "Content-Type: text/plain; version=0.0.4\r\n"
+                                  "Content-Length: %zu\r\n"
+                                  "Connection: close\r\n\r\n", status, body_len);
+        write(fd, header, header_len);
+        write(fd, body, body_len);
+        close(fd);
+    }
+    return NULL;
+}
+
+// 127.0.0.1:port 에서 엔드포인트 스레드 시작. 성공 시 0
+static int metrics_serve_start(int port) {
+    static int fd_for_thread;
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    int opt = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 8) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    // 엔드포인트 스레드는 시그널을 받지 않도록 모든 시그널을 막은 상태로 생성
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    pthread_t tid;
+    fd_for_thread = fd;
+    int rc = pthread_create(&tid, NULL, metrics_serve_main, &fd_for_thread);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (rc != 0) {
+        close(fd);
+        return -1;
+    }
+    pthread_detach(tid);
+    metrics_listen_fd = fd;
+    return 0;
+}
+
+// fork 한 자식 프로세스에서 호출 (자식에는 엔드포인트 스레드가 없음)
+static inline void metrics_close_listener(void) {
+    if (metrics_listen_fd >= 0) {
+        close(metrics_listen_fd);
+        metrics_listen_fd = -1;
+    }
+}
+
+#endif // CHAT_METRICS_H
@@ -0,0 +1,239 @@
+// mpsc_bench.c
+// 메시지 수신 경로(리더 스레드 N개 -> 라우터 스레드 1개) 핸드오프 벤치마크
+//   1) mpsc_queue.h 의 락 없는 MPSC 큐 (배치 dequeue)
+//   2) mutex + condvar 로 보호되는 연결 리스트 큐 (배치 dequeue)
+// 생산자 스레드 수를 1~32 로 바꿔 가며 초당 처리 메시지 수와 메시지당 지연(ns)을 측정한다.
+//
+// 빌드: gcc -O2 -o mpsc_bench mpsc_bench.c -pthread
+// 실행: ./mpsc_bench [전체 메시지 수 (기본 500000, 생산자들이 나눠서 보냄)]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include "mpsc_queue.h"
+
+#define MAX_PRODUCERS 32
+#define BATCH_SIZE 64           // 소비자가 한 번에 꺼내는 최대 레코드 수
+
+// 파싱된 메시지 레코드 (chat_server2.c 의 TYPE:ARG1:ARG2:CONTENT 형식을 흉내냄)
+typedef struct {
+    mpsc_node_t node;           // 큐 연결용 (침투형)
+    int sender_pipe_read_fd;    // 보낸 클라이언트 식별자
+    int producer_id;
+    unsigned long seq;          // 생산자별 순서 번호 (FIFO 검증용)
+    char type[8];
+    char arg1[32];
+    char arg2[32];
+    char content[128];
+} msg_record_t;
+
+// ===========================================
+// mutex + condvar 큐 (비교 대상)
+// ===========================================
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    mpsc_node_t *first;
+    mpsc_node_t *last;
+} locked_queue_t;
+
+static void locked_queue_init(locked_queue_t *q) {
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->not_empty, NULL);
+    q->first = q->last = NULL;
+}
+
+static void locked_queue_push(locked_queue_t *q, mpsc_node_t *node) {
+    atomic_store_explicit(&node->next, NULL, memory_order_relaxed);
+    pthread_mutex_lock(&q->lock);
+    int was_empty = (q->first == NULL);
+    if (q->last) {
+        atomic_store_explicit(&q->last->next, node, memory_order_relaxed);
+    } else {
+        q->first = node;
+    }
+    q->last = node;
+    pthread_mutex_unlock(&q->lock);
+    if (was_empty) {
+        pthread_cond_signal(&q->not_empty);
+    }
+}
+
+// 최대 max개를 꺼냄. 비어 있으면 condvar에서 대기 (timeout_ms 후 0 반환)
+static size_t locked_queue_pop_batch(locked_queue_t *q, mpsc_node_t **out, size_t max, int timeout_ms) {
+    size_t n = 0;
+    pthread_mutex_lock(&q->lock);
+    if (q->first == NULL) {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_nsec += (long)timeout_ms * 1000000L;
+        ts.tv_sec += ts.tv_nsec / 1000000000L;
+        ts.tv_nsec %= 1000000000L;
+        while (q->first == NULL) {
+            if (pthread_cond_timedwait(&q->not_empty, &q->lock, &ts) != 0) {
+                break;
+            }
+        }
+    }
+    while (n < max && q->first) {
+        out[n++] = q->first;
+        q->first = atomic_load_explicit(&q->first->next, memory_order_relaxed);
+    }
+    if (q->first == NULL) {
+        q->last = NULL;
+    }
+    pthread_mutex_unlock(&q->lock);
+    return n;
+}
+
+// ===========================================
+// 벤치마크 공통
+// ===========================================
+typedef enum { IMPL_LOCKFREE, IMPL_LOCKED } impl_t;
+
+typedef struct {
+    impl_t impl;
+    mpsc_queue_t lf;
+    locked_queue_t lk;
+    int producers;
+    unsigned long per_producer;
+    msg_record_t *records;      // producers * per_producer 개, 미리 할당
+    atomic_int start;
+} bench_t;
+
+typedef struct {
+    bench_t *b;
+    int id;
+} producer_arg_t;
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *producer_main(void *arg) {
+    producer_arg_t *pa = arg;
+    bench_t *b = pa->b;
+    msg_record_t *mine = b->records + (size_t)pa->id * b->per_producer;
+
+    while (!atomic_load_explicit(&b->start, memory_order_acquire)) {
+        sched_yield();
+    }
+    for (unsigned long i = 0; i < b->per_producer; i++) {
+        msg_record_t *r = &mine[i];
+        if (b->impl == IMPL_LOCKFREE) {
+            mpsc_queue_push(&b->lf, &r->node);
+        } else {
+            locked_queue_push(&b->lk, &r->node);
+        }
+    }
+    return NULL;
+}
+
+// 소비자(라우터) 역할: 모든 메시지를 받을 때까지 배치로 꺼내며 생산자별 FIFO 순서를 검증
+static int consume_all(bench_t *b) {
+    unsigned long total = (unsigned long)b->producers * b->per_producer;
+    unsigned long received = 0;
+    unsigned long next_seq[MAX_PRODUCERS] = {0};
+    mpsc_node_t *batch[BATCH_SIZE];
+    int order_errors = 0;
+
+    while (received < total) {
+        size_t n;
+        if (b->impl == IMPL_LOCKFREE) {
+            n = mpsc_queue_pop_batch(&b->lf, batch, BATCH_SIZE);
+            if (n == 0) {
+                sched_yield();
+                continue;
+            }
+        } else {
+            n = locked_queue_pop_batch(&b->lk, batch, BATCH_SIZE, 10);
+        }
+        for (size_t i = 0; i < n; i++) {
+            msg_record_t *r = mpsc_container_of(batch[i], msg_record_t, node);
+            if (r->seq != next_seq[r->producer_id]) {
+                order_errors++;
+            }
+            next_seq[r->producer_id] = r->seq + 1;
+        }
+        received += n;
+    }
+    return order_errors;
+}
+
+static void run_one(impl_t impl, int producers, unsigned long per_producer) {
+    bench_t b;
+    memset(&b, 0, sizeof(b));
+    b.impl = impl;
+    b.producers = producers;
+    b.per_producer = per_producer;
+    mpsc_queue_init(&b.lf);
+    locked_queue_init(&b.lk);
+    atomic_init(&b.start, 0);
+
+    size_t total = (size_t)producers * per_producer;
+    b.records = calloc(total, sizeof(msg_record_t));
+    if (b.records == NULL) {
+        perror("레코드 할당 실패");
+        exit(EXIT_FAILURE);
+    }
+    for (int p = 0; p < producers; p++) {
+        for (unsigned long i = 0; i < per_producer; i++) {
+            msg_record_t *r = &b.records[(size_t)p * per_producer + i];
+            r->producer_id = p;
+            r->seq = i;
+            r->sender_pipe_read_fd = 100 + p;
+            strcpy(r->type, "CHAT");
+            snprintf(r->arg1, sizeof(r->arg1), "user%d", p);
+            strcpy(r->arg2, "general");
+            snprintf(r->content, sizeof(r->content), "message %lu", i);
+        }
+    }
+
+    pthread_t tids[MAX_PRODUCERS];
+    producer_arg_t args[MAX_PRODUCERS];
+    for (int p = 0; p < producers; p++) {
+        args[p].b = &b;
+        args[p].id = p;
+        pthread_create(&tids[p], NULL, producer_main, &args[p]);
+    }
+
+    double t0 = now_sec();
+    atomic_store_explicit(&b.start, 1, memory_order_release);
+    int order_errors = consume_all(&b);
+    double elapsed = now_sec() - t0;
+
+    for (int p = 0; p < producers; p++) {
+        pthread_join(tids[p], NULL);
+    }
+
+    printf("%-9s %9d %14.2f %12.1f %8d\n",
+           impl == IMPL_LOCKFREE ? "lockfree" : "mutex",
+           producers, total / elapsed / 1e6, elapsed * 1e9 / total, order_errors);
+    fflush(stdout);
+    free(b.records);
+}
+
+int main(int argc, char *argv[]) {
+    unsigned long total = 500000;
+    if (argc > 1) {
+        total = strtoul(argv[1], NULL, 10);
+        if (total < MAX_PRODUCERS) {
+            fprintf(stderr, "사용법: %s [전체 메시지 수 (%d 이상)]\n", argv[0], MAX_PRODUCERS);
+            return 1;
+        }
+    }
+
+    static const int producer_counts[] = {1, 2, 4, 8, 16, 32};
+    printf("# 전체 메시지 %lu개, 배치 크기 %d\n", total, BATCH_SIZE);
+    printf("%-9s %9s %14s %12s %8s\n", "impl", "producers", "Mmsg/s", "ns/msg", "order_err");
+    for (size_t i = 0; i < sizeof(producer_counts) / sizeof(producer_counts[0]); i++) {
+        unsigned long per_producer = total / producer_counts[i];
+        run_one(IMPL_LOCKFREE, producer_counts[i], per_producer);
+        run_one(IMPL_LOCKED, producer_counts[i], per_producer);
+    }
+    return 0;
+}
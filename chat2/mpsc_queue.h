@@ -0,0 +1,100 @@
+// mpsc_queue.h
+// 락 없는(lock-free) 다중 생산자 / 단일 소비자(MPSC) 침투형(intrusive) 큐
+//
+// 여러 리더 스레드가 클라이언트 소켓에서 읽어 파싱한 메시지 레코드를
+// 하나의 라우터 스레드(process_message_from_child 역할)에게 넘길 때 사용한다.
+// - 생산자(push)는 atomic_exchange 한 번 + store 한 번, 대기 없음 (wait-free)
+// - 소비자(pop/pop_batch)는 한 스레드만 호출해야 함
+// - 노드는 레코드 구조체 안에 포함(mpsc_node_t)되므로 push 시 메모리 할당이 없음
+//
+// 알고리즘: Dmitry Vyukov의 intrusive MPSC node-based queue (stub 노드 사용)
+#ifndef MPSC_QUEUE_H
+#define MPSC_QUEUE_H
+
+#include <stddef.h>
+#include <stdatomic.h>
+
+typedef struct mpsc_node {
+    _Atomic(struct mpsc_node *) next;
+} mpsc_node_t;
+
+typedef struct {
+    _Atomic(mpsc_node_t *) head; // 생산자들이 붙이는 쪽 (가장 최근 노드)
+    char pad[64 - sizeof(void *)]; // head와 tail이 같은 캐시 라인을 공유하지 않도록
+    mpsc_node_t *tail;           // 소비자만 접근하는 쪽 (가장 오래된 노드)
+    mpsc_node_t stub;
+} mpsc_queue_t;
+
+// 노드 포인터에서 이를 포함한 레코드 구조체 포인터를 구함
+#define mpsc_container_of(ptr, type, member) \
+    ((type *)((char *)(ptr) - offsetof(type, member)))
+
+static inline void mpsc_queue_init(mpsc_queue_t *q) {
+    atomic_store_explicit(&q->stub.next, NULL, memory_order_relaxed);
+    atomic_store_explicit(&q->head, &q->stub, memory_order_relaxed);
+    q->tail = &q->stub;
+}
+
+// 생산자: 여러 스레드에서 동시에 호출 가능
+static inline void mpsc_queue_push(mpsc_queue_t *q, mpsc_node_t *node) {
+    atomic_store_explicit(&node->next, NULL, memory_order_relaxed);
+    mpsc_node_t *prev = atomic_exchange_explicit(&q->head, node, memory_order_acq_rel);
+    // 이 사이에 소비자는 prev->next가 아직 NULL인 것을 볼 수 있음 -> pop이 NULL을 반환하고 재시도
+    atomic_store_explicit(&prev->next, node, memory_order_release);
+}
+
+// 소비자: 가장 오래된 노드 하나를 꺼냄. 비어 있거나 생산자가 연결 중이면 NULL
+static inline mpsc_node_t *mpsc_queue_pop(mpsc_queue_t *q) {
+    mpsc_node_t *tail = q->tail;
+    mpsc_node_t *next = atomic_load_explicit(&tail->next, memory_order_acquire);
+
+    if (tail == &q->stub) {
+        if (next == NULL) {
+            return NULL; // 비어 있음
+        }
+        q->tail = next;
+        tail = next;
+        next = atomic_load_explicit(&next->next, memory_order_acquire);
+    }
+    if (next != NULL) {
+        q->tail = next;
+        return tail;
+    }
+
+    // tail이 마지막 노드처럼 보이는 경우: 생산자가 push 중인지 확인
+    mpsc_node_t *head = atomic_load_explicit(&q->head, memory_order_acquire);
+    if (tail != head) {
+        return NULL; // 생산자가 exchange 후 next 연결 전. 다음 호출에서 꺼낼 수 있음
+    }
+
+    // 마지막 노드를 꺼내기 위해 stub을 다시 뒤에 붙임
+    mpsc_queue_push(q, &q->stub);
+    next = atomic_load_explicit(&tail->next, memory_order_acquire);
+    if (next != NULL) {
+        q->tail = next;
+        return tail;
+    }
+    return NULL;
+}
+
+// 소비자: 최대 max개의 노드를 한 번에 꺼내 out[]에 담고 개수를 반환
+static inline size_t mpsc_queue_pop_batch(mpsc_queue_t *q, mpsc_node_t **out, size_t max) {
+    size_t n = 0;
+    while (n < max) {
+        mpsc_node_t *node = mpsc_queue_pop(q);
+        if (node == NULL) {
+            break;
+        }
+        out[n++] = node;
+    }
+    return n;
+}
+
+// 소비자: 큐가 비어 보이는지 (생산자가 연결 중인 노드는 고려하지 않음)
+static inline int mpsc_queue_empty(mpsc_queue_t *q) {
+    return q->tail == &q->stub &&
+           atomic_load_explicit(&q->stub.next, memory_order_acquire) == NULL &&
+           atomic_load_explicit(&q->head, memory_order_acquire) == &q->stub;
+}
+
+#endif // MPSC_QUEUE_H
@@ -0,0 +1,149 @@
+// nick_dir.h
+// 프로세스 사이에 공유하는 닉네임 디렉터리: 닉네임 -> 그 클라이언트를 가진 허브 샤드와 PID
+//
+// fork 전에 nick_dir_create 로 MAP_SHARED 익명 메모리에 만들면 이후 fork 한 모든 프로세스가 같은 표를 본다.
+// 칸 수가 작으므로(샤드 수 * 샤드당 최대 접속자) 해시 없이 선형 탐색하고, 표 전체를 프로세스 공유
+// 뮤텍스 하나로 보호한다. 닉네임 변경, 퇴장, 귓속말 때만 잡으므로 방 메시지 경로에는 없음.
+// 뮤텍스는 robust 속성이라 잡은 채로 죽은 프로세스가 있어도 다음에 잡는 쪽이 이어서 쓸 수 있다.
+// 닉네임은 PID 당 하나: 같은 PID 로 다시 등록하면 이전 닉네임 칸을 비움.
+// 같은 메모리에 샤드별 순번 epoch 도 둔다. 샤드가 죽어 다시 뜨면 방 기록은 사라지지만 epoch 는
+// 감독 프로세스가 살아 있는 한 남으므로, 새 샤드가 매기는 방 순번이 그 전보다 작아지지 않음.
+//
+// 사용 시 -pthread 로 빌드해야 함
+#ifndef NICK_DIR_H
+#define NICK_DIR_H
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+
+#define NICK_DIR_NAME_MAX 31         // 닉네임 최대 길이 (NULL 제외)
+#define NICK_DIR_MAX_SHARDS 16       // epoch 를 둘 수 있는 샤드 수
+
+typedef struct {
+    pid_t pid;                       // 0이면 빈 칸
+    int shard;
+    char name[NICK_DIR_NAME_MAX + 1];
+} nick_dir_entry_t;
+
+typedef struct {
+    pthread_mutex_t lock;
+    int capacity;
+    uint32_t epoch[NICK_DIR_MAX_SHARDS]; // 샤드가 시작한 횟수 (nick_dir_next_epoch)
+    nick_dir_entry_t entries[];
+} nick_dir_t;
+
+// 실패하면 NULL
+static inline nick_dir_t *nick_dir_create(int capacity) {
+    size_t size = sizeof(nick_dir_t) + sizeof(nick_dir_entry_t) * capacity;
+    nick_dir_t *d = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (d == MAP_FAILED) {
+        return NULL;
+    }
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+    int err = pthread_mutex_init(&d->lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+    if (err != 0) {
+        munmap(d, size);
+        return NULL;
+    }
+    d->capacity = capacity; // mmap 한 메모리는 0으로 채워져 있으므로 모든 칸이 비어 있음
+    return d;
+}
+
+static inline void nick_dir_lock(nick_dir_t *d) {
+    if (pthread_mutex_lock(&d->lock) == EOWNERDEAD) {
+        // 잡은 채로 죽은 프로세스가 있음: 칸 하나를 쓰다 말았을 수는 있지만 표 구조는 그대로라 이어서 씀
+        pthread_mutex_consistent(&d->lock);
+    }
+}
+
+static inline void nick_dir_unlock(nick_dir_t *d) {
+    pthread_mutex_unlock(&d->lock);
+}
+
+// name 을 pid 의 닉네임으로 등록. 다른 PID 가 쓰고 있으면 -1, 칸이 없으면 -2
+static inline int nick_dir_claim(nick_dir_t *d, const char *name, int shard, pid_t pid) {
+    nick_dir_entry_t *free_slot = NULL;
+    int result = 0;
+    nick_dir_lock(d);
+    for (int i = 0; i < d->capacity; i++) {
+        nick_dir_entry_t *e = &d->entries[i];
+        if (e->pid != 0 && e->pid != pid && strcmp(e->name, name) == 0) {
+            result = -1;
+            break;
+        }
+    }
+    if (result == 0) {
+        for (int i = 0; i < d->capacity; i++) {
+            nick_dir_entry_t *e = &d->entries[i];
+            if (e->pid == pid) {
+                e->pid = 0; // 이전 닉네임
+            }
+            if (e->pid == 0 && free_slot == NULL) {
+                free_slot = e;
+            }
+        }
+        if (free_slot == NULL) {
+            result = -2;
+        } else {
+            strncpy(free_slot->name, name, NICK_DIR_NAME_MAX);
+            free_slot->name[NICK_DIR_NAME_MAX] = '\0';
+            free_slot->shard = shard;
+            free_slot->pid = pid;
+        }
+    }
+    nick_dir_unlock(d);
+    return result;
+}
+
+static inline void nick_dir_release(nick_dir_t *d, pid_t pid) {
+    nick_dir_lock(d);
+    for (int i = 0; i < d->capacity; i++) {
+        if (d->entries[i].pid == pid) {
+            d->entries[i].pid = 0;
+        }
+    }
+    nick_dir_unlock(d);
+}
+
+// 샤드 프로세스가 죽으면 그 샤드의 클라이언트 닉네임을 모두 비움
+static inline void nick_dir_release_shard(nick_dir_t *d, int shard) {
+    nick_dir_lock(d);
+    for (int i = 0; i < d->capacity; i++) {
+        if (d->entries[i].pid != 0 && d->entries[i].shard == shard) {
+            d->entries[i].pid = 0;
+        }
+    }
+    nick_dir_unlock(d);
+}
+
+// 샤드가 시작할 때 호출: 그 샤드의 epoch 를 하나 올려 반환 (처음이면 1)
+static inline uint32_t nick_dir_next_epoch(nick_dir_t *d, int shard) {
+    nick_dir_lock(d);
+    uint32_t epoch = ++d->epoch[shard];
+    nick_dir_unlock(d);
+    return epoch;
+}
+
+// name 을 가진 클라이언트의 샤드 번호 (없으면 -1)
+static inline int nick_dir_lookup(nick_dir_t *d, const char *name) {
+    int shard = -1;
+    nick_dir_lock(d);
+    for (int i = 0; i < d->capacity; i++) {
+        if (d->entries[i].pid != 0 && strcmp(d->entries[i].name, name) == 0) {
+            shard = d->entries[i].shard;
+            break;
+        }
+    }
+    nick_dir_unlock(d);
+    return shard;
+}
+
+#endif // NICK_DIR_H
@@ -0,0 +1,84 @@
+// rate_limit.h
+// 클라이언트별 토큰 버킷 (초당 메시지 수, 초당 바이트 수 제한용)
+//
+// 버킷은 초당 rate 개씩 차고 최대 burst 개까지 쌓인다. 메시지를 보낼 때 필요한 만큼 꺼내고,
+// 모자라면 몇 ms 뒤에 충분해지는지 알려 준다 (허브는 그만큼 메시지를 붙잡아 두었다가 다시 시도).
+// 라우터의 메시지마다 도는 경로에 있으므로 나눗셈 없는 정수 연산만 쓰고, 시계도
+// CLOCK_MONOTONIC_COARSE(커널 틱 단위, vDSO라 시스템 콜 없음)를 ms 로 잘라 쓴다.
+// 토큰은 1/1000 단위로 저장해서 1ms 마다 rate/1000 개씩 찰 때도 버림 오차가 생기지 않게 했다.
+// rate 가 0이면 제한 없음. rate, burst 는 TOKEN_BUCKET_MAX 이하 (곱셈이 64비트를 넘지 않도록).
+#ifndef RATE_LIMIT_H
+#define RATE_LIMIT_H
+
+#include <stdint.h>
+#include <time.h>
+
+#define TOKEN_BUCKET_SCALE 1000      // 저장 단위: 토큰 1개 = 1000
+#define TOKEN_BUCKET_NEVER UINT64_MAX // 요청량이 burst 보다 커서 기다려도 안 되는 경우
+#define TOKEN_BUCKET_MAX 10000000    // rate, burst 의 상한
+
+typedef struct {
+    uint64_t level;                  // 지금 쌓인 토큰 (TOKEN_BUCKET_SCALE 배)
+    uint64_t last_ms;                // 마지막으로 채운 시각
+    uint32_t rate;                   // 초당 채워지는 토큰 수 (0: 제한 없음)
+    uint32_t burst;                  // 최대로 쌓이는 토큰 수
+} token_bucket_t;
+
+static inline uint64_t rate_limit_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// 처음에는 가득 찬 상태로 시작 (연결 직후의 몰아 보내기는 burst 까지 허용)
+static inline void token_bucket_init(token_bucket_t *b, uint32_t rate, uint32_t burst, uint64_t now_ms) {
+    b->rate = rate;
+    b->burst = burst < 1 ? 1 : burst;
+    b->level = (uint64_t)b->burst * TOKEN_BUCKET_SCALE;
+    b->last_ms = now_ms;
+}
+
+static inline void token_bucket_refill(token_bucket_t *b, uint64_t now_ms) {
+    uint64_t cap = (uint64_t)b->burst * TOKEN_BUCKET_SCALE;
+    if (now_ms <= b->last_ms) {
+        return;
+    }
+    uint64_t elapsed = now_ms - b->last_ms;
+    b->last_ms = now_ms;
+    // 1ms 에 rate/1000 개 = rate 단위(1/1000 토큰)만큼. 오래 쉬었으면 (rate >= 1 이므로 이미 가득) 곱하지 않음
+    if (elapsed >= cap) {
+        b->level = cap;
+        return;
+    }
+    b->level += elapsed * b->rate;
+    if (b->level > cap) {
+        b->level = cap;
+    }
+}
+
+// n 개를 꺼낼 수 있으면 0, 아니면 충분히 찰 때까지 남은 ms (올림), burst 보다 크면 TOKEN_BUCKET_NEVER.
+// 꺼내지는 않음: 두 버킷을 모두 확인한 뒤 token_bucket_take 로 함께 꺼냄
+static inline uint64_t token_bucket_wait_ms(token_bucket_t *b, uint32_t n, uint64_t now_ms) {
+    if (b->rate == 0) {
+        return 0;
+    }
+    if (n > b->burst) {
+        return TOKEN_BUCKET_NEVER;
+    }
+    token_bucket_refill(b, now_ms);
+    uint64_t need = (uint64_t)n * TOKEN_BUCKET_SCALE;
+    if (b->level >= need) {
+        return 0;
+    }
+    return (need - b->level + b->rate - 1) / b->rate; // 기다릴 때만 나눗셈 한 번
+}
+
+static inline void token_bucket_take(token_bucket_t *b, uint32_t n) {
+    if (b->rate == 0) {
+        return;
+    }
+    uint64_t need = (uint64_t)n * TOKEN_BUCKET_SCALE;
+    b->level = b->level > need ? b->level - need : 0;
+}
+
+#endif // RATE_LIMIT_H
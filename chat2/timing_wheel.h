@@ -0,0 +1,162 @@
+// timing_wheel.h
+// 계층형 타이밍 휠: 연결마다 하나씩 있는 유휴 타임아웃/하트비트 타이머용
+//
+// 타이머는 만료 틱에 따라 네 단계 휠 중 하나의 칸(연결 리스트)에 들어간다.
+// 0단계는 64틱, 1단계는 64*64틱, ... 을 덮고, 0단계가 한 바퀴 돌 때마다 1단계의 다음 칸을
+// 풀어 아래 단계로 다시 넣는다(cascade). 그래서
+// - 추가/취소: 칸 계산 + 이중 연결 리스트 조작이라 O(1)
+// - 만료: 지난 틱마다 0단계 칸 하나만 보고, 위 단계 칸은 64틱에 한 번 풀어 옮김 (타이머당 최대 3번)
+// 이므로 연결이 10만 개라도 틱마다 전체 타이머를 훑지 않는다.
+// 타이머 구조체는 호출자가 가지고 있어야 하며(침투형, 메모리 할당 없음), 휠에 들어 있는 동안 옮기면 안 된다.
+// 틱 길이(tick_ms)보다 세밀한 시간은 구분하지 않으므로 타이머는 최대 한 틱 늦게 만료될 수 있다.
+#ifndef TIMING_WHEEL_H
+#define TIMING_WHEEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define TW_SLOT_BITS 6
+#define TW_SLOTS (1 << TW_SLOT_BITS)
+#define TW_SLOT_MASK (TW_SLOTS - 1)
+#define TW_LEVELS 4                  // 최대 64^4 틱 (100ms 틱이면 약 19일). 더 먼 타이머는 그 끝에 둠
+#define TW_MAX_TICKS (((uint64_t)1 << (TW_SLOT_BITS * TW_LEVELS)) - 1)
+
+typedef struct tw_timer {
+    struct tw_timer *next, *prev;    // 칸 안의 이중 연결 리스트 (NULL 이면 휠에 없음)
+    uint64_t expires;                // 만료 틱
+    void (*fn)(struct tw_timer *t);  // 만료 시 호출. 안에서 다시 tw_add 해도 됨
+} tw_timer_t;
+
+typedef struct {
+    uint64_t start_ms;               // 0틱의 시각
+    uint64_t tick_ms;
+    uint64_t tick;                   // 다음에 처리할 틱
+    size_t count;                    // 휠에 들어 있는 타이머 수
+    tw_timer_t slots[TW_LEVELS][TW_SLOTS]; // 칸마다 리스트 머리 (원형, 비어 있으면 자기 자신을 가리킴)
+} timing_wheel_t;
+
+// 타이머 구조체를 감싸는 구조체 포인터를 구함
+#define tw_container_of(ptr, type, member) \
+    ((type *)((char *)(ptr) - offsetof(type, member)))
+
+static inline void tw_init(timing_wheel_t *w, uint64_t tick_ms, uint64_t now_ms) {
+    w->start_ms = now_ms;
+    w->tick_ms = tick_ms;
+    w->tick = 0;
+    w->count = 0;
+    for (int l = 0; l < TW_LEVELS; l++) {
+        for (int s = 0; s < TW_SLOTS; s++) {
+            w->slots[l][s].next = w->slots[l][s].prev = &w->slots[l][s];
+        }
+    }
+}
+
+static inline void tw_timer_init(tw_timer_t *t, void (*fn)(tw_timer_t *t)) {
+    t->next = t->prev = NULL;
+    t->expires = 0;
+    t->fn = fn;
+}
+
+static inline int tw_pending(const tw_timer_t *t) {
+    return t->next != NULL;
+}
+
+// 만료 틱에 맞는 칸에 넣음 (이미 지난 틱이면 다음 처리 때 바로 만료)
+static inline void tw_link(timing_wheel_t *w, tw_timer_t *t) {
+    uint64_t expires = t->expires < w->tick ? w->tick : t->expires;
+    uint64_t delta = expires - w->tick;
+    int level = 0;
+    while (level < TW_LEVELS - 1 && delta >= ((uint64_t)1 << (TW_SLOT_BITS * (level + 1)))) {
+        level++;
+    }
+    tw_timer_t *head = &w->slots[level][(expires >> (TW_SLOT_BITS * level)) & TW_SLOT_MASK];
+    t->prev = head->prev;
+    t->next = head;
+    head->prev->next = t;
+    head->prev = t;
+}
+
+static inline void tw_cancel(timing_wheel_t *w, tw_timer_t *t) {
+    if (t->next == NULL) {
+        return;
+    }
+    t->prev->next = t->next;
+    t->next->prev = t->prev;
+    t->next = t->prev = NULL;
+    w->count--;
+}
+
+// delay_ms 뒤에 만료 (이미 휠에 있으면 옮김)
+static inline void tw_add(timing_wheel_t *w, tw_timer_t *t, uint64_t delay_ms) {
+    tw_cancel(w, t);
+    uint64_t ticks = (delay_ms + w->tick_ms - 1) / w->tick_ms;
+    if (ticks > TW_MAX_TICKS) {
+        ticks = TW_MAX_TICKS;
+    }
+    t->expires = w->tick + ticks;
+    tw_link(w, t);
+    w->count++;
+}
+
+// 위 단계 칸 하나를 비우고 그 타이머들을 (이제 가까워졌으므로) 아래 단계에 다시 넣음
+static inline void tw_cascade(timing_wheel_t *w, int level) {
+    tw_timer_t *head = &w->slots[level][(w->tick >> (TW_SLOT_BITS * level)) & TW_SLOT_MASK];
+    tw_timer_t *t = head->next;
+    head->next = head->prev = head;
+    while (t != head) {
+        tw_timer_t *next = t->next;
+        tw_link(w, t);
+        t = next;
+    }
+}
+
+// now_ms 까지 지난 틱을 처리하며 만료된 타이머의 fn 호출. 처리한 타이머 수 반환
+static inline int tw_advance(timing_wheel_t *w, uint64_t now_ms) {
+    if (now_ms < w->start_ms) {
+        return 0;
+    }
+    uint64_t target = (now_ms - w->start_ms) / w->tick_ms;
+    int fired = 0;
+    while (w->tick <= target) {
+        // 0단계가 한 바퀴 돌았으면 위 단계의 이번 칸을 풀어 내림 (1단계부터, 그 칸도 0이면 다음 단계)
+        for (int level = 1; level < TW_LEVELS; level++) {
+            if ((w->tick & (((uint64_t)1 << (TW_SLOT_BITS * level)) - 1)) != 0) {
+                break;
+            }
+            tw_cascade(w, level);
+        }
+        tw_timer_t *head = &w->slots[0][w->tick & TW_SLOT_MASK];
+        // fn 안에서 같은 칸에 다시 넣을 수 있으므로 하나씩 떼어 내며 처리
+        while (head->next != head) {
+            tw_timer_t *t = head->next;
+            tw_cancel(w, t);
+            fired++;
+            t->fn(t);
+        }
+        w->tick++;
+    }
+    return fired;
+}
+
+// poll/select 타임아웃(ms): 타이머가 없으면 max_ms, 있으면 0단계에서 다음으로 차 있는 칸까지
+// (0단계가 끝까지 비었으면 다음 cascade 시점까지). 칸 64개만 보므로 타이머 수와 무관
+static inline int tw_next_timeout_ms(const timing_wheel_t *w, uint64_t now_ms, int max_ms) {
+    if (w->count == 0) {
+        return max_ms;
+    }
+    uint64_t ticks = TW_SLOTS - (w->tick & TW_SLOT_MASK);
+    for (uint64_t i = 0; i < TW_SLOTS - (w->tick & TW_SLOT_MASK); i++) {
+        const tw_timer_t *head = &w->slots[0][(w->tick + i) & TW_SLOT_MASK];
+        if (head->next != head) {
+            ticks = i;
+            break;
+        }
+    }
+    uint64_t due_ms = w->start_ms + (w->tick + ticks) * w->tick_ms;
+    if (due_ms <= now_ms) {
+        return 0;
+    }
+    return due_ms - now_ms < (uint64_t)max_ms ? (int)(due_ms - now_ms) : max_ms;
+}
+
+#endif // TIMING_WHEEL_H
@@ -0,0 +1,317 @@
+// work_steal_pool.h
+// 워커별 덱(deque)을 가진 작업 훔치기(work-stealing) 스레드 풀
+//
+// 허브(parent_main_loop)는 단일 라우팅 스레드이므로, 읽기 전용 명령(/list, /users 등)의
+// 응답 생성처럼 오래 걸리는 작업을 이 풀에 넘겨 채팅 전달이 지연되지 않게 한다.
+// - 작업 제출(ws_pool_submit)은 공용 주입 큐(injector)에 넣음 (라우터 스레드가 호출)
+// - 워커는 자기 덱의 bottom에서 먼저 꺼내고 (LIFO, 방금 넣은 작업이 캐시에 남아 있음),
+//   비어 있으면 주입 큐에서 몇 개를 한꺼번에 가져와 자기 덱에 넣고,
+//   그것도 비어 있으면 다른 워커 덱의 top에서 훔쳐 옴 (FIFO, 가장 오래된 작업)
+// - 덱은 고정 크기 Chase-Lev 덱. push/pop 은 소유 워커만, steal 은 누구나 호출
+// - 할 일이 없는 워커는 조건 변수에서 잠듦. 덱에 넣는 일은 풀 락을 잡은 채로만 하므로
+//   잠들기 직전 락 안에서 확인하면 깨울 신호를 놓치지 않음
+// - 워커 스레드는 모든 시그널을 막은 채 생성되므로 SIGCHLD 등은 라우터 스레드에서만 처리됨
+//
+// 사용 시 -pthread 로 빌드해야 함
+#ifndef WORK_STEAL_POOL_H
+#define WORK_STEAL_POOL_H
+
+#include <stdlib.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sched.h>
+#include <stdatomic.h>
+
+#define WS_MAX_WORKERS 16
+#define WS_DEQUE_CAP 256            // 덱 하나의 최대 작업 수 (2의 거듭제곱)
+
+typedef struct ws_task {
+    void (*fn)(void *arg);
+    void *arg;
+    struct ws_task *next;           // 주입 큐 연결용
+} ws_task_t;
+
+typedef struct {
+    _Atomic long top;               // 훔쳐 가는 쪽 (다른 워커들)
+    char pad1[64 - sizeof(long)];
+    _Atomic long bottom;            // 소유 워커가 넣고 꺼내는 쪽
+    char pad2[64 - sizeof(long)];
+    _Atomic(ws_task_t *) buf[WS_DEQUE_CAP];
+} ws_deque_t;
+
+struct ws_pool;
+
+typedef struct {
+    struct ws_pool *pool;
+    int id;
+    pthread_t thread;
+    ws_deque_t deque;
+    _Atomic long executed;          // 실행한 작업 수
+    _Atomic long stolen;            // 다른 워커의 덱에서 훔친 작업 수
+} ws_worker_t;
+
+typedef struct ws_pool {
+    int nworkers;
+    pthread_mutex_t lock;           // 주입 큐, idle, stopping, 그리고 덱에 넣는 일을 보호
+    pthread_cond_t wake;
+    ws_task_t *inj_head;            // 주입 큐 (제출 순서대로)
+    ws_task_t *inj_tail;
+    _Atomic long injected;          // 주입 큐에 있는 작업 수 (ws_pool_pending 은 락 없이 읽음)
+    int idle;                       // wake 에서 잠든 워커 수
+    int stopping;
+    ws_worker_t workers[WS_MAX_WORKERS];
+} ws_pool_t;
+
+// 소유 워커가 bottom 에 작업 추가. 가득 차면 -1
+static inline int ws_deque_push(ws_deque_t *d, ws_task_t *task) {
+    long b = atomic_load_explicit(&d->bottom, memory_order_relaxed);
+    long t = atomic_load_explicit(&d->top, memory_order_acquire);
+    if (b - t >= WS_DEQUE_CAP) {
+        return -1;
+    }
+    atomic_store_explicit(&d->buf[b & (WS_DEQUE_CAP - 1)], task, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+    return 0;
+}
+
+// 소유 워커가 bottom 에서 작업 하나를 꺼냄 (LIFO). 비어 있으면 NULL.
+// 마지막 하나는 훔치는 쪽과 top 을 CAS 로 다툼
+static inline ws_task_t *ws_deque_pop(ws_deque_t *d) {
+    long b = atomic_load_explicit(&d->bottom, memory_order_relaxed) - 1;
+    atomic_store_explicit(&d->bottom, b, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    long t = atomic_load_explicit(&d->top, memory_order_relaxed);
+    if (t > b) {
+        atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed); // 비어 있었음
+        return NULL;
+    }
+    ws_task_t *task = atomic_load_explicit(&d->buf[b & (WS_DEQUE_CAP - 1)], memory_order_relaxed);
+    if (t == b) {
+        if (!atomic_compare_exchange_strong_explicit(&d->top, &t, t + 1,
+                                                     memory_order_seq_cst, memory_order_relaxed)) {
+            task = NULL; // 훔치는 쪽이 먼저 가져감
+        }
+        atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+    }
+    return task;
+}
+
+// 덱의 top에서 작업 하나를 가져감 (여러 워커가 동시에 호출 가능).
+// 비어 있으면 NULL. 다른 워커와 경쟁에서 지면 *lost = 1
+static inline ws_task_t *ws_deque_steal(ws_deque_t *d, int *lost) {
+    long t = atomic_load_explicit(&d->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    long b = atomic_load_explicit(&d->bottom, memory_order_acquire);
+    if (t >= b) {
+        return NULL;
+    }
+    ws_task_t *task = atomic_load_explicit(&d->buf[t & (WS_DEQUE_CAP - 1)], memory_order_relaxed);
+    if (!atomic_compare_exchange_strong_explicit(&d->top, &t, t + 1,
+                                                 memory_order_seq_cst, memory_order_relaxed)) {
+        *lost = 1;
+        return NULL;
+    }
+    return task;
+}
+
+static inline long ws_deque_size(ws_deque_t *d) {
+    long n = atomic_load_explicit(&d->bottom, memory_order_relaxed) -
+             atomic_load_explicit(&d->top, memory_order_relaxed);
+    return n > 0 ? n : 0;
+}
+
+// 주입 큐에서 (대기 작업 수 / 워커 수 + 1)개를 가져와 하나는 바로 실행하고 나머지는 자기 덱에 넣음.
+// 덱에 넣은 것이 있고 잠든 워커가 있으면 하나를 깨워 훔쳐 가게 함
+static inline ws_task_t *ws_take_injected(ws_worker_t *w) {
+    ws_pool_t *p = w->pool;
+    pthread_mutex_lock(&p->lock);
+    ws_task_t *first = p->inj_head;
+    if (first == NULL) {
+        pthread_mutex_unlock(&p->lock);
+        return NULL;
+    }
+    long n = atomic_load_explicit(&p->injected, memory_order_relaxed) / p->nworkers + 1;
+    p->inj_head = first->next;
+    long taken = 1;
+    int pushed = 0;
+    while (taken < n && p->inj_head != NULL && ws_deque_push(&w->deque, p->inj_head) == 0) {
+        p->inj_head = p->inj_head->next;
+        taken++;
+        pushed = 1;
+    }
+    if (p->inj_head == NULL) {
+        p->inj_tail = NULL;
+    }
+    atomic_fetch_sub_explicit(&p->injected, taken, memory_order_relaxed);
+    if ((pushed || p->inj_head != NULL) && p->idle > 0) {
+        pthread_cond_signal(&p->wake);
+    }
+    pthread_mutex_unlock(&p->lock);
+    return first;
+}
+
+// 다른 워커들의 덱을 한 바퀴 돌며 top 에서 훔침
+static inline ws_task_t *ws_steal(ws_worker_t *w) {
+    ws_pool_t *p = w->pool;
+    for (;;) {
+        int lost = 0;
+        for (int i = 1; i < p->nworkers; i++) {
+            ws_worker_t *victim = &p->workers[(w->id + i) % p->nworkers];
+            ws_task_t *task = ws_deque_steal(&victim->deque, &lost);
+            if (task) {
+                atomic_fetch_add_explicit(&w->stolen, 1, memory_order_relaxed);
+                return task;
+            }
+        }
+        if (!lost) {
+            return NULL; // 정말로 비어 있음
+        }
+        sched_yield();   // 경쟁에서 졌을 뿐이면 다시 시도
+    }
+}
+
+// 할 일이 생길 때까지 잠듦. 종료 요청이 있고 남은 작업이 없으면 1
+static inline int ws_park(ws_worker_t *w) {
+    ws_pool_t *p = w->pool;
+    pthread_mutex_lock(&p->lock);
+    for (;;) {
+        int has_work = p->inj_head != NULL;
+        for (int i = 0; !has_work && i < p->nworkers; i++) {
+            has_work = ws_deque_size(&p->workers[i].deque) > 0;
+        }
+        if (has_work) {
+            pthread_mutex_unlock(&p->lock);
+            return 0;
+        }
+        if (p->stopping) {
+            pthread_mutex_unlock(&p->lock);
+            return 1;
+        }
+        p->idle++;
+        pthread_cond_wait(&p->wake, &p->lock);
+        p->idle--;
+    }
+}
+
+static void *ws_worker_main(void *arg) {
+    ws_worker_t *w = arg;
+
+    for (;;) {
+        ws_task_t *task = ws_deque_pop(&w->deque);
+        if (task == NULL) {
+            task = ws_take_injected(w);
+        }
+        if (task == NULL) {
+            task = ws_steal(w);
+        }
+        if (task == NULL) {
+            if (ws_park(w)) {
+                return NULL;
+            }
+            continue;
+        }
+        task->fn(task->arg);
+        free(task);
+        atomic_fetch_add_explicit(&w->executed, 1, memory_order_relaxed);
+    }
+}
+
+// 풀 생성. 성공 시 0
+static inline int ws_pool_init(ws_pool_t *p, int nworkers) {
+    if (nworkers < 1) nworkers = 1;
+    if (nworkers > WS_MAX_WORKERS) nworkers = WS_MAX_WORKERS;
+    p->nworkers = nworkers;
+    p->inj_head = p->inj_tail = NULL;
+    atomic_init(&p->injected, 0);
+    p->idle = 0;
+    p->stopping = 0;
+    if (pthread_mutex_init(&p->lock, NULL) != 0) {
+        return -1;
+    }
+    if (pthread_cond_init(&p->wake, NULL) != 0) {
+        pthread_mutex_destroy(&p->lock);
+        return -1;
+    }
+
+    // 워커는 시그널을 받지 않도록 모든 시그널을 막은 상태로 생성 (마스크는 상속됨)
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    for (int i = 0; i < nworkers; i++) {
+        ws_worker_t *w = &p->workers[i];
+        w->pool = p;
+        w->id = i;
+        atomic_init(&w->deque.top, 0);
+        atomic_init(&w->deque.bottom, 0);
+        atomic_init(&w->executed, 0);
+        atomic_init(&w->stolen, 0);
+    }
+    for (int i = 0; i < nworkers; i++) {
+        if (pthread_create(&p->workers[i].thread, NULL, ws_worker_main, &p->workers[i]) != 0) {
+            // 이미 띄운 워커를 멈추고 거둔 뒤 실패 (호출자는 풀 없이 직접 실행함)
+            pthread_sigmask(SIG_SETMASK, &old, NULL);
+            pthread_mutex_lock(&p->lock);
+            p->stopping = 1;
+            pthread_cond_broadcast(&p->wake);
+            pthread_mutex_unlock(&p->lock);
+            for (int j = 0; j < i; j++) {
+                pthread_join(p->workers[j].thread, NULL);
+            }
+            pthread_cond_destroy(&p->wake);
+            pthread_mutex_destroy(&p->lock);
+            p->nworkers = 0;
+            return -1;
+        }
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    return 0;
+}
+
+// 작업 제출 (주입 큐 뒤에 붙이고 잠든 워커가 있으면 하나를 깨움). 메모리가 없으면 -1 (호출자가 직접 fn(arg) 실행)
+static inline int ws_pool_submit(ws_pool_t *p, void (*fn)(void *), void *arg) {
+    ws_task_t *task = malloc(sizeof(*task));
+    if (task == NULL) {
+        return -1;
+    }
+    task->fn = fn;
+    task->arg = arg;
+    task->next = NULL;
+    pthread_mutex_lock(&p->lock);
+    if (p->inj_tail != NULL) {
+        p->inj_tail->next = task;
+    } else {
+        p->inj_head = task;
+    }
+    p->inj_tail = task;
+    atomic_fetch_add_explicit(&p->injected, 1, memory_order_relaxed);
+    if (p->idle > 0) {
+        pthread_cond_signal(&p->wake);
+    }
+    pthread_mutex_unlock(&p->lock);
+    return 0;
+}
+
+// 아직 실행되지 않은 작업 수 (대략값)
+static inline long ws_pool_pending(ws_pool_t *p) {
+    long n = atomic_load_explicit(&p->injected, memory_order_relaxed);
+    for (int i = 0; i < p->nworkers; i++) {
+        n += ws_deque_size(&p->workers[i].deque);
+    }
+    return n;
+}
+
+// 남은 작업을 모두 실행한 뒤 워커 종료
+static inline void ws_pool_shutdown(ws_pool_t *p) {
+    pthread_mutex_lock(&p->lock);
+    p->stopping = 1;
+    pthread_cond_broadcast(&p->wake);
+    pthread_mutex_unlock(&p->lock);
+    for (int i = 0; i < p->nworkers; i++) {
+        pthread_join(p->workers[i].thread, NULL);
+    }
+    pthread_cond_destroy(&p->wake);
+    pthread_mutex_destroy(&p->lock);
+}
+
+#endif // WORK_STEAL_POOL_H
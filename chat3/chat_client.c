@@ -7,6 +7,8 @@
 #include <sys/ioctl.h>  // I/O 제어 함수 (현재 코드에서 직접 사용되지는 않음)
 #include <sys/socket.h> // 소켓 함수 (socket, connect)
 #include <arpa/inet.h>  // 인터넷 주소 변환 함수 (inet_pton, htons)
+#include <poll.h>       // 소켓 읽기를 갱신 간격까지만 기다림 (poll)
+#include "../common/term_render.h" // 받은 메시지를 모아서 한 번에 그리는 출력기
 
 // 터미널 색상 코드를 위한 매크로 정의
 #define COLOR_RED     "\x1b[31m"
@@ -27,6 +29,8 @@ typedef struct {
 static int g_pfd[2];      // 파이프 파일 디스크립터 (g_pfd[0]: 읽기, g_pfd[1]: 쓰기)
 static int g_sockfd;      // 소켓 파일 디스크립터
 static int g_cont = 1;    // 프로그램 계속 실행 여부를 제어하는 플래그 (1: 계속, 0: 종료)
+static volatile sig_atomic_t g_scroll = 0; // 자식이 보낸 /scroll 요청 줄 수 (0: 없음)
+static term_render_t g_term; // 화면 출력기 (받은 메시지를 모아 갱신 간격마다 그림, 스크롤백 링 포함)
 
 // 화면을 지우는 함수
 // inline 키워드는 컴파일러에게 함수를 인라인으로 처리하도록 권장 (C99, C11 표준)
@@ -44,6 +48,12 @@ void sigHandler(int signo)
 		char buf[BUFSIZ];
 		// 파이프의 읽기 end (g_pfd[0])에서 데이터를 읽어옴
 		int n = read(g_pfd[0], buf, BUFSIZ);
+		if (n > 7 && strncmp(buf, "/scroll", 7) == 0) {
+			// 화면 명령: 서버로 보내지 않고 메인 루프가 스크롤백을 다시 그리게 함
+			int count = atoi(buf + 7);
+			g_scroll = count > 0 ? count : -1; // -1: 한 화면
+			return;
+		}
 		// 읽어온 데이터를 소켓 (g_sockfd)을 통해 서버로 전송
 		write(g_sockfd, buf, n);
 	} else if(signo == SIGCHLD) { // 자식 프로세스가 종료되었을 때 (SIGCHLD)
@@ -122,15 +132,24 @@ int main(int argc, char** argv)
 		// SIGCHLD 시그널 핸들러 설정 (자식이 종료될 때 부모도 종료되도록)
 		signal(SIGCHLD, sigHandler);
 		close(g_pfd[1]); // 부모는 파이프의 쓰기 end를 닫음 (읽기만 사용)
+		// 받은 메시지는 출력기에 쌓아 두고 갱신 간격마다 한 번의 write로 그림 (프롬프트도 프레임 끝에 한 번)
+		term_render_init(&g_term, STDOUT_FILENO, COLOR_BLUE "\r> " COLOR_RESET);
+		struct pollfd pfd = { .fd = g_sockfd, .events = POLLIN };
 		while(g_cont) { // g_cont가 1인 동안 계속 실행
-			memset(buf, 0, BUFSIZ); // 버퍼 초기화
-			// 소켓 (g_sockfd)에서 서버로부터 데이터 읽기
-			int n = read(g_sockfd, buf, BUFSIZ);
-			if(n <= 0) break; // 읽은 데이터가 없거나 에러 발생 시 루프 종료 (연결 끊김)
-			printf(COLOR_GREEN "\r%s" COLOR_RESET, buf); // 수신된 메시지를 초록색으로 출력
-			printf(COLOR_BLUE "\r> " COLOR_RESET); // 사용자 입력 프롬프트 다시 출력
-			fflush(NULL); // 출력 버퍼 비우기
+			// 소켓 (g_sockfd)에서 서버로부터 데이터가 오거나 다음 프레임 시각이 될 때까지 대기
+			int ready = poll(&pfd, 1, term_render_timeout(&g_term));
+			if (g_scroll != 0) { // 시그널 핸들러가 받은 /scroll 요청
+				term_render_scrollback(&g_term, g_scroll > 0 ? (unsigned long)g_scroll : (unsigned long)g_term.max_lines);
+				g_scroll = 0;
+			}
+			if (ready > 0) {
+				int n = read(g_sockfd, buf, BUFSIZ);
+				if(n <= 0) break; // 읽은 데이터가 없거나 에러 발생 시 루프 종료 (연결 끊김)
+				term_render_append(&g_term, COLOR_GREEN, buf, n); // 수신된 메시지는 초록색으로 그림
+			}
+			term_render_flush(&g_term, 0);
 		}
+		term_render_flush(&g_term, 1);
 		close(g_pfd[0]); // 부모 프로세스 종료 시 파이프의 읽기 end 닫음
 		kill(pid, SIGCHLD); // 자식 프로세스에게 SIGCHLD 시그널을 보내 종료를 알림
 		wait(NULL); // 자식 프로세스가 완전히 종료될 때까지 기다림
@@ -8,10 +8,27 @@
 #include <arpa/inet.h>
 #include <fcntl.h> // for daemonizing
 #include <sys/stat.h> 
+#include <sys/mman.h>  // 자식별 overflow 링 (공유 메모리)
+#include <errno.h>
+#include <stdint.h>
+#include <limits.h>    // PIPE_BUF
 
 #define BUF_SIZE 1024
+#define MAX_MESSAGE_SIZE (BUF_SIZE * 8) // 자식이 클라이언트에게서 한 번에 읽는 최대 크기 (PIPE_BUF 보다 클 수 있음)
 #define MAX_CLIENTS 30 // 최대 클라이언트 수 (필요에 따라 조정)
 
+// 자식 -> 부모 공유 파이프의 레코드 형식: [슬롯 1바이트][종류 1바이트][길이 2바이트][본문]
+// 레코드 하나는 항상 PIPE_BUF 이하로 한 번의 write()로 쓰므로, 여러 자식이 같은 파이프에 써도
+// 레코드끼리 섞이지 않고(원자적 쓰기) 부모는 슬롯 번호로 누가 보냈는지 알 수 있다.
+// 본문이 FRAME_MAX_PAYLOAD 보다 크면 자식의 overflow 링(공유 메모리)에 본문을 쓰고
+// 파이프에는 길이만 담은 FRAME_OVERFLOW 레코드를 보낸다.
+#define FRAME_HDR_SIZE 4
+#define FRAME_MAX_PAYLOAD (PIPE_BUF - FRAME_HDR_SIZE)
+#define FRAME_INLINE 0   // 본문이 레코드 안에 있음
+#define FRAME_OVERFLOW 1 // 본문은 보낸 자식의 overflow 링에 있음 (길이 필드 = 링에 쓴 바이트 수)
+#define OVERFLOW_RING_SIZE (64 * 1024)
+#define DRAIN_BUF_SIZE (PIPE_BUF * 16) // 부모가 한 번에 읽는 양 (레코드 여러 개)
+
 // 전역 변수 (자식 프로세스 관리를 위한)
 // 파이프 배열: 각 자식 프로세스와 부모 프로세스 간의 통신을 위한 파이프 (부모 -> 자식)
 // 클라이언트 메시지 전파를 위한 파이프 (자식 -> 부모)
@@ -26,12 +43,21 @@ typedef struct {
     // 기타 클라이언트 관련 정보 (예: 현재 방 이름)
 } client_info_t;
 
-// 현재 연결된 클라이언트 정보를 저장할 배열 및 관련 변수
+// 현재 연결된 클라이언트 정보를 저장할 배열 및 관련 변수 (배열 인덱스 = 슬롯 번호, pid 0 = 빈 슬롯)
 client_info_t g_clients[MAX_CLIENTS];
 int g_client_count = 0;
 
+// 자식별 overflow 링: 자식(쓰는 쪽)만 head 를, 부모(읽는 쪽)만 tail 을 증가시키는 단일 생산자/소비자 링
+typedef struct {
+    uint32_t head; // 자식이 지금까지 쓴 바이트 수
+    uint32_t tail; // 부모가 지금까지 읽은 바이트 수
+    char data[OVERFLOW_RING_SIZE];
+} overflow_ring_t;
+
 // 부모-자식 간 통신을 위한 메인 파이프 (자식 -> 부모 메시지 수신용)
 static int g_parent_pipe_read_fd; // 부모가 자식들로부터 메시지를 받을 파이프의 읽기 끝
+static int g_child_pipe_write_fd = -1; // 자식이 부모에게 레코드를 쓸 파이프의 쓰기 끝 (모든 자식이 공유)
+static overflow_ring_t *g_overflow_rings; // MAP_SHARED: fork 전에 만들어 모든 자식과 공유 (슬롯마다 하나)
 
 // 함수 프로토타입
 void handle_client(int client_sock, int client_idx);
@@ -40,6 +66,8 @@ void sig_usr1(int signo); // 자식으로부터 메시지 수신 시그널
 void sig_int_term(int signo); // 우아한 종료 시그널 핸들러
 void daemonize();
 void broadcast_message(const char* message, int sender_idx); // 모든 클라이언트에게 메시지 전송
+int send_record_to_parent(int slot, const char *data, size_t len); // 자식 -> 부모 레코드 전송
+void drain_child_records(void); // 공유 파이프에 쌓인 레코드를 한 번에 처리
 
 // 메인 함수
 int main(int argc, char *argv[]) {
@@ -57,8 +85,13 @@ int main(int argc, char *argv[]) {
     // 2. 시그널 핸들러 설정
     // SIGCHLD: 자식 프로세스 종료 시
     signal(SIGCHLD, sig_chld);
-    // SIGUSR1: 자식으로부터 메시지 수신 알림 시그널 (이 부분은 설계에 따라 달라질 수 있음)
-    signal(SIGUSR1, sig_usr1);
+    // SIGUSR1: 자식으로부터 메시지 수신 알림 시그널. 핸들러는 표시만 하고 실제 처리는 메인 루프가 함.
+    // SA_RESTART 없이 설치해서 accept() 가 EINTR 로 깨어나게 함 (signal()은 accept를 다시 시작시킴)
+    struct sigaction sa_usr1;
+    memset(&sa_usr1, 0, sizeof(sa_usr1));
+    sa_usr1.sa_handler = sig_usr1;
+    sigemptyset(&sa_usr1.sa_mask);
+    sigaction(SIGUSR1, &sa_usr1, NULL);
     // SIGINT, SIGTERM: 우아한 종료
     signal(SIGINT, sig_int_term);
     signal(SIGTERM, sig_int_term);
@@ -100,25 +133,69 @@ int main(int argc, char *argv[]) {
         exit(1);
     }
     g_parent_pipe_read_fd = child_to_parent_pipe[0]; // 부모의 읽기 끝 저장
+    g_child_pipe_write_fd = child_to_parent_pipe[1];  // 이후 fork 되는 모든 자식이 물려받아 사용
+    // 부모는 SIGUSR1 한 번에 쌓인 레코드를 EAGAIN 이 날 때까지 모두 읽음
+    fcntl(g_parent_pipe_read_fd, F_SETFL, fcntl(g_parent_pipe_read_fd, F_GETFL, 0) | O_NONBLOCK);
+
+    // 자식별 overflow 링 (PIPE_BUF 보다 큰 메시지용). fork 전에 공유 메모리로 만들어야 자식과 공유됨
+    g_overflow_rings = mmap(NULL, sizeof(overflow_ring_t) * MAX_CLIENTS, PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (g_overflow_rings == MAP_FAILED) {
+        perror("mmap() error for overflow rings");
+        exit(1);
+    }
+
+    // 시그널이 accept() 직전에 도착해 놓치더라도 1초 안에는 레코드를 처리하도록 accept 에 시간 제한
+    struct timeval accept_timeout = { 1, 0 };
+    setsockopt(listen_sock, SOL_SOCKET, SO_RCVTIMEO, &accept_timeout, sizeof(accept_timeout));
+
+    // g_clients / g_client_count 는 sig_chld 도 고치므로, 메인 루프에서 고치는 동안에는 SIGCHLD 를 막음
+    sigset_t chld_set, old_set;
+    sigemptyset(&chld_set);
+    sigaddset(&chld_set, SIGCHLD);
 
     // 부모의 메인 루프: 클라이언트 연결 대기 및 메시지 브로드캐스팅
     while (1) {
+        // 자식들이 보낸 레코드를 한 번에 처리 (SIGUSR1 이 여러 번 겹쳐 와도 파이프에 쌓인 것은 모두 읽음)
+        drain_child_records();
+
         // 7. accept() - 새로운 클라이언트 연결 대기
         client_addr_size = sizeof(client_addr);
         client_sock = accept(listen_sock, (struct sockaddr*)&client_addr, &client_addr_size);
         if (client_sock == -1) {
-            perror("accept() error");
-            continue; // 에러 발생 시 다음 연결 대기
+            if (errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK) {
+                perror("accept() error");
+            }
+            continue; // 시그널/시간 제한: 레코드 처리 후 다시 대기
         }
 
         fprintf(stdout, "New client connected: %s:%d\n", inet_ntoa(client_addr.sin_addr), ntohs(client_addr.sin_port));
 
-        // MAX_CLIENTS 초과 확인
-        if (g_client_count >= MAX_CLIENTS) {
+        // 슬롯 검색부터 g_clients 기록까지 SIGCHLD 를 막음. 그 사이에 새 자식이 바로 끝나도
+        // sig_chld 는 g_clients 에 pid 가 기록된 뒤에 실행되므로 슬롯이 새지 않음
+        sigprocmask(SIG_BLOCK, &chld_set, &old_set);
+
+        // MAX_CLIENTS 초과 확인 (빈 슬롯 찾기. 슬롯 번호가 레코드의 보낸 사람 표시가 됨)
+        int slot = -1;
+        for (i = 0; i < MAX_CLIENTS; i++) {
+            if (g_clients[i].pid == 0) {
+                slot = i;
+                break;
+            }
+        }
+        if (slot == -1) {
+            sigprocmask(SIG_SETMASK, &old_set, NULL);
             fprintf(stderr, "Max clients reached. Connection rejected.\n");
             close(client_sock);
             continue;
         }
+        // 이 슬롯을 쓰던 자식은 이미 끝났지만 그 자식이 보낸 레코드가 공유 파이프에 남아 있을 수 있음.
+        // 링을 되돌리기 전에 모두 처리해야 남은 FRAME_OVERFLOW 레코드가 새 자식의 링 내용을 읽지 않음
+        // (끝난 자식은 더 이상 쓰지 않으므로 EAGAIN 까지 읽으면 그 자식의 레코드는 모두 처리됨)
+        drain_child_records();
+        // 이 슬롯의 overflow 링은 새 자식이 처음부터 씀
+        g_overflow_rings[slot].head = 0;
+        g_overflow_rings[slot].tail = 0;
 
         // 각 클라이언트마다 별도의 파이프 쌍 생성 (부모 -> 자식, 자식 -> 부모)
         // 이 부분은 설계에 따라 달라질 수 있습니다.
@@ -132,10 +209,12 @@ int main(int argc, char *argv[]) {
         // 자식 프로세스 생성
         pid = fork();
         if (pid == -1) {
+            sigprocmask(SIG_SETMASK, &old_set, NULL);
             perror("fork() error");
             close(client_sock);
             continue;
         } else if (pid == 0) { // 자식 프로세스
+            sigprocmask(SIG_SETMASK, &old_set, NULL);
             close(listen_sock); // 자식은 리슨 소켓을 닫음
             close(child_to_parent_pipe[0]); // 자식은 부모의 읽기 끝을 닫음
             g_parent_pipe_read_fd = -1; // 자식은 부모의 메인 파이프를 사용하지 않음
@@ -144,11 +223,17 @@ int main(int argc, char *argv[]) {
             // 이 자식 프로세스 내에서 직접 사용하도록 설계할 수 있습니다.
             // g_client_count 등의 전역 변수는 fork 후 자식에서 변경되어도 부모에 반영되지 않습니다.
             // 따라서 handle_client 함수로 필요한 정보만 넘겨야 합니다.
-            handle_client(client_sock, child_to_parent_pipe[1]); // 클라이언트 소켓과 부모에게 메시지 보낼 파이프 전달
+            handle_client(client_sock, slot); // 클라이언트 소켓과 슬롯 번호 전달 (파이프는 g_child_pipe_write_fd)
             exit(0); // 클라이언트 처리 후 자식 프로세스 종료
         } else { // 부모 프로세스
             close(client_sock); // 부모는 클라이언트 소켓을 닫음 (자식이 처리)
-            close(child_to_parent_pipe[1]); // 부모는 자식에게서 메시지 받을 것이므로 쓰기 끝을 닫음
+            // 공유 파이프의 쓰기 끝은 닫지 않음: 다음에 fork 되는 자식도 같은 파이프를 물려받아야 함
+
+            g_clients[slot].pid = pid;
+            g_clients[slot].pipe_fd_read = -1;  // 자식 -> 부모는 공유 파이프 하나 (슬롯 번호로 구분)
+            g_clients[slot].pipe_fd_write = -1; // 부모 -> 자식 파이프는 아직 없음 (broadcast_message 참고)
+            g_client_count++;
+            sigprocmask(SIG_SETMASK, &old_set, NULL); // 막혀 있던 SIGCHLD 는 여기서 처리됨
 
             // 클라이언트 정보 저장 (PID와 통신용 파이프의 쓰기 끝)
             // 실제 구현에서는 각 클라이언트마다 개별 파이프 쌍을 관리해야 합니다.
@@ -181,8 +266,8 @@ int main(int argc, char *argv[]) {
 }
 
 // 클라이언트 요청을 처리하는 자식 프로세스 함수
-void handle_client(int client_sock, int child_to_parent_pipe_write_fd) {
-    char buf[BUF_SIZE];
+void handle_client(int client_sock, int client_idx) {
+    char buf[MAX_MESSAGE_SIZE];
     int str_len;
 
     // 자식 프로세스에서 시그널 핸들러 재설정 (부모와 다르게)
@@ -191,7 +276,7 @@ void handle_client(int client_sock, int child_to_parent_pipe_write_fd) {
     signal(SIGINT, SIG_DFL);
     signal(SIGTERM, SIG_DFL);
 
-    while ((str_len = read(client_sock, buf, BUF_SIZE)) != 0) {
+    while ((str_len = read(client_sock, buf, MAX_MESSAGE_SIZE - 1)) > 0) { // 널 종료 문자 자리 남김
         // 클라이언트로부터 메시지 수신
         buf[str_len] = '\0'; // 널 종료 문자 추가
         fprintf(stdout, "[Child %d] Received from client %d: %s", getpid(), client_sock, buf);
@@ -201,14 +286,114 @@ void handle_client(int client_sock, int child_to_parent_pipe_write_fd) {
 
         // 수신된 메시지를 부모에게 전달 (파이프를 통해)
         // 이 메시지를 부모가 받아서 다른 모든 자식에게 브로드캐스팅합니다.
-        write(child_to_parent_pipe_write_fd, buf, str_len + 1); // 널 종료 문자까지 전송
-        kill(getppid(), SIGUSR1); // 부모에게 메시지 도착 알림
+        // 레코드에 슬롯 번호와 길이가 있으므로 널 종료 문자는 보내지 않음
+        if (send_record_to_parent(client_idx, buf, str_len) == 0) {
+            kill(getppid(), SIGUSR1); // 부모에게 메시지 도착 알림 (겹쳐서 하나로 합쳐져도 부모가 모두 읽음)
+        }
     }
 
     // 클라이언트 연결 종료
     fprintf(stdout, "[Child %d] Client disconnected: %d\n", getpid(), client_sock);
     close(client_sock); // 클라이언트 소켓 닫기
-    close(child_to_parent_pipe_write_fd); // 자식은 이 파이프의 쓰기 끝을 닫음
+    close(g_child_pipe_write_fd); // 자식은 이 파이프의 쓰기 끝을 닫음
+}
+
+// 자식 -> 부모 레코드 전송. 본문이 레코드 하나에 들어가면 PIPE_BUF 이하의 write() 한 번 (원자적),
+// 크면 overflow 링에 본문을 쓰고 길이만 담은 레코드를 보냄. 성공 시 0, 실패 시 -1
+int send_record_to_parent(int slot, const char *data, size_t len) {
+    unsigned char record[PIPE_BUF];
+    if (len > 0xFFFF) {
+        return -1; // 길이 필드(2바이트)로 나타낼 수 없음
+    }
+    record[0] = (unsigned char)slot;
+    record[2] = (unsigned char)(len >> 8);
+    record[3] = (unsigned char)len;
+
+    if (len <= FRAME_MAX_PAYLOAD) {
+        record[1] = FRAME_INLINE;
+        memcpy(record + FRAME_HDR_SIZE, data, len);
+    } else {
+        // 본문을 내 링에 씀. 부모가 앞 메시지를 읽어 자리가 날 때까지 잠깐씩 기다림
+        overflow_ring_t *ring = &g_overflow_rings[slot];
+        if (len > OVERFLOW_RING_SIZE) {
+            return -1;
+        }
+        uint32_t head = ring->head;
+        while (OVERFLOW_RING_SIZE - (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE)) < len) {
+            kill(getppid(), SIGUSR1); // 앞에 보낸 레코드를 아직 안 읽었으면 다시 깨움
+            usleep(1000);
+        }
+        for (size_t i = 0; i < len; i++) {
+            ring->data[(head + i) % OVERFLOW_RING_SIZE] = data[i];
+        }
+        __atomic_store_n(&ring->head, head + (uint32_t)len, __ATOMIC_RELEASE); // 본문을 다 쓴 뒤에 공개
+        record[1] = FRAME_OVERFLOW;
+        len = 0; // 파이프에는 헤더만
+    }
+
+    ssize_t n;
+    do {
+        n = write(g_child_pipe_write_fd, record, FRAME_HDR_SIZE + len);
+    } while (n < 0 && errno == EINTR);
+    return n == (ssize_t)(FRAME_HDR_SIZE + len) ? 0 : -1;
+}
+
+// 레코드 하나 처리: 보낸 슬롯과 본문을 알 수 있으므로 보낸 사람을 구분해 브로드캐스트
+static void handle_child_record(int slot, const char *data, size_t len) {
+    char msg[MAX_MESSAGE_SIZE];
+    if (len >= sizeof(msg)) {
+        len = sizeof(msg) - 1; // 출력/브로드캐스트용 복사본만 자름
+    }
+    memcpy(msg, data, len);
+    msg[len] = '\0';
+    fprintf(stdout, "[Parent] Received message for broadcast from slot %d (pid %d): %s",
+            slot, g_clients[slot].pid, msg);
+    broadcast_message(msg, slot);
+}
+
+// 공유 파이프에 쌓인 레코드를 EAGAIN 이 날 때까지 읽어 한 번에 처리.
+// 레코드는 원자적으로 쓰였으므로 읽은 바이트의 끝에서만 잘릴 수 있고, 그 조각은 다음 read 앞에 이어 붙임
+void drain_child_records(void) {
+    static unsigned char buf[DRAIN_BUF_SIZE];
+    static size_t buf_len = 0;
+    static char overflow_msg[OVERFLOW_RING_SIZE];
+    int records = 0;
+    size_t bytes = 0;
+    ssize_t n;
+
+    while ((n = read(g_parent_pipe_read_fd, buf + buf_len, sizeof(buf) - buf_len)) > 0) {
+        buf_len += n;
+        bytes += n;
+        size_t off = 0;
+        while (buf_len - off >= FRAME_HDR_SIZE) {
+            int slot = buf[off];
+            int type = buf[off + 1];
+            size_t len = ((size_t)buf[off + 2] << 8) | buf[off + 3];
+            size_t body = type == FRAME_INLINE ? len : 0;
+            if (buf_len - off < FRAME_HDR_SIZE + body) {
+                break; // 레코드 뒷부분은 아직 안 읽음
+            }
+            if (slot < MAX_CLIENTS && type == FRAME_INLINE) {
+                handle_child_record(slot, (const char *)buf + off + FRAME_HDR_SIZE, len);
+            } else if (slot < MAX_CLIENTS && type == FRAME_OVERFLOW) {
+                overflow_ring_t *ring = &g_overflow_rings[slot];
+                uint32_t tail = ring->tail;
+                __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE); // 자식이 본문을 다 쓴 뒤에 레코드를 보냈음
+                for (size_t i = 0; i < len; i++) {
+                    overflow_msg[i] = ring->data[(tail + i) % OVERFLOW_RING_SIZE];
+                }
+                __atomic_store_n(&ring->tail, tail + (uint32_t)len, __ATOMIC_RELEASE); // 자리 반납
+                handle_child_record(slot, overflow_msg, len);
+            }
+            off += FRAME_HDR_SIZE + body;
+            records++;
+        }
+        buf_len -= off;
+        memmove(buf, buf + off, buf_len);
+    }
+    if (records > 0) {
+        fprintf(stdout, "[Parent] Drained %d record(s), %zu byte(s) in one batch.\n", records, bytes);
+    }
 }
 
 // SIGCHLD 핸들러: 좀비 프로세스 방지 
@@ -217,39 +402,23 @@ void sig_chld(int signo) {
     int status;
     while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
         fprintf(stdout, "Child process %d terminated.\n", pid);
-        // TODO: g_clients 배열에서 해당 클라이언트 정보 제거 및 파이프 닫기
-        // 제거된 자식의 PID를 관리 목록에서 제거
+        // 해당 자식의 슬롯을 비움 (다음 연결이 재사용)
+        // TODO: 부모 -> 자식 파이프가 생기면 여기서 닫기
+        for (int i = 0; i < MAX_CLIENTS; i++) {
+            if (g_clients[i].pid == pid) {
+                g_clients[i].pid = 0;
+                g_client_count--;
+                break;
+            }
+        }
     }
 }
 
 // SIGUSR1 핸들러: 자식으로부터 메시지 수신 시 호출됨
+// 모든 자식이 하나의 파이프를 공유하지만, 레코드마다 슬롯 번호가 있으므로 누가 보냈는지 구분할 수 있음.
+// 시그널은 겹치면 하나로 합쳐지므로 핸들러에서는 표시만 하고, 메인 루프의 drain_child_records()가
+// 파이프에 쌓인 레코드를 한 번에 모두 처리함. 핸들러는 accept()를 깨우기만 함 (fprintf/read 를 하지 않음)
 void sig_usr1(int signo) {
-    char buf[BUF_SIZE];
-    int n;
-
-    // TODO: g_parent_pipe_read_fd를 통해 자식들이 보낸 메시지를 읽습니다.
-    // 문제는 모든 자식이 동일한 파이프 쓰기 끝을 공유하고 있으므로,
-    // 이 파이프에서 읽을 때 어떤 자식이 보낸 메시지인지 구분하기 어렵습니다.
-    // 따라서 실제 구현에서는 각 자식마다 부모에게 메시지를 보낼 별도의 파이프가 필요합니다.
-    // 이 예시 뼈대에서는 단순히 메시지를 읽어 브로드캐스팅하는 방식으로 가정합니다.
-
-    // 이 예시에서는 모든 자식이 g_parent_pipe_read_fd의 쓰기 끝에 메시지를 보냅니다.
-    // 실제 구현에서는 각 클라이언트의 파이프를 select/poll 없이 어떻게 감지할지 중요합니다.
-    // 제약사항(멀티플렉싱 함수 금지) 때문에 SIGUSR1을 통한 비동기 알림 방식이 핵심입니다.
-    // 즉, 메시지를 보낸 자식이 부모에게 SIGUSR1을 보내면, 부모는 '어딘가에서' 메시지가 왔음을 인지하고
-    // 자신의 모든 자식 파이프를 순회하며 읽을 데이터가 있는지 확인해야 합니다.
-    // 하지만 파이프에 데이터가 있는지 확인하는 것은 ioctl(fd, FIONREAD, &bytes_avail)로 가능하지만,
-    // 이 또한 특정 형태의 I/O 멀티플렉싱으로 간주될 여지가 있으므로 주의해야 합니다.
-    // 가장 순수한 방법은 부모가 메시지 수신 파이프에서 블로킹으로 기다리거나,
-    // 각 자식이 메시지를 보낼 때마다 부모에게 SIGUSR1을 보내고, 부모는 시그널 핸들러에서 메시지를 처리하는 방식입니다.
-
-    // 임시 처리: 모든 자식이 하나의 파이프로 메시지를 보내고 부모가 그 파이프에서 읽는다고 가정.
-    // 실제 구현에서는 각 자식으로부터의 메시지를 구분하는 더 복잡한 로직이 필요.
-    if ((n = read(g_parent_pipe_read_fd, buf, BUF_SIZE)) > 0) {
-        buf[n] = '\0';
-        fprintf(stdout, "[Parent] Received message for broadcast: %s", buf);
-        broadcast_message(buf, -1); // -1은 보낸 사람 구분을 위한 임시 값 (실제 구현 시 필요)
-    }
 }
 
 // SIGINT, SIGTERM 핸들러: 서버 종료 시 모든 자식 프로세스 종료 및 자원 정리
@@ -257,11 +426,11 @@ void sig_int_term(int signo) {
     fprintf(stdout, "Server is shutting down...\n");
     // TODO: 모든 자식 프로세스에게 SIGTERM 등을 보내 종료를 알리고 waitpid로 기다립니다.
     // 사용 중이던 IPC 자원(파이프)도 깨끗하게 정리
-    for (int i = 0; i < g_client_count; i++) {
+    for (int i = 0; i < MAX_CLIENTS; i++) {
         if (g_clients[i].pid > 0) {
             kill(g_clients[i].pid, SIGTERM); // 자식에게 종료 시그널 전송
-            close(g_clients[i].pipe_fd_read);
-            close(g_clients[i].pipe_fd_write);
+            if (g_clients[i].pipe_fd_read >= 0) close(g_clients[i].pipe_fd_read);
+            if (g_clients[i].pipe_fd_write >= 0) close(g_clients[i].pipe_fd_write);
         }
     }
     // 모든 자식이 종료될 때까지 기다림 (선택 사항, sig_chld가 처리할 수도 있음)
@@ -312,10 +481,11 @@ void daemonize() {
     close(STDOUT_FILENO);
     close(STDERR_FILENO);
 
-    // /dev/null로 리다이렉트 (옵션)
-    // open("/dev/null", O_RDWR);
-    // dup(0);
-    // dup(0);
+    // /dev/null로 리다이렉트: 0/1/2 번이 비어 있으면 이후의 소켓/파이프가 그 번호를 받아서
+    // fprintf(stderr, ...) 가 자식 -> 부모 레코드 파이프에 섞여 들어갈 수 있음
+    open("/dev/null", O_RDWR);
+    dup(0);
+    dup(0);
 }
 
 // 모든 클라이언트에게 메시지를 브로드캐스팅하는 함수
@@ -324,7 +494,7 @@ void daemonize() {
 void broadcast_message(const char* message, int sender_idx) {
     // 메시지 수신 파이프에서 메시지를 받은 후,
     // g_clients 배열에 저장된 각 클라이언트의 파이프 쓰기 끝(pipe_fd_write)으로 메시지를 전송합니다.
-    for (int i = 0; i < g_client_count; i++) {
+    for (int i = 0; i < MAX_CLIENTS; i++) {
         // 자신을 제외한 모든 클라이언트에게 (sender_idx가 유효하다면)
         // 실제 구현에서는 방 개념이 있으므로 해당 방의 클라이언트에게만 전송
         // write(g_clients[i].pipe_fd_write, message, strlen(message) + 1);
@@ -8,6 +8,8 @@
 #include <sys/socket.h>
 #include <arpa/inet.h>
 #include <errno.h> // for errno
+#include <poll.h>  // 부모가 소켓과 파이프를 함께 기다림
+#include "../common/term_render.h" // 받은 메시지를 모아서 한 번에 그리는 출력기
 
 #define COLOR_RED     "\x1b[31m"
 #define COLOR_GREEN   "\x1b[32m"
@@ -30,6 +32,7 @@ typedef struct {
 } data_t;
 
 static int g_pfd[2], g_sockfd, g_cont = 1;
+static term_render_t g_term; // 부모 프로세스의 화면 출력기 (스크롤백 링 포함)
 
 // C99, C11에 대응하기 위해서 사용
 inline void clrscr(void);
@@ -40,32 +43,7 @@ void clrscr(void)
 
 void sigHandler(int signo)
 {
-    if(signo == SIGUSR1) {
-        char buf[MAX_MESSAGE_BUFFER_SIZE]; // 서버의 MAX_MESSAGE_BUFFER_SIZE에 맞춰 버퍼 크기 조정
-        memset(buf, 0, MAX_MESSAGE_BUFFER_SIZE); // 버퍼 초기화
-
-        // FIX: 서버는 g_sockfd(네트워크 소켓)를 통해 메시지를 보냅니다.
-        // 따라서 g_pfd[0] (클라이언트 내부 파이프)가 아닌 g_sockfd에서 읽어야 합니다.
-        int n = read(g_sockfd, buf, MAX_MESSAGE_BUFFER_SIZE - 1); // -1은 널 종료 공간 확보
-
-        if (n > 0) {
-            buf[n] = '\0'; // 널 종료
-            // FIX: 메시지를 서버로 다시 보내는 대신, 표준 출력(화면)에 출력합니다.
-            write(STDOUT_FILENO, buf, strlen(buf)); // n 대신 strlen(buf) 사용
-            fflush(stdout); // 즉시 화면에 출력되도록 버퍼 비움
-        } else if (n == 0) {
-            // 서버가 연결을 끊었습니다.
-            g_cont = 0;
-            printf("Server disconnected.\n");
-        } else {
-            // 읽기 오류 처리
-            if (errno == EINTR) {
-                // 시그널에 의해 read가 중단된 경우, 다시 시도할 필요는 없으나 오류로 간주하지 않습니다.
-            } else {
-                perror("read from socket in sigHandler");
-            }
-        }
-    } else if(signo == SIGCHLD) {
+    if(signo == SIGCHLD) {
         // 자식 프로세스 (stdin 리더)가 종료되었을 때 부모가 이 시그널을 받습니다.
         // g_cont를 0으로 설정하여 클라이언트 전체를 종료합니다.
         // 자식이 종료되면 보통 연결이 끊어진 것으로 간주합니다.
@@ -105,6 +83,7 @@ int main(int argc, char** argv)
         return -1;
     }
     printf("Connected to server.\n");
+    fflush(stdout); // 출력기는 stdio를 거치지 않고 write하므로 fork 전에 비움 (자식에게 복사되지 않게)
 
     // 클라이언트 프로세스 내에서 파이프 생성
     // 이 파이프는 자식 프로세스(STDIN 읽기)와 부모 프로세스(서버 응답 읽기) 간의 통신용이 아닙니다.
@@ -117,8 +96,7 @@ int main(int argc, char** argv)
 
     // 시그널 핸들러 설정
     // 부모 프로세스에서만 SIGCHLD를 처리해야 합니다.
-    // SIGUSR1은 서버가 이 클라이언트에게 메시지가 도착했음을 알릴 때 사용됩니다.
-    signal(SIGUSR1, sigHandler);
+    // 서버 메시지는 부모의 메인 루프가 poll()로 기다렸다가 읽습니다 (시그널 핸들러에서 읽지 않음).
     signal(SIGCHLD, sigHandler); // 부모 프로세스가 자식의 종료를 처리
 
     if((pid = fork()) < 0) {
@@ -136,7 +114,6 @@ int main(int argc, char** argv)
         // 여기서는 부모의 SIGCHLD 핸들러가 자식의 종료를 처리하도록 둡니다.
         // 자식은 자신의 SIGCHLD를 처리할 필요가 없습니다.
         signal(SIGCHLD, SIG_DFL); // 자식은 자신의 SIGCHLD를 처리하지 않음
-        signal(SIGUSR1, SIG_DFL); // 자식은 서버로부터의 SIGUSR1을 직접 처리하지 않음 (부모가 처리)
 
         do {
             memset(buf, 0, MAX_MESSAGE_BUFFER_SIZE);
@@ -147,6 +124,11 @@ int main(int argc, char** argv)
                 g_cont = 0; // 부모에게 종료를 알리기 위해 파이프에 메시지를 보낼 수도 있지만, 여기서는 그냥 종료.
                 break;
             }
+            if (strncmp(buf, "/scroll", 7) == 0) {
+                // 화면 명령: 서버가 아니라 화면을 그리는 부모에게 파이프로 전달
+                write(g_pfd[1], buf, strlen(buf));
+                continue;
+            }
             write(g_sockfd, buf, strlen(buf)); // 서버 소켓으로 직접 전송
         } while (g_cont);
 
@@ -157,16 +139,46 @@ int main(int argc, char** argv)
         // 부모는 표준 입력에서 읽는 g_pfd[1] (쓰기)를 사용하지 않습니다.
         close(g_pfd[1]); // g_pfd의 쓰기 끝을 닫음
 
-        // 부모는 서버로부터의 메시지를 SIGUSR1 시그널 핸들러를 통해 비동기적으로 처리합니다.
-        // 이 메인 루프에서는 특별히 할 일 없이 g_cont가 0이 될 때까지 대기합니다.
-        // 실제로는 select() 또는 poll()을 사용하여 g_sockfd와 g_pfd[0] (자식의 종료 또는 메시지)를 동시에 감시하는 것이 일반적입니다.
-        // 하지만 주어진 코드 구조에서는 시그널 핸들러가 메시지 수신을 담당합니다.
+        // 부모는 서버 소켓과 자식의 파이프(/scroll 요청)를 poll()로 기다립니다.
+        // 받은 메시지는 바로 출력하지 않고 출력기에 쌓아 두었다가, 갱신 간격마다 한 번의 write로 그립니다.
+        // 방이 바빠 한 화면보다 많이 쌓이면 앞부분은 생략하고 스크롤백 링에 남겨 둡니다.
+        term_render_init(&g_term, STDOUT_FILENO, NULL);
+        struct pollfd fds[2];
+        fds[0].fd = g_sockfd;
+        fds[0].events = POLLIN;
+        fds[1].fd = g_pfd[0];
+        fds[1].events = POLLIN;
         while(g_cont) {
-            // 이 루프는 g_cont가 0이 되거나 시그널이 올 때까지 대기합니다.
-            // CPU 낭비를 줄이기 위해 짧은 sleep을 넣거나, 시그널을 기다리는 함수를 사용할 수 있습니다.
-            // pause(); // 시그널이 올 때까지 프로세스를 일시 중지
-            sleep(1); // 1초 대기 (CPU 낭비 방지)
+            if (poll(fds, 2, term_render_timeout(&g_term)) < 0) {
+                if (errno == EINTR) continue; // SIGCHLD 등: g_cont를 다시 확인
+                perror("poll");
+                break;
+            }
+            if (fds[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+                int n = read(g_sockfd, buf, MAX_MESSAGE_BUFFER_SIZE);
+                if (n > 0) {
+                    term_render_append(&g_term, NULL, buf, n);
+                } else if (n == 0 || errno != EINTR) {
+                    // 서버가 연결을 끊었습니다.
+                    term_render_printf(&g_term, NULL, "Server disconnected.\n");
+                    g_cont = 0;
+                }
+            }
+            if (fds[1].revents & POLLIN) {
+                // 자식이 보낸 /scroll [줄 수]: 스크롤백 링의 마지막 줄들을 다시 그림
+                int n = read(g_pfd[0], buf, MAX_MESSAGE_BUFFER_SIZE - 1);
+                if (n > 0) {
+                    buf[n] = '\0';
+                    long count = strtol(buf + 7, NULL, 10);
+                    term_render_scrollback(&g_term, count > 0 ? (unsigned long)count : (unsigned long)g_term.max_lines);
+                }
+            }
+            term_render_flush(&g_term, 0);
         }
+        term_render_flush(&g_term, 1);
+
+        // 자식(키보드 입력)은 서버가 끊겨도 fgets에서 기다리므로 종료시킵니다.
+        kill(pid, SIGTERM);
 
         // 자식 프로세스 종료를 기다립니다.
         int status;
@@ -0,0 +1,718 @@
+// echo_bench.c
+// 동시성 모델별 에코 서버 + 부하 드라이버 (채팅 서버 엔진 선택을 위한 기준 측정)
+//
+// 서버 모델
+//   fork    : 연결마다 fork (fork_server.c, chat_server2.c 와 같은 구조)
+//   prefork : 미리 fork 한 워커들이 같은 리스닝 소켓에서 accept, 워커당 연결 하나씩 처리
+//   select  : 단일 프로세스 + select
+//   epoll   : 단일 프로세스 + epoll (레벨 트리거)
+//   io_uring: 단일 프로세스 + io_uring (liburing 없이 시스템 콜 직접 호출, accept/recv/send)
+//
+// 드라이버는 연결 conns 개를 열고, 연결마다 요청(size 바이트)을 depth 개까지 응답 없이
+// 보내 둔 채(파이프라이닝) 응답이 올 때마다 하나씩 더 보낸다. 요청/초, 지연 백분위를 측정하고
+// all 모드에서는 서버 프로세스(자식 포함)의 CPU 시간을 요청 수로 나눈 값도 출력한다.
+//
+// 빌드: gcc -O2 -o echo_bench echo_bench.c
+// 실행: ./echo_bench server <모델> <port> [prefork 워커 수]
+//       ./echo_bench client <port> [conns] [depth] [size] [seconds]
+//       ./echo_bench all [conns] [depth] [size] [seconds]   (모델별로 서버를 띄워 차례로 측정, CSV 출력)
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <poll.h>
+#include <time.h>
+#include <stdint.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/wait.h>
+#include <sys/select.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#define BUF_SIZE 16384
+#define MAX_CONNS 1024
+#define MAX_SIZE 4096                   // 요청 최대 크기
+#define MAX_DEPTH 256                   // 연결당 응답 없이 보내 둘 수 있는 요청 수
+#define MAX_INFLIGHT_BYTES 65536        // 연결당 보내 둔 데이터 (depth * size) 상한 (양쪽 소켓 버퍼 안에 들어가야 블로킹 쓰기가 교착되지 않음)
+#define MAX_SAMPLES 1000000             // 지연 표본 최대 개수 (넘으면 저수지 표본 추출)
+#define DEFAULT_PREFORK_WORKERS 8
+#define ALL_BASE_PORT 9400
+
+volatile sig_atomic_t stop = 0;
+
+void stop_handler(int sig) {
+    stop = 1;
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int write_full(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0) {
+            if (errno == EINTR && !stop) continue;
+            return -1;
+        }
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static void set_nonblocking(int fd) {
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+}
+
+static void set_nodelay(int fd) {
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+static int listen_on(int port) {
+    struct sockaddr_in adr;
+    int opt = 1;
+    int sock = socket(PF_INET, SOCK_STREAM, 0);
+    if (sock == -1) {
+        perror("socket error");
+        exit(1);
+    }
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    memset(&adr, 0, sizeof(adr));
+    adr.sin_family = AF_INET;
+    adr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    adr.sin_port = htons(port);
+    if (bind(sock, (struct sockaddr*)&adr, sizeof(adr)) == -1) {
+        perror("bind error");
+        exit(1);
+    }
+    if (listen(sock, 512) == -1) {
+        perror("listen error");
+        exit(1);
+    }
+    return sock;
+}
+
+// 블로킹 소켓 하나를 끝날 때까지 에코 (fork / prefork 용)
+static void echo_blocking(int sock) {
+    char buf[BUF_SIZE];
+    set_nodelay(sock);
+    while (!stop) {
+        ssize_t n = read(sock, buf, sizeof(buf));
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) continue;
+            break;
+        }
+        if (write_full(sock, buf, n) != 0) break;
+    }
+    close(sock);
+}
+
+// ===========================================
+// fork / prefork
+// ===========================================
+// 살아 있는 자식 PID (0 = 빈 칸). 종료할 때 이 목록의 프로세스에만 SIGTERM 을 보냄
+// 추가는 SIGCHLD 를 막은 채로 하고, 지우기는 SIGCHLD 핸들러가 함
+static pid_t children[MAX_CONNS + 64];
+
+static void untrack_child(pid_t pid) {
+    for (size_t i = 0; i < sizeof(children) / sizeof(children[0]); i++) {
+        if (children[i] == pid) {
+            children[i] = 0;
+            return;
+        }
+    }
+}
+
+// fork 해서 자식이면 0, 부모면 자식 PID, 실패하거나 목록이 가득 차면 -1
+static pid_t fork_tracked(void) {
+    sigset_t block, old;
+    sigemptyset(&block);
+    sigaddset(&block, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &block, &old);
+    pid_t pid = -1;
+    for (size_t i = 0; i < sizeof(children) / sizeof(children[0]); i++) {
+        if (children[i] == 0) {
+            pid = fork();
+            if (pid > 0) {
+                children[i] = pid;
+            }
+            break;
+        }
+    }
+    sigprocmask(SIG_SETMASK, &old, NULL);
+    return pid;
+}
+
+void reap_children(int sig) {
+    int saved = errno;
+    pid_t pid;
+    while ((pid = waitpid(-1, NULL, WNOHANG)) > 0) {
+        untrack_child(pid);
+    }
+    errno = saved;
+}
+
+static void serve_fork(int serv_sock) {
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = reap_children;
+    sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+    sigaction(SIGCHLD, &sa, NULL);
+
+    while (!stop) {
+        int clnt_sock = accept(serv_sock, NULL, NULL);
+        if (clnt_sock == -1) continue;
+        pid_t pid = fork_tracked();
+        if (pid == 0) {
+            close(serv_sock);
+            echo_blocking(clnt_sock);
+            _exit(0);
+        }
+        close(clnt_sock); // 실패했으면 연결을 끊음
+    }
+}
+
+static void serve_prefork(int serv_sock, int workers) {
+    for (int i = 0; i < workers; i++) {
+        if (fork_tracked() == 0) {
+            while (!stop) {
+                int clnt_sock = accept(serv_sock, NULL, NULL);
+                if (clnt_sock == -1) continue;
+                echo_blocking(clnt_sock);
+            }
+            _exit(0);
+        }
+    }
+    while (!stop) {
+        pause();
+    }
+}
+
+// ===========================================
+// select / epoll: 논블로킹 연결 + 못 보낸 데이터 버퍼
+// ===========================================
+typedef struct {
+    int fd;
+    size_t len;                         // buf 에 남은 (아직 못 보낸) 바이트
+    size_t off;
+    char buf[BUF_SIZE];
+} echo_conn_t;
+
+static echo_conn_t *conns[MAX_CONNS + 64];  // fd 로 색인
+
+static echo_conn_t *conn_open(int fd) {
+    if (fd >= (int)(sizeof(conns) / sizeof(conns[0]))) {
+        close(fd);
+        return NULL;
+    }
+    echo_conn_t *c = calloc(1, sizeof(*c));
+    c->fd = fd;
+    set_nonblocking(fd);
+    set_nodelay(fd);
+    conns[fd] = c;
+    return c;
+}
+
+static void conn_close(echo_conn_t *c) {
+    conns[c->fd] = NULL;
+    close(c->fd);
+    free(c);
+}
+
+// 남은 데이터를 보냄. 0: 다 보냄, 1: 아직 남음, -1: 오류
+static int conn_flush(echo_conn_t *c) {
+    while (c->len > 0) {
+        ssize_t n = write(c->fd, c->buf + c->off, c->len);
+        if (n < 0) {
+            return (errno == EAGAIN || errno == EWOULDBLOCK) ? 1 : -1;
+        }
+        c->off += n;
+        c->len -= n;
+    }
+    return 0;
+}
+
+// 읽고 바로 에코. 보낼 데이터가 남아 있으면 읽지 않음 (역압)
+static int conn_on_readable(echo_conn_t *c) {
+    if (c->len > 0) return conn_flush(c);
+    ssize_t n = read(c->fd, c->buf, sizeof(c->buf));
+    if (n == 0) return -1;
+    if (n < 0) return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+    c->off = 0;
+    c->len = n;
+    return conn_flush(c);
+}
+
+static void serve_select(int serv_sock) {
+    set_nonblocking(serv_sock);
+    while (!stop) {
+        fd_set rfds, wfds;
+        int max_fd = serv_sock;
+        FD_ZERO(&rfds);
+        FD_ZERO(&wfds);
+        FD_SET(serv_sock, &rfds);
+        for (int fd = 0; fd < FD_SETSIZE && fd < (int)(sizeof(conns) / sizeof(conns[0])); fd++) {
+            if (conns[fd] == NULL) continue;
+            if (conns[fd]->len > 0) FD_SET(fd, &wfds); else FD_SET(fd, &rfds);
+            if (fd > max_fd) max_fd = fd;
+        }
+        if (select(max_fd + 1, &rfds, &wfds, NULL, NULL) < 0) continue;
+
+        if (FD_ISSET(serv_sock, &rfds)) {
+            int fd;
+            while ((fd = accept(serv_sock, NULL, NULL)) >= 0) {
+                if (fd >= FD_SETSIZE) {
+                    close(fd);      // select 는 FD_SETSIZE 이상의 FD 를 다룰 수 없음
+                    continue;
+                }
+                conn_open(fd);
+            }
+        }
+        for (int fd = 0; fd <= max_fd; fd++) {
+            echo_conn_t *c = conns[fd];
+            if (c == NULL || fd == serv_sock) continue;
+            int rc = 0;
+            if (FD_ISSET(fd, &rfds)) rc = conn_on_readable(c);
+            else if (FD_ISSET(fd, &wfds)) rc = conn_flush(c);
+            if (rc < 0) conn_close(c);
+        }
+    }
+}
+
+static void serve_epoll(int serv_sock) {
+    struct epoll_event ev, events[256];
+    int ep = epoll_create1(0);
+    set_nonblocking(serv_sock);
+    ev.events = EPOLLIN;
+    ev.data.fd = serv_sock;
+    epoll_ctl(ep, EPOLL_CTL_ADD, serv_sock, &ev);
+
+    while (!stop) {
+        int n = epoll_wait(ep, events, 256, -1);
+        for (int i = 0; i < n; i++) {
+            int fd = events[i].data.fd;
+            if (fd == serv_sock) {
+                int cfd;
+                while ((cfd = accept(serv_sock, NULL, NULL)) >= 0) {
+                    if (conn_open(cfd) == NULL) continue;
+                    ev.events = EPOLLIN;
+                    ev.data.fd = cfd;
+                    epoll_ctl(ep, EPOLL_CTL_ADD, cfd, &ev);
+                }
+                continue;
+            }
+            echo_conn_t *c = conns[fd];
+            if (c == NULL) continue;
+            int had_pending = c->len > 0;
+            int rc = conn_on_readable(c);
+            if (rc < 0) {
+                conn_close(c);      // close 하면 epoll 에서도 빠짐
+                continue;
+            }
+            if (had_pending != (c->len > 0)) {
+                // 못 보낸 데이터가 생기면 쓰기 가능을, 다 보내면 다시 읽기를 기다림
+                ev.events = c->len > 0 ? EPOLLOUT : EPOLLIN;
+                ev.data.fd = fd;
+                epoll_ctl(ep, EPOLL_CTL_MOD, fd, &ev);
+            }
+        }
+    }
+}
+
+// ===========================================
+// io_uring (시스템 콜 직접 사용)
+// ===========================================
+enum { URING_ACCEPT = 1, URING_RECV, URING_SEND };
+
+typedef struct {
+    int fd;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    unsigned sq_entries;
+    unsigned to_submit;
+} uring_t;
+
+static int uring_init(uring_t *r, unsigned entries) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    r->fd = syscall(__NR_io_uring_setup, entries, &p);
+    if (r->fd < 0) return -1;
+
+    size_t sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    size_t cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (cq_size > sq_size) sq_size = cq_size;
+        cq_size = sq_size;
+    }
+    char *sq = mmap(NULL, sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+    if (sq == MAP_FAILED) return -1;
+    char *cq = sq;
+    if (!(p.features & IORING_FEAT_SINGLE_MMAP)) {
+        cq = mmap(NULL, cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+        if (cq == MAP_FAILED) return -1;
+    }
+    r->sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+    if (r->sqes == MAP_FAILED) return -1;
+
+    r->sq_head = (unsigned *)(sq + p.sq_off.head);
+    r->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    r->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+    r->sq_array = (unsigned *)(sq + p.sq_off.array);
+    r->cq_head = (unsigned *)(cq + p.cq_off.head);
+    r->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    r->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    r->sq_entries = p.sq_entries;
+    r->to_submit = 0;
+    return 0;
+}
+
+static int uring_enter(uring_t *r, unsigned min_complete) {
+    int n = syscall(__NR_io_uring_enter, r->fd, r->to_submit, min_complete,
+                    min_complete ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+    if (n >= 0) r->to_submit -= n;
+    return n;
+}
+
+static struct io_uring_sqe *uring_get_sqe(uring_t *r) {
+    unsigned tail = *r->sq_tail;
+    while (tail - __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE) >= r->sq_entries) {
+        uring_enter(r, 0);      // 제출 큐가 가득 참: 먼저 제출
+    }
+    unsigned idx = tail & *r->sq_mask;
+    struct io_uring_sqe *sqe = &r->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    r->sq_array[idx] = idx;
+    __atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    r->to_submit++;
+    return sqe;
+}
+
+static void uring_prep(uring_t *r, int op, int fd, void *buf, unsigned len) {
+    struct io_uring_sqe *sqe = uring_get_sqe(r);
+    sqe->fd = fd;
+    sqe->addr = (uintptr_t)buf;
+    sqe->len = len;
+    sqe->user_data = ((uint64_t)op << 32) | (uint32_t)fd;
+    switch (op) {
+    case URING_ACCEPT: sqe->opcode = IORING_OP_ACCEPT; break;
+    case URING_RECV:   sqe->opcode = IORING_OP_RECV; break;
+    case URING_SEND:   sqe->opcode = IORING_OP_SEND; sqe->msg_flags = MSG_NOSIGNAL; break;
+    }
+}
+
+static int serve_io_uring(int serv_sock) {
+    uring_t ring;
+    if (uring_init(&ring, 1024) != 0) {
+        perror("io_uring_setup");
+        return -1;
+    }
+    uring_prep(&ring, URING_ACCEPT, serv_sock, NULL, 0);
+
+    while (!stop) {
+        if (uring_enter(&ring, 1) < 0 && errno != EINTR) {
+            perror("io_uring_enter");
+            return -1;
+        }
+        unsigned head = *ring.cq_head;
+        while (head != __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE)) {
+            struct io_uring_cqe *cqe = &ring.cqes[head & *ring.cq_mask];
+            int op = cqe->user_data >> 32;
+            int fd = (int)(uint32_t)cqe->user_data;
+            int res = cqe->res;
+            head++;
+            __atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+
+            if (op == URING_ACCEPT) {
+                if (res >= 0) {
+                    echo_conn_t *c = conn_open(res);
+                    if (c) {
+                        fcntl(res, F_SETFL, fcntl(res, F_GETFL, 0) & ~O_NONBLOCK);
+                        uring_prep(&ring, URING_RECV, res, c->buf, sizeof(c->buf));
+                    }
+                }
+                uring_prep(&ring, URING_ACCEPT, serv_sock, NULL, 0);
+                continue;
+            }
+            echo_conn_t *c = conns[fd];
+            if (c == NULL) continue;
+            if (res <= 0) {
+                conn_close(c);
+                continue;
+            }
+            if (op == URING_RECV) {
+                c->off = 0;
+                c->len = res;
+                uring_prep(&ring, URING_SEND, fd, c->buf, c->len);
+            } else {
+                c->off += res;
+                c->len -= res;
+                if (c->len > 0) {
+                    uring_prep(&ring, URING_SEND, fd, c->buf + c->off, c->len);
+                } else {
+                    uring_prep(&ring, URING_RECV, fd, c->buf, sizeof(c->buf));
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+// ===========================================
+// 서버 실행 (SIGTERM 으로 종료, 자식까지 회수한 뒤 끝남)
+// ===========================================
+static int run_server(const char *model, int port, int workers) {
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = stop_handler;   // SA_RESTART 없이: 블록된 시스템 콜이 EINTR 로 깨어나도록
+    sigaction(SIGTERM, &sa, NULL);
+    sigaction(SIGINT, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    int serv_sock = listen_on(port);
+    int rc = 0;
+    if (strcmp(model, "fork") == 0) serve_fork(serv_sock);
+    else if (strcmp(model, "prefork") == 0) serve_prefork(serv_sock, workers);
+    else if (strcmp(model, "select") == 0) serve_select(serv_sock);
+    else if (strcmp(model, "epoll") == 0) serve_epoll(serv_sock);
+    else if (strcmp(model, "io_uring") == 0) rc = serve_io_uring(serv_sock);
+    else {
+        fprintf(stderr, "알 수 없는 모델: %s\n", model);
+        return 1;
+    }
+
+    // fork/prefork 자식들을 끝내고 회수해야 CPU 시간이 이 프로세스 몫으로 합산됨
+    // (kill(0, ...) 은 같은 프로세스 그룹의 다른 프로세스, 예를 들어 실행한 스크립트까지 죽임)
+    signal(SIGCHLD, SIG_DFL);
+    for (size_t i = 0; i < sizeof(children) / sizeof(children[0]); i++) {
+        if (children[i] > 0) {
+            kill(children[i], SIGTERM);
+        }
+    }
+    while (wait(NULL) > 0) { }
+    close(serv_sock);
+    return rc == 0 ? 0 : 2;
+}
+
+// ===========================================
+// 드라이버
+// ===========================================
+typedef struct {
+    int fd;
+    uint64_t sent_at[MAX_DEPTH];   // 보낸 요청의 시각 (FIFO, 에코는 순서를 지킴)
+    unsigned head, tail;
+    size_t rx_partial;                  // 현재 응답에서 이미 받은 바이트
+} drv_conn_t;
+
+typedef struct {
+    double req_per_sec;
+    double p50_us, p99_us, p999_us, max_us;
+    unsigned long requests;
+} drv_result_t;
+
+static uint64_t samples[MAX_SAMPLES];
+static unsigned long sample_seen;
+
+static void add_sample(uint64_t v) {
+    if (sample_seen < MAX_SAMPLES) {
+        samples[sample_seen] = v;
+    } else {
+        unsigned long j = (unsigned long)(((double)rand() / ((double)RAND_MAX + 1)) * (sample_seen + 1));
+        if (j < MAX_SAMPLES) samples[j] = v;
+    }
+    sample_seen++;
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static int connect_to(int port) {
+    struct sockaddr_in adr;
+    memset(&adr, 0, sizeof(adr));
+    adr.sin_family = AF_INET;
+    adr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    adr.sin_port = htons(port);
+    for (int tries = 0; tries < 50; tries++) {   // 서버가 막 뜨는 중일 수 있음
+        int sock = socket(PF_INET, SOCK_STREAM, 0);
+        if (connect(sock, (struct sockaddr*)&adr, sizeof(adr)) == 0) {
+            set_nodelay(sock);
+            return sock;
+        }
+        close(sock);
+        usleep(20000);
+    }
+    return -1;
+}
+
+static int send_request(drv_conn_t *c, const char *msg, int size) {
+    c->sent_at[c->tail++ % MAX_DEPTH] = now_ns();
+    return write_full(c->fd, msg, size);
+}
+
+static int run_driver(int port, int nconns, int depth, int size, int seconds, drv_result_t *res) {
+    static drv_conn_t dconns[MAX_CONNS];
+    static struct pollfd pfds[MAX_CONNS];
+    char msg[MAX_SIZE];
+    char rbuf[BUF_SIZE];
+    memset(msg, 'e', sizeof(msg));
+    sample_seen = 0;
+    signal(SIGPIPE, SIG_IGN);
+
+    for (int i = 0; i < nconns; i++) {
+        drv_conn_t *c = &dconns[i];
+        c->fd = connect_to(port);
+        if (c->fd < 0) {
+            perror("connect error");
+            return -1;
+        }
+        c->head = c->tail = 0;
+        c->rx_partial = 0;
+        pfds[i].fd = c->fd;
+        pfds[i].events = POLLIN;
+    }
+    for (int i = 0; i < nconns; i++) {
+        for (int d = 0; d < depth; d++) {
+            send_request(&dconns[i], msg, size);
+        }
+    }
+
+    unsigned long done = 0;
+    uint64_t start = now_ns();
+    uint64_t end = start + (uint64_t)seconds * 1000000000ULL;
+    while (now_ns() < end) {
+        if (poll(pfds, nconns, 100) <= 0) continue;
+        for (int i = 0; i < nconns; i++) {
+            if (!(pfds[i].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+            drv_conn_t *c = &dconns[i];
+            ssize_t n = recv(c->fd, rbuf, sizeof(rbuf), MSG_DONTWAIT);
+            if (n <= 0) {
+                if (n < 0 && errno == EAGAIN) continue;
+                fprintf(stderr, "서버가 연결을 끊었습니다.\n");
+                return -1;
+            }
+            c->rx_partial += n;
+            uint64_t now = now_ns();
+            while (c->rx_partial >= (size_t)size) {
+                c->rx_partial -= size;
+                add_sample(now - c->sent_at[c->head++ % MAX_DEPTH]);
+                done++;
+                if (now < end) send_request(c, msg, size);
+            }
+        }
+    }
+    double elapsed = (now_ns() - start) / 1e9;
+    for (int i = 0; i < nconns; i++) {
+        close(dconns[i].fd);
+    }
+
+    unsigned long ns = sample_seen < MAX_SAMPLES ? sample_seen : MAX_SAMPLES;
+    memset(res, 0, sizeof(*res));
+    res->requests = done;
+    res->req_per_sec = done / elapsed;
+    if (ns > 0) {
+        qsort(samples, ns, sizeof(uint64_t), cmp_u64);
+        res->p50_us = samples[ns / 2] / 1e3;
+        res->p99_us = samples[(unsigned long)(ns * 0.99)] / 1e3;
+        res->p999_us = samples[(unsigned long)(ns * 0.999)] / 1e3;
+        res->max_us = samples[ns - 1] / 1e3;
+    }
+    return 0;
+}
+
+// ===========================================
+// 모델 전체 비교
+// ===========================================
+static void run_all(int nconns, int depth, int size, int seconds) {
+    static const char *models[] = { "fork", "prefork", "select", "epoll", "io_uring" };
+    int workers = nconns < DEFAULT_PREFORK_WORKERS ? DEFAULT_PREFORK_WORKERS : nconns;
+
+    printf("# conns=%d depth=%d size=%d seconds=%d (prefork workers=%d)\n", nconns, depth, size, seconds, workers);
+    printf("model,req_per_sec,p50_us,p99_us,p999_us,max_us,server_cpu_us_per_req\n");
+    fflush(stdout);
+    for (size_t m = 0; m < sizeof(models) / sizeof(models[0]); m++) {
+        int port = ALL_BASE_PORT + (int)m;
+        pid_t pid = fork();
+        if (pid == 0) {
+            _exit(run_server(models[m], port, workers));
+        }
+
+        drv_result_t r;
+        int ok = run_driver(port, nconns, depth, size, seconds, &r) == 0;
+        usleep(100000);             // 연결 종료로 fork 모델 자식들이 끝날 시간
+        kill(pid, SIGTERM);
+
+        int status;
+        struct rusage ru;
+        wait4(pid, &status, 0, &ru);
+        if (!ok || !WIFEXITED(status) || WEXITSTATUS(status) != 0 || r.requests == 0) {
+            printf("%s,NA,NA,NA,NA,NA,NA\n", models[m]);
+            fflush(stdout);
+            continue;
+        }
+        double cpu_us = ru.ru_utime.tv_sec * 1e6 + ru.ru_utime.tv_usec + ru.ru_stime.tv_sec * 1e6 + ru.ru_stime.tv_usec;
+        printf("%s,%.1f,%.1f,%.1f,%.1f,%.1f,%.2f\n", models[m], r.req_per_sec, r.p50_us, r.p99_us,
+               r.p999_us, r.max_us, cpu_us / r.requests);
+        fflush(stdout);
+    }
+}
+
+static int parse_load_args(int argc, char *argv[], int first, int *conns, int *depth, int *size, int *seconds) {
+    *conns = argc > first ? atoi(argv[first]) : 16;
+    *depth = argc > first + 1 ? atoi(argv[first + 1]) : 1;
+    *size = argc > first + 2 ? atoi(argv[first + 2]) : 64;
+    *seconds = argc > first + 3 ? atoi(argv[first + 3]) : 3;
+    if (*conns < 1 || *conns > MAX_CONNS || *depth < 1 || *depth > MAX_DEPTH || *size < 1 || *size > MAX_SIZE ||
+        (long)*depth * *size > MAX_INFLIGHT_BYTES || *seconds < 1) {
+        fprintf(stderr, "conns 1~%d, depth 1~%d, size 1~%d, depth*size <= %d, seconds >= 1\n",
+                MAX_CONNS, MAX_DEPTH, MAX_SIZE, MAX_INFLIGHT_BYTES);
+        return -1;
+    }
+    return 0;
+}
+
+static void usage(const char *prog) {
+    printf("Usage: %s server <fork|prefork|select|epoll|io_uring> <port> [workers]\n", prog);
+    printf("       %s client <port> [conns] [depth] [size] [seconds]\n", prog);
+    printf("       %s all [conns] [depth] [size] [seconds]\n", prog);
+}
+
+int main(int argc, char *argv[]) {
+    int conns, depth, size, seconds;
+
+    if (argc >= 4 && strcmp(argv[1], "server") == 0) {
+        int workers = argc > 4 ? atoi(argv[4]) : DEFAULT_PREFORK_WORKERS;
+        return run_server(argv[2], atoi(argv[3]), workers);
+    }
+    if (argc >= 3 && strcmp(argv[1], "client") == 0) {
+        drv_result_t r;
+        if (parse_load_args(argc, argv, 3, &conns, &depth, &size, &seconds) != 0) return 1;
+        if (run_driver(atoi(argv[2]), conns, depth, size, seconds, &r) != 0) return 1;
+        printf("requests=%lu req_per_sec=%.1f p50_us=%.1f p99_us=%.1f p999_us=%.1f max_us=%.1f\n",
+               r.requests, r.req_per_sec, r.p50_us, r.p99_us, r.p999_us, r.max_us);
+        return 0;
+    }
+    if (argc >= 2 && strcmp(argv[1], "all") == 0) {
+        if (parse_load_args(argc, argv, 2, &conns, &depth, &size, &seconds) != 0) return 1;
+        run_all(conns, depth, size, seconds);
+        return 0;
+    }
+    usage(argv[0]);
+    return 1;
+}
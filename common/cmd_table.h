@@ -0,0 +1,86 @@
+// cmd_table.h
+// 명령어(동사) -> 핸들러 함수 포인터를 매핑하는 완전 해시(perfect hash) 테이블
+//
+// 각 서버는 명령어 목록을 X-매크로 한 곳에 선언하고, 시작할 때 cmd_table_build()로
+// 충돌이 하나도 없는 seed를 찾아 테이블을 만든다. 이후 디스패치는
+// "해시 한 번 + 문자열 비교 한 번"으로 끝난다 (strcmp 체인 없음).
+// C에는 컴파일 타임 문자열 해시가 없으므로 테이블은 시작 시 한 번 생성되며,
+// 같은 목록이면 항상 같은 seed/배치가 나온다 (결정적).
+//
+// 핸들러의 인자 struct cmd_ctx 는 이 헤더를 포함하는 서버가 정의한다.
+#ifndef CMD_TABLE_H
+#define CMD_TABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define CMD_TABLE_MAX_SLOTS 64
+#define CMD_TABLE_MAX_SEED 100000
+
+struct cmd_ctx;
+typedef void (*cmd_handler_fn)(struct cmd_ctx *ctx);
+
+typedef struct {
+    const char *name;
+    cmd_handler_fn handler;
+} cmd_entry_t;
+
+typedef struct {
+    uint32_t seed;
+    uint32_t mask;                                  // 슬롯 수 - 1 (2의 거듭제곱)
+    const cmd_entry_t *slots[CMD_TABLE_MAX_SLOTS];
+} cmd_table_t;
+
+// seed를 섞은 FNV-1a 해시
+static inline uint32_t cmd_hash(const char *s, uint32_t seed) {
+    uint32_t h = 2166136261u ^ (seed * 0x9e3779b9u);
+    while (*s) {
+        h ^= (unsigned char)*s++;
+        h *= 16777619u;
+    }
+    h ^= h >> 15;
+    return h;
+}
+
+// 충돌 없는 seed를 찾아 테이블을 채움. 성공 시 0, 실패 시 -1
+static inline int cmd_table_build(cmd_table_t *t, const cmd_entry_t *entries, size_t count) {
+    uint32_t slots = 1;
+    while (slots < count * 2) {
+        slots <<= 1;
+    }
+    for (; slots <= CMD_TABLE_MAX_SLOTS; slots <<= 1) {
+        for (uint32_t seed = 1; seed <= CMD_TABLE_MAX_SEED; seed++) {
+            size_t i;
+            memset(t->slots, 0, sizeof(t->slots));
+            for (i = 0; i < count; i++) {
+                uint32_t idx = cmd_hash(entries[i].name, seed) & (slots - 1);
+                if (t->slots[idx] != NULL) {
+                    break; // 충돌: 다음 seed
+                }
+                t->slots[idx] = &entries[i];
+            }
+            if (i == count) {
+                t->seed = seed;
+                t->mask = slots - 1;
+                return 0;
+            }
+        }
+    }
+    return -1;
+}
+
+// 이름에 해당하는 항목. 없으면 NULL
+static inline const cmd_entry_t *cmd_table_lookup(const cmd_table_t *t, const char *name) {
+    const cmd_entry_t *e = t->slots[cmd_hash(name, t->seed) & t->mask];
+    if (e != NULL && strcmp(e->name, name) == 0) {
+        return e;
+    }
+    return NULL;
+}
+
+// X-매크로 도우미: X(이름, 핸들러) 목록에서 선언과 테이블 항목을 생성
+#define CMD_TABLE_DECLARE_HANDLER(name, fn) static void fn(struct cmd_ctx *ctx);
+#define CMD_TABLE_ENTRY(name, fn) { name, fn },
+
+#endif // CMD_TABLE_H
@@ -0,0 +1,221 @@
+// term_render.h
+// 채팅 클라이언트용 버퍼링 터미널 출력기
+//
+// 받은 메시지를 printf + fflush 로 하나씩 찍고 프롬프트를 매번 다시 그리면, 방이 바쁠 때
+// 터미널(쓰기 시스템 콜 + 화면 갱신)이 병목이 된다. 여기서는 받은 메시지를 줄 단위로 스크롤백 링에
+// 쌓아 두고, 갱신 간격(TERM_RENDER_INTERVAL_MS)마다 그동안 쌓인 줄을 한 프레임으로 만들어
+// write 한 번으로 내보낸다. 프레임은 프롬프트 줄을 지우고(\r + ESC[2K) 새 줄들을 쓴 뒤 프롬프트를 다시 그린다.
+// 한 프레임에 화면 높이보다 많은 줄이 쌓이면 앞부분은 "N개 생략" 한 줄로 줄이고 마지막 화면분만 그리므로,
+// 초당 수천 개가 와도 터미널에 쓰는 양은 갱신 간격당 한 화면으로 제한된다.
+// 생략된 줄은 링에 남아 있어 term_render_scrollback() 으로 다시 볼 수 있다.
+// '\n' 이 아직 오지 않은 줄(두 번의 read 로 나뉘어 온 줄, "닉네임을 입력하세요: " 같은 물음)은 링에 넣지 않고
+// 프레임 끝(프롬프트 앞)에 임시로 그린다. 다음 프레임이 그 줄을 지우고 다시 그리므로, 나머지가 오면 한 줄로 이어진다.
+//
+// 사용: poll 타임아웃을 term_render_timeout() 으로 잡고, 루프를 돌 때마다 term_render_flush(r, 0) 호출.
+// 구조체가 크므로(스크롤백 링) 전역 변수로 두고 쓴다.
+#ifndef TERM_RENDER_H
+#define TERM_RENDER_H
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+#define TERM_RENDER_SCROLLBACK 1024       // 링에 남겨 두는 줄 수
+#define TERM_RENDER_LINE_MAX 1024         // 한 줄 최대 길이 (더 길면 나눠서 저장)
+#define TERM_RENDER_FRAME_SIZE (64 * 1024) // 한 번에 write 할 프레임 버퍼
+#define TERM_RENDER_INTERVAL_MS 33        // 프레임 갱신 간격 (약 30fps)
+#define TERM_RENDER_RESET "\x1b[0m"
+#define TERM_RENDER_CLEAR_LINE "\r\x1b[2K"  // 커서를 줄 처음으로 옮기고 그 줄(프롬프트)을 지움
+
+typedef struct {
+    const char *color;                   // 줄 앞에 붙일 색 (NULL: 없음)
+    unsigned short len;
+    char text[TERM_RENDER_LINE_MAX];
+} term_line_t;
+
+typedef struct {
+    int fd;                              // 출력할 터미널 (보통 STDOUT_FILENO)
+    const char *prompt;                  // 프레임 끝에 다시 그릴 프롬프트 (NULL: 없음)
+    int max_lines;                       // 한 프레임에 그리는 최대 줄 수 (화면 높이)
+    term_line_t ring[TERM_RENDER_SCROLLBACK];
+    unsigned long head;                  // 지금까지 링에 넣은 줄 수 (다음 줄의 순번)
+    unsigned long drawn;                 // 화면에 그린(또는 생략한) 줄의 순번 끝
+    int replay;                          // 다음 프레임은 줄 수 제한 없이 그림 (스크롤백 보기)
+    term_line_t partial;                 // 아직 '\n' 이 오지 않은 줄 (링에 넣지 않고 프레임 끝에 임시로 그림)
+    unsigned short partial_drawn;        // 화면에 임시로 그려 둔 partial 의 길이
+    char frame[TERM_RENDER_FRAME_SIZE];
+    size_t frame_len;
+    uint64_t last_frame_ms;
+    unsigned long frames, lines, skipped; // 통계
+} term_render_t;
+
+static inline uint64_t term_render_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static inline void term_render_init(term_render_t *r, int fd, const char *prompt) {
+    struct winsize ws;
+    memset(r, 0, sizeof(*r));
+    r->fd = fd;
+    r->prompt = prompt;
+    r->max_lines = 22; // 터미널이 아니면 24줄 화면으로 가정
+    if (ioctl(fd, TIOCGWINSZ, &ws) == 0 && ws.ws_row > 4) {
+        r->max_lines = ws.ws_row - 2; // 생략 안내 줄과 프롬프트 줄
+    }
+}
+
+static inline void term_render_push_line(term_render_t *r, const term_line_t *line) {
+    term_line_t *slot = &r->ring[r->head % TERM_RENDER_SCROLLBACK];
+    slot->color = line->color;
+    slot->len = line->len;
+    memcpy(slot->text, line->text, line->len);
+    r->head++;
+    r->lines++;
+}
+
+// 받은 바이트를 줄 단위로 링에 넣음. 마지막 줄이 '\n' 으로 끝나지 않았으면 다음 데이터를 기다림
+static inline void term_render_append(term_render_t *r, const char *color, const char *data, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        char c = data[i];
+        if (c == '\r' || c == '\0') {
+            continue; // 줄 처음으로 돌아가기는 프레임이 직접 처리, 널 문자(문자열 끝 표시)는 그리지 않음
+        }
+        if (r->partial.len == 0) {
+            r->partial.color = color;
+        }
+        if (c == '\n' || r->partial.len == TERM_RENDER_LINE_MAX) {
+            term_render_push_line(r, &r->partial);
+            r->partial.len = 0;
+            if (c == '\n') {
+                continue;
+            }
+            r->partial.color = color;
+        }
+        r->partial.text[r->partial.len++] = c;
+    }
+}
+
+// 클라이언트가 직접 만드는 안내 문구용. 줄 끝의 '\n' 은 fmt 에 포함
+static inline void term_render_printf(term_render_t *r, const char *color, const char *fmt, ...)
+    __attribute__((format(printf, 3, 4)));
+static inline void term_render_printf(term_render_t *r, const char *color, const char *fmt, ...) {
+    char buf[TERM_RENDER_LINE_MAX];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    if (n > 0) {
+        term_render_append(r, color, buf, (size_t)n < sizeof(buf) ? (size_t)n : sizeof(buf) - 1);
+    }
+}
+
+// 링에 남아 있는 마지막 count 줄을 다음 프레임에 다시 그림
+static inline void term_render_scrollback(term_render_t *r, unsigned long count) {
+    unsigned long kept = r->head < TERM_RENDER_SCROLLBACK ? r->head : TERM_RENDER_SCROLLBACK;
+    if (count > kept) count = kept;
+    r->drawn = r->head - count;
+    r->replay = 1;
+}
+
+static inline int term_render_pending(const term_render_t *r) {
+    return r->drawn != r->head || r->partial.len != r->partial_drawn;
+}
+
+// poll 타임아웃(ms): 그릴 것이 없으면 -1 (무한 대기), 있으면 다음 프레임까지 남은 시간
+static inline int term_render_timeout(const term_render_t *r) {
+    if (!term_render_pending(r)) {
+        return -1;
+    }
+    uint64_t elapsed = term_render_now_ms() - r->last_frame_ms;
+    return elapsed >= TERM_RENDER_INTERVAL_MS ? 0 : (int)(TERM_RENDER_INTERVAL_MS - elapsed);
+}
+
+static inline void term_render_write(term_render_t *r) {
+    size_t off = 0;
+    while (off < r->frame_len) {
+        ssize_t n = write(r->fd, r->frame + off, r->frame_len - off);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break; // 터미널이 닫힘: 버림
+        }
+        off += n;
+    }
+    r->frame_len = 0;
+}
+
+static inline void term_render_emit(term_render_t *r, const char *data, size_t len) {
+    while (len > 0) {
+        if (r->frame_len == sizeof(r->frame)) {
+            term_render_write(r); // 프레임 버퍼보다 큰 프레임 (긴 스크롤백 보기 등)
+        }
+        size_t n = sizeof(r->frame) - r->frame_len;
+        if (n > len) n = len;
+        memcpy(r->frame + r->frame_len, data, n);
+        r->frame_len += n;
+        data += n;
+        len -= n;
+    }
+}
+
+static inline void term_render_emit_line(term_render_t *r, const term_line_t *line) {
+    if (line->color != NULL) term_render_emit(r, line->color, strlen(line->color));
+    term_render_emit(r, line->text, line->len);
+    if (line->color != NULL) term_render_emit(r, TERM_RENDER_RESET, strlen(TERM_RENDER_RESET));
+    term_render_emit(r, "\n", 1);
+}
+
+// 쌓인 줄을 한 프레임으로 그림. force 가 0이면 갱신 간격이 지나지 않았을 때 그냥 돌아감
+static inline void term_render_flush(term_render_t *r, int force) {
+    if (!term_render_pending(r)) {
+        return;
+    }
+    uint64_t now = term_render_now_ms();
+    if (!force && now - r->last_frame_ms < TERM_RENDER_INTERVAL_MS) {
+        return;
+    }
+    unsigned long start = r->drawn;
+    unsigned long oldest = r->head > TERM_RENDER_SCROLLBACK ? r->head - TERM_RENDER_SCROLLBACK : 0;
+    if (start < oldest) {
+        start = oldest; // 링에서 이미 밀려난 줄
+    }
+    if (!r->replay && r->head - start > (unsigned long)r->max_lines) {
+        start = r->head - r->max_lines;
+    }
+    unsigned long skipped = start - r->drawn;
+
+    term_render_emit(r, TERM_RENDER_CLEAR_LINE, strlen(TERM_RENDER_CLEAR_LINE));
+    if (skipped > 0) {
+        char note[96];
+        int n = snprintf(note, sizeof(note), "\x1b[33m... 메시지 %lu개 생략 (스크롤백에 보관)" TERM_RENDER_RESET "\n", skipped);
+        term_render_emit(r, note, n);
+        r->skipped += skipped;
+    }
+    for (unsigned long i = start; i < r->head; i++) {
+        term_render_emit_line(r, &r->ring[i % TERM_RENDER_SCROLLBACK]);
+    }
+    // 끝나지 않은 줄은 줄바꿈 없이 그려 두고, 나머지가 오면 다음 프레임이 지우고 이어서 다시 그림
+    if (r->partial.len > 0) {
+        if (r->partial.color != NULL) term_render_emit(r, r->partial.color, strlen(r->partial.color));
+        term_render_emit(r, r->partial.text, r->partial.len);
+        if (r->partial.color != NULL) term_render_emit(r, TERM_RENDER_RESET, strlen(TERM_RENDER_RESET));
+    }
+    r->partial_drawn = r->partial.len;
+    if (r->prompt != NULL) {
+        term_render_emit(r, r->prompt, strlen(r->prompt));
+    }
+    term_render_write(r);
+
+    r->drawn = r->head;
+    r->replay = 0;
+    r->last_frame_ms = now;
+    r->frames++;
+}
+
+#endif // TERM_RENDER_H